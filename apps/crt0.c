@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include <sys/syscall.h>
+
+// User programs do not link the kernel, so they keep their own copy of the flag
+// syscall_invoke() consults. SYSENTER is configured whenever the CPU has SEP.
+volatile int g_sysenter_enabled;
+
+int main(void);
+
+__attribute__((section(".text.start"), noreturn)) void _start(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    g_sysenter_enabled = (edx & (1u << 11)) != 0;
+    syscall_exit(main());
+    for (;;) {
+        syscall_yield();
+    }
+}
@@ -0,0 +1,20 @@
+#include <stdint.h>
+#include <sys/syscall.h>
+
+// Large and mostly untouched: only the pages written below are ever faulted in
+static volatile char scratch[1024 * 1024];
+
+static void print(const char* text) {
+    uint32_t length = 0;
+    while (text[length]) length++;
+    syscall_console_write(text, length);
+}
+
+int main(void) {
+    print("hello: running in ring 3 from a demand-paged ELF\n");
+    for (uint32_t i = 0; i < sizeof(scratch); i += 256 * 1024) {
+        scratch[i] = 1;
+    }
+    print("hello: touched 4 of 256 scratch pages, exiting\n");
+    return 0;
+}
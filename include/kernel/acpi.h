@@ -0,0 +1,47 @@
+#ifndef _KERNEL_ACPI_H
+#define _KERNEL_ACPI_H
+
+#include <stdint.h>
+
+#define ACPI_MAX_CPUS       16
+#define ACPI_MAX_IOAPICS    4
+#define ACPI_MAX_OVERRIDES  16
+
+// Interrupt source override polarity/trigger flags (MADT type 2)
+#define ACPI_MADT_POLARITY_MASK     0x03
+#define ACPI_MADT_POLARITY_LOW      0x03
+#define ACPI_MADT_TRIGGER_MASK      0x0C
+#define ACPI_MADT_TRIGGER_LEVEL     0x0C
+
+typedef struct {
+    uint8_t id;
+    uint32_t address;
+    uint32_t gsi_base;
+} acpi_ioapic_t;
+
+typedef struct {
+    uint8_t source_irq;   // ISA IRQ number
+    uint32_t gsi;         // Global system interrupt it is wired to
+    uint16_t flags;       // Polarity/trigger (ACPI_MADT_*)
+} acpi_irq_override_t;
+
+// Interrupt controller topology, from the ACPI MADT or the legacy MP table
+typedef struct {
+    uint8_t valid;
+    uint8_t from_mp_table;
+    uint8_t has_8259;               // Dual 8259 PICs present (PC-AT compatible)
+    uint32_t lapic_address;
+    int cpu_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS];
+    int ioapic_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    int override_count;
+    acpi_irq_override_t overrides[ACPI_MAX_OVERRIDES];
+} acpi_madt_info_t;
+
+// Locate the RSDP/RSDT and parse the MADT, falling back to the MP table.
+// Returns 0 on success, -1 when no interrupt controller description was found.
+int acpi_init(void);
+const acpi_madt_info_t* acpi_get_madt_info(void);
+
+#endif // _KERNEL_ACPI_H
@@ -0,0 +1,139 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// HBA (generic host control) registers, offsets into ABAR (BAR5)
+#define AHCI_REG_CAP        0x00
+#define AHCI_REG_GHC        0x04
+#define AHCI_REG_IS         0x08
+#define AHCI_REG_PI         0x0C
+#define AHCI_REG_VS         0x10
+
+#define AHCI_CAP_NCS_SHIFT  8          // Command slots per port, minus one
+#define AHCI_CAP_NCS_MASK   0x1F
+#define AHCI_CAP_SNCQ       (1u << 30) // Native command queuing
+#define AHCI_GHC_IE         (1u << 1)
+#define AHCI_GHC_AE         (1u << 31)
+
+// Port registers, offsets into the port's 0x80-byte block
+#define AHCI_PORT_BASE(n)   (0x100 + (n) * 0x80)
+#define AHCI_PORT_CLB       0x00
+#define AHCI_PORT_CLBU      0x04
+#define AHCI_PORT_FB        0x08
+#define AHCI_PORT_FBU       0x0C
+#define AHCI_PORT_IS        0x10
+#define AHCI_PORT_IE        0x14
+#define AHCI_PORT_CMD       0x18
+#define AHCI_PORT_TFD       0x20
+#define AHCI_PORT_SIG       0x24
+#define AHCI_PORT_SSTS      0x28
+#define AHCI_PORT_SCTL      0x2C
+#define AHCI_PORT_SERR      0x30
+#define AHCI_PORT_SACT      0x34
+#define AHCI_PORT_CI        0x38
+#define AHCI_MAX_PORTS      32
+#define AHCI_ABAR_SIZE      (AHCI_PORT_BASE(AHCI_MAX_PORTS))
+
+#define AHCI_PORT_CMD_ST    (1u << 0)
+#define AHCI_PORT_CMD_FRE   (1u << 4)
+#define AHCI_PORT_CMD_FR    (1u << 14)
+#define AHCI_PORT_CMD_CR    (1u << 15)
+
+// Port interrupts: D2H register, PIO setup, DMA setup and Set Device Bits FISes,
+// descriptor processed, plus the error sources (task file, host bus fatal and
+// data, interface fatal and non-fatal, overflow)
+#define AHCI_PORT_IS_ERRORS  0x7D000000u
+#define AHCI_PORT_IE_DEFAULT (0x0000002Fu | AHCI_PORT_IS_ERRORS)
+
+#define AHCI_SSTS_DET_MASK    0xF
+#define AHCI_SSTS_DET_PRESENT 0x3      // Device present, PHY up
+#define AHCI_SSTS_IPM_ACTIVE  0x1      // Bits 8-11: interface active
+#define AHCI_SCTL_DET_RESET   0x1      // Drive COMRESET while set
+#define AHCI_SIG_ATA        0x00000101
+
+#define AHCI_TFD_BSY        0x80
+#define AHCI_TFD_DRQ        0x08
+#define AHCI_TFD_ERR        0x01
+
+// ATA commands issued through the HBA
+#define AHCI_CMD_IDENTIFY       0xEC
+#define AHCI_CMD_READ_DMA_EXT   0x25
+#define AHCI_CMD_WRITE_DMA_EXT  0x35
+#define AHCI_CMD_READ_FPDMA     0x60   // NCQ: tag in the count field, count in features
+#define AHCI_CMD_WRITE_FPDMA    0x61
+
+#define AHCI_FIS_TYPE_REG_H2D   0x27
+
+// Command list entry (32 bytes, the list is 1 KiB aligned)
+typedef struct {
+    uint16_t flags;     // CFL (FIS dwords) in bits 0-4, W (write) bit 6
+    uint16_t prdtl;     // PRDT entries
+    volatile uint32_t prdbc; // Bytes transferred, written by the HBA
+    uint32_t ctba;      // Command table, 128-byte aligned
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define AHCI_CMD_FLAG_WRITE (1u << 6)
+
+// Physical region descriptor: up to 4 MiB, word aligned
+typedef struct {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;       // Byte count minus one in bits 0-21, interrupt on completion bit 31
+} __attribute__((packed)) ahci_prd_t;
+
+// PRD entries per command table; bounds how far the block layer merges
+#define AHCI_PRDT_ENTRIES 64
+
+typedef struct {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+// Sectors one READ/WRITE FPDMA QUEUED or DMA EXT command can move
+#define AHCI_MAX_SECTORS  65536
+#define AHCI_MAX_DRIVES   4
+
+typedef struct {
+    uint8_t exists;
+    uint8_t port;       // HBA port number
+    uint8_t ncq;        // Commands go out as READ/WRITE FPDMA QUEUED
+    uint8_t depth;      // Command slots in use at most (1 without NCQ)
+    uint32_t sectors;   // Capacity, clamped to 32 bits
+    char model[41];
+} ahci_drive_t;
+
+struct blk_request;
+
+// ahci_start_request(): every command slot of the port is taken
+#define AHCI_BUSY 1
+
+// Find the AHCI controller on PCI, bring up every port with a disk attached and
+// return the number of drives. Until ahci_enable_interrupts() only the
+// synchronous transfers work.
+int ahci_init(void);
+// Wire up the HBA interrupt, preferring MSI. Call once the local APIC is up
+// (after smp_init()); queued requests are accepted from then on.
+void ahci_enable_interrupts(void);
+ahci_drive_t* ahci_get_drive(uint8_t drive);
+// Synchronous transfers of any length, for callers that cannot sleep. They poll
+// their own command slot and run alongside queued requests.
+int ahci_read_sectors(uint8_t drive, uint32_t lba, uint32_t count, void* buffer);
+int ahci_write_sectors(uint8_t drive, uint32_t lba, uint32_t count, const void* buffer);
+// True when the HBA interrupt is wired up, so queued requests can complete
+bool ahci_can_queue(uint8_t drive);
+// True while all of the drive's command slots are in use
+bool ahci_queue_busy(uint8_t drive);
+// Issue `req` and the requests merged behind it as one command in a free slot
+// and return without waiting. Returns 0 once issued, AHCI_BUSY when no slot is
+// free, or -1 if it cannot be issued. Commands complete in any order; each is
+// reported to blockdev_end_request() from the HBA interrupt.
+int ahci_start_request(uint8_t drive, struct blk_request* req);
+
+#endif // AHCI_H
@@ -0,0 +1,41 @@
+#ifndef _KERNEL_BCACHE_H
+#define _KERNEL_BCACHE_H
+
+#include <stdint.h>
+
+// Block buffer cache between the filesystems and the block drivers. Sectors are
+// cached by (device, sector) in a hash table and evicted least recently used
+// first. Writes are write-back: they only dirty buffers, which reach the disk on
+// eviction or bcache_sync(). blockdev_read/blockdev_write go through here.
+#define BCACHE_BLOCK_SIZE      512
+#define BCACHE_DEFAULT_BUFFERS 1024 // 512 KiB
+#define BCACHE_MIN_BUFFERS     16
+#define BCACHE_MAX_BUFFERS     4096
+// Transfers longer than this fraction of the cache stream around it instead of
+// flushing everything else out (cached copies are still kept coherent)
+#define BCACHE_BYPASS_DIVISOR  4
+
+typedef struct {
+    uint32_t buffers;      // Cache size in sectors
+    uint32_t used;         // Buffers holding a sector
+    uint32_t dirty;        // Buffers not yet written back
+    uint32_t hits;         // Sectors served from the cache
+    uint32_t misses;       // Sectors read from the device
+    uint32_t bypassed;     // Sectors of large transfers that skipped the cache
+    uint32_t evictions;
+    uint32_t writebacks;   // Dirty sectors written to the device
+    uint32_t write_runs;   // Device writes those went out as
+} bcache_stats_t;
+
+int bcache_init(uint32_t buffers);
+int bcache_read(uint8_t device, uint32_t sector, uint32_t count, void* buffer);
+int bcache_write(uint8_t device, uint32_t sector, uint32_t count, const void* buffer);
+// Write back every dirty buffer of `device`, or of all devices when it is -1
+int bcache_sync(int device);
+// Flush, then reallocate the cache with `buffers` sectors
+int bcache_resize(uint32_t buffers);
+void bcache_get_stats(bcache_stats_t* stats);
+void bcache_reset_stats();
+void bcache_dump_stats();
+
+#endif // _KERNEL_BCACHE_H
@@ -8,12 +8,16 @@
 #define BLOCKDEV_TYPE_IDE    1
 #define BLOCKDEV_TYPE_FLOPPY 2
 #define BLOCKDEV_TYPE_USB    3
+#define BLOCKDEV_TYPE_AHCI   4
+#define BLOCKDEV_TYPE_RAM    5
 
 // Error codes
 #define BLOCKDEV_SUCCESS     0
 #define BLOCKDEV_ERROR      -1
 #define BLOCKDEV_NOT_FOUND  -2
 #define BLOCKDEV_NO_MEDIA   -3
+#define BLOCKDEV_NOT_QUEUED -4 // Device or buffer cannot take an asynchronous request
+#define BLOCKDEV_PENDING    1  // blk_request_t::status while in flight
 
 // Maximum block devices
 #define MAX_BLOCK_DEVICES    8
@@ -25,14 +29,87 @@ typedef struct {
     uint16_t sector_size;
     uint8_t present;
     char name[16];
+    // Queue limits the I/O scheduler respects when merging requests
+    uint32_t max_sectors;    // Most sectors one command may carry
+    uint16_t max_segments;   // Most scatter-gather entries one command may use
+    uint32_t seg_boundary;   // Entries cannot cross a multiple of this (0: no limit)
 } blockdev_info_t;
 
+// Largest transfer one request may carry; blockdev_read/write split longer ones
+#define BLOCKDEV_MAX_REQUEST_SECTORS 256
+// Physical runs a request buffer may span: one per page plus a misaligned head
+#define BLOCKDEV_MAX_SEGMENTS ((BLOCKDEV_MAX_REQUEST_SECTORS * 512 + 4095) / 4096 + 1)
+// Deadlines after which the elevator dispatches a request out of sweep order
+#define BLOCKDEV_READ_EXPIRE_MS  500
+#define BLOCKDEV_WRITE_EXPIRE_MS 5000
+// Most requests blockdev_submit_wait_batch takes at once
+#define BLOCKDEV_MAX_BATCH 16
+
+struct blk_request;
+// Completion callback. Runs from SOFTIRQ_BLOCK with interrupts on; must not sleep.
+typedef void (*blk_end_io_t)(struct blk_request* req);
+
+// A physically contiguous piece of a request buffer, resolved at submit time
+// so the driver can program DMA from any address space
+typedef struct {
+    uint32_t phys;
+    uint32_t len;
+} blk_segment_t;
+
+// An asynchronous transfer. The submitter owns the memory until end_io runs.
+typedef struct blk_request {
+    uint8_t device;
+    uint8_t write;
+    uint32_t sector;
+    uint32_t count;              // Sectors
+    void* buffer;
+    blk_segment_t segments[BLOCKDEV_MAX_SEGMENTS];
+    int segment_count;
+    volatile int status;         // BLOCKDEV_PENDING, then BLOCKDEV_SUCCESS or an error
+    int result;                  // Driver outcome, published to status by SOFTIRQ_BLOCK
+    blk_end_io_t end_io;
+    void* private_data;
+    struct blk_request* next;
+    uint32_t deadline;             // Tick by which it must be dispatched
+    // Requests contiguous with this one, issued together as a single command.
+    // Drivers transfer the whole chain and complete only its first request.
+    struct blk_request* merge_next;
+} blk_request_t;
+
 // Function declarations
 int blockdev_init(void);
+// Returns the new device number, or BLOCKDEV_ERROR
 int blockdev_register(uint8_t type, uint8_t device_id, blockdev_info_t* info);
-int blockdev_read(uint8_t device, uint32_t sector, uint8_t count, void* buffer);
-int blockdev_write(uint8_t device, uint32_t sector, uint8_t count, const void* buffer);
+// Take a device offline; its number is not reused and later I/O to it fails
+void blockdev_unregister(uint8_t device);
+// Transfers through the buffer cache (see bcache.h); writes are write-back
+int blockdev_read(uint8_t device, uint32_t sector, uint32_t count, void* buffer);
+int blockdev_write(uint8_t device, uint32_t sector, uint32_t count, const void* buffer);
+// Device I/O that bypasses the cache and ignores anything it holds dirty
+int blockdev_read_direct(uint8_t device, uint32_t sector, uint32_t count, void* buffer);
+int blockdev_write_direct(uint8_t device, uint32_t sector, uint32_t count, const void* buffer);
 blockdev_info_t* blockdev_get_info(uint8_t device);
+
+void blk_request_init(blk_request_t* req, uint8_t device, uint32_t sector, uint32_t count,
+                      void* buffer, int write, blk_end_io_t end_io, void* private_data);
+// Queue `req` on its device. Returns 0 once queued (end_io will run), or an error
+// code; BLOCKDEV_NOT_QUEUED means the synchronous calls must be used instead.
+int blockdev_submit(blk_request_t* req);
+// Submit and park the calling process on a hook until the request completes.
+// Process context with interrupts enabled only. Returns the request status.
+int blockdev_submit_wait(blk_request_t* req);
+// Queue up to BLOCKDEV_MAX_BATCH requests before any is dispatched, so the
+// elevator can order and merge them, then wait for all. All-or-nothing:
+// BLOCKDEV_NOT_QUEUED means none was submitted. Returns the first error.
+int blockdev_submit_wait_batch(blk_request_t* reqs, int count);
+// Driver completion entry point (IRQ-safe); end_io runs later from SOFTIRQ_BLOCK.
+// Completes every request merged behind `req` as well.
+void blockdev_end_request(blk_request_t* req, int status);
+// Start queued requests whose controller is idle
+void blockdev_kick(void);
 int blockdev_list_devices(void);
+// Per-device I/O scheduler counters: merges, deadline expiries, command sizes
+void blockdev_dump_stats(void);
+void blockdev_reset_stats(void);
 
 #endif // BLOCKDEV_H
\ No newline at end of file
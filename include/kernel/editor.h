@@ -7,6 +7,9 @@
 
 #define EDITOR_MAX_LINES    128
 #define EDITOR_LINE_LENGTH  128
+#define EDITOR_DL_PERIOD    16 // ~60 Hz
+#define EDITOR_DL_BUDGET    4
+#define EDITOR_EVENT_BATCH  16 // Events copied per drain syscall
 
 class Editor {
 public:
@@ -0,0 +1,29 @@
+#ifndef _KERNEL_ELEVATOR_H
+#define _KERNEL_ELEVATOR_H
+
+#include <stdint.h>
+#include "kernel/blockdev.h"
+
+// I/O scheduler of the block layer: one submission queue per device, sorted by
+// sector. Requests are dispatched in deadline-aware C-LOOK order and contiguous
+// requests in the same direction are merged into one command. Callers serialize
+// access to a queue (blockdev holds blk_lock).
+typedef struct {
+    blk_request_t* head;
+    uint32_t depth;
+    uint32_t position;    // Sector just past the last dispatched command
+} blk_queue_t;
+
+// Queue `req` in sector order, behind requests for the same sector
+void elevator_add(blk_queue_t* queue, blk_request_t* req);
+// Unlink the request to dispatch at tick `now` and chain the contiguous,
+// same-direction requests sorted right behind it onto it via merge_next, within
+// `dev`'s limits. That is the request whose deadline passed longest ago, else
+// the first one at or past `position`, else the lowest sector. Sets *expired if
+// a deadline decided the pick. Returns NULL for an empty queue.
+blk_request_t* elevator_next(blk_queue_t* queue, const blockdev_info_t* dev, uint32_t now,
+                             bool* expired);
+// Put an undispatched merge chain back into its queue
+void elevator_requeue(blk_queue_t* queue, blk_request_t* req);
+
+#endif // _KERNEL_ELEVATOR_H
@@ -0,0 +1,66 @@
+#ifndef _KERNEL_ELF_H
+#define _KERNEL_ELF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ELF_MAGIC      0x464C457Fu // "\x7FELF"
+#define ELF_CLASS_32   1
+#define ELF_DATA_LSB   1
+#define ELF_TYPE_EXEC  2
+#define ELF_MACHINE_386 3
+
+#define ELF_PT_LOAD    1
+#define ELF_PF_X       0x1
+#define ELF_PF_W       0x2
+#define ELF_PF_R       0x4
+
+#define ELF_MAX_PHDRS  16
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t  elf_class;
+    uint8_t  data;
+    uint8_t  version;
+    uint8_t  pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version2;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} Elf32_Ehdr;
+
+typedef struct __attribute__((packed)) {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} Elf32_Phdr;
+
+struct Process;
+
+// Start the ELF32 executable at `path` as a new ring-3 process. Only the headers
+// are read here; PT_LOAD segments are faulted in from the file on first touch.
+// Returns NULL if the file is missing, not a valid i386 executable, or memory is short.
+struct Process* elf_exec(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _KERNEL_ELF_H
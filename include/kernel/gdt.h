@@ -17,4 +17,40 @@ struct __attribute__((packed)) GDTPtr {
     uint32_t base;
 };
 
-void init_gdt();
\ No newline at end of file
+// 32-bit task state segment. Only ss0/esp0 (the ring-0 stack used on privilege
+// changes) and the I/O map base are meaningful; hardware task switching is unused.
+struct __attribute__((packed)) TSSEntry {
+    uint32_t prev_tss;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1;
+    uint32_t ss1;
+    uint32_t esp2;
+    uint32_t ss2;
+    uint32_t cr3;
+    uint32_t eip;
+    uint32_t eflags;
+    uint32_t eax, ecx, edx, ebx;
+    uint32_t esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+};
+
+#define GDT_KERNEL_CODE_SELECTOR 0x08
+#define GDT_KERNEL_DATA_SELECTOR 0x10
+#define GDT_USER_CODE_SELECTOR   0x18
+#define GDT_USER_DATA_SELECTOR   0x20
+#define GDT_TSS_SELECTOR         0x28
+#define GDT_RPL_USER             3 // Requested privilege level for ring-3 selectors
+
+// Nonzero once the CPU supports SYSENTER and the MSRs are programmed
+extern "C" volatile int g_sysenter_enabled;
+
+// Sets up and loads the bootstrap processor's GDT and TSS.
+void init_gdt();
+// Builds, loads and activates the GDT/TSS of an application processor.
+void gdt_init_cpu(int cpu, uint32_t kernel_stack_top);
+// Updates the ring-0 stack the CPU switches to when entering from ring 3.
+void gdt_set_kernel_stack(int cpu, uint32_t esp0);
@@ -7,6 +7,11 @@
 // IDE I/O ports
 #define IDE_PRIMARY_BASE    0x1F0
 #define IDE_SECONDARY_BASE  0x170
+// Device control / alternate status registers
+#define IDE_PRIMARY_CTRL    0x3F6
+#define IDE_SECONDARY_CTRL  0x376
+#define IDE_PRIMARY_IRQ     14
+#define IDE_SECONDARY_IRQ   15
 
 // IDE register offsets
 #define IDE_REG_DATA        0x00
@@ -22,6 +27,22 @@
 // IDE commands
 #define IDE_CMD_READ_SECTORS 0x20
 #define IDE_CMD_WRITE_SECTORS 0x30
+#define IDE_CMD_READ_SECTORS_EXT  0x24
+#define IDE_CMD_WRITE_SECTORS_EXT 0x34
+#define IDE_CMD_READ_MULTIPLE      0xC4
+#define IDE_CMD_WRITE_MULTIPLE     0xC5
+#define IDE_CMD_READ_MULTIPLE_EXT  0x29
+#define IDE_CMD_WRITE_MULTIPLE_EXT 0x39
+#define IDE_CMD_SET_MULTIPLE       0xC6
+#define IDE_CMD_READ_DMA     0xC8
+#define IDE_CMD_WRITE_DMA    0xCA
+#define IDE_CMD_READ_DMA_EXT  0x25
+#define IDE_CMD_WRITE_DMA_EXT 0x35
+
+// Sectors one command can address and move
+#define IDE_LBA28_LIMIT       (1u << 28)
+#define IDE_MAX_SECTORS_LBA28 256
+#define IDE_MAX_SECTORS_LBA48 65536
 #define IDE_CMD_IDENTIFY     0xEC
 
 // IDE status bits
@@ -32,6 +53,29 @@
 #define IDE_STATUS_RDY       0x40
 #define IDE_STATUS_BSY       0x80
 
+// Bus-master IDE registers, relative to the channel's BMIDE base (BAR4, +8 for
+// the secondary channel)
+#define IDE_BM_REG_COMMAND   0x00
+#define IDE_BM_REG_STATUS    0x02
+#define IDE_BM_REG_PRDT      0x04
+
+#define IDE_BM_CMD_START     0x01
+#define IDE_BM_CMD_READ      0x08 // Device to memory
+#define IDE_BM_STATUS_ACTIVE 0x01
+#define IDE_BM_STATUS_ERR    0x02 // Write 1 to clear
+#define IDE_BM_STATUS_IRQ    0x04 // Write 1 to clear
+
+// One physical region descriptor: at most 64 KiB that must not cross a 64 KiB
+// boundary; a byte_count of 0 means 64 KiB
+typedef struct {
+    uint32_t base;
+    uint16_t byte_count;
+    uint16_t flags;
+} __attribute__((packed)) ide_prd_t;
+
+#define IDE_PRD_EOT          0x8000 // Last entry of the table
+#define IDE_PRD_ENTRIES      64
+
 // Drive selection
 #define IDE_DRIVE_MASTER     0x00
 #define IDE_DRIVE_SLAVE      0x01
@@ -43,17 +87,41 @@ typedef struct {
     uint16_t base_port;
     uint8_t drive_num;
     uint8_t exists;
-    uint32_t sectors;
+    uint32_t sectors;  // Capacity, clamped to 32 bits for LBA48 drives over 2 TiB
     uint16_t cylinders;
     uint16_t heads;
     uint16_t sectors_per_track;
+    uint8_t dma;       // IDENTIFY reports DMA support and the channel has a BMIDE block
+    uint8_t lba48;     // 48-bit addressing (READ/WRITE ... EXT) supported
+    uint8_t multiple;  // Sectors per READ/WRITE MULTIPLE block, 0 if multiple mode is off
 } ide_drive_t;
 
 // Function declarations
 int ide_init(void);
-int ide_read_sectors(uint8_t drive, uint32_t lba, uint8_t count, uint16_t* buffer);
-int ide_write_sectors(uint8_t drive, uint32_t lba, uint8_t count, uint16_t* buffer);
+// Synchronous PIO transfers of any length, split into the fewest commands the
+// drive takes; they wait for the channel if a queued request is in flight
+int ide_read_sectors(uint8_t drive, uint32_t lba, uint32_t count, uint16_t* buffer);
+int ide_write_sectors(uint8_t drive, uint32_t lba, uint32_t count, uint16_t* buffer);
 int ide_identify(uint8_t drive, uint16_t* buffer);
 ide_drive_t* ide_get_drive(uint8_t drive);
+struct blk_request;
+
+// ide_start_request(): the channel is running another command (retry after a
+// completion) or the drive is not ready yet (the driver retries from a timer)
+#define IDE_BUSY 1
+
+// True if the drive takes queued (asynchronous DMA) requests
+bool ide_can_queue(uint8_t drive);
+// True while the drive's channel runs a command (a hint: ide_start_request decides)
+bool ide_queue_busy(uint8_t drive);
+// Issue `req`, with the requests merged behind it, as one bus-master DMA
+// command and return without waiting. Returns 0 once
+// started, IDE_BUSY if the channel is occupied or the drive busy, or -1 if it
+// cannot be issued. Never waits for the drive.
+// Completion is reported to blockdev_end_request() from the IRQ 14/15 handler.
+int ide_start_request(uint8_t drive, struct blk_request* req);
+// Queue requests for DMA-capable drives (the default); with 0 the block layer
+// falls back to synchronous PIO. Returns the old setting.
+int ide_set_dma(int enabled);
 
 #endif // IDE_H
\ No newline at end of file
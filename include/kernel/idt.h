@@ -19,6 +19,7 @@ struct IDTDescriptor {
 } __attribute__((packed));
 
 void init_idt();
+void idt_load();
 void init_syscall_handler();
 void idt_set_gate(uint8_t num, uint32_t offset, uint16_t selector, uint8_t flags);
 void debug_idt_entry(int i);
@@ -0,0 +1,18 @@
+#ifndef _KERNEL_IOAPIC_H
+#define _KERNEL_IOAPIC_H
+
+#include <stdint.h>
+
+// Legacy IRQ lines keep vectors 32-47 whichever controller delivers them, so drivers
+// register the same handler numbers and call pic_unmask_irq() in either mode.
+
+// Route the ISA IRQs through the IOAPIC(s) described by the MADT, carrying over the
+// lines already unmasked on the 8259, then mask the 8259 completely. Requires the
+// local APIC. Returns false (and leaves the 8259 in charge) when there is no IOAPIC.
+bool ioapic_init();
+// True once interrupts are delivered by the IOAPIC and acknowledged at the LAPIC
+bool ioapic_enabled();
+void ioapic_unmask_irq(uint8_t irq);
+void ioapic_mask_irq(uint8_t irq);
+
+#endif // _KERNEL_IOAPIC_H
@@ -0,0 +1,38 @@
+#ifndef _KERNEL_IRQOFF_H
+#define _KERNEL_IRQOFF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Interrupts-disabled window tracer, compiled in with EXTRA_CFLAGS=-DIRQOFF_TRACE.
+// Each CPU timestamps the point where interrupts go off (spin_lock_irqsave, interrupt,
+// exception and syscall entry) and where they come back on; the longest windows are
+// kept with both addresses. Only the outermost begin/end of a window counts.
+
+#define IRQOFF_TOP_N 16
+
+// Address of the instruction at the point of use, for attributing a window
+#define IRQOFF_HERE() ({ uint32_t here__; asm volatile("1: movl $1b, %0" : "=r"(here__)); here__; })
+
+#ifdef IRQOFF_TRACE
+void irqoff_trace_begin(uint32_t eip);
+void irqoff_trace_end(uint32_t eip);
+#define IRQOFF_BEGIN() irqoff_trace_begin(IRQOFF_HERE())
+#define IRQOFF_END() irqoff_trace_end(IRQOFF_HERE())
+#else
+#define IRQOFF_BEGIN() do { } while (0)
+#define IRQOFF_END() do { } while (0)
+#endif
+
+void irqoff_trace_reset(void);
+// Write the longest windows to the serial port; returns how many were written
+int irqoff_trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _KERNEL_IRQOFF_H
@@ -0,0 +1,19 @@
+#ifndef _KERNEL_IRQSTAT_H
+#define _KERNEL_IRQSTAT_H
+
+#include <stdint.h>
+
+// Vectors 0-63 (exceptions, legacy IRQs, LAPIC and MSI) are accounted; others are ignored
+#define IRQSTAT_VECTORS 64
+// Handler latency histogram: bucket n counts handlers that took [2^n, 2^(n+1)) cycles,
+// the last bucket everything longer
+#define IRQSTAT_BUCKETS 24
+
+// Account one handler invocation on the calling CPU. Called by isr_handler and
+// irq_handler with the cycles spent in the registered handler.
+void irqstat_record(uint32_t vector, uint64_t cycles);
+void irqstat_reset(void);
+// Print per-vector counts, average/maximum cycles and the latency histogram
+void irqstat_dump(void);
+
+#endif // _KERNEL_IRQSTAT_H
@@ -2,6 +2,7 @@
 #define _KERNEL_ISR_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef struct registers {
     uint32_t ds;         // Data segment
@@ -12,6 +13,22 @@ typedef struct registers {
 
 
 typedef void (*isr_t)(registers_t*);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void register_interrupt_handler(uint8_t n, isr_t handler);
+// True inside a hardware interrupt that preempted another one on this CPU;
+// the scheduler must not switch from such a frame
+bool irq_nested(void);
+// True while this CPU is running a hardware interrupt handler
+bool irq_in_progress(void);
+// Kill the current process if `regs` faulted in ring 3 (does not return then)
+void isr_kill_user_process(registers_t* regs);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef _KERNEL_KTIME_H
+#define _KERNEL_KTIME_H
+
+#include <stdint.h>
+
+// Nanosecond clock backed by the TSC, calibrated against PIT channel 2 at boot.
+// Without a usable TSC it falls back to timer ticks (1 ms resolution).
+
+// Calibrate the TSC; call once on the BSP before anything reads the clock
+void ktime_init();
+// Nanoseconds since ktime_init(); 64-bit, so it does not wrap in practice
+uint64_t ktime_get_ns();
+// Convert a TSC delta (e.g. one measured with rdtsc()) to nanoseconds
+uint64_t ktime_cycles_to_ns(uint64_t cycles);
+// Calibrated TSC frequency in kHz, 0 if the tick fallback is in use
+uint32_t tsc_khz();
+// True if CPUID reports an invariant TSC (constant rate across P/C-states)
+bool tsc_invariant();
+
+#endif // _KERNEL_KTIME_H
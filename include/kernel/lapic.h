@@ -0,0 +1,34 @@
+#ifndef _KERNEL_LAPIC_H
+#define _KERNEL_LAPIC_H
+
+#include <stdint.h>
+
+// Vectors used by local APIC sources (the legacy PIC owns 32-47)
+#define LAPIC_TIMER_VECTOR       48
+#define LAPIC_RESCHEDULE_VECTOR  49
+// Message-signalled interrupts take the rest of the stubbed range (50-63)
+#define MSI_VECTOR_BASE          50
+#define MSI_VECTOR_LAST          63
+#define LAPIC_SPURIOUS_VECTOR    0xFF
+
+// Map the local APIC registers and enable the bootstrap processor's APIC.
+bool lapic_init(uint32_t physical_address);
+// Enable the calling CPU's local APIC (BSP and APs).
+void lapic_enable();
+bool lapic_available();
+uint8_t lapic_id();
+void lapic_eoi();
+// Task priority: vectors whose class (vector >> 4) is not above TPR >> 4 are held off
+uint32_t lapic_get_tpr();
+void lapic_set_tpr(uint32_t priority);
+
+// Inter-processor interrupts
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint8_t page);
+
+// Local APIC timer: measure the bus clock against the PIT once, then arm each CPU.
+void lapic_timer_calibrate();
+void lapic_timer_start(uint32_t frequency);
+
+#endif // _KERNEL_LAPIC_H
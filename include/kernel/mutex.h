@@ -0,0 +1,54 @@
+#ifndef _KERNEL_MUTEX_H
+#define _KERNEL_MUTEX_H
+
+#include "kernel/spinlock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Sleeping mutex for long critical sections (filesystem, disk I/O).
+// A contended process parks on a CUSTOM hook keyed by the mutex address
+// instead of spinning. Must not be taken from interrupt context.
+typedef struct mutex {
+    spinlock_t wait_lock;        // Protects the fields below
+    volatile int locked;
+    int owner_pid;               // -1 when free or held outside a process
+    int waiters;
+    lock_stats_t stats;
+} mutex_t;
+
+#define MUTEX_INIT(lock_name) { SPINLOCK_INIT(NULL), 0, -1, 0, LOCK_STATS_INIT(lock_name) }
+
+void mutex_init(mutex_t* mutex, const char* name);
+void mutex_lock(mutex_t* mutex);
+// Returns 1 if the mutex was taken, 0 if it is held by someone else
+int mutex_trylock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+#ifdef __cplusplus
+}
+
+// Scope guard: holds the mutex for the lifetime of the object
+class MutexGuard
+{
+  public:
+    explicit MutexGuard(mutex_t* mutex) : mutex_(mutex)
+    {
+        mutex_lock(mutex_);
+    }
+
+    ~MutexGuard()
+    {
+        mutex_unlock(mutex_);
+    }
+
+    MutexGuard(const MutexGuard&) = delete;
+    MutexGuard& operator=(const MutexGuard&) = delete;
+
+  private:
+    mutex_t* mutex_;
+};
+#endif
+
+#endif // _KERNEL_MUTEX_H
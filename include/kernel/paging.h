@@ -2,12 +2,55 @@
 #define PAGING_H
 
 #include <stdint.h>
+#include "kernel/vfs.h"
 
 // For the PDE/PTE arrays
 #define PAGE_SIZE    4096
 #define PDE_ENTRIES  1024
 #define PTE_ENTRIES  1024
 
+// Per-process user region; everything outside it is the shared kernel mapping
+#define USER_SPACE_START 0x40000000u
+#define USER_SPACE_END   0xC0000000u
+#define USER_STACK_TOP   USER_SPACE_END
+#define USER_STACK_SIZE  (256 * 1024)
+
+#define VM_MAX_AREAS 8
+#define VM_WRITE     0x1 // Pages are mapped writable
+#define VM_FILE      0x2 // Pages are filled from the address space's file
+#define VM_KERNEL    0x4 // Kernel pages exposed to ring 3: always resident, not owned
+
+// Place code and data used by kernel-linked ring-3 processes (k_start_user_process)
+// in the only kernel image pages their address spaces map for user mode
+#define USER_TEXT __attribute__((section(".user_text")))
+#define USER_DATA __attribute__((section(".user_data")))
+
+// A page-aligned range of user memory that is populated on first touch.
+// Bytes [file_vaddr, file_vaddr + file_size) come from the backing file at
+// file_offset; the rest of the range reads as zero.
+typedef struct vm_area
+{
+    uint32_t start;
+    uint32_t end;
+    uint32_t flags;
+    uint32_t file_vaddr;
+    uint32_t file_offset;
+    uint32_t file_size;
+} vm_area_t;
+
+typedef struct address_space
+{
+    uint32_t* page_directory; // Physical (identity-mapped) address
+    vm_area_t areas[VM_MAX_AREAS];
+    int area_count;
+    vfs_file_t file; // Backing executable, open while has_file is set
+    int has_file;
+    uint32_t faults; // Demand faults served
+    uint32_t resident_pages;
+    uint32_t kernel_table_copies; // Kernel PDEs replaced by private tables (bit per PDE)
+    char name[32];
+} address_space_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,6 +66,27 @@ void vmm_enable();
 void vmm_map(uint32_t virtual_addr, uint32_t physical_addr, int rw);
 void vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size, int rw);
 
+// New user address space sharing the kernel mappings; NULL if out of memory
+address_space_t* vmm_create_address_space(void);
+// Address space for a kernel-linked ring-3 process: the kernel mapping stays
+// supervisor-only apart from the USER_TEXT/USER_DATA pages and the page-aligned
+// stack [stack, stack + stack_size). NULL if out of memory.
+address_space_t* vmm_create_kernel_user_space(uint32_t stack, uint32_t stack_size);
+// Unmap and free every user page, the page tables and the backing file
+void vmm_destroy_address_space(address_space_t* as);
+// Register [start, end) as demand-paged; returns 0 or -1 if it is invalid or overlaps
+int vmm_add_area(address_space_t* as, uint32_t start, uint32_t end, uint32_t flags,
+                 uint32_t file_vaddr, uint32_t file_offset, uint32_t file_size);
+// Check that [addr, addr + size) lies inside `as`'s areas (writable ones if `write`)
+// and fault every page in now; an empty range must still start inside an area. Must
+// run on `as`. Returns 0, or -1 if the range is bad.
+int vmm_prepare_user_range(address_space_t* as, uint32_t addr, uint32_t size, int write);
+// Physical address behind `virtual_addr` in the current address space, for
+// programming DMA. Returns 0, or -1 if the page is not mapped.
+int vmm_virt_to_phys(uint32_t virtual_addr, uint32_t* physical_addr);
+// Load `as` into CR3 (NULL selects the kernel-only directory)
+void vmm_switch_address_space(address_space_t* as);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,26 @@ extern "C" {
 #define PCI_BAR5              0x24
 #define PCI_INTERRUPT_LINE    0x3C
 #define PCI_INTERRUPT_PIN     0x3D
+#define PCI_CAPABILITY_LIST   0x34
+
+// Command/status bits
+#define PCI_COMMAND_IO           0x0001
+#define PCI_COMMAND_MEMORY       0x0002
+#define PCI_COMMAND_MASTER       0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+#define PCI_STATUS_CAP_LIST      0x0010
+
+// Capability IDs and MSI capability layout
+#define PCI_CAP_ID_MSI        0x05
+#define PCI_MSI_FLAGS         0x02
+#define PCI_MSI_ADDRESS_LO    0x04
+#define PCI_MSI_ADDRESS_HI    0x08
+#define PCI_MSI_DATA_32       0x08
+#define PCI_MSI_DATA_64       0x0C
+#define PCI_MSI_FLAGS_ENABLE  0x0001
+#define PCI_MSI_FLAGS_QSIZE   0x0070
+#define PCI_MSI_FLAGS_64BIT   0x0080
+#define PCI_MSI_ADDRESS_BASE  0xFEE00000u
 
 // PCI Class Codes
 #define PCI_CLASS_UNCLASSIFIED        0x00
@@ -54,6 +74,15 @@ extern "C" {
 #define PCI_CLASS_SIGNAL_PROCESSING   0x11
 #define PCI_CLASS_COPROCESSOR         0x40
 
+// PCI Mass Storage Controller Subclasses
+#define PCI_SUBCLASS_STORAGE_IDE      0x01
+#define PCI_SUBCLASS_STORAGE_SATA     0x06
+
+// IDE programming interface: the controller can bus-master (BAR4 is the BMIDE block)
+#define PCI_PROG_IF_IDE_BUS_MASTER    0x80
+// SATA programming interface: AHCI 1.0 (BAR5 is the ABAR register block)
+#define PCI_PROG_IF_SATA_AHCI         0x01
+
 // PCI Network Controller Subclasses
 #define PCI_SUBCLASS_NET_ETHERNET     0x00
 #define PCI_SUBCLASS_NET_TOKEN_RING   0x01
@@ -76,6 +105,8 @@ typedef struct {
     uint8_t  header_type;
     uint8_t  interrupt_line;
     uint8_t  interrupt_pin;
+    uint8_t  msi_cap;      // Config offset of the MSI capability, 0 if none
+    uint8_t  msi_vector;   // IDT vector once MSI is enabled, 0 while on INTx
     uint32_t bar[6];
 } pci_device_t;
 
@@ -95,6 +126,12 @@ pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id);
 pci_device_t* pci_find_device_by_class(uint8_t class_code, uint8_t subclass);
 int pci_get_device_count(void);
 pci_device_t* pci_get_device(int index);
+// Config offset of capability `cap_id`, or 0 when the device does not have it
+uint8_t pci_find_capability(uint8_t bus, uint8_t device, uint8_t function, uint8_t cap_id);
+// Switch the device from its INTx pin to a single MSI vector aimed at this CPU's
+// local APIC. Returns the vector for register_interrupt_handler(), or -1 when the
+// device lacks MSI, there is no local APIC, or the vector range is used up.
+int pci_enable_msi(pci_device_t* dev);
 
 // Device class to string
 const char* pci_class_to_string(uint8_t class_code);
@@ -5,6 +5,11 @@
 
 void pic_remap();
 void pic_send_eoi(uint8_t irq);
+// Unmask a legacy IRQ line on whichever controller (8259 or IOAPIC) delivers it
 void pic_unmask_irq(uint8_t irq);
+// 8259 line masks, master in the low byte (bit set = masked)
+uint16_t pic_get_mask();
+// Mask every 8259 line; used once the IOAPIC takes over
+void pic_disable();
 void init_pic();
 #endif // PIC_H
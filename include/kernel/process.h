@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include "kernel/hooks.h"
 #include "kernel/keyboard.h"
+#include "kernel/spinlock.h"
+#include "kernel/waitqueue.h"
+#include "kernel/vfs.h"
 #include <sys/events.h>
 
 #ifdef __cplusplus
@@ -17,34 +20,77 @@ typedef struct CPUContext {
     uint32_t eax, ebx, ecx, edx;
     uint32_t esi, edi;
     uint32_t eflags;
+    uint32_t cs; // RPL 3 resumes through iret into user mode (0 means ring 0)
+    uint32_t kernel_esp; // Top of the ring-0 stack of a user-mode process
 } CPUContext;
 
-// Export the next context symbol for the trampoline
-extern struct CPUContext* g_next_context;
-
 typedef struct ProcessState {
     CPUContext context;
     uint32_t* page_directory;
     uint8_t* stack_base;
     uint32_t stack_size;
+    uint8_t* kernel_stack_base; // Only allocated for user-mode processes
 } ProcessState;
 
+#define PROCESS_KERNEL_STACK_SIZE 8192
+
 typedef void (*KeyboardHandler)(keyboard_event);
 
 #define PROCESS_MAGIC 0x50524F43u // 'PROC'
 #define EVENT_QUEUE_GUARD 0xE17E17E1u
 #define MAX_EVENT_QUEUE_SIZE 128
 #define MAX_HOOKS_PER_PROCESS 8
+#define PROCESS_MAX_FDS 16
+
+// Per-process event ring. Producers serialize on Process::lock; the owning process
+// consumes lock-free. `open_slot` names the newest slot while a producer may still
+// coalesce mouse motion into it; the consumer closes it before reading.
+#define EVENT_SLOT_INDEX_MASK 0x7FFFFFFFu
+#define EVENT_SLOT_BUSY       0x80000000u // Producer is merging into the slot
+#define EVENT_SLOT_NONE       0xFFFFFFFFu
 
 typedef struct {
-    uint32_t guard_front;
+    volatile uint32_t head; // Next slot to fill (producer side)
+    volatile uint32_t tail; // Next slot to read (consumer only)
+    volatile uint32_t open_slot;
+    uint32_t dropped; // Events refused because the ring was full
+    uint32_t coalesced; // Mouse motion events merged into a queued one
+    uint32_t guard_front; // Guards are only checked in DEBUG builds
     IOEvent queue[MAX_EVENT_QUEUE_SIZE];
-    int head;
-    int tail;
-    int count;
     uint32_t guard_back;
 } EventQueue;
 
+// Blocked-time buckets: one per HookType, then wait queues
+#define PROCESS_BLOCK_WAIT_QUEUE 3
+#define PROCESS_BLOCK_REASONS 4
+// Wakeup-to-run latency histogram: bucket 0 is < 1 us, each next bucket is 4x wider in ns
+#define WAKE_LATENCY_BUCKETS 8
+
+typedef struct ProcessStats {
+    uint32_t cpu_ticks; // Timer ticks during which the process was running
+    uint32_t voluntary_switches; // Gave up the CPU by yielding or blocking
+    uint32_t involuntary_switches; // Preempted while still runnable
+    uint32_t blocked_ticks[PROCESS_BLOCK_REASONS];
+    uint32_t wakeups;
+    uint32_t wake_latency_hist[WAKE_LATENCY_BUCKETS];
+    uint64_t wake_latency_max; // ns
+    uint32_t blocked_since; // Tick the process was switched out blocked
+    int blocked_reason; // PROCESS_BLOCK_* index while blocked, else -1
+    uint64_t woken_at; // ktime_get_ns() at wakeup, 0 unless waiting to run after one
+    uint32_t top_cpu_ticks; // cpu_ticks at the previous `top` refresh
+} ProcessStats;
+
+// Earliest-deadline-first class parameters, in timer ticks (ms). period == 0 means
+// the process is scheduled by the normal MLFQ/lottery policy only.
+typedef struct DeadlineParams {
+    uint32_t period;
+    uint32_t budget; // CPU ticks guaranteed per period
+    uint32_t deadline; // Absolute tick at which the current period ends
+    uint32_t remaining; // Budget left in the current period
+    int throttled; // Budget exhausted: falls back to the normal policy until refilled
+    uint32_t misses; // Periods that ended while runnable with budget left
+} DeadlineParams;
+
 typedef struct Process {
     uint32_t magic;
     int pid;
@@ -55,20 +101,61 @@ typedef struct Process {
     uint64_t logical_time;
     Hook hooks[MAX_HOOKS_PER_PROCESS]; // Array of hooks
     int hook_count;
-    EventQueue io_events; // Per-process I/O event queue
+    spinlock_t lock; // Serializes io_events producers and guards hooks
+    wait_queue_t io_wait; // Where the process sleeps in SYSCALL_WAIT_IO_EVENT
+    volatile int wait_pending; // Between prepare_to_wait and the wakeup or finish_wait
+    volatile int sleeping; // Blocked on a wait queue; not runnable until woken
+    wait_queue_t* wait_queue; // Queue the process is linked on, if any
+    struct Process* wait_next;
     KeyboardHandler keyboard_handler; // Per-process keyboard callback
     int tickets; // Number of tickets for lottery scheduling
+    int priority_level; // MLFQ level (0 = highest priority)
+    int quantum_ticks_used; // Ticks consumed at the current MLFQ level
+    int cpu; // CPU whose run queue holds this process
+    volatile int on_cpu; // CPU currently executing on this process's stack, or -1
+    DeadlineParams dl; // Real-time (EDF) parameters, guarded by the scheduler lock
+    ProcessStats stats; // Scheduling and latency accounting, guarded by the scheduler lock
+    int slot; // Index in process_table, or -1
+    struct Process* hash_next; // PID hash chain
+    struct Process* pool_next; // Free pool, or zombie list while awaiting the reaper
+    int reap_queued;
+    struct address_space* mm; // Demand-paged user address space, or NULL (kernel mapping)
+    vfs_file_t fds[PROCESS_MAX_FDS]; // Open files indexed by descriptor; owner-only
+    uint32_t fd_mask; // Bit n is set while fds[n] is open
+    // Kept last: k_start_process clears everything before it and only resets the
+    // queue indices, not the 128 queued events
+    EventQueue io_events; // Per-process I/O event queue
 } Process;
 
 int create_process(const char* name, void (*entry)(), int speculative);
+// Mark a process dead; the reaper frees it once no CPU is on its stack
 void kill_process(Process* proc);
+// Look up a live or not yet reaped process by pid (O(1) hash)
+Process* process_find(int pid);
+// Number of Process objects currently handed out, and the pool's total capacity
+void process_pool_stats(uint32_t* in_use, uint32_t* capacity, uint32_t* reaped);
 void register_keyboard_handler(Process* proc, KeyboardHandler handler);
 void set_process_tickets(Process* proc, int tickets); // Set tickets for a process
 
+// File descriptor table. Only the owning process (and the reaper once it is
+// dead) touches it, so no lock is needed.
+// Reserve the lowest free descriptor; returns -1 if the table is full
+int process_fd_alloc(Process* proc);
+// Open file behind `fd`, or NULL if it is not a valid open descriptor
+vfs_file_t* process_fd_get(Process* proc, int fd);
+void process_fd_release(Process* proc, int fd);
+// Close every descriptor still open (exit path)
+void process_close_fds(Process* proc);
+
 // IO event queue helpers
 void push_io_event(Process* proc, IOEvent event);
 int pop_io_event(Process* proc, IOEvent* out_event);
 int process_poll_io_event(Process* proc, IOEvent* out_event);
+// Pop up to `max_events` without blocking; returns how many were copied
+int process_drain_io_events(Process* proc, IOEvent* out_events, int max_events);
+// Block until at least one event is queued, then drain up to `max_events`
+int process_wait_drain_io_events(Process* proc, IOEvent* out_events, int max_events);
+// Block the calling process until an event is available, then pop it
 int process_wait_for_io_event(Process* proc, IOEvent* out_event);
 
 // Register a hook for a process
@@ -80,6 +167,13 @@ int process_has_matching_hook(Process* proc, HookType type, uint64_t value);
 
 // Start a process (kernel internal helper)
 Process* k_start_process(const char* name, void (*entry)(), int speculative, uint32_t stack_size);
+// Start `entry` in ring 3. `entry` and everything it touches must be USER_TEXT /
+// USER_DATA (see paging.h): the rest of the kernel stays supervisor-only and is
+// reached through syscalls. Kernel-resident code must use k_start_process.
+Process* k_start_user_process(const char* name, void (*entry)(), uint32_t stack_size);
+// Start a ring-3 process at `entry` inside `mm`, with its stack at USER_STACK_TOP.
+// On success the process owns `mm` and frees it when reaped.
+Process* k_start_mm_process(const char* name, struct address_space* mm, uint32_t entry);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,19 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+
+// Memory-backed block devices. Transfers are plain copies made in the caller's
+// context, so the block layer always takes its synchronous path for them.
+#define RAMDISK_MAX_DISKS 2
+
+// Allocate a zeroed disk of `sectors` 512-byte sectors and register it as a
+// block device ("rd0", ...). Returns the block device number, or -1.
+int ramdisk_create(uint32_t sectors);
+// Take the block device made by ramdisk_create offline and free its memory.
+// Anything the buffer cache holds dirty for it must be synced first.
+void ramdisk_destroy(uint8_t device);
+int ramdisk_read_sectors(uint8_t disk, uint32_t sector, uint32_t count, void* buffer);
+int ramdisk_write_sectors(uint8_t disk, uint32_t sector, uint32_t count, const void* buffer);
+
+#endif // RAMDISK_H
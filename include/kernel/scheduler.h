@@ -5,6 +5,18 @@
 
 #define MAX_PROCESSES 32
 
+// Multilevel feedback queue parameters
+#define MLFQ_LEVELS 3
+#define MLFQ_BOOST_INTERVAL_TICKS 500 // Periodic priority boost to prevent starvation
+
+// Deadline class admission limit: total budget/period per CPU, in permille
+#define SCHED_DL_MAX_UTIL_PERMILLE 900
+
+typedef enum {
+    SCHED_POLICY_LOTTERY = 0, // Single-level lottery with a fixed quantum
+    SCHED_POLICY_MLFQ = 1     // Lottery within the highest non-empty MLFQ level
+} SchedulerPolicy;
+
 // Forward decl for ISR regs
 struct registers;
 typedef struct registers registers_t;
@@ -12,12 +24,15 @@ typedef struct registers registers_t;
 // Scheduler process table
 extern Process* process_table[MAX_PROCESSES];
 extern int process_count;
-extern int current_process_idx;
 
 // Add a process to the scheduler
 int scheduler_add_process(Process* proc);
 // Remove a process from the scheduler
 int scheduler_remove_process(int pid);
+// Forget a dead process once no CPU is on its stack; -1 if it is still in use
+int scheduler_release_dead(Process* proc);
+// Ask the CPU currently running `proc` to switch away from it
+void scheduler_evict(Process* proc);
 // Get the next process in round-robin order
 Process* scheduler_next_process();
 // Get the current process
@@ -32,6 +47,8 @@ Process* scheduler_next_eligible_process(HookType event_type, uint64_t event_val
 void process_yield_for_event(Process* proc, HookType event_type, uint64_t event_value);
 // Called by event source to resume processes waiting for an event
 void scheduler_resume_processes_for_event(HookType event_type, uint64_t event_value);
+// Wake a process blocked on a wait queue; `boost` makes it the next one its CPU runs
+void scheduler_wake_process(Process* proc, bool boost);
 // Called on each tick for quantum-based scheduling
 void scheduler_on_tick(registers_t* regs);
 // Force a context switch using last saved registers (from an interrupt)
@@ -42,8 +59,30 @@ void scheduler_force_switch_with_regs(registers_t* regs);
 void scheduler_exit_current_and_switch(registers_t* regs) __attribute__((noreturn));
 // Context switch to another process
 void context_switch(registers_t* regs);
-// Start executing the first scheduled process
-void scheduler_start();
+// Start executing the first scheduled process on the boot CPU (does not return)
+void scheduler_start() __attribute__((noreturn));
+// Park an application processor in its idle loop (does not return)
+void scheduler_ap_enter() __attribute__((noreturn));
+// Reschedule IPI handler: switch if another CPU flagged this one
+void scheduler_handle_reschedule(registers_t* regs);
+
+// Put a process in the EDF class with `budget` ticks of CPU every `period` ticks.
+// period == 0 returns it to the normal policy. Returns -1 if the parameters are
+// invalid or the CPU's deadline utilisation would exceed SCHED_DL_MAX_UTIL_PERMILLE.
+int scheduler_set_deadline(Process* proc, uint32_t period, uint32_t budget);
+
+// Scheduling policy selection
+void scheduler_set_policy(SchedulerPolicy policy);
+SchedulerPolicy scheduler_get_policy();
+// Quantum (in ticks) granted to a process at the given MLFQ level
+int scheduler_level_quantum(int level);
+// Print policy and per-process scheduling state
+void scheduler_dump();
+// Print per-CPU run queue length, switch/steal counters and utilisation
+void scheduler_dump_cpus();
+// Print per-process CPU use since the previous call, switch counts, blocked time
+// per wait reason and wakeup-to-run latency
+void scheduler_dump_top();
 
 // Foreground (keyboard focus) process helpers
 void scheduler_set_foreground(Process* proc);
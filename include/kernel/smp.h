@@ -0,0 +1,28 @@
+#ifndef _KERNEL_SMP_H
+#define _KERNEL_SMP_H
+
+#include <stdint.h>
+
+#define MAX_CPUS 8
+#define SMP_AP_STACK_SIZE 16384
+#define SMP_TRAMPOLINE_ADDR 0x8000 // Real-mode entry page for application processors
+#define SMP_TIMER_HZ 1000          // Local APIC timer rate on application processors
+
+typedef struct cpu_info {
+    int index;               // Logical CPU number (0 = bootstrap processor)
+    uint8_t apic_id;         // Local APIC id
+    volatile int online;     // Set by the CPU itself once it can schedule
+    uint32_t stack_top;      // Idle/boot stack of the CPU
+} cpu_info_t;
+
+// Discover CPUs through ACPI/MP tables and start every application processor.
+void smp_init();
+// Number of CPUs that completed bring-up (always >= 1)
+int smp_cpu_count();
+// Logical index of the executing CPU
+int smp_current_cpu();
+cpu_info_t* smp_get_cpu(int index);
+// Ask another CPU to re-run its scheduler as soon as possible
+void smp_send_reschedule(int cpu);
+
+#endif // _KERNEL_SMP_H
@@ -0,0 +1,30 @@
+#ifndef _KERNEL_SOFTIRQ_H
+#define _KERNEL_SOFTIRQ_H
+
+#include <stdint.h>
+
+// Bottom halves: hard IRQ handlers only capture device state and raise one of
+// these; the handler runs on the same CPU at interrupt exit with IRQs enabled.
+typedef enum {
+    SOFTIRQ_TIMER = 0,     // Run expired ktimers, wake TIME_REACHED hooks
+    SOFTIRQ_KEYBOARD,      // Decode buffered scancodes and dispatch key events
+    SOFTIRQ_MOUSE,         // Turn buffered packets into mouse events
+    SOFTIRQ_BLOCK,         // Complete finished block requests, start queued ones
+    NR_SOFTIRQS
+} softirq_t;
+
+typedef void (*softirq_handler_t)(void);
+
+void softirq_register(softirq_t nr, softirq_handler_t handler);
+// Mark a softirq pending on the calling CPU (safe from hard IRQ context)
+void softirq_raise(softirq_t nr);
+// Run pending softirqs; called by irq_handler after the hard handler
+void softirq_run_pending();
+// True while the calling CPU is executing softirq handlers
+bool softirq_in_progress();
+
+// Record one hard IRQ for `softirqs`: controller acknowledge and handler time, in cycles
+void softirq_note_hardirq(uint32_t vector, uint64_t ack_cycles, uint64_t handler_cycles);
+void softirq_dump_stats();
+
+#endif // _KERNEL_SOFTIRQ_H
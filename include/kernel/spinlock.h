@@ -0,0 +1,145 @@
+#ifndef _KERNEL_SPINLOCK_H
+#define _KERNEL_SPINLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "kernel/tsc.h"
+#include "kernel/irqoff.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Hold-time and contention accounting is compiled into DEBUG builds
+#ifdef DEBUG
+#define LOCK_STATS 1
+#endif
+
+typedef struct lock_stats {
+    const char* name;            // NULL keeps the lock out of `lockstat`
+    uint32_t acquisitions;
+    uint32_t contentions;        // Acquisitions that found the lock taken
+    uint64_t wait_cycles;        // TSC cycles spent waiting for the lock
+    uint64_t hold_cycles;        // TSC cycles between acquire and release
+    uint64_t max_hold_cycles;
+    uint64_t acquired_at;
+    struct lock_stats* next;     // Registry link, see lock_stats_register()
+    int registered;
+} lock_stats_t;
+
+// FIFO ticket spinlock: CPUs are served in the order they arrived
+typedef struct spinlock {
+    volatile uint16_t owner;     // Ticket currently holding the lock
+    volatile uint16_t next;      // Next ticket to hand out
+    lock_stats_t stats;
+} spinlock_t;
+
+#define LOCK_STATS_INIT(lock_name) { lock_name, 0, 0, 0, 0, 0, 0, NULL, 0 }
+#define SPINLOCK_INIT(lock_name) { 0, 0, LOCK_STATS_INIT(lock_name) }
+
+// Registry used by `lockstat`; locks register on their first acquisition
+void lock_stats_register(lock_stats_t* stats);
+void lock_stats_unregister(lock_stats_t* stats);
+void lock_stats_dump(void);
+void lock_stats_reset(void);
+
+static inline uint64_t lock_clock(void) {
+    return rdtsc();
+}
+
+static inline void lock_stats_acquired(lock_stats_t* stats, uint64_t wait_start, int contended) {
+#ifdef LOCK_STATS
+    uint64_t now = lock_clock();
+    stats->acquisitions++;
+    if (contended) {
+        stats->contentions++;
+        stats->wait_cycles += now - wait_start;
+    }
+    stats->acquired_at = now;
+    if (!stats->registered && stats->name) {
+        lock_stats_register(stats);
+    }
+#else
+    (void)stats;
+    (void)wait_start;
+    (void)contended;
+#endif
+}
+
+static inline void lock_stats_released(lock_stats_t* stats) {
+#ifdef LOCK_STATS
+    uint64_t held = lock_clock() - stats->acquired_at;
+    stats->hold_cycles += held;
+    if (held > stats->max_hold_cycles) {
+        stats->max_hold_cycles = held;
+    }
+#else
+    (void)stats;
+#endif
+}
+
+static inline void spin_lock_init(spinlock_t* lock, const char* name) {
+    lock->owner = 0;
+    lock->next = 0;
+    lock_stats_t init = LOCK_STATS_INIT(name);
+    lock->stats = init;
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+#ifdef LOCK_STATS
+    uint64_t start = lock_clock();
+#else
+    uint64_t start = 0;
+#endif
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_ACQUIRE);
+    int contended = 0;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        contended = 1;
+        asm volatile("pause");
+    }
+    lock_stats_acquired(&lock->stats, start, contended);
+}
+
+// Take the lock only if nobody holds or waits for it; returns 1 on success
+static inline int spin_trylock(spinlock_t* lock) {
+    uint16_t ticket = lock->next;
+    if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        return 0;
+    }
+    if (!__atomic_compare_exchange_n(&lock->next, &ticket, (uint16_t)(ticket + 1), 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    lock_stats_acquired(&lock->stats, 0, 0);
+    return 1;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    lock_stats_released(&lock->stats);
+    __atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline int spin_is_locked(spinlock_t* lock) {
+    return lock->owner != lock->next;
+}
+
+// Disable local interrupts and take the lock; returns the previous EFLAGS
+static inline uint32_t spin_lock_irqsave(spinlock_t* lock) {
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
+    if (flags & 0x200) IRQOFF_BEGIN();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spin_unlock(lock);
+    if (flags & 0x200) IRQOFF_END();
+    asm volatile("push %0\n\tpopf" :: "r"(flags) : "memory", "cc");
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _KERNEL_SPINLOCK_H
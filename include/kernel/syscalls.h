@@ -3,16 +3,31 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "kernel/vfs.h"
+#include <sys/uio.h>
+
+// File I/O on the calling process's descriptor table. Paths may be relative to the
+// working directory. Return a descriptor / byte count, or a negative VFS_* code.
 int sys_open(const char* path);
 int sys_read(int fd, uint8_t* buffer, size_t size);
 int sys_write(int fd, const uint8_t* buffer, size_t size);
+int sys_seek(int fd, uint32_t position);
+int sys_close(int fd);
+int sys_readdir(const char* path, vfs_dirent_t* entries, int max_entries);
+int sys_stat(const char* path, vfs_dirent_t* info);
+// Vectored variants: one call moves every segment in order. A short transfer ends
+// the call early; the byte total so far (or the first segment's error) is returned.
+int sys_readv(int fd, const struct iovec* iov, int count);
+int sys_writev(int fd, const struct iovec* iov, int count);
 size_t sys_console_write(const char* buffer, size_t size);
-void sys_close(int fd);
+size_t sys_console_writev(const struct iovec* iov, int count);
 char sys_getchar();
 // Yield execution for current process
 void sys_yield();
 // Yield and wait for a specific event (hook)
 void sys_yield_for_event(int hook_type, uint64_t trigger_value);
+// Enter (period > 0) or leave the deadline scheduling class, in ticks
+int sys_set_deadline(uint32_t period, uint32_t budget);
 // PCI event registration
 void sys_pci_register_listener(uint16_t vendor_id, uint16_t device_id);
 void sys_pci_unregister_listener();
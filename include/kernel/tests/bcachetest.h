@@ -0,0 +1 @@
+void bcache_test();
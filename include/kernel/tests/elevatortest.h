@@ -0,0 +1 @@
+void elevator_test();
@@ -0,0 +1 @@
+void event_ring_test();
@@ -0,0 +1 @@
+void ktime_test();
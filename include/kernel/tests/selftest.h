@@ -0,0 +1 @@
+void selftest_entry();
@@ -0,0 +1 @@
+void timer_wheel_test();
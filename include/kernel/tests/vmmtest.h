@@ -0,0 +1 @@
+void vmm_range_test();
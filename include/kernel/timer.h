@@ -10,7 +10,50 @@ void init_timer(uint32_t frequency);
 // Timer interrupt handler.
 void timer_handler(registers_t* regs);
 
+// Spin for the given number of microseconds using PIT channel 2 (no interrupts needed).
+void timer_busy_wait_us(uint32_t microseconds);
+
 uint32_t get_ticks();
-uint32_t get_ticks_miliseconds();
+// Milliseconds since the timer started; wraps after about 49 days
+uint32_t get_ticks_milliseconds();
+// True once init_timer() has started the periodic tick
+bool timer_running();
+// Convert a duration to whole timer ticks, rounding up (at least 1 for a nonzero duration)
+uint32_t timer_ms_to_ticks(uint32_t milliseconds);
+
+struct ktimer;
+typedef void (*ktimer_func_t)(struct ktimer* timer, void* arg);
+
+// A callback scheduled on the timing wheel. Callbacks run from SOFTIRQ_TIMER with
+// interrupts enabled, so they must not sleep; hand longer work to queue_work().
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev;   // Link that points at this timer; NULL while idle
+    uint32_t expires;        // Absolute tick of the next expiry
+    uint32_t period;         // Re-arm interval in ticks, 0 for a one-shot timer
+    ktimer_func_t func;
+    void* arg;
+} ktimer_t;
+
+#define KTIMER_INIT(timer_func, timer_arg) { 0, 0, 0, 0, timer_func, timer_arg }
+
+void timer_init(ktimer_t* timer, ktimer_func_t func, void* arg);
+// Arm an idle timer to fire after `delay_ms`, then every `period_ms` (0 = once).
+// Returns -1 if it is already pending; use timer_mod() to move it.
+int timer_add(ktimer_t* timer, uint32_t delay_ms, uint32_t period_ms);
+// (Re)arm a timer to fire after `delay_ms`, keeping its period. Returns 1 if it
+// was pending, 0 if it was idle.
+int timer_mod(ktimer_t* timer, uint32_t delay_ms);
+// Disarm a timer and wait for a callback running on another CPU to return, so
+// the caller may free it afterwards. Returns 1 if it was pending. Safe to call
+// from the timer's own callback, which stops a periodic timer.
+int timer_del(ktimer_t* timer);
+bool timer_pending(const ktimer_t* timer);
+// Sleep for at least `milliseconds`. Outside a process, with interrupts off or
+// before the timer runs, this busy-waits on the PIT instead.
+void timer_sleep_ms(uint32_t milliseconds);
+
+// Run callbacks for every tick up to `now`; called by SOFTIRQ_TIMER
+void timer_wheel_advance(uint32_t now);
 
 #endif // TIMER_H
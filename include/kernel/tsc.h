@@ -0,0 +1,13 @@
+#ifndef _KERNEL_TSC_H
+#define _KERNEL_TSC_H
+
+#include <stdint.h>
+
+// Raw time-stamp counter; units are CPU cycles
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif // _KERNEL_TSC_H
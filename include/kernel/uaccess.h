@@ -0,0 +1,27 @@
+#ifndef _KERNEL_UACCESS_H
+#define _KERNEL_UACCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Copies between kernel and ring-3 memory. A fault the page-fault handler cannot
+// resolve (an unmapped user address) makes them fail instead of halting the
+// kernel. Callers still check ranges first (vmm_prepare_user_range): these only
+// catch what slips past, they do not keep ring 3 out of kernel memory.
+// Return 0, or -1 if part of the range could not be accessed.
+int copy_from_user(void* dst, const void* user_src, size_t size);
+int copy_to_user(void* user_dst, const void* src, size_t size);
+
+// Resume address for a kernel fault at `eip` inside one of the copies above,
+// or 0 if `eip` is not a user access
+uint32_t uaccess_fixup(uint32_t eip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _KERNEL_UACCESS_H
@@ -0,0 +1,55 @@
+#ifndef _KERNEL_WAITQUEUE_H
+#define _KERNEL_WAITQUEUE_H
+
+#include <stdint.h>
+#include "kernel/spinlock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct Process;
+
+// FIFO of processes sleeping until some condition becomes true. A process
+// waits on at most one queue at a time; it is linked through Process::wait_next.
+typedef struct wait_queue {
+    spinlock_t lock;
+    struct Process* head;
+    struct Process* tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT(name) { SPINLOCK_INIT(name), 0, 0 }
+
+// wake_up() flags
+#define WAKE_ALL   0x1u // Wake every waiter instead of only the oldest
+#define WAKE_BOOST 0x2u // Make the woken process the next one its CPU runs
+
+void wait_queue_init(wait_queue_t* wq, const char* name);
+// Queue `proc` on `wq`. Check the wait condition after this call: a wake_up()
+// racing with the check just makes the next wait_queue_sleep() return at once.
+void prepare_to_wait(wait_queue_t* wq, struct Process* proc);
+// Leave `wq` and mark `proc` runnable again
+void finish_wait(wait_queue_t* wq, struct Process* proc);
+// Block until woken, unless a wakeup already arrived. Only valid in process context.
+void wait_queue_sleep(wait_queue_t* wq, struct Process* proc);
+// Wake the oldest waiter (or all with WAKE_ALL); returns the number woken. IRQ-safe.
+int wake_up(wait_queue_t* wq, uint32_t flags);
+// Drop `proc` from whatever queue it is sleeping on (used when it is killed)
+void wait_queue_remove(struct Process* proc);
+
+// Sleep on `wq` until `condition` holds, for use in process context
+#define wait_event(wq, proc, condition)         \
+    do {                                        \
+        for (;;) {                              \
+            prepare_to_wait((wq), (proc));      \
+            if (condition) break;               \
+            wait_queue_sleep((wq), (proc));     \
+        }                                       \
+        finish_wait((wq), (proc));              \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _KERNEL_WAITQUEUE_H
@@ -0,0 +1,29 @@
+#ifndef _KERNEL_WORKQUEUE_H
+#define _KERNEL_WORKQUEUE_H
+
+#include <stdint.h>
+
+typedef void (*work_func_t)(void* arg);
+
+// A deferred call executed by a kworker process. An item runs on at most one
+// worker at a time; queueing it while it runs schedules exactly one more run.
+typedef struct work {
+    work_func_t func;
+    void* arg;
+    struct work* next;
+    volatile uint32_t state;     // WORK_STATE_* bits, protected by the queue lock
+} work_t;
+
+#define WORK_STATE_QUEUED  0x1u
+#define WORK_STATE_RUNNING 0x2u
+#define WORK_STATE_REQUEUE 0x4u
+
+#define WORK_INIT(work_func, work_arg) { work_func, work_arg, 0, 0 }
+
+// Start one kworker process per online CPU
+void workqueue_init();
+// Queue `work` (IRQ-safe). Returns 0 if it was already waiting to run.
+int queue_work(work_t* work);
+void workqueue_dump_stats();
+
+#endif // _KERNEL_WORKQUEUE_H
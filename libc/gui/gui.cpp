@@ -11,6 +11,33 @@ int gui_send_command(const GuiCommand *command)
     return 0;
 }
 
+int gui_send_commands(const GuiCommand *commands, int count)
+{
+    if (commands == nullptr || count <= 0)
+    {
+        return 0;
+    }
+    SyscallBatchEntry batch[16];
+    int sent = 0;
+    while (sent < count)
+    {
+        int chunk = count - sent < 16 ? count - sent : 16;
+        for (int i = 0; i < chunk; ++i)
+        {
+            batch[i] = SyscallBatchEntry{};
+            batch[i].num = SYSCALL_GUI_COMMAND;
+            batch[i].args[0] = (uint32_t)&commands[sent + i];
+        }
+        int done = syscall_batch(batch, chunk);
+        if (done <= 0)
+        {
+            break;
+        }
+        sent += done;
+    }
+    return sent;
+}
+
 void gui_request_redraw(void)
 {
     GuiCommand cmd{};
@@ -9,6 +9,9 @@ extern "C" {
 #endif
 
 int gui_send_command(const GuiCommand *command);
+// Submit `count` commands through SYSCALL_BATCH: one kernel entry per frame instead of
+// one per command. Returns the number of commands submitted.
+int gui_send_commands(const GuiCommand *commands, int count);
 void gui_request_redraw(void);
 void gui_set_terminal_origin(int32_t x, int32_t y);
 void gui_request_new_window(void);
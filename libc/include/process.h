@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <sys/events.h>
+#include <kernel/vfs.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,11 +17,29 @@ void yield_for_event(int hook_type, uint64_t trigger_value);
 int start_process(const char* name, void (*entry)(), int speculative, uint32_t stack_size);
 // Poll for an IO event without blocking (returns 1 if event populated, 0 otherwise)
 int process_poll_event(IOEvent* event);
-// Wait for an IO event (blocks cooperatively until an event arrives)
+// Wait for an IO event (blocks in the kernel until one arrives; returns 1)
 int process_wait_event(IOEvent* event);
+// Copy up to `max_events` queued IO events in a single syscall. With `wait` set,
+// block until at least one arrives. Returns the number of events copied.
+int process_drain_events(IOEvent* events, int max_events, int wait);
+// Join the real-time (EDF) class: `budget_ms` of CPU guaranteed every `period_ms`.
+// period_ms == 0 leaves it. Returns 0 on success, -1 if rejected by admission control.
+int process_set_deadline(uint32_t period_ms, uint32_t budget_ms);
 // Terminate the current process with the given status code
 void process_exit(int status);
 
+// File I/O. Descriptors belong to the calling process and are closed when it exits.
+// Paths may be relative to the working directory. Errors are negative VFS_* codes.
+int file_open(const char* path);
+// Reads and writes go directly between the file and `buffer`
+int file_read(int fd, void* buffer, uint32_t size);
+int file_write(int fd, const void* buffer, uint32_t size);
+int file_seek(int fd, uint32_t position);
+int file_close(int fd);
+// Fill up to `max_entries` entries for the directory at `path`; returns the count
+int file_readdir(const char* path, vfs_dirent_t* entries, int max_entries);
+int file_stat(const char* path, vfs_dirent_t* info);
+
 // PCI event handling
 // Register to receive PCI events (vendor_id=0xFFFF and device_id=0xFFFF for all devices)
 void pci_register_listener(uint16_t vendor_id, uint16_t device_id);
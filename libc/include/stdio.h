@@ -5,6 +5,7 @@
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #define EOF (-1)
 
@@ -16,11 +17,16 @@ int printf(const char* __restrict, ...);
 int vprintf(const char* __restrict, va_list);
 int putchar(int);
 int puts(const char*);
+// Write every segment to the console with one kernel entry
+int console_writev(const struct iovec* iov, int count);
 
 // File I/O wrappers
 int open(const char* path);
 int read(int fd, uint8_t* buffer, size_t size);
 int write(int fd, const uint8_t* buffer, size_t size);
+// Vectored file I/O: all segments in one kernel entry; returns the bytes moved
+int readv(int fd, const struct iovec* iov, int count);
+int writev(int fd, const struct iovec* iov, int count);
 void close(int fd);
 
 // Keyboard input
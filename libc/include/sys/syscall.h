@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <sys/events.h>
 #include <sys/gui.h>
+#include <sys/uio.h>
+#include <kernel/vfs.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,94 +21,181 @@ extern "C" {
 #define SYSCALL_CONSOLE_WRITE 0x87
 #define SYSCALL_PCI_REGISTER_LISTENER 0x88
 #define SYSCALL_PCI_UNREGISTER_LISTENER 0x89
+#define SYSCALL_SET_DEADLINE 0x8A
+#define SYSCALL_DRAIN_IO_EVENTS 0x8B
+#define SYSCALL_NOP 0x8C
+#define SYSCALL_OPEN 0x8D
+#define SYSCALL_READ 0x8E
+#define SYSCALL_WRITE 0x8F
+#define SYSCALL_SEEK 0x90
+#define SYSCALL_CLOSE 0x91
+#define SYSCALL_READDIR 0x92
+#define SYSCALL_STAT 0x93
+#define SYSCALL_BATCH 0x94
+#define SYSCALL_CONSOLE_WRITEV 0x95
+#define SYSCALL_READV 0x96
+#define SYSCALL_WRITEV 0x97
 
-static inline void syscall_yield() {
-    asm volatile ("int $0x80" : : "a"(SYSCALL_YIELD));
+// One call in a SYSCALL_BATCH array. `result` receives what EAX would have held.
+typedef struct {
+    uint32_t num;
+    uint32_t args[4];
+    int32_t result;
+} SyscallBatchEntry;
+
+// Longest array a single SYSCALL_BATCH accepts
+#define SYSCALL_BATCH_MAX 64
+
+// Nonzero once the kernel has programmed the SYSENTER MSRs (see gdt.cpp)
+extern volatile int g_sysenter_enabled;
+
+// SYSEXIT can only return to ring 3, so kernel-resident callers always use int $0x80
+static inline int syscall_from_user(void) {
+    uint16_t cs;
+    asm volatile("mov %%cs, %0" : "=r"(cs));
+    return (cs & 3) == 3;
 }
 
-static inline void syscall_yield_for_event(int hook_type, uint64_t trigger_value) {
-#if defined(__x86_64__)
-    register uint64_t rcx asm("rcx") = trigger_value;
-    __asm__ volatile (
-        "int $0x80"
-        :
-        : "a"(SYSCALL_YIELD_FOR_EVENT), "b"(hook_type), "c"(rcx)
-    );
-#else
-    __asm__ volatile (
+// Arguments travel in EBX, ECX, EDX and ESI; the result comes back in EAX
+static inline uint32_t syscall_int80(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4) {
+    asm volatile (
         "int $0x80"
-        :
-        : "a"(SYSCALL_YIELD_FOR_EVENT), "b"(hook_type), "c"((uint32_t)trigger_value)
+        : "+a"(num)
+        : "b"(a1), "c"(a2), "d"(a3), "S"(a4)
+        : "memory"
     );
-#endif
+    return num;
 }
 
-static inline int syscall_start_process(const char* name, void (*entry)(), int speculative, uint32_t stack_size) {
-    int ret;
+// SYSENTER saves neither EIP nor ESP, so the return address, arg2 and arg3 are
+// pushed and EBP points the kernel at them. ECX and EDX come back clobbered.
+static inline uint32_t syscall_sysenter(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4) {
     asm volatile (
-        "int $0x80"
-        : "=a"(ret)
-        : "a"(SYSCALL_START_PROCESS), "b"(name), "c"(entry), "d"(speculative), "S"(stack_size)
+        "push %%ebp\n\t"
+        "push %%edx\n\t"
+        "push %%ecx\n\t"
+        "push $1f\n\t"
+        "mov %%esp, %%ebp\n\t"
+        "sysenter\n"
+        "1:\n\t"
+        "add $12, %%esp\n\t"
+        "pop %%ebp"
+        : "+a"(num), "+c"(a2), "+d"(a3)
+        : "b"(a1), "S"(a4)
+        : "memory", "cc"
     );
-    return ret;
+    return num;
+}
+
+// Take the SYSENTER fast path from ring 3 when the CPU supports it
+static inline uint32_t syscall_invoke(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4) {
+    if (g_sysenter_enabled && syscall_from_user()) {
+        return syscall_sysenter(num, a1, a2, a3, a4);
+    }
+    return syscall_int80(num, a1, a2, a3, a4);
+}
+
+static inline void syscall_yield() {
+    syscall_invoke(SYSCALL_YIELD, 0, 0, 0, 0);
+}
+
+static inline void syscall_yield_for_event(int hook_type, uint64_t trigger_value) {
+    syscall_invoke(SYSCALL_YIELD_FOR_EVENT, (uint32_t)hook_type, (uint32_t)trigger_value, 0, 0);
+}
+
+// Starts `entry` as a ring-0 process, so it is refused (-1) from ring 3
+static inline int syscall_start_process(const char* name, void (*entry)(), int speculative, uint32_t stack_size) {
+    return (int)syscall_invoke(SYSCALL_START_PROCESS, (uint32_t)name, (uint32_t)entry,
+                               (uint32_t)speculative, stack_size);
 }
 
 static inline void syscall_exit(int status) {
-    asm volatile (
-        "int $0x80"
-        :
-        : "a"(SYSCALL_EXIT), "b"(status)
-        : "memory"
-    );
+    syscall_invoke(SYSCALL_EXIT, (uint32_t)status, 0, 0, 0);
 }
 
 static inline int syscall_poll_io_event(IOEvent* event) {
-    int ret;
-    asm volatile (
-        "int $0x80"
-        : "=a"(ret)
-        : "a"(SYSCALL_POLL_IO_EVENT), "b"(event)
-        : "memory"
-    );
-    return ret;
+    return (int)syscall_invoke(SYSCALL_POLL_IO_EVENT, (uint32_t)event, 0, 0, 0);
 }
 
 static inline int syscall_wait_io_event(IOEvent* event) {
-    int ret;
-    asm volatile (
-        "int $0x80"
-        : "=a"(ret)
-        : "a"(SYSCALL_WAIT_IO_EVENT), "b"(event)
-        : "memory"
-    );
-    return ret;
+    return (int)syscall_invoke(SYSCALL_WAIT_IO_EVENT, (uint32_t)event, 0, 0, 0);
+}
+
+static inline int syscall_drain_io_events(IOEvent* events, int max_events, int wait) {
+    return (int)syscall_invoke(SYSCALL_DRAIN_IO_EVENTS, (uint32_t)events, (uint32_t)max_events,
+                               (uint32_t)wait, 0);
 }
 
 static inline void syscall_gui_command(const GuiCommand* command) {
-    asm volatile (
-        "int $0x80"
-        :
-        : "a"(SYSCALL_GUI_COMMAND), "b"(command)
-        : "memory"
-    );
+    syscall_invoke(SYSCALL_GUI_COMMAND, (uint32_t)command, 0, 0, 0);
+}
+
+static inline int syscall_console_write(const char* buffer, uint32_t size) {
+    return (int)syscall_invoke(SYSCALL_CONSOLE_WRITE, (uint32_t)buffer, size, 0, 0);
 }
 
 static inline void syscall_pci_register_listener(uint16_t vendor_id, uint16_t device_id) {
-    asm volatile (
-        "int $0x80"
-        :
-        : "a"(SYSCALL_PCI_REGISTER_LISTENER), "b"(vendor_id), "c"(device_id)
-        : "memory"
-    );
+    syscall_invoke(SYSCALL_PCI_REGISTER_LISTENER, vendor_id, device_id, 0, 0);
 }
 
 static inline void syscall_pci_unregister_listener() {
-    asm volatile (
-        "int $0x80"
-        :
-        : "a"(SYSCALL_PCI_UNREGISTER_LISTENER)
-        : "memory"
-    );
+    syscall_invoke(SYSCALL_PCI_UNREGISTER_LISTENER, 0, 0, 0, 0);
+}
+
+static inline int syscall_set_deadline(uint32_t period, uint32_t budget) {
+    return (int)syscall_invoke(SYSCALL_SET_DEADLINE, period, budget, 0, 0);
+}
+
+// Does nothing; used to measure the raw cost of entering and leaving the kernel
+static inline int syscall_nop() {
+    return (int)syscall_invoke(SYSCALL_NOP, 0, 0, 0, 0);
+}
+
+// File I/O on the per-process descriptor table; errors are negative VFS_* codes
+static inline int syscall_open(const char* path) {
+    return (int)syscall_invoke(SYSCALL_OPEN, (uint32_t)path, 0, 0, 0);
+}
+
+static inline int syscall_read(int fd, void* buffer, uint32_t size) {
+    return (int)syscall_invoke(SYSCALL_READ, (uint32_t)fd, (uint32_t)buffer, size, 0);
+}
+
+static inline int syscall_write(int fd, const void* buffer, uint32_t size) {
+    return (int)syscall_invoke(SYSCALL_WRITE, (uint32_t)fd, (uint32_t)buffer, size, 0);
+}
+
+static inline int syscall_seek(int fd, uint32_t position) {
+    return (int)syscall_invoke(SYSCALL_SEEK, (uint32_t)fd, position, 0, 0);
+}
+
+static inline int syscall_close(int fd) {
+    return (int)syscall_invoke(SYSCALL_CLOSE, (uint32_t)fd, 0, 0, 0);
+}
+
+static inline int syscall_readdir(const char* path, vfs_dirent_t* entries, int max_entries) {
+    return (int)syscall_invoke(SYSCALL_READDIR, (uint32_t)path, (uint32_t)entries, (uint32_t)max_entries, 0);
+}
+
+static inline int syscall_stat(const char* path, vfs_dirent_t* info) {
+    return (int)syscall_invoke(SYSCALL_STAT, (uint32_t)path, (uint32_t)info, 0, 0);
+}
+
+// Run `count` calls in order with a single kernel entry. Yield, yield-for-event, exit
+// and nested batches are refused with result -1. Returns the number of entries run.
+static inline int syscall_batch(SyscallBatchEntry* entries, int count) {
+    return (int)syscall_invoke(SYSCALL_BATCH, (uint32_t)entries, (uint32_t)count, 0, 0);
+}
+
+static inline int syscall_console_writev(const struct iovec* iov, int count) {
+    return (int)syscall_invoke(SYSCALL_CONSOLE_WRITEV, (uint32_t)iov, (uint32_t)count, 0, 0);
+}
+
+static inline int syscall_readv(int fd, const struct iovec* iov, int count) {
+    return (int)syscall_invoke(SYSCALL_READV, (uint32_t)fd, (uint32_t)iov, (uint32_t)count, 0);
+}
+
+static inline int syscall_writev(int fd, const struct iovec* iov, int count) {
+    return (int)syscall_invoke(SYSCALL_WRITEV, (uint32_t)fd, (uint32_t)iov, (uint32_t)count, 0);
 }
 
 #ifdef __cplusplus
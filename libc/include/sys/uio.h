@@ -0,0 +1,23 @@
+#ifndef LIBC_SYS_UIO_H
+#define LIBC_SYS_UIO_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One segment of a vectored read or write
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+
+// Longest vector a single readv/writev call accepts
+#define IOV_MAX 64
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBC_SYS_UIO_H
@@ -17,6 +17,14 @@ int process_wait_event(IOEvent* event) {
     return syscall_wait_io_event(event);
 }
 
+int process_drain_events(IOEvent* events, int max_events, int wait) {
+    return syscall_drain_io_events(events, max_events, wait);
+}
+
+int process_set_deadline(uint32_t period_ms, uint32_t budget_ms) {
+    return syscall_set_deadline(period_ms, budget_ms);
+}
+
 void process_exit(int status) {
     syscall_exit(status);
     while (1) {
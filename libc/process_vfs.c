@@ -0,0 +1,30 @@
+#include "process.h"
+#include <sys/syscall.h>
+
+int file_open(const char* path) {
+    return syscall_open(path);
+}
+
+int file_read(int fd, void* buffer, uint32_t size) {
+    return syscall_read(fd, buffer, size);
+}
+
+int file_write(int fd, const void* buffer, uint32_t size) {
+    return syscall_write(fd, buffer, size);
+}
+
+int file_seek(int fd, uint32_t position) {
+    return syscall_seek(fd, position);
+}
+
+int file_close(int fd) {
+    return syscall_close(fd);
+}
+
+int file_readdir(const char* path, vfs_dirent_t* entries, int max_entries) {
+    return syscall_readdir(path, entries, max_entries);
+}
+
+int file_stat(const char* path, vfs_dirent_t* info) {
+    return syscall_stat(path, info);
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <kernel/syscalls.h>
+#include <sys/syscall.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
@@ -10,18 +11,22 @@ static void console_write(const char* data, size_t size)
     {
         return;
     }
+    if (syscall_from_user())
+    {
+        // Ring-3 callers cannot take the console lock themselves
+        syscall_console_write(data, (uint32_t)size);
+        return;
+    }
     sys_console_write(data, size);
 }
 
-static void console_write_string(const char* str)
+int console_writev(const struct iovec* iov, int count)
 {
-    if (!str)
+    if (syscall_from_user())
     {
-        static const char null_str[] = "(null)";
-        console_write(null_str, sizeof(null_str) - 1);
-        return;
+        return syscall_console_writev(iov, count);
     }
-    console_write(str, strlen(str));
+    return (int)sys_console_writev(iov, count);
 }
 
 int putchar(char c)
@@ -32,45 +37,75 @@ int putchar(char c)
 
 int puts(const char* str)
 {
-    console_write_string(str);
-    const char newline = '\n';
-    console_write(&newline, 1);
+    static const char null_str[] = "(null)";
+    static char newline[] = "\n";
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)(str ? str : null_str);
+    iov[0].iov_len = str ? strlen(str) : sizeof(null_str) - 1;
+    iov[1].iov_base = newline;
+    iov[1].iov_len = 1;
+    console_writev(iov, 2);
     return 0;
 }
 
-static void console_write_range(const char* data, size_t length)
-{
-    if (!data || length == 0)
-    {
-        return;
-    }
-    console_write(data, length);
-}
-
 static bool is_digit(char c)
 {
     return c >= '0' && c <= '9';
 }
 
-static size_t console_write_repeat(char ch, int count)
+namespace
 {
-    if (count <= 0)
+// printf output is gathered here and handed to the console in as few writes as
+// possible: a ring-3 caller pays one kernel entry per 256 bytes, not per fragment
+struct PrintBuffer
+{
+    char data[256];
+    size_t length = 0;
+
+    void flush()
     {
-        return 0;
+        if (length > 0)
+        {
+            console_write(data, length);
+            length = 0;
+        }
     }
 
-    char block[32];
-    memset(block, ch, sizeof(block));
+    void append(const char* text, size_t count)
+    {
+        while (text && count > 0)
+        {
+            if (length == sizeof(data))
+            {
+                flush();
+            }
+            size_t room = sizeof(data) - length;
+            size_t chunk = count < room ? count : room;
+            memcpy(data + length, text, chunk);
+            length += chunk;
+            text += chunk;
+            count -= chunk;
+        }
+    }
 
-    int remaining = count;
-    while (remaining > 0)
+    void put(char ch)
     {
-        int chunk = remaining < (int)sizeof(block) ? remaining : (int)sizeof(block);
-        console_write(block, (size_t)chunk);
-        remaining -= chunk;
+        if (length == sizeof(data))
+        {
+            flush();
+        }
+        data[length++] = ch;
     }
-    return (size_t)count;
-}
+
+    void repeat(char ch, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            put(ch);
+        }
+    }
+};
+} // namespace
 
 static size_t format_unsigned(uint64_t value, unsigned base, char* buffer, bool uppercase)
 {
@@ -93,24 +128,14 @@ static size_t format_unsigned(uint64_t value, unsigned base, char* buffer, bool
 
 static int vprintf_internal(const char* format, va_list args)
 {
-    char literal_buffer[128];
-    size_t literal_len = 0;
+    PrintBuffer out;
     char value_buffer[65];
 
-    auto flush_literal = [&]() {
-        if (literal_len > 0)
-        {
-            console_write(literal_buffer, literal_len);
-            literal_len = 0;
-        }
-    };
-
     while (*format)
     {
         if (*format == '%')
         {
             ++format;
-            flush_literal();
 
             bool left_adjust = false;
             bool force_sign = false;
@@ -257,20 +282,20 @@ static int vprintf_internal(const char* format, va_list args)
 
                 if (!left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 if (prefix_len)
                 {
-                    console_write_range(prefix, prefix_len);
+                    out.append(prefix, prefix_len);
                 }
-                console_write_repeat('0', (int)zeroes);
+                out.repeat('0', (int)zeroes);
                 if (digits_len)
                 {
-                    console_write_range(value_buffer, digits_len);
+                    out.append(value_buffer, digits_len);
                 }
                 if (left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 break;
             }
@@ -307,16 +332,16 @@ static int vprintf_internal(const char* format, va_list args)
 
                 if (!left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
-                console_write_repeat('0', (int)zeroes);
+                out.repeat('0', (int)zeroes);
                 if (digits_len)
                 {
-                    console_write_range(value_buffer, digits_len);
+                    out.append(value_buffer, digits_len);
                 }
                 if (left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 break;
             }
@@ -363,20 +388,20 @@ static int vprintf_internal(const char* format, va_list args)
 
                 if (!left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 if (prefix_len)
                 {
-                    console_write_range(prefix, prefix_len);
+                    out.append(prefix, prefix_len);
                 }
-                console_write_repeat('0', (int)zeroes);
+                out.repeat('0', (int)zeroes);
                 if (digits_len)
                 {
-                    console_write_range(value_buffer, digits_len);
+                    out.append(value_buffer, digits_len);
                 }
                 if (left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 break;
             }
@@ -393,12 +418,12 @@ static int vprintf_internal(const char* format, va_list args)
                 int padding = width > (int)len ? width - (int)len : 0;
                 if (!left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
-                console_write_range(output, len);
+                out.append(output, len);
                 if (left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 break;
             }
@@ -408,12 +433,12 @@ static int vprintf_internal(const char* format, va_list args)
                 int padding = width > 1 ? width - 1 : 0;
                 if (!left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
-                console_write(&c, 1);
+                out.put(c);
                 if (left_adjust)
                 {
-                    console_write_repeat(' ', padding);
+                    out.repeat(' ', padding);
                 }
                 break;
             }
@@ -432,14 +457,14 @@ static int vprintf_internal(const char* format, va_list args)
                     int padding = width > (int)total_len ? width - (int)total_len : 0;
                     if (!left_adjust)
                     {
-                        console_write_repeat(' ', padding);
+                        out.repeat(' ', padding);
                     }
-                    console_write_range(prefix, prefix_len);
-                    console_write_repeat('0', (int)zeroes);
-                    console_write_range(value_buffer, digits_len);
+                    out.append(prefix, prefix_len);
+                    out.repeat('0', (int)zeroes);
+                    out.append(value_buffer, digits_len);
                     if (left_adjust)
                     {
-                        console_write_repeat(' ', padding);
+                        out.repeat(' ', padding);
                     }
                 }
                 else
@@ -448,13 +473,13 @@ static int vprintf_internal(const char* format, va_list args)
                     int padding = width > (int)total_len ? width - (int)total_len : 0;
                     if (!left_adjust)
                     {
-                        console_write_repeat(' ', padding);
+                        out.repeat(' ', padding);
                     }
-                    console_write_range(prefix, prefix_len);
-                    console_write_range(value_buffer, digits_len);
+                    out.append(prefix, prefix_len);
+                    out.append(value_buffer, digits_len);
                     if (left_adjust)
                     {
-                        console_write_repeat(' ', padding);
+                        out.repeat(' ', padding);
                     }
                 }
                 break;
@@ -462,14 +487,14 @@ static int vprintf_internal(const char* format, va_list args)
             case '%':
             {
                 const char percent = '%';
-                console_write(&percent, 1);
+                out.put(percent);
                 break;
             }
             default:
             {
                 const char percent = '%';
-                console_write(&percent, 1);
-                console_write(&specifier, 1);
+                out.put(percent);
+                out.put(specifier);
                 break;
             }
             }
@@ -482,16 +507,12 @@ static int vprintf_internal(const char* format, va_list args)
         }
         else
         {
-            if (literal_len >= sizeof(literal_buffer))
-            {
-                flush_literal();
-            }
-            literal_buffer[literal_len++] = *format;
+            out.put(*format);
         }
         ++format;
     }
 
-    flush_literal();
+    out.flush();
     return 0;
 }
 
@@ -516,20 +537,37 @@ int vprintf(const char* format, va_list args)
 }
 #endif
 
-// File I/O wrappers
+// File I/O wrappers; ring-3 callers trap, kernel-resident ones call straight in
 int open(const char* path) {
+    if (syscall_from_user()) return syscall_open(path);
     return sys_open(path);
 }
 
 int read(int fd, uint8_t* buffer, size_t size) {
+    if (syscall_from_user()) return syscall_read(fd, buffer, (uint32_t)size);
     return sys_read(fd, buffer, size);
 }
 
 int write(int fd, const uint8_t* buffer, size_t size) {
+    if (syscall_from_user()) return syscall_write(fd, buffer, (uint32_t)size);
     return sys_write(fd, buffer, size);
 }
 
+int readv(int fd, const struct iovec* iov, int count) {
+    if (syscall_from_user()) return syscall_readv(fd, iov, count);
+    return sys_readv(fd, iov, count);
+}
+
+int writev(int fd, const struct iovec* iov, int count) {
+    if (syscall_from_user()) return syscall_writev(fd, iov, count);
+    return sys_writev(fd, iov, count);
+}
+
 void close(int fd) {
+    if (syscall_from_user()) {
+        syscall_close(fd);
+        return;
+    }
     sys_close(fd);
 }
 
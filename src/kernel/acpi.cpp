@@ -0,0 +1,308 @@
+#include "kernel/acpi.h"
+#include "kernel/paging.h"
+#include "kernel/debug.h"
+#include <string.h>
+#include <stddef.h>
+
+struct __attribute__((packed)) acpi_rsdp_t {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+};
+
+struct __attribute__((packed)) acpi_sdt_header_t {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+};
+
+struct __attribute__((packed)) acpi_madt_t {
+    acpi_sdt_header_t header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    // Variable-length interrupt controller structures follow
+};
+
+struct __attribute__((packed)) mp_floating_t {
+    char signature[4];
+    uint32_t config_table;
+    uint8_t length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];
+};
+
+struct __attribute__((packed)) mp_config_t {
+    char signature[4];
+    uint16_t base_length;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_size;
+    uint16_t entry_count;
+    uint32_t lapic_address;
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+};
+
+#define MADT_TYPE_LAPIC           0
+#define MADT_TYPE_IOAPIC          1
+#define MADT_TYPE_OVERRIDE        2
+#define MADT_TYPE_LAPIC_OVERRIDE  5
+
+#define MP_ENTRY_PROCESSOR  0
+#define MP_ENTRY_BUS        1
+#define MP_ENTRY_IOAPIC     2
+#define MP_ENTRY_IO_INT     3
+#define MP_ENTRY_LOCAL_INT  4
+
+#define MP_MAX_BUSES 32
+
+static acpi_madt_info_t madt_info;
+
+// Firmware tables may live above the identity-mapped low memory; map them on demand.
+static void acpi_map(uint32_t phys, uint32_t length) {
+    uint32_t base = phys & ~(PAGE_SIZE - 1);
+    vmm_map_range(base, base, length + (phys - base), 0);
+}
+
+static bool checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; ++i) {
+        sum = (uint8_t)(sum + bytes[i]);
+    }
+    return sum == 0;
+}
+
+static const void* scan_for_signature(uint32_t start, uint32_t length, const char* sig, uint32_t sig_len,
+                                      uint32_t struct_len) {
+    for (uint32_t addr = start; addr + struct_len <= start + length; addr += 16) {
+        if (memcmp((const void*)addr, sig, sig_len) == 0 && checksum_ok((const void*)addr, struct_len)) {
+            return (const void*)addr;
+        }
+    }
+    return NULL;
+}
+
+// The EBDA segment is stored at 0x40E; the spec also allows the BIOS ROM area.
+static const void* find_in_bios_areas(const char* sig, uint32_t sig_len, uint32_t struct_len) {
+    volatile uint16_t* ebda_segment = (volatile uint16_t*)(uintptr_t)0x40E;
+    asm volatile("" : "+r"(ebda_segment)); // Hide the constant address from bounds checks
+    uint32_t ebda = (uint32_t)(*ebda_segment) << 4;
+    const void* found = NULL;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        found = scan_for_signature(ebda, 1024, sig, sig_len, struct_len);
+    }
+    if (!found) {
+        found = scan_for_signature(0x9FC00, 1024, sig, sig_len, struct_len);
+    }
+    if (!found) {
+        found = scan_for_signature(0xE0000, 0x20000, sig, sig_len, struct_len);
+    }
+    return found;
+}
+
+static void add_cpu(uint8_t apic_id) {
+    if (madt_info.cpu_count >= ACPI_MAX_CPUS) return;
+    madt_info.cpu_apic_ids[madt_info.cpu_count++] = apic_id;
+}
+
+static void add_ioapic(uint8_t id, uint32_t address, uint32_t gsi_base) {
+    if (madt_info.ioapic_count >= ACPI_MAX_IOAPICS) return;
+    acpi_ioapic_t& io = madt_info.ioapics[madt_info.ioapic_count++];
+    io.id = id;
+    io.address = address;
+    io.gsi_base = gsi_base;
+}
+
+static void add_override(uint8_t source_irq, uint32_t gsi, uint16_t flags) {
+    if (madt_info.override_count >= ACPI_MAX_OVERRIDES) return;
+    acpi_irq_override_t& ov = madt_info.overrides[madt_info.override_count++];
+    ov.source_irq = source_irq;
+    ov.gsi = gsi;
+    ov.flags = flags;
+}
+
+static const acpi_sdt_header_t* map_table(uint32_t phys) {
+    acpi_map(phys, sizeof(acpi_sdt_header_t));
+    const acpi_sdt_header_t* header = (const acpi_sdt_header_t*)phys;
+    acpi_map(phys, header->length);
+    if (!checksum_ok(header, header->length)) {
+        return NULL;
+    }
+    return header;
+}
+
+static void parse_madt(const acpi_madt_t* madt) {
+    madt_info.lapic_address = madt->lapic_address;
+    madt_info.has_8259 = (madt->flags & 1u) ? 1 : 0;
+
+    const uint8_t* ptr = (const uint8_t*)madt + sizeof(acpi_madt_t);
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+    while (ptr + 2 <= end) {
+        uint8_t type = ptr[0];
+        uint8_t length = ptr[1];
+        if (length < 2 || ptr + length > end) break;
+        switch (type) {
+            case MADT_TYPE_LAPIC: {
+                uint32_t flags = *(const uint32_t*)(ptr + 4);
+                if (flags & 1u) { // Enabled
+                    add_cpu(ptr[3]);
+                }
+                break;
+            }
+            case MADT_TYPE_IOAPIC:
+                add_ioapic(ptr[2], *(const uint32_t*)(ptr + 4), *(const uint32_t*)(ptr + 8));
+                break;
+            case MADT_TYPE_OVERRIDE:
+                add_override(ptr[3], *(const uint32_t*)(ptr + 4), *(const uint16_t*)(ptr + 8));
+                break;
+            case MADT_TYPE_LAPIC_OVERRIDE: {
+                uint64_t address = *(const uint64_t*)(ptr + 4);
+                if ((address >> 32) == 0) {
+                    madt_info.lapic_address = (uint32_t)address;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        ptr += length;
+    }
+}
+
+static int acpi_parse(void) {
+    const acpi_rsdp_t* rsdp = (const acpi_rsdp_t*)find_in_bios_areas("RSD PTR ", 8, 20);
+    if (!rsdp) {
+        debug("[ACPI] RSDP not found");
+        return -1;
+    }
+
+    bool use_xsdt = rsdp->revision >= 2 && (rsdp->xsdt_address >> 32) == 0 && rsdp->xsdt_address != 0;
+    uint32_t root_phys = use_xsdt ? (uint32_t)rsdp->xsdt_address : rsdp->rsdt_address;
+    const acpi_sdt_header_t* root = map_table(root_phys);
+    if (!root) {
+        error("[ACPI] Root table checksum mismatch at 0x%x", root_phys);
+        return -1;
+    }
+
+    uint32_t entry_size = use_xsdt ? 8 : 4;
+    uint32_t entries = (root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    const uint8_t* entry_base = (const uint8_t*)root + sizeof(acpi_sdt_header_t);
+    for (uint32_t i = 0; i < entries; ++i) {
+        uint64_t addr64 = use_xsdt ? *(const uint64_t*)(entry_base + i * 8)
+                                   : *(const uint32_t*)(entry_base + i * 4);
+        if ((addr64 >> 32) != 0) continue;
+        const acpi_sdt_header_t* table = map_table((uint32_t)addr64);
+        if (table && memcmp(table->signature, "APIC", 4) == 0) {
+            parse_madt((const acpi_madt_t*)table);
+            return 0;
+        }
+    }
+    debug("[ACPI] MADT not present");
+    return -1;
+}
+
+// Legacy Intel MultiProcessor Specification tables, used when ACPI is unavailable.
+static int mptable_parse(void) {
+    const mp_floating_t* fp = (const mp_floating_t*)find_in_bios_areas("_MP_", 4, 16);
+    if (!fp || fp->config_table == 0) {
+        debug("[ACPI] MP floating pointer not found");
+        return -1;
+    }
+    acpi_map(fp->config_table, sizeof(mp_config_t));
+    const mp_config_t* config = (const mp_config_t*)fp->config_table;
+    acpi_map(fp->config_table, config->base_length);
+    if (memcmp(config->signature, "PCMP", 4) != 0 || !checksum_ok(config, config->base_length)) {
+        error("[ACPI] MP configuration table invalid");
+        return -1;
+    }
+
+    madt_info.lapic_address = config->lapic_address;
+    madt_info.has_8259 = 1;
+
+    bool bus_is_isa[MP_MAX_BUSES] = {};
+    const uint8_t* ptr = (const uint8_t*)config + sizeof(mp_config_t);
+    const uint8_t* end = (const uint8_t*)config + config->base_length;
+    for (uint16_t i = 0; i < config->entry_count && ptr < end; ++i) {
+        switch (ptr[0]) {
+            case MP_ENTRY_PROCESSOR:
+                if (ptr[3] & 1u) { // Enabled
+                    add_cpu(ptr[1]);
+                }
+                ptr += 20;
+                break;
+            case MP_ENTRY_BUS:
+                if (ptr[1] < MP_MAX_BUSES && memcmp(ptr + 2, "ISA", 3) == 0) {
+                    bus_is_isa[ptr[1]] = true;
+                }
+                ptr += 8;
+                break;
+            case MP_ENTRY_IOAPIC:
+                if (ptr[3] & 1u) {
+                    add_ioapic(ptr[1], *(const uint32_t*)(ptr + 4), 0);
+                }
+                ptr += 8;
+                break;
+            case MP_ENTRY_IO_INT: {
+                uint16_t flags = *(const uint16_t*)(ptr + 2);
+                uint8_t bus = ptr[4];
+                uint8_t irq = ptr[5];
+                uint8_t pin = ptr[7];
+                // Only vectored ISA interrupts that are not identity-wired need an override
+                if (ptr[1] == 0 && bus < MP_MAX_BUSES && bus_is_isa[bus] && (irq != pin || flags != 0)) {
+                    add_override(irq, pin, flags);
+                }
+                ptr += 8;
+                break;
+            }
+            case MP_ENTRY_LOCAL_INT:
+            default:
+                ptr += 8;
+                break;
+        }
+    }
+    madt_info.from_mp_table = 1;
+    return 0;
+}
+
+int acpi_init(void) {
+    memset(&madt_info, 0, sizeof(madt_info));
+    if (acpi_parse() != 0) {
+        memset(&madt_info, 0, sizeof(madt_info));
+        if (mptable_parse() != 0) {
+            error("[ACPI] No MADT or MP table; staying uniprocessor");
+            return -1;
+        }
+    }
+    if (madt_info.lapic_address == 0) {
+        madt_info.lapic_address = 0xFEE00000u;
+    }
+    madt_info.valid = 1;
+    success("[ACPI] %s: %d CPU(s), %d IOAPIC(s), %d override(s), LAPIC at 0x%x",
+            madt_info.from_mp_table ? "MP table" : "MADT",
+            madt_info.cpu_count, madt_info.ioapic_count, madt_info.override_count,
+            madt_info.lapic_address);
+    return 0;
+}
+
+const acpi_madt_info_t* acpi_get_madt_info(void) {
+    return madt_info.valid ? &madt_info : NULL;
+}
@@ -0,0 +1,621 @@
+#include "kernel/ahci.h"
+#include "kernel/blockdev.h"
+#include "kernel/debug.h"
+#include "kernel/heap.h"
+#include "kernel/isr.h"
+#include "kernel/paging.h"
+#include "kernel/pci.h"
+#include "kernel/pic.h"
+#include "kernel/spinlock.h"
+#include "kernel/timer.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Polled commands spin for a while, then check once per millisecond
+#define AHCI_SPIN_POLLS   10000
+#define AHCI_TIMEOUT_MS   5000
+// Port engine start/stop must settle within 500 ms (AHCI 1.3, 10.1.2)
+#define AHCI_STOP_MS      500
+// Largest polled transfer per command: the size of the per-port bounce buffer
+#define AHCI_SYNC_SECTORS 128
+
+// Per-port state. Up to `depth` commands are outstanding at once, one per slot;
+// with NCQ the drive may finish them in any order.
+typedef struct {
+    uint32_t base;                 // Port register block, offset into ABAR
+    ahci_cmd_header_t* cmd_list;   // 32 headers
+    uint8_t* fis;                  // Received FIS area
+    ahci_cmd_table_t* tables;      // One command table per slot
+    uint32_t tables_phys;
+    uint32_t slot_mask;            // Slots this port may use
+    blk_request_t* slot_req[32];   // Queued request owning each busy slot
+    uint32_t issued;               // Slots with a command outstanding
+    uint32_t polled;               // Of those, slots a synchronous caller polls itself
+    uint32_t failed;               // Polled slots an error recovery aborted
+    uint32_t progress;             // Tick of the last completion (or first issue)
+    uint8_t* bounce;               // Polled transfers of unaligned buffers
+    ktimer_t timeout;
+} ahci_port_t;
+
+static volatile uint32_t* abar = NULL;
+static ahci_drive_t drives[AHCI_MAX_DRIVES];
+static ahci_port_t ports[AHCI_MAX_DRIVES];
+static uint8_t drive_count = 0;
+static pci_device_t* ahci_dev = NULL;
+static bool ahci_irq_ready = false;
+// Port state; nests inside the block layer's queue lock
+static spinlock_t ahci_lock = SPINLOCK_INIT("ahci");
+
+static inline uint32_t hba_read(uint32_t reg) {
+    return abar[reg / 4];
+}
+
+static inline void hba_write(uint32_t reg, uint32_t value) {
+    abar[reg / 4] = value;
+}
+
+static inline uint32_t port_read(const ahci_port_t* p, uint32_t reg) {
+    return abar[(p->base + reg) / 4];
+}
+
+static inline void port_write(const ahci_port_t* p, uint32_t reg, uint32_t value) {
+    abar[(p->base + reg) / 4] = value;
+}
+
+// The heap is identity mapped, so an aligned kmalloc block is DMA-able as is.
+// `*raw` receives the kmalloc pointer to free the block with.
+static void* ahci_alloc(uint32_t size, uint32_t align, uint32_t* phys, void** raw) {
+    *raw = kmalloc(size + align);
+    if (!*raw) return NULL;
+    uint8_t* block = (uint8_t*)(((uint32_t)*raw + align - 1) & ~(align - 1));
+    if (vmm_virt_to_phys((uint32_t)block, phys) != 0) {
+        kfree(*raw);
+        *raw = NULL;
+        return NULL;
+    }
+    memset(block, 0, size);
+    return block;
+}
+
+// Wait for `mask` bits of a port register to clear. Spins, so it is usable
+// with ahci_lock held; only error recovery and port setup come here.
+static bool ahci_wait_clear(const ahci_port_t* p, uint32_t reg, uint32_t mask, uint32_t ms) {
+    for (uint32_t i = 0; i < ms * 10; i++) {
+        if (!(port_read(p, reg) & mask)) return true;
+        timer_busy_wait_us(100);
+    }
+    return !(port_read(p, reg) & mask);
+}
+
+static void ahci_port_stop(ahci_port_t* p) {
+    port_write(p, AHCI_PORT_CMD, port_read(p, AHCI_PORT_CMD) & ~(AHCI_PORT_CMD_ST | AHCI_PORT_CMD_FRE));
+    if (!ahci_wait_clear(p, AHCI_PORT_CMD, AHCI_PORT_CMD_CR | AHCI_PORT_CMD_FR, AHCI_STOP_MS)) {
+        error("[AHCI] Port engine at 0x%x did not stop", p->base);
+    }
+}
+
+static void ahci_port_start(ahci_port_t* p) {
+    ahci_wait_clear(p, AHCI_PORT_CMD, AHCI_PORT_CMD_CR, AHCI_STOP_MS);
+    port_write(p, AHCI_PORT_CMD, port_read(p, AHCI_PORT_CMD) | AHCI_PORT_CMD_FRE);
+    port_write(p, AHCI_PORT_CMD, port_read(p, AHCI_PORT_CMD) | AHCI_PORT_CMD_ST);
+}
+
+// Stop the port, which drops every outstanding command, and start it again
+// (with a COMRESET if the drive stays busy). Queued requests are moved to
+// `aborted` for the caller to fail; polled slots still outstanding are marked
+// failed for their owners. Caller holds ahci_lock.
+static int ahci_recover_locked(ahci_port_t* p, blk_request_t** aborted) {
+    error("[AHCI] Port at 0x%x: recovering, TFD 0x%x SERR 0x%x, slots 0x%x", p->base,
+          port_read(p, AHCI_PORT_TFD), port_read(p, AHCI_PORT_SERR), p->issued);
+    uint32_t busy = port_read(p, AHCI_PORT_SACT) | port_read(p, AHCI_PORT_CI);
+    ahci_port_stop(p);
+    port_write(p, AHCI_PORT_SERR, 0xFFFFFFFF);
+    port_write(p, AHCI_PORT_IS, 0xFFFFFFFF);
+    if (port_read(p, AHCI_PORT_TFD) & (AHCI_TFD_BSY | AHCI_TFD_DRQ)) {
+        port_write(p, AHCI_PORT_SCTL, AHCI_SCTL_DET_RESET);
+        timer_busy_wait_us(1000);
+        port_write(p, AHCI_PORT_SCTL, 0);
+        ahci_wait_clear(p, AHCI_PORT_TFD, AHCI_TFD_BSY | AHCI_TFD_DRQ, AHCI_STOP_MS);
+        port_write(p, AHCI_PORT_SERR, 0xFFFFFFFF);
+    }
+    ahci_port_start(p);
+
+    int count = 0;
+    for (int slot = 0; slot < 32; slot++) {
+        uint32_t bit = 1u << slot;
+        if (!(p->issued & bit)) continue;
+        if (p->polled & bit) {
+            if (busy & bit) p->failed |= bit;
+            continue;
+        }
+        aborted[count++] = p->slot_req[slot];
+        p->slot_req[slot] = NULL;
+        p->issued &= ~bit;
+    }
+    p->progress = get_ticks();
+    return count;
+}
+
+// Reap finished commands and handle errors. Called from the HBA interrupt and
+// by polling callers; slots in `polled` are left to their owners.
+static void ahci_service(ahci_port_t* p) {
+    blk_request_t* done[32];
+    blk_request_t* aborted[32];
+    int done_count = 0;
+    int aborted_count = 0;
+    uint32_t flags = spin_lock_irqsave(&ahci_lock);
+    // Acknowledge before sampling, so a command finishing after the read raises a new interrupt
+    uint32_t is = port_read(p, AHCI_PORT_IS);
+    port_write(p, AHCI_PORT_IS, is);
+    // Slots the drive has already cleared finished successfully, even when
+    // another command failed; only those still outstanding are lost to recovery
+    uint32_t busy = port_read(p, AHCI_PORT_SACT) | port_read(p, AHCI_PORT_CI);
+    uint32_t finished = p->issued & ~p->polled & ~busy;
+    for (int slot = 0; finished; slot++, finished >>= 1) {
+        if (!(finished & 1)) continue;
+        done[done_count++] = p->slot_req[slot];
+        p->slot_req[slot] = NULL;
+        p->issued &= ~(1u << slot);
+    }
+    if (done_count) p->progress = get_ticks();
+    if (is & AHCI_PORT_IS_ERRORS) {
+        aborted_count = ahci_recover_locked(p, aborted);
+    }
+    spin_unlock_irqrestore(&ahci_lock, flags);
+
+    for (int i = 0; i < done_count; i++) {
+        blockdev_end_request(done[i], BLOCKDEV_SUCCESS);
+    }
+    for (int i = 0; i < aborted_count; i++) {
+        blockdev_end_request(aborted[i], BLOCKDEV_ERROR);
+    }
+}
+
+static void ahci_irq(registers_t* regs) {
+    (void)regs;
+    uint32_t pending = hba_read(AHCI_REG_IS);
+    for (int d = 0; d < drive_count; d++) {
+        if (pending & (1u << drives[d].port)) {
+            ahci_service(&ports[d]);
+        }
+    }
+    // Port status first, then the HBA's summary bits (AHCI 1.3, 10.7.2.1)
+    hba_write(AHCI_REG_IS, pending);
+}
+
+// No completion for a whole timeout while commands are outstanding: reap what
+// finished (a lost interrupt), then reset the port and fail the rest
+static void ahci_timeout(ktimer_t* timer, void* arg) {
+    (void)timer;
+    ahci_port_t* p = (ahci_port_t*)arg;
+    ahci_service(p);
+
+    blk_request_t* aborted[32];
+    int count = 0;
+    uint32_t flags = spin_lock_irqsave(&ahci_lock);
+    if ((p->issued & ~p->polled) && get_ticks() - p->progress >= timer_ms_to_ticks(AHCI_TIMEOUT_MS)) {
+        count = ahci_recover_locked(p, aborted);
+    }
+    bool outstanding = p->issued != 0;
+    spin_unlock_irqrestore(&ahci_lock, flags);
+
+    for (int i = 0; i < count; i++) {
+        blockdev_end_request(aborted[i], BLOCKDEV_ERROR);
+    }
+    if (outstanding) timer_mod(&p->timeout, AHCI_TIMEOUT_MS);
+}
+
+// Fill slot `slot`'s header and register FIS for a read or write of `count`
+// sectors with `entries` PRDs already in its table. Caller holds ahci_lock.
+static void ahci_prepare_rw(ahci_port_t* p, int slot, uint32_t lba, uint32_t count, bool write,
+                            int entries) {
+    const ahci_drive_t* drive = &drives[p - ports];
+    ahci_cmd_header_t* header = &p->cmd_list[slot];
+    header->flags = (uint16_t)(5 | (write ? AHCI_CMD_FLAG_WRITE : 0)); // 5-dword register FIS
+    header->prdtl = (uint16_t)entries;
+    header->prdbc = 0;
+
+    uint8_t* fis = p->tables[slot].cfis;
+    memset(fis, 0, 20);
+    fis[0] = AHCI_FIS_TYPE_REG_H2D;
+    fis[1] = 0x80; // Command, not device control
+    if (drive->ncq) {
+        fis[2] = write ? AHCI_CMD_WRITE_FPDMA : AHCI_CMD_READ_FPDMA;
+        fis[3] = count & 0xFF;          // Count travels in the features register
+        fis[11] = (count >> 8) & 0xFF;
+        fis[12] = (uint8_t)(slot << 3);  // Tag
+    } else {
+        fis[2] = write ? AHCI_CMD_WRITE_DMA_EXT : AHCI_CMD_READ_DMA_EXT;
+        fis[12] = count & 0xFF;         // 65536 encodes as 0
+        fis[13] = (count >> 8) & 0xFF;
+    }
+    fis[4] = lba & 0xFF;
+    fis[5] = (lba >> 8) & 0xFF;
+    fis[6] = (lba >> 16) & 0xFF;
+    fis[7] = 0x40; // LBA mode
+    fis[8] = (lba >> 24) & 0xFF;
+}
+
+// Hand a prepared slot to the HBA. Caller holds ahci_lock.
+static void ahci_issue_locked(ahci_port_t* p, int slot, bool polled) {
+    uint32_t bit = 1u << slot;
+    if (!(p->issued & ~p->polled)) p->progress = get_ticks();
+    p->issued |= bit;
+    if (polled) p->polled |= bit;
+    if (drives[p - ports].ncq) port_write(p, AHCI_PORT_SACT, bit);
+    port_write(p, AHCI_PORT_CI, bit);
+}
+
+// Lowest free slot, or -1. Caller holds ahci_lock.
+static int ahci_free_slot_locked(const ahci_port_t* p) {
+    uint32_t free = p->slot_mask & ~p->issued;
+    return free ? __builtin_ctz(free) : -1;
+}
+
+// PRD entries for a virtually contiguous buffer, one per physical run
+static int ahci_map_buffer(ahci_prd_t* prdt, const void* buffer, uint32_t bytes) {
+    uint32_t virt = (uint32_t)buffer;
+    int entries = 0;
+    while (bytes > 0) {
+        uint32_t phys;
+        if (vmm_virt_to_phys(virt, &phys) != 0) return -1;
+        uint32_t chunk = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+        if (chunk > bytes) chunk = bytes;
+        if (entries > 0 && prdt[entries - 1].dba + (prdt[entries - 1].dbc + 1) == phys) {
+            prdt[entries - 1].dbc += chunk;
+        } else {
+            if (entries == AHCI_PRDT_ENTRIES) return -1;
+            prdt[entries].dba = phys;
+            prdt[entries].dbau = 0;
+            prdt[entries].reserved = 0;
+            prdt[entries].dbc = chunk - 1;
+            entries++;
+        }
+        virt += chunk;
+        bytes -= chunk;
+    }
+    return entries;
+}
+
+// Wait for a polled slot to finish, reaping queued completions meanwhile
+static int ahci_wait_polled(ahci_port_t* p, int slot) {
+    uint32_t bit = 1u << slot;
+    for (uint32_t poll = 0; poll < AHCI_SPIN_POLLS + AHCI_TIMEOUT_MS; poll++) {
+        ahci_service(p);
+        int result = BLOCKDEV_PENDING;
+        uint32_t flags = spin_lock_irqsave(&ahci_lock);
+        if (p->failed & bit) {
+            result = BLOCKDEV_ERROR;
+        } else if (!((port_read(p, AHCI_PORT_SACT) | port_read(p, AHCI_PORT_CI)) & bit)) {
+            result = (port_read(p, AHCI_PORT_TFD) & AHCI_TFD_ERR) ? BLOCKDEV_ERROR : BLOCKDEV_SUCCESS;
+        }
+        if (result != BLOCKDEV_PENDING) {
+            p->issued &= ~bit;
+            p->polled &= ~bit;
+            p->failed &= ~bit;
+        }
+        spin_unlock_irqrestore(&ahci_lock, flags);
+        if (result != BLOCKDEV_PENDING) return result;
+
+        if (poll >= AHCI_SPIN_POLLS) {
+            timer_sleep_ms(1);
+        } else {
+            asm volatile("pause");
+        }
+    }
+
+    error("[AHCI] Polled command in slot %d timed out", slot);
+    blk_request_t* aborted[32];
+    uint32_t flags = spin_lock_irqsave(&ahci_lock);
+    int count = ahci_recover_locked(p, aborted);
+    p->issued &= ~bit;
+    p->polled &= ~bit;
+    p->failed &= ~bit;
+    spin_unlock_irqrestore(&ahci_lock, flags);
+    for (int i = 0; i < count; i++) {
+        blockdev_end_request(aborted[i], BLOCKDEV_ERROR);
+    }
+    return BLOCKDEV_ERROR;
+}
+
+// Take a free slot for a polled command, reaping completions until one frees up.
+// Returns the slot with its PRDT filled from `data`, or -1.
+static int ahci_claim_polled(ahci_port_t* p, const void* data, uint32_t bytes, int* entries,
+                             uint32_t* irq_flags) {
+    for (uint32_t poll = 0; poll < AHCI_SPIN_POLLS + AHCI_TIMEOUT_MS; poll++) {
+        *irq_flags = spin_lock_irqsave(&ahci_lock);
+        int slot = ahci_free_slot_locked(p);
+        if (slot >= 0) {
+            *entries = ahci_map_buffer(p->tables[slot].prdt, data, bytes);
+            if (*entries > 0) return slot; // Lock stays held for the issue
+            spin_unlock_irqrestore(&ahci_lock, *irq_flags);
+            return -1;
+        }
+        spin_unlock_irqrestore(&ahci_lock, *irq_flags);
+        ahci_service(p);
+        if (poll >= AHCI_SPIN_POLLS) {
+            timer_sleep_ms(1);
+        } else {
+            asm volatile("pause");
+        }
+    }
+    return -1;
+}
+
+static int ahci_sync_transfer(uint8_t drive_id, uint32_t lba, uint32_t count, uint8_t* buffer, bool write) {
+    if (drive_id >= drive_count) {
+        error("[AHCI] Invalid drive: %d", drive_id);
+        return BLOCKDEV_NOT_FOUND;
+    }
+    ahci_port_t* p = &ports[drive_id];
+    while (count > 0) {
+        uint32_t chunk = count < AHCI_SYNC_SECTORS ? count : AHCI_SYNC_SECTORS;
+        uint32_t bytes = chunk * 512;
+        // PRDs must be word aligned; odd buffers go through the bounce buffer
+        // (the block layer's mutex keeps polled transfers from sharing it)
+        bool bounce = ((uint32_t)buffer & 1) != 0;
+        uint8_t* data = bounce ? p->bounce : buffer;
+        if (bounce && write) memcpy(p->bounce, buffer, bytes);
+
+        int entries;
+        uint32_t flags;
+        int slot = ahci_claim_polled(p, data, bytes, &entries, &flags);
+        if (slot < 0) {
+            error("[AHCI] No command slot for a polled transfer");
+            return BLOCKDEV_ERROR;
+        }
+        ahci_prepare_rw(p, slot, lba, chunk, write, entries);
+        ahci_issue_locked(p, slot, true);
+        spin_unlock_irqrestore(&ahci_lock, flags);
+
+        int result = ahci_wait_polled(p, slot);
+        if (result != BLOCKDEV_SUCCESS) {
+            error("[AHCI] %s of sectors %u+%u failed", write ? "Write" : "Read", lba, chunk);
+            return result;
+        }
+        if (bounce && !write) memcpy(buffer, p->bounce, bytes);
+        lba += chunk;
+        count -= chunk;
+        buffer += bytes;
+    }
+    return BLOCKDEV_SUCCESS;
+}
+
+int ahci_read_sectors(uint8_t drive_id, uint32_t lba, uint32_t count, void* buffer) {
+    return ahci_sync_transfer(drive_id, lba, count, (uint8_t*)buffer, false);
+}
+
+int ahci_write_sectors(uint8_t drive_id, uint32_t lba, uint32_t count, const void* buffer) {
+    return ahci_sync_transfer(drive_id, lba, count, (uint8_t*)buffer, true);
+}
+
+bool ahci_can_queue(uint8_t drive_id) {
+    return drive_id < drive_count && ahci_irq_ready;
+}
+
+bool ahci_queue_busy(uint8_t drive_id) {
+    const ahci_port_t* p = &ports[drive_id];
+    return (p->slot_mask & ~p->issued) == 0;
+}
+
+int ahci_start_request(uint8_t drive_id, blk_request_t* req) {
+    if (!ahci_can_queue(drive_id)) {
+        return -1;
+    }
+    uint32_t count = 0;
+    for (const blk_request_t* r = req; r; r = r->merge_next) {
+        count += r->count;
+    }
+    if (count == 0 || count > AHCI_MAX_SECTORS) {
+        return -1;
+    }
+    ahci_port_t* p = &ports[drive_id];
+
+    uint32_t flags = spin_lock_irqsave(&ahci_lock);
+    int slot = ahci_free_slot_locked(p);
+    if (slot < 0) {
+        spin_unlock_irqrestore(&ahci_lock, flags);
+        return AHCI_BUSY;
+    }
+    // Requests merged behind the first one continue the same transfer
+    ahci_prd_t* prdt = p->tables[slot].prdt;
+    int entries = 0;
+    for (const blk_request_t* r = req; r; r = r->merge_next) {
+        for (int s = 0; s < r->segment_count; s++) {
+            if (entries == AHCI_PRDT_ENTRIES || ((r->segments[s].phys | r->segments[s].len) & 1)) {
+                spin_unlock_irqrestore(&ahci_lock, flags);
+                return -1;
+            }
+            prdt[entries].dba = r->segments[s].phys;
+            prdt[entries].dbau = 0;
+            prdt[entries].reserved = 0;
+            prdt[entries].dbc = r->segments[s].len - 1;
+            entries++;
+        }
+    }
+    ahci_prepare_rw(p, slot, req->sector, count, req->write != 0, entries);
+    p->slot_req[slot] = req;
+    ahci_issue_locked(p, slot, false);
+    spin_unlock_irqrestore(&ahci_lock, flags);
+
+    if (!timer_pending(&p->timeout)) timer_mod(&p->timeout, AHCI_TIMEOUT_MS);
+    return 0;
+}
+
+// IDENTIFY DEVICE through slot 0, polled; runs before NCQ is in use
+static int ahci_identify(ahci_port_t* p, uint16_t* identify) {
+    int entries;
+    uint32_t flags;
+    int slot = ahci_claim_polled(p, identify, 512, &entries, &flags);
+    if (slot < 0) return -1;
+    ahci_cmd_header_t* header = &p->cmd_list[slot];
+    header->flags = 5;
+    header->prdtl = (uint16_t)entries;
+    header->prdbc = 0;
+    uint8_t* fis = p->tables[slot].cfis;
+    memset(fis, 0, 20);
+    fis[0] = AHCI_FIS_TYPE_REG_H2D;
+    fis[1] = 0x80;
+    fis[2] = AHCI_CMD_IDENTIFY;
+    p->issued |= 1u << slot;
+    p->polled |= 1u << slot;
+    port_write(p, AHCI_PORT_CI, 1u << slot);
+    spin_unlock_irqrestore(&ahci_lock, flags);
+    return ahci_wait_polled(p, slot);
+}
+
+static void ahci_probe_port(uint8_t port, uint32_t cap) {
+    ahci_port_t* p = &ports[drive_count];
+    ahci_drive_t* drive = &drives[drive_count];
+    memset(p, 0, sizeof(*p));
+    p->base = AHCI_PORT_BASE(port);
+
+    uint32_t ssts = port_read(p, AHCI_PORT_SSTS);
+    if ((ssts & AHCI_SSTS_DET_MASK) != AHCI_SSTS_DET_PRESENT ||
+        ((ssts >> 8) & 0xF) != AHCI_SSTS_IPM_ACTIVE) {
+        return;
+    }
+    if (port_read(p, AHCI_PORT_SIG) != AHCI_SIG_ATA) {
+        debug("[AHCI] Port %d: signature 0x%x is not a disk", port, port_read(p, AHCI_PORT_SIG));
+        return;
+    }
+
+    ahci_port_stop(p);
+    uint32_t list_phys, fis_phys, bounce_phys;
+    void* raw[4];
+    p->cmd_list = (ahci_cmd_header_t*)ahci_alloc(32 * sizeof(ahci_cmd_header_t), 1024, &list_phys, &raw[0]);
+    p->fis = (uint8_t*)ahci_alloc(256, 256, &fis_phys, &raw[1]);
+    p->tables = (ahci_cmd_table_t*)ahci_alloc(32 * sizeof(ahci_cmd_table_t), 128, &p->tables_phys, &raw[2]);
+    p->bounce = (uint8_t*)ahci_alloc(AHCI_SYNC_SECTORS * 512, PAGE_SIZE, &bounce_phys, &raw[3]);
+    if (!p->cmd_list || !p->fis || !p->tables || !p->bounce) {
+        error("[AHCI] Port %d: out of memory", port);
+        for (int i = 0; i < 4; i++) kfree(raw[i]);
+        return;
+    }
+    for (int slot = 0; slot < 32; slot++) {
+        p->cmd_list[slot].ctba = p->tables_phys + slot * sizeof(ahci_cmd_table_t);
+    }
+    port_write(p, AHCI_PORT_CLB, list_phys);
+    port_write(p, AHCI_PORT_CLBU, 0);
+    port_write(p, AHCI_PORT_FB, fis_phys);
+    port_write(p, AHCI_PORT_FBU, 0);
+    port_write(p, AHCI_PORT_SERR, 0xFFFFFFFF);
+    port_write(p, AHCI_PORT_IS, 0xFFFFFFFF);
+    ahci_port_start(p);
+    p->slot_mask = 1; // IDENTIFY uses slot 0 alone
+
+    uint16_t* identify = (uint16_t*)kmalloc(512);
+    if (!identify || ahci_identify(p, identify) != BLOCKDEV_SUCCESS) {
+        error("[AHCI] Port %d: IDENTIFY failed", port);
+        kfree(identify);
+        // The engine no longer touches the command list or FIS area once stopped
+        ahci_port_stop(p);
+        for (int i = 0; i < 4; i++) kfree(raw[i]);
+        return;
+    }
+
+    memset(drive, 0, sizeof(*drive));
+    drive->port = port;
+    // Word 76 bit 8: NCQ; word 75: queue depth minus one
+    uint32_t slots = ((cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1;
+    drive->ncq = (cap & AHCI_CAP_SNCQ) && (identify[76] & 0x0100);
+    drive->depth = 1;
+    if (drive->ncq) {
+        uint32_t depth = (identify[75] & 0x1F) + 1;
+        drive->depth = (uint8_t)(depth < slots ? depth : slots);
+    }
+    p->slot_mask = drive->depth == 32 ? 0xFFFFFFFFu : (1u << drive->depth) - 1;
+    // Words 100-103: 48-bit capacity; words 60-61 otherwise
+    if (identify[83] & 0x0400) {
+        bool huge = identify[102] || identify[103];
+        drive->sectors = huge ? 0xFFFFFFFFu : ((uint32_t)identify[101] << 16) | identify[100];
+    } else {
+        drive->sectors = ((uint32_t)identify[61] << 16) | identify[60];
+    }
+    // Model string: words 27-46, two characters per word, high byte first
+    for (int i = 0; i < 20; i++) {
+        drive->model[i * 2] = (char)(identify[27 + i] >> 8);
+        drive->model[i * 2 + 1] = (char)(identify[27 + i] & 0xFF);
+    }
+    drive->model[40] = '\0';
+    for (int i = 39; i >= 0 && drive->model[i] == ' '; i--) drive->model[i] = '\0';
+    kfree(identify);
+
+    timer_init(&p->timeout, ahci_timeout, p);
+    port_write(p, AHCI_PORT_IE, AHCI_PORT_IE_DEFAULT);
+    drive->exists = 1;
+    success("[AHCI] Port %d: %s, %u sectors (%u MB), %s depth %u", port, drive->model, drive->sectors,
+            drive->sectors / 2048, drive->ncq ? "NCQ" : "no NCQ,", drive->depth);
+    drive_count++;
+}
+
+int ahci_init(void) {
+    drive_count = 0;
+    pci_device_t* dev = pci_find_device_by_class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_STORAGE_SATA);
+    if (!dev || dev->prog_if != PCI_PROG_IF_SATA_AHCI) {
+        debug("[AHCI] No AHCI controller");
+        return 0;
+    }
+    uint32_t abar_phys = dev->bar[5] & ~0xFu;
+    if (!abar_phys || (dev->bar[5] & 1)) {
+        error("[AHCI] BAR5 is not a memory BAR");
+        return 0;
+    }
+    vmm_map_range(abar_phys, abar_phys, AHCI_ABAR_SIZE, 1);
+    abar = (volatile uint32_t*)abar_phys;
+    uint16_t command = pci_read_config_word(dev->bus, dev->device, dev->function, PCI_COMMAND);
+    pci_write_config_word(dev->bus, dev->device, dev->function, PCI_COMMAND,
+                          command | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+    hba_write(AHCI_REG_GHC, hba_read(AHCI_REG_GHC) | AHCI_GHC_AE);
+    uint32_t cap = hba_read(AHCI_REG_CAP);
+    uint32_t implemented = hba_read(AHCI_REG_PI);
+    uint32_t version = hba_read(AHCI_REG_VS);
+    debug("[AHCI] Version %x.%x, %u slots, ports 0x%x%s", version >> 16, version & 0xFFFF,
+          ((cap >> AHCI_CAP_NCS_SHIFT) & AHCI_CAP_NCS_MASK) + 1, implemented,
+          (cap & AHCI_CAP_SNCQ) ? ", NCQ" : "");
+
+    for (uint8_t port = 0; port < AHCI_MAX_PORTS && drive_count < AHCI_MAX_DRIVES; port++) {
+        if (implemented & (1u << port)) {
+            ahci_probe_port(port, cap);
+        }
+    }
+    if (drive_count == 0) {
+        return 0;
+    }
+    ahci_dev = dev;
+    success("[AHCI] Found %d drives", drive_count);
+    return drive_count;
+}
+
+void ahci_enable_interrupts(void) {
+    if (!ahci_dev || ahci_irq_ready) {
+        return;
+    }
+    // One vector serves every port; MSI when the controller and CPU support it
+    int vector = pci_enable_msi(ahci_dev);
+    bool msi = vector >= 0;
+    if (!msi) {
+        if (ahci_dev->interrupt_line >= 16) {
+            error("[AHCI] No usable interrupt; queued requests disabled");
+            return;
+        }
+        vector = 32 + ahci_dev->interrupt_line;
+        register_interrupt_handler((uint8_t)vector, ahci_irq);
+        pic_unmask_irq(ahci_dev->interrupt_line);
+    } else {
+        register_interrupt_handler((uint8_t)vector, ahci_irq);
+    }
+    hba_write(AHCI_REG_IS, 0xFFFFFFFF);
+    hba_write(AHCI_REG_GHC, hba_read(AHCI_REG_GHC) | AHCI_GHC_IE);
+    ahci_irq_ready = true;
+    success("[AHCI] Interrupts on vector %d (%s)", vector, msi ? "MSI" : "INTx");
+}
+
+ahci_drive_t* ahci_get_drive(uint8_t drive_id) {
+    if (drive_id >= drive_count || !drives[drive_id].exists) {
+        return NULL;
+    }
+    return &drives[drive_id];
+}
@@ -0,0 +1,69 @@
+# Application processor start-up code.
+# The BSP copies [ap_trampoline_start, ap_trampoline_end) to SMP_TRAMPOLINE_ADDR (0x8000)
+# and points the STARTUP IPI at that page. Everything here is position dependent on that
+# copy, so addresses are computed relative to ap_trampoline_start.
+
+.set AP_BASE, 0x8000
+
+.section .text
+.code16
+.global ap_trampoline_start
+ap_trampoline_start:
+    cli
+    cld
+    xorw %ax, %ax
+    movw %ax, %ds
+    lgdtl (ap_gdt_desc - ap_trampoline_start + AP_BASE)
+
+    movl %cr0, %eax
+    orl $1, %eax             # Protected mode
+    movl %eax, %cr0
+    ljmpl $0x08, $((ap_protected_entry - ap_trampoline_start + AP_BASE))
+
+.code32
+ap_protected_entry:
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    movw %ax, %ss
+
+    # Share the kernel page directory, then enable paging
+    movl (ap_cr3 - ap_trampoline_start + AP_BASE), %eax
+    movl %eax, %cr3
+    movl %cr0, %eax
+    orl $0x80000000, %eax
+    movl %eax, %cr0
+
+    movl (ap_stack - ap_trampoline_start + AP_BASE), %esp
+    xorl %ebp, %ebp
+    movl (ap_entry - ap_trampoline_start + AP_BASE), %eax
+    call *%eax
+1:
+    cli
+    hlt
+    jmp 1b
+
+.align 8
+ap_gdt:
+    .quad 0x0000000000000000  # Null
+    .quad 0x00CF9A000000FFFF  # Flat ring-0 code
+    .quad 0x00CF92000000FFFF  # Flat ring-0 data
+ap_gdt_desc:
+    .word ap_gdt_desc - ap_gdt - 1
+    .long (ap_gdt - ap_trampoline_start + AP_BASE)
+
+# Hand-off values written by the BSP into the copied page before each STARTUP IPI
+.global ap_cr3
+ap_cr3:
+    .long 0
+.global ap_stack
+ap_stack:
+    .long 0
+.global ap_entry
+ap_entry:
+    .long 0
+
+.global ap_trampoline_end
+ap_trampoline_end:
@@ -0,0 +1,418 @@
+#include "kernel/bcache.h"
+#include "kernel/blockdev.h"
+#include "kernel/heap.h"
+#include "kernel/mutex.h"
+#include "kernel/debug.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct bcache_buf {
+    struct bcache_buf* hash_next;
+    // LRU list: head is the most recently used, tail the next victim
+    struct bcache_buf* lru_prev;
+    struct bcache_buf* lru_next;
+    uint32_t sector;
+    uint8_t device;
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t* data;
+} bcache_buf_t;
+
+// Longest run of dirty sectors written back with one device request
+#define BCACHE_RUN_SECTORS BLOCKDEV_MAX_REQUEST_SECTORS
+
+static bcache_buf_t* bufs = NULL;
+static uint8_t* buf_data = NULL;
+static uint32_t buf_count = 0;
+static bcache_buf_t** hash_table = NULL;
+static uint32_t hash_bits = 0;
+static bcache_buf_t* lru_head = NULL;
+static bcache_buf_t* lru_tail = NULL;
+// Staging area that gathers a dirty run into one contiguous write
+static uint8_t* run_buffer = NULL;
+static bcache_stats_t stats;
+// Held across device I/O, so only process context or boot code may use the cache
+static mutex_t bcache_mutex = MUTEX_INIT("bcache");
+
+static inline uint32_t hash_of(uint8_t device, uint32_t sector) {
+    return ((sector ^ ((uint32_t)device << 27)) * 2654435761u) >> (32 - hash_bits);
+}
+
+static bcache_buf_t* lookup(uint8_t device, uint32_t sector) {
+    for (bcache_buf_t* b = hash_table[hash_of(device, sector)]; b; b = b->hash_next) {
+        if (b->sector == sector && b->device == device) return b;
+    }
+    return NULL;
+}
+
+static void hash_insert(bcache_buf_t* b) {
+    bcache_buf_t** slot = &hash_table[hash_of(b->device, b->sector)];
+    b->hash_next = *slot;
+    *slot = b;
+}
+
+static void hash_remove(bcache_buf_t* b) {
+    bcache_buf_t** link = &hash_table[hash_of(b->device, b->sector)];
+    while (*link && *link != b) link = &(*link)->hash_next;
+    if (*link) *link = b->hash_next;
+    b->hash_next = NULL;
+}
+
+static void lru_unlink(bcache_buf_t* b) {
+    if (b->lru_prev) b->lru_prev->lru_next = b->lru_next; else lru_head = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev; else lru_tail = b->lru_prev;
+    b->lru_prev = b->lru_next = NULL;
+}
+
+static void lru_push_head(bcache_buf_t* b) {
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = b; else lru_tail = b;
+    lru_head = b;
+}
+
+static void lru_touch(bcache_buf_t* b) {
+    if (b == lru_head) return;
+    lru_unlink(b);
+    lru_push_head(b);
+}
+
+// Caller holds bcache_mutex
+static void mark_clean(uint8_t device, uint32_t sector, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        lookup(device, sector + i)->dirty = 0;
+    }
+    stats.dirty -= count;
+    stats.writebacks += count;
+    stats.write_runs++;
+}
+
+// Write the dirty run [first, first + count) through the shared staging buffer
+static int writeback_run(uint8_t device, uint32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(run_buffer + i * BCACHE_BLOCK_SIZE, lookup(device, first + i)->data, BCACHE_BLOCK_SIZE);
+    }
+
+    int result = blockdev_write_direct(device, first, count, run_buffer);
+    if (result != BLOCKDEV_SUCCESS) {
+        error("[BCACHE] Write-back of sectors %u+%u on device %d failed: %d", first, count, device, result);
+        return result;
+    }
+    mark_clean(device, first, count);
+    return BLOCKDEV_SUCCESS;
+}
+
+// Write `b` together with the dirty sectors around it as one contiguous run
+static int writeback_around(bcache_buf_t* b) {
+    uint8_t device = b->device;
+    uint32_t first = b->sector;
+    bcache_buf_t* prev;
+    while (first > 0 && b->sector - first < BCACHE_RUN_SECTORS - 1 &&
+           (prev = lookup(device, first - 1)) && prev->dirty) {
+        first--;
+    }
+
+    uint32_t count = 0;
+    bcache_buf_t* next;
+    while (count < BCACHE_RUN_SECTORS && (next = lookup(device, first + count)) && next->dirty) {
+        count++;
+    }
+    return writeback_run(device, first, count);
+}
+
+// Take the least recently used buffer for (device, sector), writing it back
+// first if needed. Returns NULL only when that write-back fails.
+static bcache_buf_t* grab(uint8_t device, uint32_t sector) {
+    bcache_buf_t* b = lru_tail;
+    if (b->valid) {
+        if (b->dirty && writeback_around(b) != BLOCKDEV_SUCCESS) {
+            return NULL;
+        }
+        hash_remove(b);
+        stats.evictions++;
+        stats.used--;
+    }
+    b->device = device;
+    b->sector = sector;
+    b->valid = 1;
+    b->dirty = 0;
+    hash_insert(b);
+    lru_touch(b);
+    stats.used++;
+    return b;
+}
+
+static void free_cache() {
+    kfree(bufs);
+    kfree(buf_data);
+    kfree(hash_table);
+    kfree(run_buffer);
+    bufs = NULL;
+    buf_data = NULL;
+    hash_table = NULL;
+    run_buffer = NULL;
+    buf_count = 0;
+    lru_head = lru_tail = NULL;
+}
+
+// Caller holds bcache_mutex and has written back every dirty buffer
+static int setup_cache(uint32_t buffers) {
+    if (buffers < BCACHE_MIN_BUFFERS) buffers = BCACHE_MIN_BUFFERS;
+    if (buffers > BCACHE_MAX_BUFFERS) buffers = BCACHE_MAX_BUFFERS;
+    free_cache();
+
+    uint32_t bits = 1;
+    while ((1u << bits) < buffers) bits++;
+    bufs = (bcache_buf_t*)kmalloc(buffers * sizeof(bcache_buf_t));
+    buf_data = (uint8_t*)kmalloc(buffers * BCACHE_BLOCK_SIZE);
+    hash_table = (bcache_buf_t**)kmalloc((1u << bits) * sizeof(bcache_buf_t*));
+    run_buffer = (uint8_t*)kmalloc(BCACHE_RUN_SECTORS * BCACHE_BLOCK_SIZE);
+    if (!bufs || !buf_data || !hash_table || !run_buffer) {
+        error("[BCACHE] Out of memory for %u buffers; caching disabled", buffers);
+        free_cache();
+        return -1;
+    }
+
+    memset(bufs, 0, buffers * sizeof(bcache_buf_t));
+    memset(hash_table, 0, (1u << bits) * sizeof(bcache_buf_t*));
+    hash_bits = bits;
+    buf_count = buffers;
+    for (uint32_t i = 0; i < buffers; i++) {
+        bufs[i].data = buf_data + i * BCACHE_BLOCK_SIZE;
+        lru_push_head(&bufs[i]);
+    }
+    stats.buffers = buffers;
+    stats.used = 0;
+    stats.dirty = 0;
+    return 0;
+}
+
+int bcache_init(uint32_t buffers) {
+    MutexGuard guard(&bcache_mutex);
+    memset(&stats, 0, sizeof(stats));
+    if (setup_cache(buffers) != 0) {
+        return -1;
+    }
+    success("[BCACHE] %u buffers (%u KiB)", buf_count, buf_count * BCACHE_BLOCK_SIZE / 1024);
+    return 0;
+}
+
+// Sector sizes other than the buffer size are passed straight through
+static bool cacheable(uint8_t device) {
+    blockdev_info_t* info = blockdev_get_info(device);
+    return buf_count > 0 && info && info->sector_size == BCACHE_BLOCK_SIZE;
+}
+
+int bcache_read(uint8_t device, uint32_t sector, uint32_t count, void* buffer) {
+    MutexGuard guard(&bcache_mutex);
+    if (!cacheable(device)) {
+        return blockdev_read_direct(device, sector, count, buffer);
+    }
+
+    uint8_t* out = (uint8_t*)buffer;
+    bool fill = count <= buf_count / BCACHE_BYPASS_DIVISOR;
+    uint32_t i = 0;
+    while (i < count) {
+        bcache_buf_t* b = lookup(device, sector + i);
+        if (b) {
+            memcpy(out + i * BCACHE_BLOCK_SIZE, b->data, BCACHE_BLOCK_SIZE);
+            lru_touch(b);
+            stats.hits++;
+            i++;
+            continue;
+        }
+
+        // Read the whole run of missing sectors straight into the caller's buffer
+        uint32_t run = 1;
+        while (i + run < count && !lookup(device, sector + i + run)) run++;
+        int result = blockdev_read_direct(device, sector + i, run, out + i * BCACHE_BLOCK_SIZE);
+        if (result != BLOCKDEV_SUCCESS) {
+            return result;
+        }
+        stats.misses += run;
+        if (!fill) {
+            stats.bypassed += run;
+        } else {
+            for (uint32_t j = 0; j < run; j++) {
+                b = grab(device, sector + i + j);
+                if (!b) break;
+                memcpy(b->data, out + (i + j) * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+            }
+        }
+        i += run;
+    }
+    return BLOCKDEV_SUCCESS;
+}
+
+int bcache_write(uint8_t device, uint32_t sector, uint32_t count, const void* buffer) {
+    MutexGuard guard(&bcache_mutex);
+    if (!cacheable(device)) {
+        return blockdev_write_direct(device, sector, count, buffer);
+    }
+    blockdev_info_t* info = blockdev_get_info(device);
+    if (count == 0 || sector >= info->sector_count || count > info->sector_count - sector) {
+        error("[BCACHE] Write of sectors %u+%u out of range (max: %u)", sector, count, info->sector_count);
+        return BLOCKDEV_ERROR;
+    }
+
+    const uint8_t* in = (const uint8_t*)buffer;
+    if (count > buf_count / BCACHE_BYPASS_DIVISOR) {
+        int result = blockdev_write_direct(device, sector, count, buffer);
+        if (result != BLOCKDEV_SUCCESS) {
+            return result;
+        }
+        // The disk now holds the newest data; refresh any copies we keep
+        for (uint32_t i = 0; i < count; i++) {
+            bcache_buf_t* b = lookup(device, sector + i);
+            if (!b) continue;
+            memcpy(b->data, in + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+            if (b->dirty) {
+                b->dirty = 0;
+                stats.dirty--;
+            }
+        }
+        stats.bypassed += count;
+        return BLOCKDEV_SUCCESS;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        // Whole sectors are overwritten, so a missing buffer needs no read first
+        bcache_buf_t* b = lookup(device, sector + i);
+        if (b) {
+            lru_touch(b);
+        } else if (!(b = grab(device, sector + i))) {
+            int result = blockdev_write_direct(device, sector + i, 1, in + i * BCACHE_BLOCK_SIZE);
+            if (result != BLOCKDEV_SUCCESS) {
+                return result;
+            }
+            continue;
+        }
+        memcpy(b->data, in + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+        if (!b->dirty) {
+            b->dirty = 1;
+            stats.dirty++;
+        }
+    }
+    return BLOCKDEV_SUCCESS;
+}
+
+// Write a batch of staged runs, mark the ones that made it clean and free
+// their staging buffers. Caller holds bcache_mutex.
+static int write_batch(blk_request_t* reqs, int count) {
+    int result = blockdev_submit_wait_batch(reqs, count);
+    if (result == BLOCKDEV_NOT_QUEUED) {
+        // Boot code and devices without queued I/O write the runs one by one
+        for (int i = 0; i < count; i++) {
+            reqs[i].status = blockdev_write_direct(reqs[i].device, reqs[i].sector, reqs[i].count,
+                                                   reqs[i].buffer);
+        }
+    }
+    int first_error = BLOCKDEV_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        // Still pending: the batch was refused before anything was queued
+        int status = reqs[i].status == BLOCKDEV_PENDING ? result : reqs[i].status;
+        if (status == BLOCKDEV_SUCCESS) {
+            mark_clean(reqs[i].device, reqs[i].sector, reqs[i].count);
+        } else {
+            error("[BCACHE] Write-back of sectors %u+%u on device %d failed: %d", reqs[i].sector,
+                  reqs[i].count, reqs[i].device, status);
+            if (first_error == BLOCKDEV_SUCCESS) first_error = status;
+        }
+        kfree(reqs[i].buffer);
+    }
+    return first_error;
+}
+
+// Stage every dirty run as a request and submit them in batches, so the block
+// layer's elevator writes them back in one sweep. Caller holds bcache_mutex.
+static int sync_locked(int device) {
+    blk_request_t* reqs = (blk_request_t*)kmalloc(BLOCKDEV_MAX_BATCH * sizeof(blk_request_t));
+    int result = BLOCKDEV_SUCCESS;
+    int batched = 0;
+    for (uint32_t i = 0; i < buf_count; i++) {
+        bcache_buf_t* b = &bufs[i];
+        if (!b->dirty || (device >= 0 && b->device != device)) continue;
+        int r = BLOCKDEV_SUCCESS;
+        if (!reqs) {
+            r = writeback_around(b);
+            if (r != BLOCKDEV_SUCCESS) result = r;
+            continue;
+        }
+        // Stage each run once, from its first sector, in request-sized pieces
+        bcache_buf_t* prev = b->sector > 0 ? lookup(b->device, b->sector - 1) : NULL;
+        if (prev && prev->dirty) continue;
+        uint32_t sector = b->sector;
+        for (;;) {
+            uint32_t count = 0;
+            bcache_buf_t* next;
+            while (count < BCACHE_RUN_SECTORS && (next = lookup(b->device, sector + count)) && next->dirty) {
+                count++;
+            }
+            if (count == 0) break;
+            uint8_t* data = (uint8_t*)kmalloc(count * BCACHE_BLOCK_SIZE);
+            if (!data) {
+                // Low on memory: write just this piece from the shared staging
+                // buffer. Sectors before it may already sit in `reqs`, so it must
+                // not widen the run backwards over them.
+                r = writeback_run(b->device, sector, count);
+                if (r != BLOCKDEV_SUCCESS) break;
+                sector += count;
+                continue;
+            }
+            for (uint32_t j = 0; j < count; j++) {
+                memcpy(data + j * BCACHE_BLOCK_SIZE, lookup(b->device, sector + j)->data, BCACHE_BLOCK_SIZE);
+            }
+            blk_request_init(&reqs[batched++], b->device, sector, count, data, 1, NULL, NULL);
+            sector += count;
+            if (batched == BLOCKDEV_MAX_BATCH) {
+                r = write_batch(reqs, batched);
+                batched = 0;
+                if (r != BLOCKDEV_SUCCESS) break;
+            }
+        }
+        if (r != BLOCKDEV_SUCCESS) result = r;
+    }
+    if (batched > 0) {
+        int r = write_batch(reqs, batched);
+        if (r != BLOCKDEV_SUCCESS) result = r;
+    }
+    kfree(reqs);
+    return result;
+}
+
+int bcache_sync(int device) {
+    MutexGuard guard(&bcache_mutex);
+    return sync_locked(device);
+}
+
+int bcache_resize(uint32_t buffers) {
+    MutexGuard guard(&bcache_mutex);
+    // Dirty data must not be dropped with the old buffers
+    if (sync_locked(-1) != BLOCKDEV_SUCCESS) {
+        return -1;
+    }
+    return setup_cache(buffers);
+}
+
+void bcache_get_stats(bcache_stats_t* out) {
+    MutexGuard guard(&bcache_mutex);
+    *out = stats;
+}
+
+void bcache_reset_stats() {
+    MutexGuard guard(&bcache_mutex);
+    stats.hits = stats.misses = stats.bypassed = 0;
+    stats.evictions = stats.writebacks = stats.write_runs = 0;
+}
+
+void bcache_dump_stats() {
+    bcache_stats_t s;
+    bcache_get_stats(&s);
+    uint32_t lookups = s.hits + s.misses;
+    printf("Buffer cache: %u/%u buffers used (%u KiB), %u dirty\n", s.used, s.buffers,
+           s.buffers * BCACHE_BLOCK_SIZE / 1024, s.dirty);
+    printf("  hits %u, misses %u (%u%% hit rate), %u bypassed\n", s.hits, s.misses,
+           lookups ? (uint32_t)((uint64_t)s.hits * 100 / lookups) : 0, s.bypassed);
+    printf("  evictions %u, written back %u sectors in %u requests\n", s.evictions, s.writebacks,
+           s.write_runs);
+}
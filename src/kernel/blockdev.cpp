@@ -1,17 +1,57 @@
 #include "kernel/blockdev.h"
 #include "kernel/ide.h"
+#include "kernel/ahci.h"
+#include "kernel/ramdisk.h"
+#include "kernel/bcache.h"
+#include "kernel/elevator.h"
 #include "kernel/debug.h"
+#include "kernel/mutex.h"
+#include "kernel/spinlock.h"
+#include "kernel/paging.h"
+#include "kernel/scheduler.h"
+#include "kernel/process.h"
+#include "kernel/softirq.h"
+#include "kernel/isr.h"
+#include "kernel/timer.h"
+#include "kernel/heap.h"
+#include <sys/syscall.h>
 #include <stdio.h>
 #include <string.h>
 
 static blockdev_info_t devices[MAX_BLOCK_DEVICES];
 static uint8_t device_count = 0;
+// Serializes synchronous (polled) transfers among themselves; the IDE driver
+// keeps them off a channel that has a queued request in flight
+static mutex_t blockdev_mutex = MUTEX_INIT("blockdev");
+
+typedef struct {
+    uint32_t requests;    // Submitted
+    uint32_t merged;      // Issued as part of an earlier request's command
+    uint32_t commands;    // Commands handed to the driver
+    uint64_t sectors;     // Sectors those commands moved
+    uint32_t expired;     // Dispatched out of sweep order on their deadline
+    uint32_t max_depth;
+} blk_queue_stats_t;
+
+static blk_queue_t queues[MAX_BLOCK_DEVICES];
+static blk_queue_stats_t queue_stats[MAX_BLOCK_DEVICES];
+// Requests finished by a driver, waiting for SOFTIRQ_BLOCK to run end_io
+static blk_request_t* done_head = NULL;
+static blk_request_t* done_tail = NULL;
+// Protects the queues and the done list; taken before the driver's own locks
+static spinlock_t blk_lock = SPINLOCK_INIT("blockdev");
+
+static void blockdev_softirq();
 
 int blockdev_init(void) {
     debug("[BLOCKDEV] Initializing block device subsystem");
     
     device_count = 0;
     memset(devices, 0, sizeof(devices));
+    memset(queues, 0, sizeof(queues));
+    memset(queue_stats, 0, sizeof(queue_stats));
+    softirq_register(SOFTIRQ_BLOCK, blockdev_softirq);
+    bcache_init(BCACHE_DEFAULT_BUFFERS);
     
     // Initialize IDE subsystem
     int ide_drives = ide_init();
@@ -29,10 +69,37 @@ int blockdev_init(void) {
             strcpy(info.name, "hd");
             info.name[2] = '0' + i;
             info.name[3] = '\0';
+            // One PRD table per command; PRD entries stop at 64 KiB boundaries
+            info.max_sectors = drive->lba48 ? IDE_MAX_SECTORS_LBA48 : IDE_MAX_SECTORS_LBA28;
+            info.max_segments = IDE_PRD_ENTRIES;
+            info.seg_boundary = 0x10000;
             
             blockdev_register(BLOCKDEV_TYPE_IDE, i, &info);
         }
     }
+
+    // Register SATA drives behind an AHCI controller
+    int ahci_drives = ahci_init();
+    for (int i = 0; i < ahci_drives && device_count < MAX_BLOCK_DEVICES; i++) {
+        ahci_drive_t* drive = ahci_get_drive(i);
+        if (drive && drive->exists) {
+            blockdev_info_t info;
+            info.type = BLOCKDEV_TYPE_AHCI;
+            info.device_id = i;
+            info.sector_count = drive->sectors;
+            info.sector_size = 512;
+            info.present = 1;
+            strcpy(info.name, "sd");
+            info.name[2] = '0' + i;
+            info.name[3] = '\0';
+            // PRD entries take up to 4 MiB each and cross any boundary
+            info.max_sectors = AHCI_MAX_SECTORS;
+            info.max_segments = AHCI_PRDT_ENTRIES;
+            info.seg_boundary = 0;
+
+            blockdev_register(BLOCKDEV_TYPE_AHCI, i, &info);
+        }
+    }
     
     success("[BLOCKDEV] Registered %d block devices", device_count);
     return device_count;
@@ -45,32 +112,385 @@ int blockdev_register(uint8_t type, uint8_t device_id, blockdev_info_t* info) {
     }
     
     devices[device_count] = *info;
+    if (devices[device_count].max_sectors == 0) {
+        devices[device_count].max_sectors = BLOCKDEV_MAX_REQUEST_SECTORS;
+        devices[device_count].max_segments = BLOCKDEV_MAX_SEGMENTS;
+    }
     debug("[BLOCKDEV] Registered device %d: %s (%u sectors, %u bytes/sector)",
            device_count, info->name, info->sector_count, info->sector_size);
     
-    device_count++;
+    return device_count++;
+}
+
+void blockdev_unregister(uint8_t device) {
+    MutexGuard guard(&blockdev_mutex);
+    if (device < device_count) {
+        devices[device].present = 0;
+    }
+}
+
+// Sleeping needs a process to park and interrupts enabled so the IRQ can complete
+static Process* blockdev_sleeper() {
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0" : "=r"(flags));
+    if (!(flags & 0x200) || irq_in_progress() || softirq_in_progress()) return NULL;
+    return scheduler_current_process();
+}
+
+static bool blockdev_can_queue(const blockdev_info_t* dev) {
+    switch (dev->type) {
+        case BLOCKDEV_TYPE_IDE:
+            return ide_can_queue(dev->device_id);
+        case BLOCKDEV_TYPE_AHCI:
+            return ahci_can_queue(dev->device_id);
+        default:
+            return false;
+    }
+}
+
+// Resolve the buffer into physical segments in the submitter's address space
+static int blockdev_map_segments(blk_request_t* req, uint32_t bytes) {
+    uint32_t virt = (uint32_t)req->buffer;
+    int count = 0;
+    while (bytes > 0) {
+        uint32_t phys;
+        if (vmm_virt_to_phys(virt, &phys) != 0) return -1;
+        uint32_t chunk = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+        if (chunk > bytes) chunk = bytes;
+        if (count > 0 && req->segments[count - 1].phys + req->segments[count - 1].len == phys) {
+            req->segments[count - 1].len += chunk;
+        } else {
+            if (count == BLOCKDEV_MAX_SEGMENTS) return -1;
+            req->segments[count].phys = phys;
+            req->segments[count].len = chunk;
+            count++;
+        }
+        virt += chunk;
+        bytes -= chunk;
+    }
+    req->segment_count = count;
+    return 0;
+}
+
+void blk_request_init(blk_request_t* req, uint8_t device, uint32_t sector, uint32_t count,
+                      void* buffer, int write, blk_end_io_t end_io, void* private_data) {
+    req->device = device;
+    req->write = write ? 1 : 0;
+    req->sector = sector;
+    req->count = count;
+    req->buffer = buffer;
+    req->segment_count = 0;
+    req->status = BLOCKDEV_PENDING;
+    req->result = BLOCKDEV_SUCCESS;
+    req->end_io = end_io;
+    req->private_data = private_data;
+    req->next = NULL;
+    req->deadline = 0;
+    req->merge_next = NULL;
+}
+
+// Move `req` and everything merged behind it to the done list. Caller holds blk_lock.
+static void blockdev_complete_locked(blk_request_t* req, int status) {
+    while (req) {
+        blk_request_t* merged = req->merge_next;
+        req->merge_next = NULL;
+        req->next = NULL;
+        req->result = status;
+        if (done_tail) {
+            done_tail->next = req;
+        } else {
+            done_head = req;
+        }
+        done_tail = req;
+        req = merged;
+    }
+    softirq_raise(SOFTIRQ_BLOCK);
+}
+
+static bool blockdev_driver_busy(const blockdev_info_t* dev) {
+    switch (dev->type) {
+        case BLOCKDEV_TYPE_IDE:
+            return ide_queue_busy(dev->device_id);
+        case BLOCKDEV_TYPE_AHCI:
+            return ahci_queue_busy(dev->device_id);
+        default:
+            return false;
+    }
+}
+
+// Dispatch the next command of every queue whose controller is free.
+// Caller holds blk_lock.
+static void blockdev_run_queues_locked() {
+    for (int d = 0; d < device_count; d++) {
+        blk_queue_t* queue = &queues[d];
+        blk_queue_stats_t* stats = &queue_stats[d];
+        while (queue->head && !blockdev_driver_busy(&devices[d])) {
+            bool expired;
+            blk_request_t* req = elevator_next(queue, &devices[d], get_ticks(), &expired);
+            if (expired) stats->expired++;
+            int started;
+            switch (devices[d].type) {
+                case BLOCKDEV_TYPE_IDE:
+                    started = ide_start_request(devices[d].device_id, req);
+                    break;
+                case BLOCKDEV_TYPE_AHCI:
+                    started = ahci_start_request(devices[d].device_id, req);
+                    break;
+                default:
+                    started = -1;
+                    break;
+            }
+            if (started > 0) { // IDE_BUSY / AHCI_BUSY: no free slot after all
+                elevator_requeue(queue, req);
+                break;
+            }
+            if (started == 0) {
+                stats->commands++;
+                for (blk_request_t* r = req; r; r = r->merge_next) {
+                    stats->sectors += r->count;
+                    if (r != req) stats->merged++;
+                    queue->position = r->sector + r->count;
+                }
+                // Keep going while the driver has free slots (NCQ takes up to 32)
+                continue;
+            }
+            // Could not be issued: complete it with an error
+            blockdev_complete_locked(req, BLOCKDEV_ERROR);
+        }
+    }
+}
+
+void blockdev_kick(void) {
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    blockdev_run_queues_locked();
+    spin_unlock_irqrestore(&blk_lock, flags);
+}
+
+// Validate `req` and resolve its buffer. BLOCKDEV_SUCCESS means it can be queued.
+static int blockdev_prepare(blk_request_t* req) {
+    if (!req || req->device >= device_count || !devices[req->device].present) {
+        return BLOCKDEV_NOT_FOUND;
+    }
+    blockdev_info_t* dev = &devices[req->device];
+    if (req->count == 0 || req->count > BLOCKDEV_MAX_REQUEST_SECTORS ||
+        req->sector >= dev->sector_count || req->count > dev->sector_count - req->sector) {
+        error("[BLOCKDEV] Request for sectors %u+%u out of range (max: %u)",
+              req->sector, req->count, dev->sector_count);
+        return BLOCKDEV_ERROR;
+    }
+    if (!blockdev_can_queue(dev) ||
+        blockdev_map_segments(req, req->count * dev->sector_size) != 0) {
+        return BLOCKDEV_NOT_QUEUED;
+    }
     return BLOCKDEV_SUCCESS;
 }
 
-int blockdev_read(uint8_t device, uint32_t sector, uint8_t count, void* buffer) {
+// Caller holds blk_lock
+static void blockdev_enqueue_locked(blk_request_t* req) {
+    blk_queue_t* queue = &queues[req->device];
+    blk_queue_stats_t* stats = &queue_stats[req->device];
+    uint32_t expire_ms = req->write ? BLOCKDEV_WRITE_EXPIRE_MS : BLOCKDEV_READ_EXPIRE_MS;
+    req->status = BLOCKDEV_PENDING;
+    req->merge_next = NULL;
+    req->deadline = get_ticks() + timer_ms_to_ticks(expire_ms);
+    elevator_add(queue, req);
+    stats->requests++;
+    if (queue->depth > stats->max_depth) stats->max_depth = queue->depth;
+}
+
+int blockdev_submit(blk_request_t* req) {
+    int result = blockdev_prepare(req);
+    if (result != BLOCKDEV_SUCCESS) return result;
+
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    blockdev_enqueue_locked(req);
+    blockdev_run_queues_locked();
+    spin_unlock_irqrestore(&blk_lock, flags);
+    return BLOCKDEV_SUCCESS;
+}
+
+void blockdev_end_request(blk_request_t* req, int status) {
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    blockdev_complete_locked(req, status);
+    spin_unlock_irqrestore(&blk_lock, flags);
+}
+
+// Publish results and run callbacks, then refill the idle controllers
+static void blockdev_softirq() {
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    blk_request_t* list = done_head;
+    done_head = NULL;
+    done_tail = NULL;
+    spin_unlock_irqrestore(&blk_lock, flags);
+
+    while (list) {
+        blk_request_t* req = list;
+        list = req->next;
+        req->next = NULL;
+        blk_end_io_t end_io = req->end_io;
+        // A blocking waiter checks status under blk_lock and may return at once
+        flags = spin_lock_irqsave(&blk_lock);
+        req->status = req->result;
+        spin_unlock_irqrestore(&blk_lock, flags);
+        if (end_io) end_io(req);
+    }
+    blockdev_kick();
+}
+
+static inline uint64_t blockdev_request_key(blk_request_t* req) {
+    return (uint64_t)(uintptr_t)req;
+}
+
+// end_io of blockdev_submit_wait: only the request's address is used, since the
+// waiter may already have returned and released it
+static void blockdev_wake_waiter(blk_request_t* req) {
+    scheduler_resume_processes_for_event(HookType::CUSTOM, blockdev_request_key(req));
+}
+
+// Park `proc` until `req`, submitted with blockdev_wake_waiter, completes
+static int blockdev_wait(Process* proc, blk_request_t* req) {
+    uint64_t key = blockdev_request_key(req);
+    for (;;) {
+        uint32_t flags = spin_lock_irqsave(&blk_lock);
+        if (req->status != BLOCKDEV_PENDING) {
+            spin_unlock_irqrestore(&blk_lock, flags);
+            break;
+        }
+        // Register before dropping blk_lock so the completion cannot slip between
+        if (!process_has_matching_hook(proc, HookType::CUSTOM, key)) {
+            process_register_hook(proc, HookType::CUSTOM, key);
+        }
+        spin_unlock_irqrestore(&blk_lock, flags);
+        syscall_yield();
+    }
+    // Drop a hook left behind when the yield found nothing else to run
+    process_remove_hook(proc, HookType::CUSTOM, key);
+    return req->status;
+}
+
+int blockdev_submit_wait(blk_request_t* req) {
+    Process* proc = blockdev_sleeper();
+    if (!proc) return BLOCKDEV_NOT_QUEUED;
+    req->end_io = blockdev_wake_waiter;
+    int result = blockdev_submit(req);
+    if (result != BLOCKDEV_SUCCESS) return result;
+    return blockdev_wait(proc, req);
+}
+
+int blockdev_submit_wait_batch(blk_request_t* reqs, int count) {
+    if (count <= 0 || count > BLOCKDEV_MAX_BATCH) return BLOCKDEV_ERROR;
+    Process* proc = blockdev_sleeper();
+    if (!proc) return BLOCKDEV_NOT_QUEUED;
+    for (int i = 0; i < count; i++) {
+        reqs[i].end_io = blockdev_wake_waiter;
+        int result = blockdev_prepare(&reqs[i]);
+        if (result != BLOCKDEV_SUCCESS) return result;
+    }
+
+    // Queue the whole batch before dispatching so it is sorted and merged as one
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    for (int i = 0; i < count; i++) {
+        blockdev_enqueue_locked(&reqs[i]);
+    }
+    blockdev_run_queues_locked();
+    spin_unlock_irqrestore(&blk_lock, flags);
+
+    int result = BLOCKDEV_SUCCESS;
+    for (int i = 0; i < count; i++) {
+        int status = blockdev_wait(proc, &reqs[i]);
+        if (status != BLOCKDEV_SUCCESS && result == BLOCKDEV_SUCCESS) result = status;
+    }
+    return result;
+}
+
+// Queue a transfer as batches of request-sized pieces. Returns BLOCKDEV_NOT_QUEUED
+// when the rest, starting *done sectors in, has to go the synchronous way.
+static int blockdev_submit_chunks(uint8_t device, uint32_t sector, uint32_t count, uint8_t* buffer,
+                                  int write, uint32_t* done) {
+    *done = 0;
     if (device >= device_count || !devices[device].present) {
-        error("[BLOCKDEV] Invalid device: %d", device);
         return BLOCKDEV_NOT_FOUND;
     }
-    
+    uint32_t sector_size = devices[device].sector_size;
+
+    // Long transfers go out in batches the elevator can merge into larger commands
+    blk_request_t single;
+    blk_request_t* reqs = &single;
+    uint32_t batch = (count + BLOCKDEV_MAX_REQUEST_SECTORS - 1) / BLOCKDEV_MAX_REQUEST_SECTORS;
+    if (batch > BLOCKDEV_MAX_BATCH) batch = BLOCKDEV_MAX_BATCH;
+    if (batch > 1) {
+        reqs = (blk_request_t*)kmalloc(batch * sizeof(blk_request_t));
+        if (!reqs) {
+            reqs = &single;
+            batch = 1;
+        }
+    }
+
+    int result = BLOCKDEV_SUCCESS;
+    while (*done < count && result == BLOCKDEV_SUCCESS) {
+        uint32_t n = 0;
+        uint32_t queued = 0;
+        while (n < batch && *done + queued < count) {
+            uint32_t chunk = count - *done - queued;
+            if (chunk > BLOCKDEV_MAX_REQUEST_SECTORS) chunk = BLOCKDEV_MAX_REQUEST_SECTORS;
+            blk_request_init(&reqs[n++], device, sector + *done + queued, chunk,
+                             buffer + queued * sector_size, write, NULL, NULL);
+            queued += chunk;
+        }
+        result = blockdev_submit_wait_batch(reqs, (int)n);
+        if (result == BLOCKDEV_SUCCESS) {
+            buffer += queued * sector_size;
+            *done += queued;
+        }
+    }
+    if (reqs != &single) kfree(reqs);
+    return result;
+}
+
+// Caller holds blockdev_mutex
+static blockdev_info_t* blockdev_check_range(uint8_t device, uint32_t sector, uint32_t count) {
+    if (device >= device_count || !devices[device].present) {
+        error("[BLOCKDEV] Invalid device: %d", device);
+        return NULL;
+    }
     blockdev_info_t* dev = &devices[device];
-    
-    if (sector >= dev->sector_count) {
-        error("[BLOCKDEV] Sector %u out of range (max: %u)", sector, dev->sector_count - 1);
-        return BLOCKDEV_ERROR;
+    if (count == 0 || sector >= dev->sector_count || count > dev->sector_count - sector) {
+        error("[BLOCKDEV] Sectors %u+%u out of range (max: %u)", sector, count, dev->sector_count);
+        return NULL;
     }
+    return dev;
+}
+
+int blockdev_read_direct(uint8_t device, uint32_t sector, uint32_t count, void* buffer) {
+    // Processes sleep while the controller works; boot code and IRQ-off callers poll
+    uint32_t done;
+    int result = blockdev_submit_chunks(device, sector, count, (uint8_t*)buffer, 0, &done);
+    if (result != BLOCKDEV_NOT_QUEUED) {
+        return result;
+    }
+
+    MutexGuard guard(&blockdev_mutex);
+    blockdev_info_t* dev = blockdev_check_range(device, sector, count);
+    if (!dev) {
+        return device < device_count && devices[device].present ? BLOCKDEV_ERROR : BLOCKDEV_NOT_FOUND;
+    }
+    sector += done;
+    count -= done;
+    buffer = (uint8_t*)buffer + done * dev->sector_size;
     
-    debug("[BLOCKDEV] Reading %d sectors from sector %u on device %d (%s)",
+    debug("[BLOCKDEV] Reading %u sectors from sector %u on device %d (%s)",
            count, sector, device, dev->name);
     
     switch (dev->type) {
         case BLOCKDEV_TYPE_IDE:
+            // The driver splits the transfer into the largest commands the drive takes
             return ide_read_sectors(dev->device_id, sector, count, (uint16_t*)buffer);
+
+        case BLOCKDEV_TYPE_AHCI:
+            return ahci_read_sectors(dev->device_id, sector, count, buffer);
+
+        case BLOCKDEV_TYPE_RAM:
+            return ramdisk_read_sectors(dev->device_id, sector, count, buffer);
         
         default:
             error("[BLOCKDEV] Unsupported device type: %d", dev->type);
@@ -78,19 +498,21 @@ int blockdev_read(uint8_t device, uint32_t sector, uint8_t count, void* buffer)
     }
 }
 
-int blockdev_write(uint8_t device, uint32_t sector, uint8_t count, const void* buffer) {
-    if (device >= device_count || !devices[device].present) {
-        return BLOCKDEV_NOT_FOUND;
+int blockdev_write_direct(uint8_t device, uint32_t sector, uint32_t count, const void* buffer) {
+    uint32_t done;
+    int result = blockdev_submit_chunks(device, sector, count, (uint8_t*)buffer, 1, &done);
+    if (result != BLOCKDEV_NOT_QUEUED) {
+        return result;
     }
-    
-    blockdev_info_t* dev = &devices[device];
-    
-    if (sector >= dev->sector_count || (uint32_t)count > dev->sector_count ||
-        sector + count > dev->sector_count) {
-        error("[BLOCKDEV] Write sector %u count %u out of range (max: %u)",
-              sector, count, dev->sector_count);
-        return BLOCKDEV_ERROR;
+
+    MutexGuard guard(&blockdev_mutex);
+    blockdev_info_t* dev = blockdev_check_range(device, sector, count);
+    if (!dev) {
+        return device < device_count && devices[device].present ? BLOCKDEV_ERROR : BLOCKDEV_NOT_FOUND;
     }
+    sector += done;
+    count -= done;
+    buffer = (const uint8_t*)buffer + done * dev->sector_size;
 
     switch (dev->type) {
         case BLOCKDEV_TYPE_IDE:
@@ -98,12 +520,26 @@ int blockdev_write(uint8_t device, uint32_t sector, uint8_t count, const void* b
                 return BLOCKDEV_ERROR;
             }
             return BLOCKDEV_SUCCESS;
+
+        case BLOCKDEV_TYPE_AHCI:
+            return ahci_write_sectors(dev->device_id, sector, count, buffer);
+
+        case BLOCKDEV_TYPE_RAM:
+            return ramdisk_write_sectors(dev->device_id, sector, count, buffer);
         
         default:
             return BLOCKDEV_ERROR;
     }
 }
 
+int blockdev_read(uint8_t device, uint32_t sector, uint32_t count, void* buffer) {
+    return bcache_read(device, sector, count, buffer);
+}
+
+int blockdev_write(uint8_t device, uint32_t sector, uint32_t count, const void* buffer) {
+    return bcache_write(device, sector, count, buffer);
+}
+
 blockdev_info_t* blockdev_get_info(uint8_t device) {
     if (device >= device_count || !devices[device].present) {
         return NULL;
@@ -122,3 +558,27 @@ int blockdev_list_devices(void) {
     }
     return device_count;
 }
+
+void blockdev_dump_stats(void) {
+    blk_queue_stats_t snapshot[MAX_BLOCK_DEVICES];
+    uint32_t depth[MAX_BLOCK_DEVICES];
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    memcpy(snapshot, queue_stats, sizeof(snapshot));
+    for (int d = 0; d < device_count; d++) depth[d] = queues[d].depth;
+    spin_unlock_irqrestore(&blk_lock, flags);
+
+    printf("DEV   REQUESTS  MERGED    COMMANDS  AVG-SECT  EXPIRED  QUEUED  MAX-DEPTH\n");
+    for (int d = 0; d < device_count; d++) {
+        if (!devices[d].present) continue;
+        const blk_queue_stats_t* st = &snapshot[d];
+        printf("%-5s %-9u %-9u %-9u %-9u %-8u %-7u %u\n", devices[d].name, st->requests, st->merged,
+               st->commands, st->commands ? (uint32_t)(st->sectors / st->commands) : 0, st->expired,
+               depth[d], st->max_depth);
+    }
+}
+
+void blockdev_reset_stats(void) {
+    uint32_t flags = spin_lock_irqsave(&blk_lock);
+    memset(queue_stats, 0, sizeof(queue_stats));
+    spin_unlock_irqrestore(&blk_lock, flags);
+}
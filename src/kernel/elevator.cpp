@@ -0,0 +1,81 @@
+#include "kernel/elevator.h"
+
+void elevator_add(blk_queue_t* queue, blk_request_t* req) {
+    blk_request_t** link = &queue->head;
+    while (*link && (*link)->sector <= req->sector) link = &(*link)->next;
+    req->next = *link;
+    *link = req;
+    queue->depth++;
+}
+
+// Scatter-gather entries `req` takes on a device whose entries stop at `boundary`
+static uint32_t request_entries(const blk_request_t* req, uint32_t boundary) {
+    if (boundary == 0) return (uint32_t)req->segment_count;
+    uint32_t entries = 0;
+    for (int s = 0; s < req->segment_count; s++) {
+        uint32_t first = req->segments[s].phys / boundary;
+        uint32_t last = (req->segments[s].phys + req->segments[s].len - 1) / boundary;
+        entries += last - first + 1;
+    }
+    return entries;
+}
+
+// Deadline-aware C-LOOK: the request whose deadline passed longest ago, else the
+// first one at or past the head position, else wrap to the lowest sector.
+// Returns the link that points at it.
+static blk_request_t** pick(blk_queue_t* queue, uint32_t now, bool* expired_pick) {
+    blk_request_t** expired = NULL;
+    blk_request_t** ahead = NULL;
+    for (blk_request_t** link = &queue->head; *link; link = &(*link)->next) {
+        blk_request_t* req = *link;
+        if ((int32_t)(now - req->deadline) >= 0 &&
+            (!expired || (int32_t)(req->deadline - (*expired)->deadline) < 0)) {
+            expired = link;
+        }
+        if (!ahead && req->sector >= queue->position) ahead = link;
+    }
+    if (!ahead) ahead = &queue->head;
+    *expired_pick = expired && expired != ahead;
+    return *expired_pick ? expired : ahead;
+}
+
+blk_request_t* elevator_next(blk_queue_t* queue, const blockdev_info_t* dev, uint32_t now,
+                             bool* expired) {
+    *expired = false;
+    if (!queue->head) return NULL;
+    blk_request_t** link = pick(queue, now, expired);
+    blk_request_t* req = *link;
+    *link = req->next;
+    req->next = NULL;
+    queue->depth--;
+
+    // Chain the contiguous, same-direction requests sorted right behind it
+    uint32_t sectors = req->count;
+    uint32_t entries = request_entries(req, dev->seg_boundary);
+    blk_request_t* tail = req;
+    while (*link) {
+        blk_request_t* next = *link;
+        uint32_t next_entries = request_entries(next, dev->seg_boundary);
+        if (next->sector != req->sector + sectors || next->write != req->write ||
+            sectors + next->count > dev->max_sectors || entries + next_entries > dev->max_segments) {
+            break;
+        }
+        *link = next->next;
+        next->next = NULL;
+        queue->depth--;
+        tail->merge_next = next;
+        tail = next;
+        sectors += next->count;
+        entries += next_entries;
+    }
+    return req;
+}
+
+void elevator_requeue(blk_queue_t* queue, blk_request_t* req) {
+    while (req) {
+        blk_request_t* merged = req->merge_next;
+        req->merge_next = NULL;
+        elevator_add(queue, req);
+        req = merged;
+    }
+}
@@ -0,0 +1,74 @@
+#include "kernel/elf.h"
+#include "kernel/paging.h"
+#include "kernel/process.h"
+#include "kernel/vfs.h"
+#include "kernel/debug.h"
+#include <string.h>
+
+static bool read_at(vfs_file_t* file, uint32_t offset, void* buffer, uint32_t size) {
+    return vfs_seek(file, offset) == VFS_SUCCESS && vfs_read(file, buffer, size) == (int)size;
+}
+
+static bool header_valid(const Elf32_Ehdr* eh) {
+    return eh->magic == ELF_MAGIC && eh->elf_class == ELF_CLASS_32 && eh->data == ELF_DATA_LSB &&
+           eh->type == ELF_TYPE_EXEC && eh->machine == ELF_MACHINE_386 &&
+           eh->phentsize == sizeof(Elf32_Phdr) && eh->phnum > 0 && eh->phnum <= ELF_MAX_PHDRS;
+}
+
+// Record every PT_LOAD segment as a demand-paged area; nothing is read yet
+static bool map_segments(address_space_t* as, const Elf32_Phdr* phdrs, int count) {
+    for (int i = 0; i < count; ++i) {
+        const Elf32_Phdr* ph = &phdrs[i];
+        if (ph->type != ELF_PT_LOAD || ph->memsz == 0) continue;
+        if (ph->filesz > ph->memsz || ph->vaddr + ph->memsz < ph->vaddr) {
+            error("[ELF] %s: malformed segment %d", as->name, i);
+            return false;
+        }
+        uint32_t flags = VM_FILE | ((ph->flags & ELF_PF_W) ? VM_WRITE : 0);
+        if (vmm_add_area(as, ph->vaddr, ph->vaddr + ph->memsz, flags,
+                         ph->vaddr, ph->offset, ph->filesz) != 0) {
+            error("[ELF] %s: segment %d at 0x%x is outside user space or overlaps", as->name, i, ph->vaddr);
+            return false;
+        }
+    }
+    return true;
+}
+
+Process* elf_exec(const char* path) {
+    if (!path) return NULL;
+    address_space_t* as = vmm_create_address_space();
+    if (!as) {
+        error("[ELF] No memory for an address space");
+        return NULL;
+    }
+    const char* base = strrchr(path, '/');
+    strncpy(as->name, base ? base + 1 : path, sizeof(as->name) - 1);
+
+    if (vfs_open(path, &as->file) != VFS_SUCCESS) {
+        vmm_destroy_address_space(as);
+        return NULL;
+    }
+    as->has_file = 1;
+
+    Elf32_Ehdr eh;
+    Elf32_Phdr phdrs[ELF_MAX_PHDRS];
+    if (!read_at(&as->file, 0, &eh, sizeof(eh)) || !header_valid(&eh)) {
+        error("[ELF] %s: not an i386 ELF executable", path);
+        vmm_destroy_address_space(as);
+        return NULL;
+    }
+    if (!read_at(&as->file, eh.phoff, phdrs, eh.phnum * sizeof(Elf32_Phdr)) ||
+        !map_segments(as, phdrs, eh.phnum) ||
+        vmm_add_area(as, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP, VM_WRITE, 0, 0, 0) != 0) {
+        vmm_destroy_address_space(as);
+        return NULL;
+    }
+
+    Process* proc = k_start_mm_process(as->name, as, eh.entry);
+    if (!proc) {
+        vmm_destroy_address_space(as);
+        return NULL;
+    }
+    debug("[ELF] %s: pid %d entry 0x%x, %d areas mapped lazily", path, proc->pid, eh.entry, as->area_count);
+    return proc;
+}
@@ -1,5 +1,6 @@
 #include "kernel/fat32.h"
 #include "kernel/blockdev.h"
+#include "kernel/bcache.h"
 #include "kernel/heap.h"
 #include "kernel/debug.h"
 #include <stdio.h>
@@ -663,6 +664,11 @@ int fat32_unmount(void) {
         return -1;
     }
     
+    // Dirty buffers must reach the disk before it can be detached
+    if (bcache_sync(fs_info.device_id) != BLOCKDEV_SUCCESS) {
+        error("[FAT32] Failed to write back cached sectors");
+    }
+    
     if (fs_info.fat_table) {
         kfree(fs_info.fat_table);
         fs_info.fat_table = NULL;
@@ -1339,29 +1345,40 @@ int fat32_read(int fd, void* buffer, size_t size) {
         size = file->file_size - file->position;
     }
     
-    // Allocate cluster buffer
-    uint8_t* cluster_buffer = (uint8_t*)kmalloc(cluster_size);
-    if (!cluster_buffer) {
-        error("[FAT32] Failed to allocate cluster buffer");
-        return -1;
-    }
-    
+    // Whole sectors are read straight into the caller's buffer; only a partial
+    // first or last sector goes through this bounce buffer
+    uint8_t sector_buffer[512];
+    const uint32_t sector_size = fs_info.bytes_per_sector; // Always 512, checked at mount
+
     while (bytes_read < size && file->current_cluster < FAT32_END_CLUSTER) {
-        // Read current cluster
-        if (fat32_read_cluster(file->current_cluster, cluster_buffer) != 0) {
-            error("[FAT32] Failed to read cluster %u", file->current_cluster);
-            kfree(cluster_buffer);
+        uint32_t first_sector = fat32_cluster_to_sector(file->current_cluster);
+        if (first_sector == 0) {
+            error("[FAT32] Invalid cluster %u", file->current_cluster);
             return -1;
         }
-        
-        // Calculate how much to read from this cluster
-        uint32_t offset_in_cluster = file->cluster_position;
-        uint32_t bytes_in_cluster = cluster_size - offset_in_cluster;
-        uint32_t bytes_to_read = (size - bytes_read < bytes_in_cluster) ? 
-                                 (size - bytes_read) : bytes_in_cluster;
-        
-        // Copy data
-        memcpy(dest + bytes_read, cluster_buffer + offset_in_cluster, bytes_to_read);
+        uint32_t sector = first_sector + file->cluster_position / sector_size;
+        uint32_t offset_in_sector = file->cluster_position % sector_size;
+        uint32_t bytes_in_cluster = cluster_size - file->cluster_position;
+        uint32_t wanted = (size - bytes_read < bytes_in_cluster) ? 
+                          (size - bytes_read) : bytes_in_cluster;
+
+        uint32_t bytes_to_read;
+        if (offset_in_sector == 0 && wanted >= sector_size) {
+            uint32_t sectors = wanted / sector_size;
+            if (blockdev_read(fs_info.device_id, sector, sectors, dest + bytes_read) != 0) {
+                error("[FAT32] Failed to read cluster %u", file->current_cluster);
+                return -1;
+            }
+            bytes_to_read = sectors * sector_size;
+        } else {
+            if (blockdev_read(fs_info.device_id, sector, 1, sector_buffer) != 0) {
+                error("[FAT32] Failed to read cluster %u", file->current_cluster);
+                return -1;
+            }
+            bytes_to_read = sector_size - offset_in_sector;
+            if (bytes_to_read > wanted) bytes_to_read = wanted;
+            memcpy(dest + bytes_read, sector_buffer + offset_in_sector, bytes_to_read);
+        }
         bytes_read += bytes_to_read;
         file->position += bytes_to_read;
         file->cluster_position += bytes_to_read;
@@ -1373,7 +1390,6 @@ int fat32_read(int fd, void* buffer, size_t size) {
         }
     }
     
-    kfree(cluster_buffer);
     debug("[FAT32] Read %u bytes", bytes_read);
     return bytes_read;
 }
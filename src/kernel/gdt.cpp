@@ -1,32 +1,48 @@
 // gdt.cpp
 #include <stdint.h>
+#include <string.h>
 #include "kernel/gdt.h"
+#include "kernel/smp.h"
 #include "kernel/debug.h"
+#include "kernel/msr.h"
 
+#define GDT_ENTRIES 6
 
-// We'll define 5 segments: Null, Kernel Code, Kernel Data, User Code, User Data.
-static GDTEntry gdt[5];
-static GDTPtr   gdt_ptr;
+// Every CPU gets its own table so that each one can own a busy TSS descriptor:
+// Null, Kernel Code, Kernel Data, User Code, User Data, TSS.
+static GDTEntry gdt[MAX_CPUS][GDT_ENTRIES];
+static GDTPtr   gdt_ptr[MAX_CPUS];
+static TSSEntry tss[MAX_CPUS];
 
+// Top of the boot stack (see linker.ld), used as the BSP's initial ring-0 stack.
+extern "C" uint8_t __stack_top[];
+extern "C" void sysenter_entry();
 
-// Set one GDT entry in our table.
-static void set_gdt_entry(int index, 
+// Read by libc to pick SYSENTER over int $0x80 for ring-3 callers
+extern "C" { volatile int g_sysenter_enabled = 0; }
+
+
+// Set one GDT entry in the given CPU's table.
+static void set_gdt_entry(int cpu,
+                          int index, 
                           uint32_t base, 
                           uint32_t limit,
                           uint8_t access,
                           uint8_t gran)
 {
+    GDTEntry* entry = &gdt[cpu][index];
+
     // Limit
-    gdt[index].limit_low    = (limit & 0xFFFF);
-    gdt[index].granularity  = (limit >> 16) & 0x0F;
+    entry->limit_low    = (limit & 0xFFFF);
+    entry->granularity  = (limit >> 16) & 0x0F;
 
     // Base
-    gdt[index].base_low     = (base & 0xFFFF);
-    gdt[index].base_mid     = (base >> 16) & 0xFF;
-    gdt[index].base_high    = (base >> 24) & 0xFF;
+    entry->base_low     = (base & 0xFFFF);
+    entry->base_mid     = (base >> 16) & 0xFF;
+    entry->base_high    = (base >> 24) & 0xFF;
 
-    gdt[index].access       = access;
-    gdt[index].granularity |= (gran & 0xF0);
+    entry->access       = access;
+    entry->granularity |= (gran & 0xF0);
 }
 
 extern "C" void gdt_flush(uint32_t gdt_ptr_addr)
@@ -57,22 +73,23 @@ extern "C" void gdt_flush(uint32_t gdt_ptr_addr)
 }
 
 
-// Initialize our GDT with five entries: 
+// Initialize a CPU's GDT with six entries: 
 // 0 = null, 
 // 1 = kernel code, 
 // 2 = kernel data, 
 // 3 = user code, 
-// 4 = user data.
-void init_gdt()
+// 4 = user data,
+// 5 = TSS.
+static void build_gdt(int cpu, uint32_t kernel_stack_top)
 {
     // 1) Null segment
-    set_gdt_entry(0, 0, 0, 0, 0);
+    set_gdt_entry(cpu, 0, 0, 0, 0, 0);
 
     // 2) Kernel code (index 1)
     // Base=0, Limit=4GB => 0xFFFFF, 
     // Access=0x9A=10011010b (present=1, ring=0, code=1),
     // Gran=0xCF=11001111b (4KB gran, 32-bit op size).
-    set_gdt_entry(1, 
+    set_gdt_entry(cpu, 1, 
                   0, 
                   0xFFFFF,   // 4 GB limit in pages
                   0x9A,      // ring0 code, present, exec/read
@@ -80,7 +97,7 @@ void init_gdt()
 
     // 3) Kernel data (index 2)
     // Access=0x92=10010010b (present=1, ring=0, data=1, writable=1),
-    set_gdt_entry(2, 
+    set_gdt_entry(cpu, 2, 
                   0, 
                   0xFFFFF,
                   0x92,
@@ -88,7 +105,7 @@ void init_gdt()
 
     // 4) User code (index 3)
     // Same limit & gran, but ring=3 => Access=0xFA=11111010b
-    set_gdt_entry(3, 
+    set_gdt_entry(cpu, 3, 
                   0, 
                   0xFFFFF,
                   0xFA, // ring3 code
@@ -96,17 +113,75 @@ void init_gdt()
 
     // 5) User data (index 4)
     // ring=3 => Access=0xF2=11110010b
-    set_gdt_entry(4, 
+    set_gdt_entry(cpu, 4, 
                   0, 
                   0xFFFFF,
                   0xF2, // ring3 data
                   0xCF);
 
+    // 6) TSS (index 5)
+    // Access=0x89=10001001b (present=1, ring=0, 32-bit available TSS), byte granularity.
+    TSSEntry* t = &tss[cpu];
+    memset(t, 0, sizeof(TSSEntry));
+    t->ss0 = GDT_KERNEL_DATA_SELECTOR;
+    t->esp0 = kernel_stack_top;
+    t->iomap_base = sizeof(TSSEntry); // No I/O permission bitmap
+    set_gdt_entry(cpu, 5,
+                  (uint32_t)t,
+                  sizeof(TSSEntry) - 1,
+                  0x89,
+                  0x00);
+
     // Populate the GDTPtr
-    gdt_ptr.limit = (sizeof(gdt) - 1);
-    gdt_ptr.base  = (uint32_t)&gdt;
-    debug("[GDT] Base=0x%x, Limit=0x%x\n", gdt_ptr.base, gdt_ptr.limit);
+    gdt_ptr[cpu].limit = (sizeof(gdt[cpu]) - 1);
+    gdt_ptr[cpu].base  = (uint32_t)&gdt[cpu];
+}
+
+// CPUID.01h:EDX bit 11 (SEP) advertises SYSENTER/SYSEXIT
+static bool cpu_has_sysenter()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & (1u << 11)) != 0;
+}
+
+// SYSENTER loads ESP from an MSR rather than the TSS. Point it at this CPU's TSS
+// so the entry stub can fetch esp0, which the scheduler already keeps current.
+static void init_sysenter(int cpu)
+{
+    wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE_SELECTOR);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&tss[cpu]);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
 
-    // Flush the GDT with our assembly function
-    gdt_flush((uint32_t)&gdt_ptr);
+static void load_gdt(int cpu)
+{
+    // Flush the GDT with our assembly function, then load the task register
+    gdt_flush((uint32_t)&gdt_ptr[cpu]);
+    asm volatile("ltr %w0" :: "r"((uint16_t)GDT_TSS_SELECTOR));
+    if (g_sysenter_enabled) {
+        init_sysenter(cpu);
+    }
+}
+
+void init_gdt()
+{
+    build_gdt(0, (uint32_t)__stack_top);
+    debug("[GDT] Base=0x%x, Limit=0x%x\n", gdt_ptr[0].base, gdt_ptr[0].limit);
+    g_sysenter_enabled = cpu_has_sysenter();
+    load_gdt(0);
+    debug("[GDT] SYSENTER fast syscalls %s", g_sysenter_enabled ? "enabled" : "unavailable");
+}
+
+void gdt_init_cpu(int cpu, uint32_t kernel_stack_top)
+{
+    if (cpu <= 0 || cpu >= MAX_CPUS) return;
+    build_gdt(cpu, kernel_stack_top);
+    load_gdt(cpu);
+}
+
+void gdt_set_kernel_stack(int cpu, uint32_t esp0)
+{
+    if (cpu < 0 || cpu >= MAX_CPUS) return;
+    tss[cpu].esp0 = esp0;
 }
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <kernel/debug.h>
+#include <kernel/spinlock.h>
 
 // Heap block header structure.
 typedef struct heap_block {
@@ -15,6 +16,8 @@ typedef struct heap_block {
 
 // Global pointer to the start of the heap
 static heap_block_t* free_list = NULL;  
+// Serializes free-list walks between CPUs
+static spinlock_t heap_lock = SPINLOCK_INIT("heap");
 
 // Align size to 16 bytes
 static size_t align16(size_t size) {
@@ -44,6 +47,7 @@ void* kmalloc(size_t size) {
         return NULL;
     }
 
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
     heap_block_t* current = free_list;
     heap_block_t* previous = NULL;
 
@@ -57,6 +61,7 @@ void* kmalloc(size_t size) {
     }
 
     if (current == NULL) {
+        spin_unlock_irqrestore(&heap_lock, flags);
         error("[HEAP] Error: No free block large enough for %d bytes!", size);
         return NULL;
     }
@@ -74,6 +79,7 @@ void* kmalloc(size_t size) {
 
     current->free = 0; // Mark block as used
     void* alloc_addr = (void*)((uintptr_t)current + sizeof(heap_block_t));
+    spin_unlock_irqrestore(&heap_lock, flags);
 
     debug("[HEAP] Allocated %d bytes at 0x%x", size, (uint32_t)alloc_addr);
     return alloc_addr;
@@ -84,14 +90,16 @@ void kfree(void* ptr) {
     if (!ptr) return;
 
     heap_block_t* block = (heap_block_t*)((uintptr_t)ptr - sizeof(heap_block_t));
+    uint32_t flags = spin_lock_irqsave(&heap_lock);
     block->free = 1;
-    debug("[HEAP] Freed block at 0x%x (size: %d bytes)", (uint32_t)ptr, block->size);
 
     // Try to merge with next block if free
     if (block->next && block->next->free) {
         block->size += block->next->size + sizeof(heap_block_t);
         block->next = block->next->next;
     }
+    spin_unlock_irqrestore(&heap_lock, flags);
+    debug("[HEAP] Freed block at 0x%x (size: %d bytes)", (uint32_t)ptr, block->size);
 }
 
 // Reallocate memory from the heap
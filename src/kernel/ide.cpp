@@ -1,6 +1,16 @@
 #include "kernel/ide.h"
 #include "kernel/port_io.h"
 #include "kernel/debug.h"
+#include "kernel/timer.h"
+#include "kernel/pci.h"
+#include "kernel/paging.h"
+#include "kernel/isr.h"
+#include "kernel/pic.h"
+#include "kernel/scheduler.h"
+#include "kernel/softirq.h"
+#include "kernel/waitqueue.h"
+#include "kernel/blockdev.h"
+#include "kernel/spinlock.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
@@ -8,6 +18,40 @@
 static ide_drive_t drives[IDE_MAX_DRIVES];
 static uint8_t drive_count = 0;
 
+// Most status waits end within microseconds, so poll hot for a while; a drive
+// still busy after that (spin-up, a long seek) is polled once per millisecond
+// with the CPU free for other processes.
+#define IDE_SPIN_POLLS 10000
+#define IDE_TIMEOUT_MS 1000
+#define IDE_DMA_TIMEOUT_MS 5000
+// A queued request finding the drive busy is retried this often, up to IDE_TIMEOUT_MS
+#define IDE_RETRY_MS 1
+
+// Per-channel state. A channel runs one command at a time: either a queued
+// DMA request (`active`) or a synchronous PIO transfer by its owner (`claimed`).
+typedef struct {
+    uint16_t base_port;
+    uint16_t ctrl_port;
+    uint16_t bmide;              // Bus-master register block, 0 if unavailable
+    uint32_t prdt_phys;
+    ide_prd_t* prdt;
+    blk_request_t* active;       // DMA request in flight
+    uint32_t started;            // Tick `active` was issued
+    int claimed;                 // A synchronous transfer owns the channel
+    uint32_t not_ready_since;    // Tick a queued request first found the drive busy
+    int not_ready;
+    ktimer_t timeout;
+    ktimer_t retry;              // Kicks the block layer while the drive is busy
+    wait_queue_t wait;           // Synchronous callers waiting for the channel
+} ide_channel_t;
+
+// 8-byte entries, 512-byte aligned: a table can never straddle a 64 KiB boundary
+static ide_prd_t ide_prdt[2][IDE_PRD_ENTRIES] __attribute__((aligned(512)));
+static ide_channel_t channels[2];
+static int ide_dma_enabled = 1;
+// Channel state; nests inside the block layer's queue lock
+static spinlock_t ide_lock = SPINLOCK_INIT("ide");
+
 static void ide_delay(uint16_t base_port) {
     // 400ns delay by reading status register 4 times
     for (int i = 0; i < 4; i++) {
@@ -17,9 +61,11 @@ static void ide_delay(uint16_t base_port) {
 
 static int ide_wait_ready(uint16_t base_port, bool quiet) {
     uint8_t status;
-    int timeout = 1000000;
-    
-    while (timeout--) {
+
+    for (uint32_t poll = 0; poll < IDE_SPIN_POLLS + IDE_TIMEOUT_MS; poll++) {
+        if (poll >= IDE_SPIN_POLLS) {
+            timer_sleep_ms(1);
+        }
         status = inb(base_port + IDE_REG_STATUS);
         if (!(status & IDE_STATUS_BSY) && (status & IDE_STATUS_RDY)) {
             return 0;
@@ -43,9 +89,11 @@ static int ide_wait_ready(uint16_t base_port, bool quiet) {
 
 static int ide_wait_drq(uint16_t base_port, bool quiet) {
     uint8_t status;
-    int timeout = 1000000;
-    
-    while (timeout--) {
+
+    for (uint32_t poll = 0; poll < IDE_SPIN_POLLS + IDE_TIMEOUT_MS; poll++) {
+        if (poll >= IDE_SPIN_POLLS) {
+            timer_sleep_ms(1);
+        }
         status = inb(base_port + IDE_REG_STATUS);
         if (!(status & IDE_STATUS_BSY) && (status & IDE_STATUS_DRQ)) {
             return 0;
@@ -73,6 +121,285 @@ static void ide_select_drive(uint16_t base_port, uint8_t drive) {
     ide_delay(base_port);
 }
 
+// Largest sector count one command can carry (a count register of 0 means the maximum)
+static inline uint32_t ide_max_sectors(const ide_drive_t* drive) {
+    return drive->lba48 ? IDE_MAX_SECTORS_LBA48 : IDE_MAX_SECTORS_LBA28;
+}
+
+// The 28-bit commands are shorter to issue; use the EXT forms only when needed
+static inline bool ide_needs_lba48(const ide_drive_t* drive, uint32_t lba, uint32_t count) {
+    return drive->lba48 && (count > IDE_MAX_SECTORS_LBA28 || lba + count > IDE_LBA28_LIMIT);
+}
+
+// Load the task file and issue `command`. For LBA48 each register takes its
+// high-order byte first; the drive keeps the previous write as the high half.
+static void ide_issue(const ide_drive_t* drive, uint32_t lba, uint32_t count, bool lba48, uint8_t command) {
+    uint16_t base_port = drive->base_port;
+    outb(base_port + IDE_REG_FEATURES, 0x00);
+    if (lba48) {
+        outb(base_port + IDE_REG_SECTOR_COUNT, (count >> 8) & 0xFF);
+        outb(base_port + IDE_REG_LBA_LOW, (lba >> 24) & 0xFF);
+        outb(base_port + IDE_REG_LBA_MID, 0); // LBA bits 32-47: sectors are 32-bit here
+        outb(base_port + IDE_REG_LBA_HIGH, 0);
+    }
+    outb(base_port + IDE_REG_SECTOR_COUNT, count & 0xFF);
+    outb(base_port + IDE_REG_LBA_LOW, lba & 0xFF);
+    outb(base_port + IDE_REG_LBA_MID, (lba >> 8) & 0xFF);
+    outb(base_port + IDE_REG_LBA_HIGH, (lba >> 16) & 0xFF);
+    if (lba48) {
+        outb(base_port + IDE_REG_DRIVE, 0x40 | ((drive->drive_num & 1) << 4));
+    } else {
+        outb(base_port + IDE_REG_DRIVE, 0xE0 | ((drive->drive_num & 1) << 4) | ((lba >> 24) & 0x0F));
+    }
+    outb(base_port + IDE_REG_COMMAND, command);
+}
+
+static inline ide_channel_t* ide_channel_of(const ide_drive_t* drive) {
+    return &channels[drive->base_port == IDE_PRIMARY_BASE ? 0 : 1];
+}
+
+// Sleeping needs a process to park and interrupts on so the completion IRQ can land
+static Process* ide_sleeper() {
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0" : "=r"(flags));
+    if (!(flags & 0x200) || irq_in_progress() || softirq_in_progress()) return NULL;
+    return scheduler_current_process();
+}
+
+// Translate a request's physical segments into the channel's PRD table,
+// splitting at 64 KiB boundaries. Returns -1 if a segment is not word aligned
+// or the table is too small.
+static int ide_build_prdt(ide_channel_t* ch, const blk_request_t* req) {
+    int entries = 0;
+    // Requests merged behind the first one continue the same transfer
+    for (const blk_request_t* r = req; r; r = r->merge_next) {
+        for (int s = 0; s < r->segment_count; s++) {
+            uint32_t phys = r->segments[s].phys;
+            uint32_t len = r->segments[s].len;
+            if ((phys | len) & 1) return -1;
+            while (len > 0) {
+                uint32_t chunk = 0x10000 - (phys & 0xFFFF);
+                if (chunk > len) chunk = len;
+                if (entries == IDE_PRD_ENTRIES) return -1;
+                ch->prdt[entries].base = phys;
+                ch->prdt[entries].byte_count = (uint16_t)chunk; // 0x10000 wraps to 0, meaning 64 KiB
+                ch->prdt[entries].flags = 0;
+                entries++;
+                phys += chunk;
+                len -= chunk;
+            }
+        }
+    }
+    if (entries == 0) return -1;
+    ch->prdt[entries - 1].flags = IDE_PRD_EOT;
+    return 0;
+}
+
+// Stop the engine and detach the finished request. Caller holds ide_lock.
+static blk_request_t* ide_dma_finish_locked(ide_channel_t* ch, int* status) {
+    blk_request_t* req = ch->active;
+    uint8_t bm = inb(ch->bmide + IDE_BM_REG_STATUS);
+    outb(ch->bmide + IDE_BM_REG_COMMAND, 0);
+    uint8_t ata = inb(ch->base_port + IDE_REG_STATUS); // Also drops INTRQ
+    outb(ch->bmide + IDE_BM_REG_STATUS, bm | IDE_BM_STATUS_IRQ | IDE_BM_STATUS_ERR);
+    ch->active = NULL;
+    *status = BLOCKDEV_SUCCESS;
+    if ((bm & IDE_BM_STATUS_ERR) || (ata & (IDE_STATUS_ERR | IDE_STATUS_DF))) {
+        error("[IDE] DMA error: bus master 0x%x, status 0x%x", bm, ata);
+        *status = BLOCKDEV_ERROR;
+    }
+    return req;
+}
+
+// Complete the channel's DMA request if the controller has raised its
+// interrupt. Used by the IRQ handler and by synchronous callers that cannot sleep.
+static void ide_service(ide_channel_t* ch) {
+    blk_request_t* req = NULL;
+    int status = BLOCKDEV_SUCCESS;
+    uint32_t flags = spin_lock_irqsave(&ide_lock);
+    if (ch->active && (inb(ch->bmide + IDE_BM_REG_STATUS) & IDE_BM_STATUS_IRQ)) {
+        req = ide_dma_finish_locked(ch, &status);
+    } else {
+        // PIO command or a stray interrupt: reading status drops INTRQ
+        inb(ch->base_port + IDE_REG_STATUS);
+    }
+    spin_unlock_irqrestore(&ide_lock, flags);
+    if (req) {
+        blockdev_end_request(req, status);
+        wake_up(&ch->wait, WAKE_ALL);
+    }
+}
+
+static void ide_primary_irq(registers_t* regs) {
+    (void)regs;
+    ide_service(&channels[0]);
+}
+
+static void ide_secondary_irq(registers_t* regs) {
+    (void)regs;
+    ide_service(&channels[1]);
+}
+
+static void ide_retry(ktimer_t* timer, void* arg) {
+    (void)timer;
+    (void)arg;
+    blockdev_kick();
+}
+
+// The drive never interrupted: complete the request anyway if the controller
+// finished (a lost IRQ), otherwise abort it with an error
+static void ide_dma_timeout(ktimer_t* timer, void* arg) {
+    (void)timer;
+    ide_channel_t* ch = (ide_channel_t*)arg;
+    blk_request_t* req = NULL;
+    int status = BLOCKDEV_ERROR;
+    uint32_t flags = spin_lock_irqsave(&ide_lock);
+    if (ch->active && get_ticks() - ch->started >= timer_ms_to_ticks(IDE_DMA_TIMEOUT_MS)) {
+        bool finished = (inb(ch->bmide + IDE_BM_REG_STATUS) & IDE_BM_STATUS_ACTIVE) == 0;
+        req = ide_dma_finish_locked(ch, &status);
+        if (!finished) {
+            error("[IDE] DMA timeout on port 0x%x", ch->base_port);
+            status = BLOCKDEV_ERROR;
+        }
+    }
+    spin_unlock_irqrestore(&ide_lock, flags);
+    if (req) {
+        blockdev_end_request(req, status);
+        wake_up(&ch->wait, WAKE_ALL);
+        blockdev_kick();
+    }
+}
+
+static bool ide_try_claim(ide_channel_t* ch) {
+    uint32_t flags = spin_lock_irqsave(&ide_lock);
+    bool claimed = !ch->active && !ch->claimed;
+    if (claimed) ch->claimed = 1;
+    spin_unlock_irqrestore(&ide_lock, flags);
+    return claimed;
+}
+
+// Take the channel for a synchronous transfer, waiting out a queued request in flight
+static void ide_claim_channel(ide_channel_t* ch) {
+    Process* proc = ide_sleeper();
+    if (proc) {
+        wait_event(&ch->wait, proc, ide_try_claim(ch));
+        return;
+    }
+    while (!ide_try_claim(ch)) {
+        ide_service(ch);
+        asm volatile("pause");
+    }
+}
+
+static void ide_release_channel(ide_channel_t* ch) {
+    uint32_t flags = spin_lock_irqsave(&ide_lock);
+    ch->claimed = 0;
+    spin_unlock_irqrestore(&ide_lock, flags);
+    wake_up(&ch->wait, WAKE_ALL);
+    // Requests queued meanwhile were turned away as busy
+    blockdev_kick();
+}
+
+bool ide_can_queue(uint8_t drive_id) {
+    return drive_id < IDE_MAX_DRIVES && drives[drive_id].exists && drives[drive_id].dma &&
+           ide_dma_enabled;
+}
+
+bool ide_queue_busy(uint8_t drive_id) {
+    const ide_channel_t* ch = ide_channel_of(&drives[drive_id]);
+    return ch->active || ch->claimed;
+}
+
+int ide_start_request(uint8_t drive_id, blk_request_t* req) {
+    if (!ide_can_queue(drive_id)) {
+        return -1;
+    }
+    uint32_t count = 0;
+    for (const blk_request_t* r = req; r; r = r->merge_next) {
+        count += r->count;
+    }
+    if (count == 0 || count > ide_max_sectors(&drives[drive_id])) {
+        return -1;
+    }
+    ide_drive_t* drive = &drives[drive_id];
+    ide_channel_t* ch = ide_channel_of(drive);
+    uint16_t base_port = drive->base_port;
+
+    uint32_t flags = spin_lock_irqsave(&ide_lock);
+    if (ch->active || ch->claimed) {
+        spin_unlock_irqrestore(&ide_lock, flags);
+        return IDE_BUSY;
+    }
+    // One look at the status: this runs under blk_lock with interrupts off, so a
+    // drive that is still busy is retried from a timer rather than waited for
+    ide_select_drive(base_port, drive->drive_num);
+    uint8_t status = inb(base_port + IDE_REG_STATUS);
+    if (!(status & IDE_STATUS_BSY) && (status & IDE_STATUS_ERR)) {
+        ch->not_ready = 0;
+        spin_unlock_irqrestore(&ide_lock, flags);
+        error("[IDE] Error status: 0x%x", status);
+        return -1;
+    }
+    if ((status & (IDE_STATUS_BSY | IDE_STATUS_DRQ)) || !(status & IDE_STATUS_RDY)) {
+        uint32_t now = get_ticks();
+        if (!ch->not_ready) {
+            ch->not_ready = 1;
+            ch->not_ready_since = now;
+        } else if (now - ch->not_ready_since >= timer_ms_to_ticks(IDE_TIMEOUT_MS)) {
+            ch->not_ready = 0;
+            spin_unlock_irqrestore(&ide_lock, flags);
+            error("[IDE] Timeout waiting for ready");
+            return -1;
+        }
+        spin_unlock_irqrestore(&ide_lock, flags);
+        timer_mod(&ch->retry, IDE_RETRY_MS);
+        return IDE_BUSY;
+    }
+    ch->not_ready = 0;
+    if (ide_build_prdt(ch, req) != 0) {
+        spin_unlock_irqrestore(&ide_lock, flags);
+        return -1;
+    }
+
+    uint8_t direction = req->write ? 0 : IDE_BM_CMD_READ;
+    outb(ch->bmide + IDE_BM_REG_COMMAND, direction);
+    outl(ch->bmide + IDE_BM_REG_PRDT, ch->prdt_phys);
+    outb(ch->bmide + IDE_BM_REG_STATUS,
+         inb(ch->bmide + IDE_BM_REG_STATUS) | IDE_BM_STATUS_IRQ | IDE_BM_STATUS_ERR);
+
+    bool lba48 = ide_needs_lba48(drive, req->sector, count);
+    ide_issue(drive, req->sector, count, lba48,
+              req->write ? (lba48 ? IDE_CMD_WRITE_DMA_EXT : IDE_CMD_WRITE_DMA)
+                         : (lba48 ? IDE_CMD_READ_DMA_EXT : IDE_CMD_READ_DMA));
+    outb(ch->bmide + IDE_BM_REG_COMMAND, direction | IDE_BM_CMD_START);
+    ch->active = req;
+    ch->started = get_ticks();
+    spin_unlock_irqrestore(&ide_lock, flags);
+
+    timer_mod(&ch->timeout, IDE_DMA_TIMEOUT_MS);
+    return 0;
+}
+
+// Find the PCI IDE function and hand each legacy channel its BMIDE block
+static void ide_setup_bus_master() {
+    pci_device_t* dev = pci_find_device_by_class(PCI_CLASS_MASS_STORAGE, PCI_SUBCLASS_STORAGE_IDE);
+    if (!dev || !(dev->prog_if & PCI_PROG_IF_IDE_BUS_MASTER) || !(dev->bar[4] & 1)) {
+        debug("[IDE] No bus-master IDE controller; using PIO");
+        return;
+    }
+    uint16_t bmide = (uint16_t)(dev->bar[4] & 0xFFFC);
+    uint16_t command = pci_read_config_word(dev->bus, dev->device, dev->function, PCI_COMMAND);
+    pci_write_config_word(dev->bus, dev->device, dev->function, PCI_COMMAND,
+                          command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+    for (int c = 0; c < 2; c++) {
+        ide_channel_t* ch = &channels[c];
+        if (vmm_virt_to_phys((uint32_t)ch->prdt, &ch->prdt_phys) != 0) return;
+        ch->bmide = bmide + c * 8;
+    }
+    success("[IDE] Bus-master DMA at I/O 0x%x (PCI %02x:%02x.%x)", bmide, dev->bus, dev->device,
+            dev->function);
+}
+
 int ide_identify(uint8_t drive_id, uint16_t* buffer) {
     if (drive_id >= IDE_MAX_DRIVES) {
         return -1;
@@ -110,117 +437,111 @@ int ide_identify(uint8_t drive_id, uint16_t* buffer) {
     return 0;
 }
 
-int ide_read_sectors(uint8_t drive_id, uint32_t lba, uint8_t count, uint16_t* buffer) {
-    if (drive_id >= IDE_MAX_DRIVES || !drives[drive_id].exists) {
-        error("[IDE] Invalid drive: %d", drive_id);
-        return -1;
-    }
-    
-    if (count == 0) {
-        error("[IDE] Invalid sector count: %d", count);
-        return -1;
-    }
-    
-    ide_drive_t* drive = &drives[drive_id];
+// One PIO command of at most ide_max_sectors() sectors. With multiple mode set
+// the drive raises DRQ once per block of `multiple` sectors instead of per sector.
+static int ide_pio_transfer(ide_drive_t* drive, uint32_t lba, uint32_t count, uint16_t* buffer, bool write) {
     uint16_t base_port = drive->base_port;
-    uint8_t drive_num = drive->drive_num;
-    
-    debug("[IDE] Reading %d sectors from LBA %u on drive %d", count, lba, drive_id);
-    
-    ide_select_drive(base_port, drive_num);
+    bool lba48 = ide_needs_lba48(drive, lba, count);
+    uint8_t command;
+    if (drive->multiple) {
+        command = write ? (lba48 ? IDE_CMD_WRITE_MULTIPLE_EXT : IDE_CMD_WRITE_MULTIPLE)
+                        : (lba48 ? IDE_CMD_READ_MULTIPLE_EXT : IDE_CMD_READ_MULTIPLE);
+    } else {
+        command = write ? (lba48 ? IDE_CMD_WRITE_SECTORS_EXT : IDE_CMD_WRITE_SECTORS)
+                        : (lba48 ? IDE_CMD_READ_SECTORS_EXT : IDE_CMD_READ_SECTORS);
+    }
+
+    ide_select_drive(base_port, drive->drive_num);
     
     if (ide_wait_ready(base_port, false) != 0) {
         return -1;
     }
-    
-    // Set up LBA addressing
-    outb(base_port + IDE_REG_FEATURES, 0x00);
-    outb(base_port + IDE_REG_SECTOR_COUNT, count);
-    outb(base_port + IDE_REG_LBA_LOW, lba & 0xFF);
-    outb(base_port + IDE_REG_LBA_MID, (lba >> 8) & 0xFF);
-    outb(base_port + IDE_REG_LBA_HIGH, (lba >> 16) & 0xFF);
-    
-    // Set drive and upper LBA bits (LBA mode)
-    uint8_t drive_select = 0xE0 | ((drive_num & 1) << 4) | ((lba >> 24) & 0x0F);
-    outb(base_port + IDE_REG_DRIVE, drive_select);
-    
-    // Send READ SECTORS command
-    outb(base_port + IDE_REG_COMMAND, IDE_CMD_READ_SECTORS);
-    
-    // Read each sector
-    for (int sector = 0; sector < count; sector++) {
+
+    ide_issue(drive, lba, count, lba48, command);
+
+    uint32_t block = drive->multiple ? drive->multiple : 1;
+    for (uint32_t sector = 0; sector < count; sector += block) {
         if (ide_wait_drq(base_port, false) != 0) {
-            error("[IDE] Failed to read sector %d", sector);
+            error("[IDE] Failed to get DRQ for %s sector %u", write ? "write" : "read", sector);
             return -1;
         }
-        
-        // Read 256 words (512 bytes) per sector
-        for (int i = 0; i < 256; i++) {
-            buffer[sector * 256 + i] = inw(base_port + IDE_REG_DATA);
+
+        uint32_t words = (count - sector < block ? count - sector : block) * 256;
+        uint16_t* data = buffer + sector * 256;
+        if (write) {
+            for (uint32_t i = 0; i < words; i++) {
+                outw(base_port + IDE_REG_DATA, data[i]);
+            }
+        } else {
+            for (uint32_t i = 0; i < words; i++) {
+                data[i] = inw(base_port + IDE_REG_DATA);
+            }
         }
     }
-    
-    success("[IDE] Successfully read %d sectors", count);
+
+    if (write && ide_wait_ready(base_port, false) != 0) {
+        return -1;
+    }
     return 0;
 }
 
-int ide_write_sectors(uint8_t drive_id, uint32_t lba, uint8_t count, uint16_t* buffer) {
+// Synchronous transfers use PIO and own the channel for their duration. Large
+// counts go out as the fewest commands the drive accepts.
+static int ide_pio_request(uint8_t drive_id, uint32_t lba, uint32_t count, uint16_t* buffer, bool write) {
     if (drive_id >= IDE_MAX_DRIVES || !drives[drive_id].exists) {
         error("[IDE] Invalid drive: %d", drive_id);
         return -1;
     }
-
     if (count == 0) {
-        error("[IDE] Invalid sector count: %d", count);
+        error("[IDE] Invalid sector count: %u", count);
         return -1;
     }
 
     ide_drive_t* drive = &drives[drive_id];
-    uint16_t base_port = drive->base_port;
-    uint8_t drive_num = drive->drive_num;
-
-    debug("[IDE] Writing %d sectors to LBA %u on drive %d", count, lba, drive_id);
-
-    ide_select_drive(base_port, drive_num);
-
-    if (ide_wait_ready(base_port, false) != 0) {
-        return -1;
+    debug("[IDE] %s %u sectors at LBA %u on drive %d", write ? "Writing" : "Reading", count, lba,
+          drive_id);
+    ide_channel_t* ch = ide_channel_of(drive);
+    ide_claim_channel(ch);
+    int result = 0;
+    uint32_t max = ide_max_sectors(drive);
+    while (count > 0 && result == 0) {
+        uint32_t chunk = count < max ? count : max;
+        result = ide_pio_transfer(drive, lba, chunk, buffer, write);
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * 256;
     }
-
-    outb(base_port + IDE_REG_FEATURES, 0x00);
-    outb(base_port + IDE_REG_SECTOR_COUNT, count);
-    outb(base_port + IDE_REG_LBA_LOW, lba & 0xFF);
-    outb(base_port + IDE_REG_LBA_MID, (lba >> 8) & 0xFF);
-    outb(base_port + IDE_REG_LBA_HIGH, (lba >> 16) & 0xFF);
-
-    uint8_t drive_select = 0xE0 | ((drive_num & 1) << 4) | ((lba >> 24) & 0x0F);
-    outb(base_port + IDE_REG_DRIVE, drive_select);
-
-    outb(base_port + IDE_REG_COMMAND, IDE_CMD_WRITE_SECTORS);
-
-    for (int sector = 0; sector < count; sector++) {
-        if (ide_wait_drq(base_port, false) != 0) {
-            error("[IDE] Failed to get DRQ for write sector %d", sector);
-            return -1;
-        }
-
-        for (int i = 0; i < 256; i++) {
-            outw(base_port + IDE_REG_DATA, buffer[sector * 256 + i]);
-        }
+    ide_release_channel(ch);
+    if (result == 0) {
+        success("[IDE] Successfully %s sectors", write ? "wrote" : "read");
     }
+    return result;
+}
 
-    if (ide_wait_ready(base_port, false) != 0) {
-        return -1;
-    }
+int ide_read_sectors(uint8_t drive_id, uint32_t lba, uint32_t count, uint16_t* buffer) {
+    return ide_pio_request(drive_id, lba, count, buffer, false);
+}
 
-    success("[IDE] Successfully wrote %d sectors", count);
-    return 0;
+int ide_write_sectors(uint8_t drive_id, uint32_t lba, uint32_t count, uint16_t* buffer) {
+    return ide_pio_request(drive_id, lba, count, buffer, true);
+}
+
+// Let READ/WRITE MULTIPLE move up to `sectors` per DRQ block
+static uint8_t ide_set_multiple(ide_drive_t* drive, uint8_t sectors) {
+    if (sectors < 2) return 0;
+    ide_select_drive(drive->base_port, drive->drive_num);
+    if (ide_wait_ready(drive->base_port, true) != 0) return 0;
+    outb(drive->base_port + IDE_REG_SECTOR_COUNT, sectors);
+    outb(drive->base_port + IDE_REG_COMMAND, IDE_CMD_SET_MULTIPLE);
+    ide_delay(drive->base_port);
+    return ide_wait_ready(drive->base_port, true) == 0 ? sectors : 0;
 }
 
 static int ide_detect_drive(uint16_t base_port, uint8_t drive_num) {
     uint16_t identify_buffer[256];
     
     ide_drive_t temp_drive;
+    memset(&temp_drive, 0, sizeof(temp_drive));
     temp_drive.base_port = base_port;
     temp_drive.drive_num = drive_num;
     
@@ -233,13 +554,26 @@ static int ide_detect_drive(uint16_t base_port, uint8_t drive_num) {
         drives[drive_count].cylinders = identify_buffer[1];
         drives[drive_count].heads = identify_buffer[3];
         drives[drive_count].sectors_per_track = identify_buffer[6];
+        // Word 49 bit 8: DMA supported
+        drives[drive_count].dma = (identify_buffer[49] & 0x0100) && ide_channel_of(&drives[drive_count])->bmide;
         
         // Calculate total sectors (LBA mode)
         drives[drive_count].sectors = *((uint32_t*)&identify_buffer[60]);
+        // Word 83 bit 10: 48-bit addressing; words 100-103 hold the 48-bit capacity
+        if (identify_buffer[83] & 0x0400) {
+            drives[drive_count].lba48 = 1;
+            bool huge = identify_buffer[102] || identify_buffer[103];
+            drives[drive_count].sectors = huge ? 0xFFFFFFFFu
+                : ((uint32_t)identify_buffer[101] << 16) | identify_buffer[100];
+        }
+        // Word 47 low byte: most sectors per READ/WRITE MULTIPLE block
+        drives[drive_count].multiple = ide_set_multiple(&drives[drive_count], identify_buffer[47] & 0xFF);
         
-        success("[IDE] Drive %d detected: %u sectors (%u MB)", 
+        success("[IDE] Drive %d detected: %u sectors (%u MB, %s%s, multiple %u)", 
                drive_count, drives[drive_count].sectors,
-               (drives[drive_count].sectors * 512) / (1024 * 1024));
+               drives[drive_count].sectors / 2048,
+               drives[drive_count].dma ? "DMA" : "PIO",
+               drives[drive_count].lba48 ? ", LBA48" : "", drives[drive_count].multiple);
         
         drive_count++;
         return 1;
@@ -254,6 +588,19 @@ int ide_init(void) {
     
     drive_count = 0;
     memset(drives, 0, sizeof(drives));
+    memset(channels, 0, sizeof(channels));
+    channels[0].base_port = IDE_PRIMARY_BASE;
+    channels[0].ctrl_port = IDE_PRIMARY_CTRL;
+    channels[1].base_port = IDE_SECONDARY_BASE;
+    channels[1].ctrl_port = IDE_SECONDARY_CTRL;
+    for (int c = 0; c < 2; c++) {
+        channels[c].prdt = ide_prdt[c];
+        wait_queue_init(&channels[c].wait, c == 0 ? "ide0" : "ide1");
+        timer_init(&channels[c].timeout, ide_dma_timeout, &channels[c]);
+        timer_init(&channels[c].retry, ide_retry, &channels[c]);
+        outb(channels[c].ctrl_port, 0x00); // Clear nIEN so drives raise INTRQ
+    }
+    ide_setup_bus_master();
     
     // Detect drives on primary IDE controller
     debug("[IDE] Scanning primary IDE controller (0x1F0)");
@@ -265,6 +612,12 @@ int ide_init(void) {
     ide_detect_drive(IDE_SECONDARY_BASE, IDE_DRIVE_MASTER);
     ide_detect_drive(IDE_SECONDARY_BASE, IDE_DRIVE_SLAVE);
     
+    // DMA completion is interrupt driven; PIO commands just get their INTRQ cleared
+    register_interrupt_handler(32 + IDE_PRIMARY_IRQ, ide_primary_irq);
+    register_interrupt_handler(32 + IDE_SECONDARY_IRQ, ide_secondary_irq);
+    pic_unmask_irq(IDE_PRIMARY_IRQ);
+    pic_unmask_irq(IDE_SECONDARY_IRQ);
+
     success("[IDE] Found %d drives", drive_count);
     return drive_count;
 }
@@ -275,3 +628,9 @@ ide_drive_t* ide_get_drive(uint8_t drive_id) {
     }
     return &drives[drive_id];
 }
+
+int ide_set_dma(int enabled) {
+    int old = ide_dma_enabled;
+    ide_dma_enabled = enabled ? 1 : 0;
+    return old;
+}
@@ -9,7 +9,8 @@ static IDTDescriptor idt_desc;
 extern "C" void load_idt(uint32_t);
 
 extern "C" void* isr_stub_table[32];
-extern "C" void* irq_stub_table[16];
+extern "C" void* irq_stub_table[32];
+extern "C" void irq_spurious();
 
 void init_idt() {
     idt_desc.limit = (sizeof(IDTEntry) * IDT_ENTRIES) - 1;
@@ -26,14 +27,20 @@ void init_idt() {
         idt_set_gate(i, (uint32_t)isr_stub_table[i], 0x08, 0x8E);  // Interrupt Gate
     }
 
-    // Set IRQs (32-47) to their respective handlers
-    for (uint8_t i = 32; i < 48; i++) {
+    // Set IRQs (32-47 legacy PIC, 48-63 local APIC) to their respective handlers
+    for (uint8_t i = 32; i < 64; i++) {
         idt_set_gate(i, (uint32_t)irq_stub_table[i - 32], 0x08, 0x8E);  // Interrupt Gate
     }
+    idt_set_gate(0xFF, (uint32_t)irq_spurious, 0x08, 0x8E);
     // Load IDT
     load_idt((uint32_t)&idt_desc);
 }
 
+// Load the shared IDT on the calling CPU (application processors)
+void idt_load() {
+    load_idt((uint32_t)&idt_desc);
+}
+
 void idt_set_gate(uint8_t num, uint32_t offset, uint16_t selector, uint8_t flags) {
     idt[num].offset_low = offset & 0xFFFF;
     idt[num].offset_high = (offset >> 16) & 0xFFFF;
@@ -46,7 +53,7 @@ void idt_set_gate(uint8_t num, uint32_t offset, uint16_t selector, uint8_t flags
 extern "C" void _syscall_handler();
 
 void init_syscall_handler() {
-    // Set IDT entry for syscall interrupt (0x80)
-    idt_set_gate(0x80, (uint32_t)_syscall_handler, 0x08, 0x8E);
+    // Set IDT entry for syscall interrupt (0x80); DPL 3 so ring-3 code may raise it
+    idt_set_gate(0x80, (uint32_t)_syscall_handler, 0x08, 0xEE);
 }
 
@@ -0,0 +1,145 @@
+#include "kernel/ioapic.h"
+#include "kernel/acpi.h"
+#include "kernel/lapic.h"
+#include "kernel/pic.h"
+#include "kernel/paging.h"
+#include "kernel/debug.h"
+
+#define IOAPIC_REG_SELECT   0x00
+#define IOAPIC_REG_WINDOW   0x10
+
+#define IOAPIC_ID           0x00
+#define IOAPIC_VERSION      0x01
+#define IOAPIC_REDIRECTION  0x10
+
+#define IOAPIC_POLARITY_LOW 0x2000
+#define IOAPIC_TRIGGER_LEVEL 0x8000
+#define IOAPIC_MASKED       0x10000
+
+#define ISA_IRQ_COUNT 16
+#define ISA_IRQ_CASCADE 2
+
+typedef struct {
+    volatile uint32_t* base;
+    uint32_t gsi_base;
+    uint32_t entries;
+} ioapic_t;
+
+static ioapic_t ioapics[ACPI_MAX_IOAPICS];
+static int ioapic_count = 0;
+static bool ioapic_active = false;
+
+// Where each ISA IRQ ended up, and the redirection flags it needs
+static uint32_t isa_gsi[ISA_IRQ_COUNT];
+static uint32_t isa_flags[ISA_IRQ_COUNT];
+
+static uint32_t ioapic_read(const ioapic_t* io, uint32_t reg) {
+    io->base[IOAPIC_REG_SELECT / 4] = reg;
+    return io->base[IOAPIC_REG_WINDOW / 4];
+}
+
+static void ioapic_write(const ioapic_t* io, uint32_t reg, uint32_t value) {
+    io->base[IOAPIC_REG_SELECT / 4] = reg;
+    io->base[IOAPIC_REG_WINDOW / 4] = value;
+}
+
+static ioapic_t* ioapic_for_gsi(uint32_t gsi) {
+    for (int i = 0; i < ioapic_count; ++i) {
+        if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].entries) {
+            return &ioapics[i];
+        }
+    }
+    return nullptr;
+}
+
+// Program one redirection entry for fixed, physical-mode delivery to `apic_id`
+static void ioapic_set_entry(uint32_t gsi, uint8_t vector, uint32_t flags, uint8_t apic_id) {
+    ioapic_t* io = ioapic_for_gsi(gsi);
+    if (!io) return;
+    uint32_t pin = gsi - io->gsi_base;
+    ioapic_write(io, IOAPIC_REDIRECTION + pin * 2 + 1, (uint32_t)apic_id << 24);
+    ioapic_write(io, IOAPIC_REDIRECTION + pin * 2, vector | flags);
+}
+
+static void ioapic_set_masked(uint32_t gsi, bool masked) {
+    ioapic_t* io = ioapic_for_gsi(gsi);
+    if (!io) return;
+    uint32_t reg = IOAPIC_REDIRECTION + (gsi - io->gsi_base) * 2;
+    uint32_t low = ioapic_read(io, reg);
+    low = masked ? (low | IOAPIC_MASKED) : (low & ~IOAPIC_MASKED);
+    ioapic_write(io, reg, low);
+}
+
+// ISA lines are edge-triggered and active-high unless the MADT overrides them
+static void resolve_isa_irq(const acpi_madt_info_t* info, uint8_t irq) {
+    isa_gsi[irq] = irq;
+    isa_flags[irq] = 0;
+    for (int i = 0; i < info->override_count; ++i) {
+        const acpi_irq_override_t& ov = info->overrides[i];
+        if (ov.source_irq != irq) continue;
+        isa_gsi[irq] = ov.gsi;
+        if ((ov.flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_POLARITY_LOW) {
+            isa_flags[irq] |= IOAPIC_POLARITY_LOW;
+        }
+        if ((ov.flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_TRIGGER_LEVEL) {
+            isa_flags[irq] |= IOAPIC_TRIGGER_LEVEL;
+        }
+        break;
+    }
+}
+
+bool ioapic_init() {
+#ifdef PIC_ONLY
+    debug("[IOAPIC] Disabled at build time; using the 8259");
+    return false;
+#else
+    const acpi_madt_info_t* info = acpi_get_madt_info();
+    if (!info || info->ioapic_count == 0 || !lapic_available()) {
+        debug("[IOAPIC] Not available; using the 8259");
+        return false;
+    }
+
+    ioapic_count = 0;
+    for (int i = 0; i < info->ioapic_count; ++i) {
+        const acpi_ioapic_t& desc = info->ioapics[i];
+        vmm_map_range(desc.address, desc.address, PAGE_SIZE, 1);
+        ioapic_t& io = ioapics[ioapic_count++];
+        io.base = (volatile uint32_t*)desc.address;
+        io.gsi_base = desc.gsi_base;
+        io.entries = ((ioapic_read(&io, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+        for (uint32_t pin = 0; pin < io.entries; ++pin) {
+            ioapic_write(&io, IOAPIC_REDIRECTION + pin * 2, IOAPIC_MASKED);
+        }
+    }
+
+    // Take over every line the 8259 currently lets through, then silence it
+    uint16_t pic_mask = pic_get_mask();
+    uint8_t bsp = lapic_id();
+    for (uint8_t irq = 0; irq < ISA_IRQ_COUNT; ++irq) {
+        if (irq == ISA_IRQ_CASCADE) continue;
+        resolve_isa_irq(info, irq);
+        bool masked = (pic_mask & (1u << irq)) != 0;
+        ioapic_set_entry(isa_gsi[irq], (uint8_t)(32 + irq), isa_flags[irq] | (masked ? IOAPIC_MASKED : 0), bsp);
+    }
+    pic_disable();
+    ioapic_active = true;
+
+    success("[IOAPIC] %d IOAPIC(s), %u pins at GSI %u; 8259 masked", ioapic_count, ioapics[0].entries,
+            ioapics[0].gsi_base);
+    return true;
+#endif
+}
+
+bool ioapic_enabled() {
+    return ioapic_active;
+}
+
+void ioapic_unmask_irq(uint8_t irq) {
+    if (!ioapic_active || irq >= ISA_IRQ_COUNT || irq == ISA_IRQ_CASCADE) return;
+    ioapic_set_masked(isa_gsi[irq], false);
+}
+
+void ioapic_mask_irq(uint8_t irq) {
+    if (!ioapic_active || irq >= ISA_IRQ_COUNT || irq == ISA_IRQ_CASCADE) return;
+    ioapic_set_masked(isa_gsi[irq], true);
+}
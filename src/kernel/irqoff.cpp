@@ -0,0 +1,103 @@
+#include "kernel/irqoff.h"
+#include "kernel/smp.h"
+#include "kernel/tsc.h"
+#include "kernel/ktime.h"
+#include "kernel/serial.h"
+#include <string.h>
+
+typedef struct {
+    uint64_t cycles;
+    uint32_t begin_eip;
+    uint32_t end_eip;
+    int cpu;
+} irqoff_window_t;
+
+typedef struct {
+    int open;
+    uint32_t begin_eip;
+    uint64_t start;
+} irqoff_cpu_t;
+
+// Sorted longest first; guarded by a bare flag since spinlocks call into the tracer
+static irqoff_window_t irqoff_top[IRQOFF_TOP_N];
+static uint32_t irqoff_windows = 0;
+static volatile uint32_t irqoff_busy = 0;
+
+#ifdef IRQOFF_TRACE
+static irqoff_cpu_t irqoff_cpus[MAX_CPUS];
+
+void irqoff_trace_begin(uint32_t eip) {
+    irqoff_cpu_t* state = &irqoff_cpus[smp_current_cpu()];
+    if (state->open) return;
+    state->open = 1;
+    state->begin_eip = eip;
+    state->start = rdtsc();
+}
+
+void irqoff_trace_end(uint32_t eip) {
+    uint64_t now = rdtsc();
+    int cpu = smp_current_cpu();
+    irqoff_cpu_t* state = &irqoff_cpus[cpu];
+    if (!state->open) return;
+    state->open = 0;
+    uint64_t cycles = now - state->start;
+    // Racy pre-check: most windows are too short to make the table
+    if (cycles <= irqoff_top[IRQOFF_TOP_N - 1].cycles) {
+        __atomic_add_fetch(&irqoff_windows, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    while (__sync_lock_test_and_set(&irqoff_busy, 1)) {
+        asm volatile("pause");
+    }
+    irqoff_windows++;
+    int slot = IRQOFF_TOP_N - 1;
+    if (cycles > irqoff_top[slot].cycles) {
+        while (slot > 0 && irqoff_top[slot - 1].cycles < cycles) {
+            irqoff_top[slot] = irqoff_top[slot - 1];
+            slot--;
+        }
+        irqoff_top[slot].cycles = cycles;
+        irqoff_top[slot].begin_eip = state->begin_eip;
+        irqoff_top[slot].end_eip = eip;
+        irqoff_top[slot].cpu = cpu;
+    }
+    __sync_lock_release(&irqoff_busy);
+}
+#endif
+
+void irqoff_trace_reset(void) {
+    while (__sync_lock_test_and_set(&irqoff_busy, 1)) {
+        asm volatile("pause");
+    }
+    memset(irqoff_top, 0, sizeof(irqoff_top));
+    irqoff_windows = 0;
+    __sync_lock_release(&irqoff_busy);
+}
+
+int irqoff_trace_dump(void) {
+#ifndef IRQOFF_TRACE
+    serial_printf("[IRQOFF] Tracer not built in (EXTRA_CFLAGS=-DIRQOFF_TRACE)\n");
+    return 0;
+#else
+    irqoff_window_t copy[IRQOFF_TOP_N];
+    while (__sync_lock_test_and_set(&irqoff_busy, 1)) {
+        asm volatile("pause");
+    }
+    memcpy(copy, irqoff_top, sizeof(copy));
+    uint32_t windows = irqoff_windows;
+    __sync_lock_release(&irqoff_busy);
+
+    serial_printf("[IRQOFF] %u windows traced; longest interrupts-off sections:\n", windows);
+    serial_printf("[IRQOFF] RANK CPU CYCLES       US       DISABLED-AT ENABLED-AT\n");
+    int written = 0;
+    for (int i = 0; i < IRQOFF_TOP_N && copy[i].cycles; ++i) {
+        serial_printf("[IRQOFF] %-4d %-3d %-12u %-8u 0x%08x  0x%08x\n", i + 1, copy[i].cpu,
+                      copy[i].cycles > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)copy[i].cycles,
+                      (uint32_t)(ktime_cycles_to_ns(copy[i].cycles) / 1000),
+                      copy[i].begin_eip, copy[i].end_eip);
+        written++;
+    }
+    return written;
+#endif
+}
@@ -0,0 +1,90 @@
+#include "kernel/irqstat.h"
+#include "kernel/lapic.h"
+#include "kernel/smp.h"
+#include "kernel/ktime.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t histogram[IRQSTAT_BUCKETS];
+} irqstat_vector_t;
+
+// Per CPU so recording needs neither locks nor atomics; readers sum the rows
+static irqstat_vector_t irqstats[MAX_CPUS][IRQSTAT_VECTORS];
+
+static const char* vector_name(uint32_t vector) {
+    switch (vector) {
+        case 13: return "gp-fault";
+        case 14: return "page-fault";
+        case 32: return "timer";
+        case 33: return "keyboard";
+        case 44: return "mouse";
+        case 46: return "ide0";
+        case 47: return "ide1";
+        case LAPIC_TIMER_VECTOR: return "lapic-timer";
+        case LAPIC_RESCHEDULE_VECTOR: return "resched-ipi";
+        default: break;
+    }
+    if (vector < 32) return "exception";
+    if (vector >= MSI_VECTOR_BASE) return "msi";
+    return "irq";
+}
+
+void irqstat_record(uint32_t vector, uint64_t cycles) {
+    if (vector >= IRQSTAT_VECTORS) return;
+    uint32_t c = cycles > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)cycles;
+    int bucket = c ? 31 - __builtin_clz(c) : 0;
+    if (bucket >= IRQSTAT_BUCKETS) bucket = IRQSTAT_BUCKETS - 1;
+
+    // A page-fault handler may sleep and re-enable interrupts; keep the update whole
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
+    irqstat_vector_t* stats = &irqstats[smp_current_cpu()][vector];
+    stats->count++;
+    stats->total_cycles += c;
+    if (c > stats->max_cycles) stats->max_cycles = c;
+    stats->histogram[bucket]++;
+    asm volatile("push %0\n\tpopf" :: "r"(flags) : "memory", "cc");
+}
+
+// Counters updated concurrently on other CPUs may survive a reset by one event
+void irqstat_reset(void) {
+    memset(irqstats, 0, sizeof(irqstats));
+}
+
+void irqstat_dump(void) {
+    int cpus = smp_cpu_count();
+    printf("VEC NAME         COUNT      AVG-CYC  MAX-CYC    AVG-NS   MAX-NS\n");
+    for (uint32_t vector = 0; vector < IRQSTAT_VECTORS; ++vector) {
+        irqstat_vector_t sum;
+        memset(&sum, 0, sizeof(sum));
+        for (int cpu = 0; cpu < cpus; ++cpu) {
+            const irqstat_vector_t* stats = &irqstats[cpu][vector];
+            sum.count += stats->count;
+            sum.total_cycles += stats->total_cycles;
+            if (stats->max_cycles > sum.max_cycles) sum.max_cycles = stats->max_cycles;
+            for (int b = 0; b < IRQSTAT_BUCKETS; ++b) {
+                sum.histogram[b] += stats->histogram[b];
+            }
+        }
+        if (sum.count == 0) continue;
+
+        uint32_t avg = (uint32_t)(sum.total_cycles / sum.count);
+        printf("%-3u %-12s %-10u %-8u %-10u %-8u %u\n", vector, vector_name(vector), sum.count,
+               avg, sum.max_cycles, (uint32_t)ktime_cycles_to_ns(avg),
+               (uint32_t)ktime_cycles_to_ns(sum.max_cycles));
+        // Only the populated range of buckets, as "<2^n:count"
+        int first = 0;
+        int last = IRQSTAT_BUCKETS - 1;
+        while (sum.histogram[first] == 0) first++;
+        while (sum.histogram[last] == 0) last--;
+        printf("    ");
+        for (int b = first; b <= last; ++b) {
+            printf(" <2^%d:%u", b + 1, sum.histogram[b]);
+        }
+        printf("\n");
+    }
+}
@@ -3,31 +3,77 @@
 #include <stdio.h>
 #include <kernel/port_io.h>
 #include <kernel/debug.h>
+#include <kernel/lapic.h>
+#include <kernel/ioapic.h>
+#include <kernel/softirq.h>
+#include <kernel/scheduler.h>
+#include <kernel/tsc.h>
+#include <kernel/irqstat.h>
+#include <kernel/irqoff.h>
+#include <kernel/smp.h>
 
 #define ISR_COUNT 256 // Total number of ISRs
 
 // Array of function pointers to handle interrupts
 static isr_t interrupt_handlers[ISR_COUNT];
 
+// Hardware interrupts currently being handled on each CPU (more than one = nested)
+static volatile int irq_depth[MAX_CPUS];
+
+bool irq_nested(void)
+{
+    return irq_depth[smp_current_cpu()] > 1;
+}
+
+bool irq_in_progress(void)
+{
+    return irq_depth[smp_current_cpu()] > 0;
+}
+
 // Registers a custom ISR handler for a given interrupt
 void register_interrupt_handler(uint8_t n, isr_t handler)
 {
     interrupt_handlers[n] = handler;
 }
 
+// A fault in ring 3 only takes down the offending process; returns for kernel faults
+void isr_kill_user_process(registers_t *regs)
+{
+    if ((regs->cs & 3) != 3)
+    {
+        return;
+    }
+    Process* proc = scheduler_current_process();
+    if (proc)
+    {
+        error("[ISR] Killing user process pid=%d (%s) after exception %d",
+              proc->pid, proc->name ? proc->name : "?", regs->int_no);
+        kill_process(proc);
+        scheduler_exit_current_and_switch(regs);
+    }
+}
+
 // ISR Handler (for CPU exceptions)
 extern "C" void isr_handler(registers_t *regs)
 {
+    // Exception handlers return only if they resolved the fault (e.g. demand paging)
+    if(interrupt_handlers[regs->int_no]) {
+        isr_t handler = interrupt_handlers[regs->int_no];
+        uint32_t vector = regs->int_no;
+        IRQOFF_BEGIN();
+        uint64_t start = rdtsc();
+        handler(regs);
+        irqstat_record(vector, rdtsc() - start);
+        IRQOFF_END();
+        return;
+    }
+
     // Print the interrupt code (exception number)
     error("ISR Exception: Interrupt %d, Error Code: %d", regs->int_no, regs->err_code);
     printf("  EIP=0x%x EAX=0x%x EBX=0x%x ECX=0x%x EDX=0x%x\n", regs->eip, regs->eax, regs->ebx, regs->ecx, regs->edx);
     printf("  ESP=0x%x EBP=0x%x ESI=0x%x EDI=0x%x EFLAGS=0x%x\n", regs->esp, regs->ebp, regs->esi, regs->edi, regs->eflags);
 
-    // Handle critical exceptions like page faults (Interrupt 14)
-    if(interrupt_handlers[regs->int_no]) {
-        isr_t handler = interrupt_handlers[regs->int_no];
-        handler(regs);
-    }
+    isr_kill_user_process(regs);
 
     // Halt if it's a critical CPU exception
     if (regs->int_no < 32)
@@ -39,25 +85,64 @@ extern "C" void isr_handler(registers_t *regs)
 // IRQ Handler (for hardware interrupts)
 extern "C" void irq_handler(registers_t *regs)
 {
-    // Send an EOI (end of interrupt) signal to the PICs
-    // (debug code for irq_nb removed)
-    uint32_t irq_nb = regs->int_no - 32;
-    (void)irq_nb; // debug disabled
+    IRQOFF_BEGIN();
+    int cpu = smp_current_cpu();
+    irq_depth[cpu]++;
 
-    if (regs->int_no >= 40)
+    // Acknowledge exactly once, here; handlers must not EOI themselves.
+    // LAPIC, MSI and IOAPIC-routed sources take a single MMIO store; the
+    // 8259 fallback needs one or two port writes.
+    uint64_t entry = rdtsc();
+    bool apic = regs->int_no >= LAPIC_TIMER_VECTOR || ioapic_enabled();
+    if (apic)
     {
-        // Send reset signal to slave PIC
-        outb(0xA0, 0x20);
+        lapic_eoi();
     }
-    if (regs->int_no >= 32)
+    else
     {
-        // Send reset signal to master PIC
-        outb(0x20, 0x20);
+        pic_send_eoi((uint8_t)(regs->int_no - 32));
     }
+    uint64_t start = rdtsc();
 
     if (interrupt_handlers[regs->int_no])
     {
         isr_t handler = interrupt_handlers[regs->int_no];
+        // Under the APIC the handler runs with interrupts on and the task priority
+        // raised to its own class: only higher classes (LAPIC timer, IPIs and MSI
+        // over the legacy lines) can preempt it, and never the same vector. The
+        // 8259 has no such filter, so its handlers keep interrupts off.
+        bool nest = apic && lapic_available();
+        uint32_t saved_tpr = 0;
+        if (nest)
+        {
+            saved_tpr = lapic_get_tpr();
+            lapic_set_tpr(regs->int_no & 0xF0);
+            IRQOFF_END();
+            asm volatile("sti" ::: "memory");
+        }
         handler(regs);
+        if (nest)
+        {
+            asm volatile("cli" ::: "memory");
+            IRQOFF_BEGIN();
+            lapic_set_tpr(saved_tpr);
+        }
+    }
+    uint64_t handler_cycles = rdtsc() - start;
+    irqstat_record(regs->int_no, handler_cycles);
+    softirq_note_hardirq(regs->int_no, start - entry, handler_cycles);
+
+    // A nested interrupt leaves softirqs and rescheduling to the one it interrupted
+    if (--irq_depth[cpu] > 0)
+    {
+        IRQOFF_END();
+        return;
     }
+
+    // Bottom halves raised by the handler run now, with interrupts re-enabled
+    softirq_run_pending();
+    // Honour a reschedule that a nested tick deferred while softirqs were running
+    scheduler_handle_reschedule(regs);
+    // The stub's iret re-enables interrupts a few instructions later
+    IRQOFF_END();
 }
@@ -405,6 +405,123 @@ irq15:
     pushl $47               # IRQs start at 32 in IDT
     jmp irq_common_stub
 
+.global irq16
+irq16:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $48               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq17
+irq17:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $49               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq18
+irq18:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $50               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq19
+irq19:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $51               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq20
+irq20:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $52               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq21
+irq21:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $53               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq22
+irq22:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $54               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq23
+irq23:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $55               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq24
+irq24:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $56               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq25
+irq25:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $57               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq26
+irq26:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $58               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq27
+irq27:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $59               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq28
+irq28:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $60               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq29
+irq29:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $61               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq30
+irq30:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $62               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+.global irq31
+irq31:
+    cli
+    pushl $0                # Push dummy error code
+    pushl $63               # Local APIC vectors follow the PIC range
+    jmp irq_common_stub
+
+# Spurious local APIC interrupt: no EOI, no handler
+.global irq_spurious
+irq_spurious:
+    iret
+
 .section .data
 .global isr_stub_table
 isr_stub_table:
@@ -459,33 +576,87 @@ irq_stub_table:
     .long irq13
     .long irq14
     .long irq15
+    .long irq16
+    .long irq17
+    .long irq18
+    .long irq19
+    .long irq20
+    .long irq21
+    .long irq22
+    .long irq23
+    .long irq24
+    .long irq25
+    .long irq26
+    .long irq27
+    .long irq28
+    .long irq29
+    .long irq30
+    .long irq31
 
 # Trampoline used by scheduler to finalize a context switch
+# EDX = pointer to the next CPUContext
+# ECX = pointer to the previous process's on_cpu field (0 if none); it is set
+#       to -1 once we are off that stack so another CPU may pick the process up
 .global switch_to_trampoline
-.extern g_next_context
 switch_to_trampoline:
     cli
-    # EDX = pointer to CPUContext
-    mov g_next_context, %edx
-    # Load and set EFLAGS first
-    mov 36(%edx), %eax
-    push %eax
-    popf
-    # Switch stacks
+    # A frame that left ring 3 may have returned here with user data segments
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    testl $3, 40(%edx)      # CS: ring-3 contexts resume through iret
+    jnz 2f
+    # Switch stacks first; nothing below touches the previous stack
     mov 4(%edx), %esp
+    test %ecx, %ecx
+    jz 1f
+    movl $-1, (%ecx)
+1:
+    # Next EIP and EFLAGS go on the new stack for ret/popf
+    push 0(%edx)            # EIP
+    push 36(%edx)           # EFLAGS
     mov 8(%edx), %ebp
-    # Restore general-purpose registers (order chosen to avoid clobbering pointer)
     mov 12(%edx), %eax      # EAX
     mov 16(%edx), %ebx      # EBX
     mov 20(%edx), %ecx      # ECX
-    # Push next EIP onto new stack and finally restore remaining regs
-    push 0(%edx)            # EIP
-    mov 24(%edx), %edx      # EDX
-    mov g_next_context, %esi
-    mov 28(%esi), %esi      # ESI
-    mov g_next_context, %edi
-    mov 32(%edi), %edi      # EDI
-    sti
+    mov 28(%edx), %esi      # ESI
+    mov 32(%edx), %edi      # EDI
+    mov 24(%edx), %edx      # EDX (last, it holds the context pointer)
+    popf
     ret
 
-
+2:
+    # Ring-3 context: build an inter-privilege iret frame at the top of the
+    # process's kernel stack, which is unused while it runs in user mode
+    mov 44(%edx), %esp
+    test %ecx, %ecx
+    jz 3f
+    movl $-1, (%ecx)
+3:
+    pushl $0x23             # User SS
+    push 4(%edx)            # User ESP
+    push 36(%edx)           # EFLAGS
+    push 40(%edx)           # User CS
+    push 0(%edx)            # EIP
+    movw $0x23, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    mov 8(%edx), %ebp
+    mov 12(%edx), %eax      # EAX
+    mov 16(%edx), %ebx      # EBX
+    mov 20(%edx), %ecx      # ECX
+    mov 28(%edx), %esi      # ESI
+    mov 32(%edx), %edi      # EDI
+    mov 24(%edx), %edx      # EDX (last, it holds the context pointer)
+    iret
+
+# Idle loop for CPUs without runnable work
+.global scheduler_idle_loop
+scheduler_idle_loop:
+    sti
+    hlt
+    jmp scheduler_idle_loop
@@ -19,15 +19,24 @@
 #include "kernel/tests/memtest.h"
 #include "kernel/tests/pagetest.h"
 #include "kernel/tests/heaptest.h"
+#include "kernel/tests/elevatortest.h"
+#include "kernel/tests/bcachetest.h"
+#include "kernel/tests/timertest.h"
+#include "kernel/tests/ktimetest.h"
+#include "kernel/tests/selftest.h"
 #include "kernel/scheduler.h"
 #include <kernel/process.h>
 #include "kernel/blockdev.h"
+#include "kernel/ahci.h"
 #include "kernel/fat32.h"
 #include "kernel/multiboot.h"
 #include "kernel/framebuffer.h"
 #include "kernel/gui.h"
 #include "kernel/terminal_windows.h"
 #include "kernel/pci.h"
+#include "kernel/smp.h"
+#include "kernel/workqueue.h"
+#include "kernel/ktime.h"
 
 #include "utils.h"
 #include <stdio.h> // Changed back to just stdio.h since include path is set in Makefile
@@ -122,12 +131,12 @@ extern "C"
 		// Set up heap
 		init_heap();
 
+		// Initialize PCI subsystem (before IDE, which looks up its bus-master block)
+		pci_init();
+
 		// Initialize block devices (IDE, etc.)
 		blockdev_init();
 
-		// Initialize PCI subsystem
-		pci_init();
-
 		// Initialize FAT32 support
 		fat32_init();
 
@@ -196,13 +205,27 @@ extern "C"
 			success("Memory multiple allocations test passed!");
 		}
 		paging_test();
+		elevator_test();
+		bcache_test();
+		timer_wheel_test();
 #endif
 
 		// Create some built-in files or directories.
 		fs_get_root();
 		keyboard_install();
+		// Calibrate the TSC against PIT channel 2 for ktime_get_ns()
+		ktime_init();
+#ifdef TEST
+		ktime_test();
+#endif
 		// Initialize the PIT timer to 1000 Hz
 		init_timer(1000);
+		// Start application processors; they idle until the scheduler runs
+		smp_init();
+		// MSI targets the local APIC, which smp_init() brought up
+		ahci_enable_interrupts();
+		// Kernel worker processes for deferred (bottom-half) work
+		workqueue_init();
 
 		if (framebuffer_ready)
 		{
@@ -215,6 +238,10 @@ extern "C"
 			// In text mode, just start the shell process.
 			k_start_process("shell", shell_entry, 0, 8192);
 		}
+#ifdef TEST
+		// Tests that need a process context
+		k_start_process("selftest", selftest_entry, 0, 8192);
+#endif
 
 		__asm__ volatile("sti");
 
@@ -9,6 +9,7 @@
 #include "kernel/syscalls.h"
 #include "kernel/scheduler.h"
 #include "kernel/process.h"
+#include "kernel/softirq.h"
 
 #ifdef DEBUG
 #define KB_DEBUG(...) debug(__VA_ARGS__)
@@ -19,6 +20,12 @@
 static bool shift_pressed = false;
 static bool caps_lock_active = false;
 
+// Raw scancodes captured by the IRQ handler, decoded in SOFTIRQ_KEYBOARD
+#define SCANCODE_RING_SIZE 64
+static volatile uint8_t scancode_ring[SCANCODE_RING_SIZE];
+static volatile uint32_t scancode_head = 0; // Written by the IRQ handler
+static volatile uint32_t scancode_tail = 0; // Written by the softirq
+
 static void dispatch_keyboard_event(keyboard_event event, const char* source) {
     char c = kb_to_ascii(event);
     if (!event.release && c) {
@@ -31,7 +38,6 @@ static void dispatch_keyboard_event(keyboard_event event, const char* source) {
         io_event.type = EVENT_KEYBOARD;
         io_event.data.keyboard = event;
         push_io_event(target, io_event);
-        scheduler_resume_processes_for_event(HookType::SIGNAL, (uint64_t)target->pid);
         return;
     }
 
@@ -41,7 +47,6 @@ static void dispatch_keyboard_event(keyboard_event event, const char* source) {
         io_event.type = EVENT_KEYBOARD;
         io_event.data.keyboard = event;
         push_io_event(target, io_event);
-        scheduler_resume_processes_for_event(HookType::SIGNAL, (uint64_t)target->pid);
         return;
     }
 
@@ -51,7 +56,6 @@ static void dispatch_keyboard_event(keyboard_event event, const char* source) {
         io_event.type = EVENT_KEYBOARD;
         io_event.data.keyboard = event;
         push_io_event(target, io_event);
-        scheduler_resume_processes_for_event(HookType::SIGNAL, (uint64_t)target->pid);
         return;
     }
 
@@ -81,9 +85,8 @@ char kb_to_ascii(keyboard_event event) {
     return ascii;
 }
 
-keyboard_event read_keyboard() {
+static keyboard_event decode_scancode(uint8_t scancode) {
     static bool extended = false;
-    uint8_t scancode = inb(KBD_DATA_PORT);
 
     keyboard_event event = {
         .scancode   = scancode,
@@ -137,18 +140,34 @@ keyboard_event read_keyboard() {
     return event;
 }
 
+keyboard_event read_keyboard() {
+    return decode_scancode(inb(KBD_DATA_PORT));
+}
+
 void keyboard_callback(registers_t *regs) {
     (void)regs; // Unused
-    keyboard_event event = read_keyboard();
-    dispatch_keyboard_event(event, "irq");
-    pic_send_eoi(1);
+    uint8_t scancode = inb(KBD_DATA_PORT);
+    uint32_t head = scancode_head;
+    if (head - scancode_tail < SCANCODE_RING_SIZE) {
+        scancode_ring[head % SCANCODE_RING_SIZE] = scancode;
+        __atomic_store_n(&scancode_head, head + 1, __ATOMIC_RELEASE);
+    }
+    softirq_raise(SOFTIRQ_KEYBOARD);
+}
+
+// Decode and deliver everything the IRQ handler captured
+static void keyboard_softirq() {
+    while (scancode_tail != __atomic_load_n(&scancode_head, __ATOMIC_ACQUIRE)) {
+        uint8_t scancode = scancode_ring[scancode_tail % SCANCODE_RING_SIZE];
+        __atomic_store_n(&scancode_tail, scancode_tail + 1, __ATOMIC_RELEASE);
+        dispatch_keyboard_event(decode_scancode(scancode), "irq");
+    }
 }
 
 void keyboard_service_pending() {
     while (inb(KBD_STATUS_PORT) & 0x01) {
         keyboard_event event = read_keyboard();
         dispatch_keyboard_event(event, "poll");
-        pic_send_eoi(1);
     }
 }
 
@@ -190,6 +209,7 @@ void keyboard_enable() {
 void keyboard_install() {
     debug("[KB] Enabling keyboard...");
     keyboard_enable();
+    softirq_register(SOFTIRQ_KEYBOARD, keyboard_softirq);
     register_interrupt_handler(33, keyboard_callback);
     pic_unmask_irq(1);
 }
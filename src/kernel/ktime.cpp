@@ -0,0 +1,92 @@
+#include "kernel/ktime.h"
+#include "kernel/tsc.h"
+#include "kernel/timer.h"
+#include "kernel/debug.h"
+
+#define TSC_CALIBRATION_US   10000
+#define TSC_CALIBRATION_RUNS 3
+
+static uint32_t tsc_freq_khz = 0;
+static bool tsc_is_invariant = false;
+static uint64_t tsc_boot = 0;
+// ns = (cycles * tsc_mult) >> tsc_shift, evaluated in 32x32-bit pieces
+static uint32_t tsc_mult = 0;
+static uint32_t tsc_shift = 0;
+
+static void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    uint32_t a = leaf, b, c = 0, d;
+    asm volatile("cpuid" : "+a"(a), "=b"(b), "+c"(c), "=d"(d));
+    *eax = a;
+    *ebx = b;
+    *ecx = c;
+    *edx = d;
+}
+
+void ktime_init() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1u << 4))) {
+        error("[KTIME] No TSC; ktime falls back to timer ticks");
+        return;
+    }
+    cpuid(0x80000000u, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000007u) {
+        cpuid(0x80000007u, &eax, &ebx, &ecx, &edx);
+        tsc_is_invariant = (edx & (1u << 8)) != 0;
+    }
+
+    // An SMI or emulator exit only ever stretches a run, so keep the shortest
+    uint64_t best = ~0ull;
+    for (int run = 0; run < TSC_CALIBRATION_RUNS; ++run) {
+        uint64_t start = rdtsc();
+        timer_busy_wait_us(TSC_CALIBRATION_US);
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best) best = cycles;
+    }
+    uint64_t khz = best / (TSC_CALIBRATION_US / 1000);
+    if (khz == 0 || khz > 0xFFFFFFFFull) {
+        error("[KTIME] TSC calibration failed; ktime falls back to timer ticks");
+        return;
+    }
+
+    // Largest shift (up to 32) whose multiplier still fits in 32 bits
+    uint32_t shift = 32;
+    uint64_t mult = (1000000ull << shift) / khz;
+    while (mult > 0xFFFFFFFFull) {
+        shift--;
+        mult = (1000000ull << shift) / khz;
+    }
+    tsc_mult = (uint32_t)mult;
+    tsc_shift = shift;
+    tsc_boot = rdtsc();
+    tsc_freq_khz = (uint32_t)khz;
+
+    // A TSC that changes rate with P-states still beats 1 ms ticks; just say so
+    success("[KTIME] TSC runs at %u.%03u MHz (%s)", tsc_freq_khz / 1000, tsc_freq_khz % 1000,
+            tsc_is_invariant ? "invariant" : "not invariant");
+}
+
+uint64_t ktime_cycles_to_ns(uint64_t cycles) {
+    if (tsc_freq_khz == 0) return 0;
+    uint32_t hi = (uint32_t)(cycles >> 32);
+    uint32_t lo = (uint32_t)cycles;
+    uint64_t ns = ((uint64_t)lo * tsc_mult) >> tsc_shift;
+    ns += ((uint64_t)hi * tsc_mult) << (32 - tsc_shift);
+    return ns;
+}
+
+uint64_t ktime_get_ns() {
+    if (tsc_freq_khz == 0) {
+        // timer_ms_to_ticks(1000) is the tick rate
+        return (uint64_t)get_ticks() * 1000000000ull / timer_ms_to_ticks(1000);
+    }
+    return ktime_cycles_to_ns(rdtsc() - tsc_boot);
+}
+
+uint32_t tsc_khz() {
+    return tsc_freq_khz;
+}
+
+bool tsc_invariant() {
+    return tsc_is_invariant;
+}
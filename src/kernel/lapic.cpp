@@ -0,0 +1,134 @@
+#include "kernel/lapic.h"
+#include "kernel/paging.h"
+#include "kernel/timer.h"
+#include "kernel/debug.h"
+
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_VERSION       0x030
+#define LAPIC_REG_TPR           0x080
+#define LAPIC_REG_EOI           0x0B0
+#define LAPIC_REG_SVR           0x0F0
+#define LAPIC_REG_ESR           0x280
+#define LAPIC_REG_ICR_LOW       0x300
+#define LAPIC_REG_ICR_HIGH      0x310
+#define LAPIC_REG_LVT_TIMER     0x320
+#define LAPIC_REG_LVT_ERROR     0x370
+#define LAPIC_REG_TIMER_INITIAL 0x380
+#define LAPIC_REG_TIMER_CURRENT 0x390
+#define LAPIC_REG_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_TIMER_PERIODIC    0x20000
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define LAPIC_ICR_INIT          0x500
+#define LAPIC_ICR_STARTUP       0x600
+#define LAPIC_ICR_DELIVERY_PENDING 0x1000
+#define LAPIC_ICR_ASSERT        0x4000
+#define LAPIC_ICR_LEVEL         0x8000
+
+#define LAPIC_CALIBRATION_US    10000
+
+static volatile uint32_t* lapic_base = nullptr;
+static uint32_t lapic_ticks_per_second = 0;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic_base[reg / 4] = value;
+    (void)lapic_base[LAPIC_REG_ID / 4]; // Read back to post the write
+}
+
+bool lapic_init(uint32_t physical_address) {
+    if (physical_address == 0) return false;
+    vmm_map_range(physical_address, physical_address, PAGE_SIZE, 1);
+    lapic_base = (volatile uint32_t*)physical_address;
+    lapic_enable();
+    success("[LAPIC] BSP APIC id=%u version=0x%x", lapic_id(), lapic_read(LAPIC_REG_VERSION) & 0xFF);
+    return true;
+}
+
+void lapic_enable() {
+    if (!lapic_base) return;
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_write(LAPIC_REG_ESR, 0);
+}
+
+bool lapic_available() {
+    return lapic_base != nullptr;
+}
+
+uint8_t lapic_id() {
+    if (!lapic_base) return 0;
+    return (uint8_t)(lapic_read(LAPIC_REG_ID) >> 24);
+}
+
+void lapic_eoi() {
+    if (lapic_base) {
+        lapic_base[LAPIC_REG_EOI / 4] = 0;
+    }
+}
+
+uint32_t lapic_get_tpr() {
+    return lapic_base ? lapic_read(LAPIC_REG_TPR) & 0xFF : 0;
+}
+
+void lapic_set_tpr(uint32_t priority) {
+    if (lapic_base) {
+        lapic_write(LAPIC_REG_TPR, priority & 0xFF);
+    }
+}
+
+static void lapic_wait_icr_idle() {
+    int timeout = 100000;
+    while ((lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_DELIVERY_PENDING) && timeout-- > 0) {
+        asm volatile("pause");
+    }
+}
+
+static void lapic_send_icr(uint8_t apic_id, uint32_t low) {
+    if (!lapic_base) return;
+    lapic_wait_icr_idle();
+    lapic_write(LAPIC_REG_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, low);
+    lapic_wait_icr_idle();
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector) {
+    lapic_send_icr(apic_id, vector);
+}
+
+void lapic_send_init(uint8_t apic_id) {
+    lapic_send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL | LAPIC_ICR_ASSERT);
+    timer_busy_wait_us(200);
+    lapic_send_icr(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint8_t page) {
+    lapic_send_icr(apic_id, LAPIC_ICR_STARTUP | page);
+}
+
+void lapic_timer_calibrate() {
+    if (!lapic_base) return;
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0xFFFFFFFFu);
+    timer_busy_wait_us(LAPIC_CALIBRATION_US);
+    uint32_t elapsed = 0xFFFFFFFFu - lapic_read(LAPIC_REG_TIMER_CURRENT);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+    lapic_ticks_per_second = elapsed * (1000000 / LAPIC_CALIBRATION_US);
+    debug("[LAPIC] Timer runs at %u ticks/s (divide by 16)", lapic_ticks_per_second);
+}
+
+void lapic_timer_start(uint32_t frequency) {
+    if (!lapic_base || lapic_ticks_per_second == 0 || frequency == 0) return;
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, lapic_ticks_per_second / frequency);
+}
@@ -0,0 +1,201 @@
+#include "kernel/spinlock.h"
+#include "kernel/mutex.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include <sys/syscall.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOCKSTAT_MAX_NAMES 32
+
+// Registry of named locks, guarded by a bare flag so it never recurses into itself
+static lock_stats_t* registry_head = NULL;
+static volatile uint32_t registry_busy = 0;
+
+static void registry_acquire() {
+    while (__sync_lock_test_and_set(&registry_busy, 1)) {
+        asm volatile("pause");
+    }
+}
+
+static void registry_release() {
+    __sync_lock_release(&registry_busy);
+}
+
+void lock_stats_register(lock_stats_t* stats) {
+    registry_acquire();
+    if (!stats->registered) {
+        stats->next = registry_head;
+        registry_head = stats;
+        stats->registered = 1;
+    }
+    registry_release();
+}
+
+void lock_stats_unregister(lock_stats_t* stats) {
+    registry_acquire();
+    lock_stats_t** link = &registry_head;
+    while (*link) {
+        if (*link == stats) {
+            *link = stats->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    stats->registered = 0;
+    stats->next = NULL;
+    registry_release();
+}
+
+void lock_stats_reset(void) {
+    registry_acquire();
+    for (lock_stats_t* stats = registry_head; stats; stats = stats->next) {
+        stats->acquisitions = 0;
+        stats->contentions = 0;
+        stats->wait_cycles = 0;
+        stats->hold_cycles = 0;
+        stats->max_hold_cycles = 0;
+    }
+    registry_release();
+}
+
+static uint32_t clamp_cycles(uint64_t cycles) {
+    return cycles > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)cycles;
+}
+
+// Locks sharing a name (e.g. every process's event lock) are reported as one row
+void lock_stats_dump(void) {
+#ifndef LOCK_STATS
+    printf("Lock statistics are only collected in DEBUG builds\n");
+#endif
+    struct {
+        const char* name;
+        int instances;
+        uint32_t acquisitions;
+        uint32_t contentions;
+        uint64_t wait_cycles;
+        uint64_t hold_cycles;
+        uint64_t max_hold_cycles;
+    } rows[LOCKSTAT_MAX_NAMES];
+    int row_count = 0;
+
+    registry_acquire();
+    for (lock_stats_t* stats = registry_head; stats; stats = stats->next) {
+        int row = 0;
+        while (row < row_count && strcmp(rows[row].name, stats->name) != 0) {
+            ++row;
+        }
+        if (row == row_count) {
+            if (row_count == LOCKSTAT_MAX_NAMES) continue;
+            memset(&rows[row], 0, sizeof(rows[row]));
+            rows[row].name = stats->name;
+            ++row_count;
+        }
+        rows[row].instances++;
+        rows[row].acquisitions += stats->acquisitions;
+        rows[row].contentions += stats->contentions;
+        rows[row].wait_cycles += stats->wait_cycles;
+        rows[row].hold_cycles += stats->hold_cycles;
+        if (stats->max_hold_cycles > rows[row].max_hold_cycles) {
+            rows[row].max_hold_cycles = stats->max_hold_cycles;
+        }
+    }
+    registry_release();
+
+    printf("LOCK             N   ACQUIRED  CONTENDED  AVG-WAIT  AVG-HOLD  MAX-HOLD (cycles)\n");
+    for (int row = 0; row < row_count; ++row) {
+        uint32_t acquisitions = rows[row].acquisitions;
+        uint32_t contentions = rows[row].contentions;
+        printf("%-16s %-3d %-9u %-10u %-9u %-9u %u\n", rows[row].name, rows[row].instances,
+               acquisitions, contentions,
+               contentions ? clamp_cycles(rows[row].wait_cycles / contentions) : 0,
+               acquisitions ? clamp_cycles(rows[row].hold_cycles / acquisitions) : 0,
+               clamp_cycles(rows[row].max_hold_cycles));
+    }
+}
+
+void mutex_init(mutex_t* mutex, const char* name) {
+    spin_lock_init(&mutex->wait_lock, NULL);
+    mutex->locked = 0;
+    mutex->owner_pid = -1;
+    mutex->waiters = 0;
+    lock_stats_t init = LOCK_STATS_INIT(name);
+    mutex->stats = init;
+}
+
+// Sleeping needs a process to park and interrupts enabled so someone can wake it
+static Process* mutex_sleeper() {
+    uint32_t flags;
+    asm volatile("pushf\n\tpop %0" : "=r"(flags));
+    if (!(flags & 0x200)) return NULL;
+    return scheduler_current_process();
+}
+
+static inline uint64_t mutex_key(mutex_t* mutex) {
+    return (uint64_t)(uintptr_t)mutex;
+}
+
+void mutex_lock(mutex_t* mutex) {
+#ifdef LOCK_STATS
+    uint64_t start = lock_clock();
+#else
+    uint64_t start = 0;
+#endif
+    int contended = 0;
+    for (;;) {
+        Process* proc = mutex_sleeper();
+        uint32_t flags = spin_lock_irqsave(&mutex->wait_lock);
+        if (!mutex->locked) {
+            mutex->locked = 1;
+            mutex->owner_pid = proc ? proc->pid : -1;
+            if (contended) mutex->waiters--;
+            spin_unlock_irqrestore(&mutex->wait_lock, flags);
+            if (proc && contended) {
+                // Drop a hook left behind when the yield found nothing else to run
+                process_remove_hook(proc, HookType::CUSTOM, mutex_key(mutex));
+            }
+            break;
+        }
+        if (!contended) {
+            contended = 1;
+            mutex->waiters++;
+        }
+        // Register the hook before dropping wait_lock so an unlock cannot slip between
+        if (proc && !process_has_matching_hook(proc, HookType::CUSTOM, mutex_key(mutex))) {
+            process_register_hook(proc, HookType::CUSTOM, mutex_key(mutex));
+        }
+        spin_unlock_irqrestore(&mutex->wait_lock, flags);
+        if (proc) {
+            syscall_yield();
+        } else {
+            asm volatile("pause");
+        }
+    }
+    lock_stats_acquired(&mutex->stats, start, contended);
+}
+
+int mutex_trylock(mutex_t* mutex) {
+    uint32_t flags = spin_lock_irqsave(&mutex->wait_lock);
+    if (mutex->locked) {
+        spin_unlock_irqrestore(&mutex->wait_lock, flags);
+        return 0;
+    }
+    Process* proc = scheduler_current_process();
+    mutex->locked = 1;
+    mutex->owner_pid = proc ? proc->pid : -1;
+    spin_unlock_irqrestore(&mutex->wait_lock, flags);
+    lock_stats_acquired(&mutex->stats, 0, 0);
+    return 1;
+}
+
+void mutex_unlock(mutex_t* mutex) {
+    lock_stats_released(&mutex->stats);
+    uint32_t flags = spin_lock_irqsave(&mutex->wait_lock);
+    mutex->locked = 0;
+    mutex->owner_pid = -1;
+    int wake = mutex->waiters > 0;
+    spin_unlock_irqrestore(&mutex->wait_lock, flags);
+    if (wake) {
+        scheduler_resume_processes_for_event(HookType::CUSTOM, mutex_key(mutex));
+    }
+}
@@ -11,6 +11,9 @@
 #include <kernel/process.h>
 #include <kernel/shell.h>
 #include <kernel/hooks.h>
+#include <kernel/softirq.h>
+#include <kernel/workqueue.h>
+#include <kernel/timer.h>
 
 #include <stddef.h>
 
@@ -53,28 +56,37 @@ uint8_t g_packet_index = 0;
 uint8_t g_bytes_expected = 3;
 bool g_has_scroll_wheel = false;
 
+// Complete packets captured in IRQ context, decoded by SOFTIRQ_MOUSE
+constexpr uint32_t PACKET_RING_SIZE = 32;
+uint8_t g_packet_ring[PACKET_RING_SIZE][MAX_PACKET_SIZE] = {};
+volatile uint32_t g_packet_head = 0;
+volatile uint32_t g_packet_tail = 0;
+
+// Decoded events waiting for the GUI/dispatch work item (softirq -> kworker)
+constexpr uint32_t EVENT_RING_SIZE = 64;
+MouseEvent g_event_ring[EVENT_RING_SIZE] = {};
+volatile uint32_t g_event_head = 0;
+volatile uint32_t g_event_tail = 0;
+
+// The controller normally answers within microseconds; after a short hot
+// spin, poll once per millisecond (a PIT busy-wait before the timer runs)
+constexpr int MOUSE_SPIN_POLLS = 1000;
+constexpr int MOUSE_TIMEOUT_MS = 100;
+
 void mouse_wait(uint8_t type)
 {
     // type 0 = wait for data, type 1 = wait for input clear
-    int timeout = 100000;
-    if (type == 0)
+    for (int poll = 0; poll < MOUSE_SPIN_POLLS + MOUSE_TIMEOUT_MS; ++poll)
     {
-        while (timeout-- > 0)
+        if (poll >= MOUSE_SPIN_POLLS)
         {
-            if (inb(PS2_CMD_PORT) & PS2_STATUS_OUTPUT_FULL)
-            {
-                return;
-            }
+            timer_sleep_ms(1);
         }
-    }
-    else
-    {
-        while (timeout-- > 0)
+        uint8_t status = inb(PS2_CMD_PORT);
+        if (type == 0 ? (status & PS2_STATUS_OUTPUT_FULL) != 0
+                      : (status & PS2_STATUS_INPUT_FULL) == 0)
         {
-            if ((inb(PS2_CMD_PORT) & PS2_STATUS_INPUT_FULL) == 0)
-            {
-                return;
-            }
+            return;
         }
     }
 }
@@ -187,22 +199,20 @@ void dispatch_event(MouseEvent &event)
     io_event.type = EVENT_MOUSE;
     io_event.data.mouse = event;
     push_io_event(target, io_event);
-    scheduler_resume_processes_for_event(HookType::SIGNAL, static_cast<uint64_t>(target->pid));
 }
 
-void handle_packet()
+void handle_packet(const uint8_t *packet)
 {
-    const uint8_t status = g_packet[0];
+    const uint8_t status = packet[0];
     const bool x_overflow = (status & 0x40u) != 0;
     const bool y_overflow = (status & 0x80u) != 0;
     if (x_overflow || y_overflow)
     {
-        g_packet_index = 0;
         return;
     }
 
-    const int16_t dx = static_cast<int8_t>(g_packet[1]);
-    const int16_t dy_raw = static_cast<int8_t>(g_packet[2]);
+    const int16_t dx = static_cast<int8_t>(packet[1]);
+    const int16_t dy_raw = static_cast<int8_t>(packet[2]);
     const int16_t dy = static_cast<int16_t>(-dy_raw);
 
     const int32_t previous_x = g_mouse_x;
@@ -221,7 +231,7 @@ void handle_packet()
     int8_t scroll_y = 0;
     if (g_has_scroll_wheel && g_bytes_expected == 4)
     {
-        scroll_y = static_cast<int8_t>(g_packet[3]);
+        scroll_y = static_cast<int8_t>(packet[3]);
     }
 
     g_state.x = g_mouse_x;
@@ -240,8 +250,43 @@ void handle_packet()
     event.changed = changed;
     event.target_pid = -1;
 
-    gui::handle_mouse_event(event, terminal);
-    dispatch_event(event);
+    // Window hit-testing may change the foreground, so the GUI must see the
+    // event before it is dispatched; both happen in the work item, in order
+    uint32_t head = g_event_head;
+    if (head - g_event_tail >= EVENT_RING_SIZE)
+    {
+        return;
+    }
+    g_event_ring[head % EVENT_RING_SIZE] = event;
+    __atomic_store_n(&g_event_head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Redraw the cursor/windows and deliver events to processes from a kworker
+void mouse_event_work(void *arg)
+{
+    (void)arg;
+    while (g_event_tail != __atomic_load_n(&g_event_head, __ATOMIC_ACQUIRE))
+    {
+        MouseEvent event = g_event_ring[g_event_tail % EVENT_RING_SIZE];
+        __atomic_store_n(&g_event_tail, g_event_tail + 1, __ATOMIC_RELEASE);
+        gui::handle_mouse_event(event, terminal);
+        dispatch_event(event);
+    }
+}
+
+work_t g_mouse_event_work = WORK_INIT(mouse_event_work, nullptr);
+
+void mouse_softirq()
+{
+    while (g_packet_tail != __atomic_load_n(&g_packet_head, __ATOMIC_ACQUIRE))
+    {
+        handle_packet(g_packet_ring[g_packet_tail % PACKET_RING_SIZE]);
+        __atomic_store_n(&g_packet_tail, g_packet_tail + 1, __ATOMIC_RELEASE);
+    }
+    if (g_event_tail != g_event_head)
+    {
+        queue_work(&g_mouse_event_work);
+    }
 }
 
 void mouse_callback(registers_t *regs)
@@ -267,14 +312,21 @@ void mouse_callback(registers_t *regs)
         g_packet[g_packet_index++] = data;
         if (g_packet_index >= g_bytes_expected)
         {
-            handle_packet();
+            uint32_t head = g_packet_head;
+            if (head - g_packet_tail < PACKET_RING_SIZE)
+            {
+                for (size_t i = 0; i < MAX_PACKET_SIZE; ++i)
+                {
+                    g_packet_ring[head % PACKET_RING_SIZE][i] = g_packet[i];
+                }
+                __atomic_store_n(&g_packet_head, head + 1, __ATOMIC_RELEASE);
+                softirq_raise(SOFTIRQ_MOUSE);
+            }
             g_packet_index = 0;
         }
 
         status = inb(PS2_CMD_PORT);
     }
-
-    pic_send_eoi(IRQ_MOUSE);
 }
 
 bool try_enable_scroll_wheel()
@@ -342,6 +394,7 @@ void mouse_initialize()
         error("[MOUSE] Failed to enable streaming");
     }
 
+    softirq_register(SOFTIRQ_MOUSE, mouse_softirq);
     register_interrupt_handler(ISR_MOUSE, mouse_callback);
     pic_unmask_irq(IRQ_MOUSE);
 
@@ -4,6 +4,13 @@
 #include "kernel/isr.h"
 #include "kernel/debug.h"
 #include "kernel/memory.h" // For PMM
+#include "kernel/heap.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/spinlock.h"
+#include "kernel/uaccess.h"
+#include "kernel/irqoff.h"
+#include "kernel/softirq.h"
 
 // Define heap boundaries to avoid conflicts with paging
 #define KERNEL_HEAP_START 0x00800000  // Heap starts at 8 MiB
@@ -18,11 +25,197 @@ static uint32_t* kernel_page_tables[IDENTITY_TABLES] = { nullptr };
 
 static constexpr bool VMM_VERBOSE_LOGGING = false;
 
-// Page fault handler
+extern "C" uint8_t __user_text_start[];
+extern "C" uint8_t __user_data_start[];
+extern "C" uint8_t __user_end[];
+
+#define PTE_PRESENT 0x1
+#define PTE_RW      0x2
+#define PTE_USER    0x4
+#define USER_PDE_FIRST (USER_SPACE_START >> 22)
+#define USER_PDE_LAST  (USER_SPACE_END >> 22)
+#define IDENTITY_LIMIT ((uint32_t)IDENTITY_MAP_SIZE_MB << 20)
+
+// The PMM itself is not SMP-safe; user page-ins may run on any CPU
+static spinlock_t frame_lock = SPINLOCK_INIT("vmm-frames");
+
+static void* alloc_frame()
+{
+    uint32_t flags = spin_lock_irqsave(&frame_lock);
+    void* frame = PhysicalMemoryManager::allocate_frame();
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return frame;
+}
+
+static void free_frame(void* frame)
+{
+    uint32_t flags = spin_lock_irqsave(&frame_lock);
+    PhysicalMemoryManager::free_frame(frame);
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+// Page directories and tables are edited through the identity map
+static void* alloc_table_frame()
+{
+    void* frame = alloc_frame();
+    if (frame && (uint32_t)frame + PAGE_SIZE > IDENTITY_LIMIT)
+    {
+        free_frame(frame);
+        return nullptr;
+    }
+    if (frame)
+    {
+        memset(frame, 0, PAGE_SIZE);
+    }
+    return frame;
+}
+
+static inline uint32_t* current_directory()
+{
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (uint32_t*)(cr3 & 0xFFFFF000);
+}
+
+static vm_area_t* find_area(address_space_t* as, uint32_t addr)
+{
+    for (int i = 0; i < as->area_count; ++i)
+    {
+        if (addr >= as->areas[i].start && addr < as->areas[i].end)
+        {
+            return &as->areas[i];
+        }
+    }
+    return nullptr;
+}
+
+// Populate the page containing `addr` in the current (faulting) address space.
+// The page is mapped writable first so it can be filled through its user address.
+static bool demand_page_in(address_space_t* as, vm_area_t* area, uint32_t addr)
+{
+    uint32_t page = addr & ~(PAGE_SIZE - 1);
+    uint32_t* directory = as->page_directory;
+    uint32_t pd_index = page >> 22;
+    if (!(directory[pd_index] & PTE_PRESENT))
+    {
+        uint32_t* table = (uint32_t*)alloc_table_frame();
+        if (!table)
+        {
+            error("[VMM] No low memory for a page table at 0x%x", page);
+            return false;
+        }
+        directory[pd_index] = (uint32_t)table | PTE_USER | PTE_RW | PTE_PRESENT;
+    }
+    uint32_t* table = (uint32_t*)(directory[pd_index] & 0xFFFFF000);
+    uint32_t pt_index = (page >> 12) & 0x3FF;
+
+    void* frame = alloc_frame();
+    if (!frame)
+    {
+        error("[VMM] Out of memory paging in 0x%x for %s", page, as->name);
+        return false;
+    }
+    table[pt_index] = (uint32_t)frame | PTE_USER | PTE_RW | PTE_PRESENT;
+    asm volatile("invlpg (%0)" :: "r"(page) : "memory");
+    memset((void*)page, 0, PAGE_SIZE);
+
+    if ((area->flags & VM_FILE) && as->has_file)
+    {
+        uint32_t file_end = area->file_vaddr + area->file_size;
+        uint32_t copy_start = page > area->file_vaddr ? page : area->file_vaddr;
+        uint32_t copy_end = page + PAGE_SIZE < file_end ? page + PAGE_SIZE : file_end;
+        if (copy_start < copy_end)
+        {
+            uint32_t offset = area->file_offset + (copy_start - area->file_vaddr);
+            uint32_t length = copy_end - copy_start;
+            if (vfs_seek(&as->file, offset) != VFS_SUCCESS ||
+                vfs_read(&as->file, (void*)copy_start, length) != (int)length)
+            {
+                // Running on with a zeroed page would hide the error; fail the fault
+                error("[VMM] Short read paging in 0x%x for %s", page, as->name);
+                table[pt_index] = 0;
+                asm volatile("invlpg (%0)" :: "r"(page) : "memory");
+                free_frame(frame);
+                return false;
+            }
+        }
+    }
+
+    if (!(area->flags & VM_WRITE))
+    {
+        table[pt_index] = (uint32_t)frame | PTE_USER | PTE_PRESENT;
+        asm volatile("invlpg (%0)" :: "r"(page) : "memory");
+    }
+    as->faults++;
+    as->resident_pages++;
+    return true;
+}
+
+// Returns true if the fault was resolved and the instruction can be retried
+static bool handle_page_fault(uint32_t fault_addr, uint32_t err_code)
+{
+    if (err_code & PTE_PRESENT)
+    {
+        return false; // Protection violation, not a missing page
+    }
+    uint32_t* directory = current_directory();
+    uint32_t pd_index = fault_addr >> 22;
+    if (fault_addr < USER_SPACE_START || fault_addr >= USER_SPACE_END)
+    {
+        // Kernel tables created after this address space was cloned
+        if (directory != kernel_page_directory && (kernel_page_directory[pd_index] & PTE_PRESENT) &&
+            !(directory[pd_index] & PTE_PRESENT))
+        {
+            directory[pd_index] = kernel_page_directory[pd_index] & ~PTE_USER;
+            return true;
+        }
+        return false;
+    }
+    Process* proc = scheduler_current_process();
+    address_space_t* as = proc ? proc->mm : nullptr;
+    if (!as || as->page_directory != directory)
+    {
+        return false;
+    }
+    vm_area_t* area = find_area(as, fault_addr);
+    return area && demand_page_in(as, area, fault_addr);
+}
+
+// Page fault handler; returns only if the fault was resolved
 void page_fault_handler(registers_t *registers) {
     uint32_t fault_addr;
     asm("mov %%cr2, %0" : "=r"(fault_addr));
-    
+
+    // Paging in reads the executable under the VFS, buffer cache and block layer
+    // mutexes, which only spin with interrupts off. A holder preempted on this CPU
+    // would then never run again, so user faults from a context that had
+    // interrupts on are served with them on and may sleep on those mutexes.
+    bool interruptible = (registers->eflags & 0x200) && fault_addr >= USER_SPACE_START &&
+                         fault_addr < USER_SPACE_END && !irq_in_progress() &&
+                         !softirq_in_progress() && scheduler_current_process();
+    if (interruptible)
+    {
+        IRQOFF_END();
+        asm volatile("sti" ::: "memory");
+    }
+    bool resolved = handle_page_fault(fault_addr, registers->err_code);
+    if (interruptible)
+    {
+        asm volatile("cli" ::: "memory");
+        IRQOFF_BEGIN();
+    }
+    if (resolved)
+    {
+        return;
+    }
+    // A kernel copy to or from a bad user address fails the syscall instead
+    uint32_t fixup = (registers->cs & 3) == 0 ? uaccess_fixup(registers->eip) : 0;
+    if (fixup)
+    {
+        registers->eip = fixup;
+        return;
+    }
+
     error("[VMM] Page Fault at 0x%x", fault_addr);
     error("[VMM] Page info: 0x%x", registers->eip);
     error("[VMM] Page fault caused by %s access",
@@ -34,6 +227,7 @@ void page_fault_handler(registers_t *registers) {
     error("[VMM] Page fault caused by %s operation",
            (registers->err_code & 0x8) ? "instruction fetch" : "data access");
 
+    isr_kill_user_process(registers);
     for (;;) asm("hlt");
 }
 
@@ -54,7 +248,9 @@ void vmm_init()
 
         for (uint32_t i = 0; i < 1024; ++i) {
             uint32_t phys_addr = (table_idx * 0x400000) + (i * 0x1000);
-            kernel_page_tables[table_idx][i] = (phys_addr & 0xFFFFF000) | 0x03; // Present + RW
+            // Present + RW, supervisor only: ring 3 reaches kernel pages solely
+            // through the private tables of vmm_create_kernel_user_space
+            kernel_page_tables[table_idx][i] = (phys_addr & 0xFFFFF000) | 0x03;
         }
 
         kernel_page_directory[table_idx] = ((uint32_t)kernel_page_tables[table_idx] & 0xFFFFF000) | 0x03;
@@ -177,3 +373,221 @@ void vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size,
           page_count,
           rw);
 }
+
+address_space_t* vmm_create_address_space(void)
+{
+    address_space_t* as = (address_space_t*)kmalloc(sizeof(address_space_t));
+    if (!as)
+    {
+        return nullptr;
+    }
+    memset(as, 0, sizeof(address_space_t));
+    as->page_directory = (uint32_t*)alloc_table_frame();
+    if (!as->page_directory)
+    {
+        kfree(as);
+        return nullptr;
+    }
+    // Share the kernel's page tables, supervisor-only whatever their entries say,
+    // so a loaded program cannot reach kernel memory; the user range starts out empty
+    for (uint32_t i = 0; i < PDE_ENTRIES; ++i)
+    {
+        if (i < USER_PDE_FIRST || i >= USER_PDE_LAST)
+        {
+            as->page_directory[i] = kernel_page_directory[i] & ~PTE_USER;
+        }
+    }
+    return as;
+}
+
+// Let ring 3 reach the identity-mapped pages of [start, end) with `flags`
+// access. The page tables covering them are replaced by private copies first,
+// so no other address space sees the change.
+static int expose_kernel_range(address_space_t* as, uint32_t start, uint32_t end, uint32_t flags)
+{
+    start &= ~(PAGE_SIZE - 1);
+    end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (start >= end)
+    {
+        return 0;
+    }
+    if (end > IDENTITY_LIMIT || as->area_count >= VM_MAX_AREAS)
+    {
+        return -1;
+    }
+    for (uint32_t page = start; page < end; page += PAGE_SIZE)
+    {
+        uint32_t pd_index = page >> 22;
+        if (!(as->kernel_table_copies & (1u << pd_index)))
+        {
+            uint32_t* copy = (uint32_t*)alloc_table_frame();
+            if (!copy)
+            {
+                return -1;
+            }
+            memcpy(copy, kernel_page_tables[pd_index], PAGE_SIZE);
+            as->page_directory[pd_index] = (uint32_t)copy | PTE_USER | PTE_RW | PTE_PRESENT;
+            as->kernel_table_copies |= 1u << pd_index;
+        }
+        uint32_t* table = (uint32_t*)(as->page_directory[pd_index] & 0xFFFFF000);
+        table[(page >> 12) & 0x3FF] = page | PTE_USER | PTE_PRESENT | ((flags & VM_WRITE) ? PTE_RW : 0);
+    }
+    vm_area_t* area = &as->areas[as->area_count++];
+    memset(area, 0, sizeof(*area));
+    area->start = start;
+    area->end = end;
+    area->flags = flags | VM_KERNEL;
+    return 0;
+}
+
+address_space_t* vmm_create_kernel_user_space(uint32_t stack, uint32_t stack_size)
+{
+    if ((stack | stack_size) & (PAGE_SIZE - 1))
+    {
+        return nullptr;
+    }
+    address_space_t* as = vmm_create_address_space();
+    if (!as)
+    {
+        return nullptr;
+    }
+    if (expose_kernel_range(as, (uint32_t)__user_text_start, (uint32_t)__user_data_start, 0) != 0 ||
+        expose_kernel_range(as, (uint32_t)__user_data_start, (uint32_t)__user_end, VM_WRITE) != 0 ||
+        expose_kernel_range(as, stack, stack + stack_size, VM_WRITE) != 0)
+    {
+        vmm_destroy_address_space(as);
+        return nullptr;
+    }
+    return as;
+}
+
+void vmm_destroy_address_space(address_space_t* as)
+{
+    if (!as)
+    {
+        return;
+    }
+    // Never free the directory we are running on
+    if (current_directory() == as->page_directory)
+    {
+        vmm_switch_address_space(nullptr);
+    }
+    for (uint32_t i = USER_PDE_FIRST; i < USER_PDE_LAST; ++i)
+    {
+        uint32_t pde = as->page_directory[i];
+        if (!(pde & PTE_PRESENT))
+        {
+            continue;
+        }
+        uint32_t* table = (uint32_t*)(pde & 0xFFFFF000);
+        for (uint32_t j = 0; j < PTE_ENTRIES; ++j)
+        {
+            if (table[j] & PTE_PRESENT)
+            {
+                free_frame((void*)(table[j] & 0xFFFFF000));
+            }
+        }
+        free_frame(table);
+    }
+    // Private copies of kernel tables; the frames they map belong to the kernel
+    for (uint32_t i = 0; i < IDENTITY_TABLES; ++i)
+    {
+        if (as->kernel_table_copies & (1u << i))
+        {
+            free_frame((void*)(as->page_directory[i] & 0xFFFFF000));
+        }
+    }
+    free_frame(as->page_directory);
+    if (as->has_file)
+    {
+        vfs_close(&as->file);
+    }
+    debug("[VMM] %s: %u demand faults, %u pages resident at exit", as->name, as->faults, as->resident_pages);
+    kfree(as);
+}
+
+int vmm_add_area(address_space_t* as, uint32_t start, uint32_t end, uint32_t flags,
+                 uint32_t file_vaddr, uint32_t file_offset, uint32_t file_size)
+{
+    start &= ~(PAGE_SIZE - 1);
+    end = (end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (!as || as->area_count >= VM_MAX_AREAS || start >= end ||
+        start < USER_SPACE_START || end > USER_SPACE_END)
+    {
+        return -1;
+    }
+    for (int i = 0; i < as->area_count; ++i)
+    {
+        if (start < as->areas[i].end && as->areas[i].start < end)
+        {
+            return -1;
+        }
+    }
+    vm_area_t* area = &as->areas[as->area_count++];
+    area->start = start;
+    area->end = end;
+    area->flags = flags;
+    area->file_vaddr = file_vaddr;
+    area->file_offset = file_offset;
+    area->file_size = file_size;
+    return 0;
+}
+
+int vmm_prepare_user_range(address_space_t* as, uint32_t addr, uint32_t size, int write)
+{
+    if (!as)
+    {
+        return 0;
+    }
+    uint32_t end = addr + size;
+    if (end < addr || current_directory() != as->page_directory)
+    {
+        return -1;
+    }
+    if (size == 0)
+    {
+        // Nothing is touched, but the pointer must still be one the caller owns
+        return find_area(as, addr) ? 0 : -1;
+    }
+    for (uint32_t page = addr & ~(PAGE_SIZE - 1); page < end; page += PAGE_SIZE)
+    {
+        vm_area_t* area = find_area(as, page < addr ? addr : page);
+        if (!area || (write && !(area->flags & VM_WRITE)))
+        {
+            return -1;
+        }
+        // Touching the page runs the demand fault now rather than mid-copy
+        uint8_t probe;
+        if (copy_from_user(&probe, (const void*)(page < addr ? addr : page), 1) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int vmm_virt_to_phys(uint32_t virtual_addr, uint32_t* physical_addr)
+{
+    uint32_t pde = current_directory()[virtual_addr >> 22];
+    if (!(pde & PTE_PRESENT))
+    {
+        return -1;
+    }
+    uint32_t* table = (uint32_t*)(pde & 0xFFFFF000); // Identity-mapped
+    uint32_t pte = table[(virtual_addr >> 12) & 0x3FF];
+    if (!(pte & PTE_PRESENT))
+    {
+        return -1;
+    }
+    *physical_addr = (pte & 0xFFFFF000) | (virtual_addr & (PAGE_SIZE - 1));
+    return 0;
+}
+
+void vmm_switch_address_space(address_space_t* as)
+{
+    uint32_t* directory = as ? as->page_directory : kernel_page_directory;
+    if (current_directory() != directory)
+    {
+        asm volatile("mov %0, %%cr3" :: "r"(directory) : "memory");
+    }
+}
@@ -1,6 +1,7 @@
 #include <kernel/pci.h>
 #include <kernel/port_io.h>
 #include <kernel/process.h>
+#include <kernel/lapic.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/events.h>
@@ -21,6 +22,9 @@ typedef struct {
 static pci_listener_t pci_listeners[MAX_PCI_LISTENERS];
 static int pci_listener_count = 0;
 
+// MSI vectors are handed out once and never reused
+static uint8_t pci_next_msi_vector = MSI_VECTOR_BASE;
+
 // Read a 32-bit value from PCI configuration space
 uint32_t pci_read_config_dword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
     uint32_t address = (uint32_t)(
@@ -83,6 +87,21 @@ static bool pci_device_exists(uint8_t bus, uint8_t device, uint8_t function) {
     return (vendor_id != 0xFFFF);
 }
 
+uint8_t pci_find_capability(uint8_t bus, uint8_t device, uint8_t function, uint8_t cap_id) {
+    if (!(pci_read_config_word(bus, device, function, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+    uint8_t offset = pci_read_config_byte(bus, device, function, PCI_CAPABILITY_LIST) & 0xFC;
+    // Bound the walk in case a broken device links its list into a loop
+    for (int i = 0; i < 48 && offset >= 0x40; i++) {
+        if (pci_read_config_byte(bus, device, function, offset) == cap_id) {
+            return offset;
+        }
+        offset = pci_read_config_byte(bus, device, function, offset + 1) & 0xFC;
+    }
+    return 0;
+}
+
 // Read device information
 static void pci_read_device_info(pci_device_t* dev, uint8_t bus, uint8_t device, uint8_t function) {
     dev->bus = bus;
@@ -98,6 +117,8 @@ static void pci_read_device_info(pci_device_t* dev, uint8_t bus, uint8_t device,
     dev->header_type = pci_read_config_byte(bus, device, function, PCI_HEADER_TYPE);
     dev->interrupt_line = pci_read_config_byte(bus, device, function, PCI_INTERRUPT_LINE);
     dev->interrupt_pin = pci_read_config_byte(bus, device, function, PCI_INTERRUPT_PIN);
+    dev->msi_cap = pci_find_capability(bus, device, function, PCI_CAP_ID_MSI);
+    dev->msi_vector = 0;
     
     // Read BARs
     for (int i = 0; i < 6; i++) {
@@ -262,6 +283,12 @@ void pci_list_devices(void) {
             }
             printf("\n");
         }
+
+        if (dev->msi_vector) {
+            printf("       MSI: vector %d\n", dev->msi_vector);
+        } else if (dev->msi_cap) {
+            printf("       MSI: capable (cap at 0x%02x)\n", dev->msi_cap);
+        }
     }
     
     printf("----------------------------------------------------------------------\n");
@@ -302,12 +329,50 @@ pci_device_t* pci_get_device(int index) {
     return &pci_devices[index];
 }
 
+int pci_enable_msi(pci_device_t* dev) {
+    if (!dev || !dev->msi_cap || !lapic_available()) {
+        return -1;
+    }
+    if (dev->msi_vector) {
+        return dev->msi_vector;
+    }
+    if (pci_next_msi_vector > MSI_VECTOR_LAST) {
+        printf("PCI: Out of MSI vectors for %02x:%02x.%x\n", dev->bus, dev->device, dev->function);
+        return -1;
+    }
+    uint8_t vector = pci_next_msi_vector++;
+    uint8_t cap = dev->msi_cap;
+    uint16_t flags = pci_read_config_word(dev->bus, dev->device, dev->function, cap + PCI_MSI_FLAGS);
+
+    // Fixed delivery, edge-triggered, physical destination
+    uint32_t address = PCI_MSI_ADDRESS_BASE | ((uint32_t)lapic_id() << 12);
+    pci_write_config_dword(dev->bus, dev->device, dev->function, cap + PCI_MSI_ADDRESS_LO, address);
+    if (flags & PCI_MSI_FLAGS_64BIT) {
+        pci_write_config_dword(dev->bus, dev->device, dev->function, cap + PCI_MSI_ADDRESS_HI, 0);
+        pci_write_config_word(dev->bus, dev->device, dev->function, cap + PCI_MSI_DATA_64, vector);
+    } else {
+        pci_write_config_word(dev->bus, dev->device, dev->function, cap + PCI_MSI_DATA_32, vector);
+    }
+    // One message only, then enable it and stop the legacy pin from firing as well
+    flags = (uint16_t)((flags & ~PCI_MSI_FLAGS_QSIZE) | PCI_MSI_FLAGS_ENABLE);
+    pci_write_config_word(dev->bus, dev->device, dev->function, cap + PCI_MSI_FLAGS, flags);
+    uint16_t command = pci_read_config_word(dev->bus, dev->device, dev->function, PCI_COMMAND);
+    pci_write_config_word(dev->bus, dev->device, dev->function, PCI_COMMAND, command | PCI_COMMAND_INTX_DISABLE);
+
+    dev->msi_vector = vector;
+    return vector;
+}
+
 // Initialize PCI subsystem
 void pci_init(void) {
     printf("PCI: Initializing PCI subsystem...\n");
     pci_listener_count = 0;
     pci_scan_bus();
-    printf("PCI: Found %d device(s)\n", pci_device_count);
+    int msi_capable = 0;
+    for (int i = 0; i < pci_device_count; i++) {
+        if (pci_devices[i].msi_cap) msi_capable++;
+    }
+    printf("PCI: Found %d device(s), %d MSI-capable\n", pci_device_count, msi_capable);
 }
 
 // Register a process to receive PCI events
@@ -2,6 +2,7 @@
 #include "stdio.h"
 #include "kernel/port_io.h"
 #include "kernel/pic.h" // Include the new header file
+#include "kernel/ioapic.h"
 #include <kernel/debug.h>
 
 #define PIC1 0x20
@@ -33,13 +34,13 @@ void pic_remap() {
     outb(PIC2_DATA, a2);io_wait();
 }
 
+// One EOI per interrupt: a second non-specific EOI would retire whichever
+// lower-priority IRQ happens to be in service. No io_wait() is needed after it.
 void pic_send_eoi(uint8_t irq) {
     if (irq >= 8) {
         outb(PIC2_COMMAND, PIC_EOI);
-        io_wait();
     }
     outb(PIC1_COMMAND, PIC_EOI);
-    io_wait();
 }
 
 
@@ -47,6 +48,11 @@ void pic_unmask_irq(uint8_t irq) {
     uint16_t port;
     uint8_t value;
 
+    if (ioapic_enabled()) {
+        ioapic_unmask_irq(irq);
+        return;
+    }
+
     if (irq < 8) {
         port = 0x21; // Master PIC data port
     } else {
@@ -67,6 +73,15 @@ void pic_unmask_irq(uint8_t irq) {
     }
 }
 
+uint16_t pic_get_mask() {
+    return (uint16_t)(inb(PIC1_DATA) | ((uint16_t)inb(PIC2_DATA) << 8));
+}
+
+void pic_disable() {
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
+
 void init_pic() {
     pic_remap();
     success("[PIC] PIC initialized");
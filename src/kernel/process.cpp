@@ -2,23 +2,186 @@
 #include "kernel/scheduler.h"
 #include "kernel/process.h"
 #include "kernel/debug.h"
+#include "kernel/gdt.h"
+#include "kernel/paging.h"
 #include "kernel/terminal_windows.h"
 #include "kernel/vga.h"
+#include "kernel/pci.h"
+#include "kernel/workqueue.h"
+#include <string.h>
 
 extern Terminal terminal;
 
 // Forward declarations for internal helpers
 static inline bool process_is_valid(Process* proc, const char* where);
+static int has_matching_hook_locked(Process* proc, HookType type, uint64_t value);
 
 // Static PID counter
 static int next_pid = 1;
 
+// Process objects are carved out of slabs and recycled through a free list
+#define PROCESS_SLAB_SIZE 8
+#define PID_HASH_SIZE 64
+
+static spinlock_t process_pool_lock = SPINLOCK_INIT("process-pool");
+static Process* process_free_list = NULL;
+static uint32_t process_pool_capacity = 0;
+static uint32_t process_pool_in_use = 0;
+static uint32_t processes_reaped = 0;
+
+static spinlock_t pid_hash_lock = SPINLOCK_INIT("pid-hash");
+static Process* pid_hash[PID_HASH_SIZE];
+
+// Dead processes waiting for the reaper
+static spinlock_t zombie_lock = SPINLOCK_INIT("zombies");
+static Process* zombie_list = NULL;
+static void reap_zombies(void* arg);
+static work_t reap_work = WORK_INIT(reap_zombies, NULL);
+
+static Process* process_alloc() {
+    uint32_t flags = spin_lock_irqsave(&process_pool_lock);
+    if (!process_free_list) {
+        spin_unlock_irqrestore(&process_pool_lock, flags);
+        Process* slab = (Process*)kmalloc(sizeof(Process) * PROCESS_SLAB_SIZE);
+        if (!slab) return NULL;
+        flags = spin_lock_irqsave(&process_pool_lock);
+        for (int i = 0; i < PROCESS_SLAB_SIZE; ++i) {
+            slab[i].magic = 0;
+            slab[i].pool_next = process_free_list;
+            process_free_list = &slab[i];
+        }
+        process_pool_capacity += PROCESS_SLAB_SIZE;
+    }
+    Process* proc = process_free_list;
+    process_free_list = proc->pool_next;
+    process_pool_in_use++;
+    spin_unlock_irqrestore(&process_pool_lock, flags);
+    return proc;
+}
+
+static void process_release(Process* proc) {
+    proc->magic = 0; // Stale pointers now fail process_is_valid
+    uint32_t flags = spin_lock_irqsave(&process_pool_lock);
+    proc->pool_next = process_free_list;
+    process_free_list = proc;
+    process_pool_in_use--;
+    spin_unlock_irqrestore(&process_pool_lock, flags);
+}
+
+void process_pool_stats(uint32_t* in_use, uint32_t* capacity, uint32_t* reaped) {
+    if (in_use) *in_use = process_pool_in_use;
+    if (capacity) *capacity = process_pool_capacity;
+    if (reaped) *reaped = processes_reaped;
+}
+
+static inline uint32_t pid_bucket(int pid) {
+    return (uint32_t)pid % PID_HASH_SIZE;
+}
+
+static void pid_hash_insert(Process* proc) {
+    uint32_t flags = spin_lock_irqsave(&pid_hash_lock);
+    Process** head = &pid_hash[pid_bucket(proc->pid)];
+    proc->hash_next = *head;
+    *head = proc;
+    spin_unlock_irqrestore(&pid_hash_lock, flags);
+}
+
+static void pid_hash_remove(Process* proc) {
+    uint32_t flags = spin_lock_irqsave(&pid_hash_lock);
+    Process** link = &pid_hash[pid_bucket(proc->pid)];
+    while (*link) {
+        if (*link == proc) {
+            *link = proc->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    proc->hash_next = NULL;
+    spin_unlock_irqrestore(&pid_hash_lock, flags);
+}
+
+Process* process_find(int pid) {
+    uint32_t flags = spin_lock_irqsave(&pid_hash_lock);
+    Process* proc = pid_hash[pid_bucket(pid)];
+    while (proc && proc->pid != pid) {
+        proc = proc->hash_next;
+    }
+    spin_unlock_irqrestore(&pid_hash_lock, flags);
+    return proc;
+}
+
+// Give a dead process's stack, object, pid and scheduler slot back
+static void process_free(Process* proc) {
+    pid_hash_remove(proc);
+    pci_unregister_process_listener(proc);
+    lock_stats_unregister(&proc->lock.stats);
+    lock_stats_unregister(&proc->io_wait.lock.stats);
+    if (proc->current_state.stack_base) {
+        kfree(proc->current_state.stack_base);
+    }
+    if (proc->current_state.kernel_stack_base) {
+        kfree(proc->current_state.kernel_stack_base);
+    }
+    process_close_fds(proc);
+    if (proc->mm) {
+        vmm_destroy_address_space(proc->mm);
+    }
+    processes_reaped++;
+    process_release(proc);
+}
+
+// Workqueue handler: free every zombie that no CPU is still running on
+static void reap_zombies(void* arg) {
+    (void)arg;
+    uint32_t flags = spin_lock_irqsave(&zombie_lock);
+    Process* list = zombie_list;
+    zombie_list = NULL;
+    spin_unlock_irqrestore(&zombie_lock, flags);
+
+    Process* pending = NULL;
+    while (list) {
+        Process* proc = list;
+        list = proc->pool_next;
+        if (scheduler_release_dead(proc) == 0) {
+            process_free(proc);
+        } else {
+            proc->pool_next = pending;
+            pending = proc;
+        }
+    }
+    if (!pending) return;
+
+    // Still leaving a CPU's stack: try again on the next pass
+    flags = spin_lock_irqsave(&zombie_lock);
+    while (pending) {
+        Process* proc = pending;
+        pending = proc->pool_next;
+        proc->pool_next = zombie_list;
+        zombie_list = proc;
+    }
+    spin_unlock_irqrestore(&zombie_lock, flags);
+    queue_work(&reap_work);
+}
+
+static void process_queue_reap(Process* proc) {
+    uint32_t flags = spin_lock_irqsave(&zombie_lock);
+    if (proc->reap_queued) {
+        spin_unlock_irqrestore(&zombie_lock, flags);
+        return;
+    }
+    proc->reap_queued = 1;
+    proc->pool_next = zombie_list;
+    zombie_list = proc;
+    spin_unlock_irqrestore(&zombie_lock, flags);
+    queue_work(&reap_work);
+}
+
 int create_process(const char* name, void (*entry)(), int speculative) {
     // This function should allocate and return a new PID
     // Actual process registration in a scheduler is done externally
 
     Process p;
-    p.pid = next_pid++;
+    p.pid = __sync_fetch_and_add(&next_pid, 1);
     p.name = name;
     p.speculative = speculative;
     p.logical_time = 0;
@@ -34,10 +197,12 @@ int create_process(const char* name, void (*entry)(), int speculative) {
 }
 
 void kill_process(Process* proc) {
-    if (process_is_valid(proc, "kill")) {
+    if (process_is_valid(proc, "kill") && proc->alive) {
         // Unregister keyboard handler FIRST
         // This ensures no more input is routed to the dying process
         register_keyboard_handler(proc, nullptr);
+        // A process killed while blocked must not stay linked on a wait queue
+        wait_queue_remove(proc);
         
         // Mark process as dead
         // This prevents any focus events from being queued to it
@@ -48,6 +213,10 @@ void kill_process(Process* proc) {
         
         // Restore foreground (will skip sending events to dead process)
         scheduler_restore_foreground(proc);
+
+        // Get it off whatever CPU runs it, then let the reaper reclaim it
+        scheduler_evict(proc);
+        process_queue_reap(proc);
     }
 }
 
@@ -58,24 +227,6 @@ void register_keyboard_handler(Process* proc, KeyboardHandler handler) {
     proc->keyboard_handler = handler;
 }
 
-static inline uint32_t irq_save() {
-    uint32_t flags;
-    asm volatile("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
-    return flags;
-}
-
-static inline void irq_restore(uint32_t flags) {
-    asm volatile("push %0\n\tpopf" :: "r"(flags) : "memory", "cc");
-}
-
-static inline int normalize_index(int value) {
-    if (value < 0) {
-        int mod = (-value) % MAX_EVENT_QUEUE_SIZE;
-        return (MAX_EVENT_QUEUE_SIZE - mod) % MAX_EVENT_QUEUE_SIZE;
-    }
-    return value % MAX_EVENT_QUEUE_SIZE;
-}
-
 static inline bool process_is_valid(Process* proc, const char* where) {
     if (!proc) {
         error("[process] null process pointer where=%s", where);
@@ -88,152 +239,189 @@ static inline bool process_is_valid(Process* proc, const char* where) {
     return true;
 }
 
-static void reset_event_queue(Process* proc, const char* reason) {
-    if (!proc) return;
-    error("[process] resetting IO queue pid=%d name=%s reason=%s", proc->pid, proc->name ? proc->name : "(null)", reason ? reason : "(unknown)");
-    for (int i = 0; i < MAX_EVENT_QUEUE_SIZE; ++i) {
-        proc->io_events.queue[i] = IOEvent{};
-    }
-    proc->io_events.head = 0;
-    proc->io_events.tail = 0;
-    proc->io_events.count = 0;
-    proc->io_events.guard_front = EVENT_QUEUE_GUARD;
-    proc->io_events.guard_back = EVENT_QUEUE_GUARD;
-}
-
-static bool ensure_event_queue_integrity(Process* proc, const char* where) {
-    if (!process_is_valid(proc, where)) {
-        return false;
-    }
-
+#ifdef DEBUG
+// Debug builds check the guard words and ring indices on every push/pop
+static bool event_queue_valid(Process* proc, const char* where) {
     EventQueue& queue = proc->io_events;
     if (queue.guard_front != EVENT_QUEUE_GUARD || queue.guard_back != EVENT_QUEUE_GUARD) {
         error("[process] queue guard violated pid=%d name=%s front=0x%x back=0x%x where=%s",
               proc->pid, proc->name ? proc->name : "(null)", queue.guard_front, queue.guard_back, where);
-        reset_event_queue(proc, "guard-corruption");
-        return true; // continue with cleared queue
-    }
-
-    int raw_head = queue.head;
-    int raw_tail = queue.tail;
-    int raw_count = queue.count;
-    bool adjusted = false;
-
-    if (raw_head < 0 || raw_head >= MAX_EVENT_QUEUE_SIZE) {
-        error("[process] queue head out of range pid=%d name=%s head=%d where=%s", proc->pid, proc->name ? proc->name : "(null)", raw_head, where);
-        raw_head = normalize_index(raw_head);
-        adjusted = true;
-    }
-
-    if (raw_tail < 0 || raw_tail >= MAX_EVENT_QUEUE_SIZE) {
-        error("[process] queue tail out of range pid=%d name=%s tail=%d where=%s", proc->pid, proc->name ? proc->name : "(null)", raw_tail, where);
-        raw_tail = normalize_index(raw_tail);
-        adjusted = true;
+        return false;
     }
-
-    if (raw_count < 0 || raw_count > MAX_EVENT_QUEUE_SIZE) {
-        error("[process] queue count out of range pid=%d name=%s count=%d where=%s", proc->pid, proc->name ? proc->name : "(null)", raw_count, where);
-        raw_count = 0;
-        adjusted = true;
+    uint32_t used = queue.head - queue.tail;
+    if (used > MAX_EVENT_QUEUE_SIZE) {
+        error("[process] queue indices corrupt pid=%d name=%s head=%u tail=%u where=%s",
+              proc->pid, proc->name ? proc->name : "(null)", queue.head, queue.tail, where);
+        return false;
     }
+    return true;
+}
+#define EVENT_QUEUE_CHECK(proc, where, fail) \
+    do { if (!event_queue_valid((proc), (where))) { fail; } } while (0)
+#else
+#define EVENT_QUEUE_CHECK(proc, where, fail) do { } while (0)
+#endif
+
+// Mouse motion without button or wheel changes can be merged into the previous one
+static inline bool event_coalescable(const IOEvent* event) {
+    return event->type == EVENT_MOUSE && event->data.mouse.changed == 0 &&
+           event->data.mouse.scroll_x == 0 && event->data.mouse.scroll_y == 0;
+}
 
-    int distance = raw_head - raw_tail;
-    if (distance < 0) distance += MAX_EVENT_QUEUE_SIZE;
-
-    if (raw_count != distance && raw_count != MAX_EVENT_QUEUE_SIZE) {
-        error("[process] queue count mismatch pid=%d name=%s count=%d expected=%d where=%s",
-              proc->pid, proc->name ? proc->name : "(null)", raw_count, distance, where);
-        raw_count = distance;
-        adjusted = true;
-    }
+static inline int16_t clamp_delta(int32_t value) {
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return (int16_t)value;
+}
 
-    if (raw_count == MAX_EVENT_QUEUE_SIZE && distance != 0) {
-        error("[process] queue full inconsistency pid=%d name=%s distance=%d where=%s",
-              proc->pid, proc->name ? proc->name : "(null)", distance, where);
-        raw_count = distance;
-        adjusted = true;
+// Producer side, proc->lock held: fold `event` into the newest queued event if the
+// consumer has not started reading it. Returns true if merged.
+static bool try_coalesce_locked(EventQueue& queue, const IOEvent& event) {
+    uint32_t last = (queue.head - 1) & EVENT_SLOT_INDEX_MASK;
+    // Claim the open slot; fails if the consumer already closed it for reading
+    if (!__sync_bool_compare_and_swap(&queue.open_slot, last, last | EVENT_SLOT_BUSY)) {
+        return false;
     }
-
-    if (adjusted) {
-        queue.head = raw_head;
-        queue.tail = raw_tail;
-        queue.count = raw_count;
+    IOEvent& prev = queue.queue[(queue.head - 1) % MAX_EVENT_QUEUE_SIZE];
+    bool merged = false;
+    if (event_coalescable(&prev) && prev.data.mouse.buttons == event.data.mouse.buttons &&
+        prev.data.mouse.target_pid == event.data.mouse.target_pid) {
+        prev.data.mouse.x = event.data.mouse.x;
+        prev.data.mouse.y = event.data.mouse.y;
+        prev.data.mouse.dx = clamp_delta((int32_t)prev.data.mouse.dx + event.data.mouse.dx);
+        prev.data.mouse.dy = clamp_delta((int32_t)prev.data.mouse.dy + event.data.mouse.dy);
+        merged = true;
     }
-
-    queue.guard_front = EVENT_QUEUE_GUARD;
-    queue.guard_back = EVENT_QUEUE_GUARD;
-    return true;
+    __atomic_store_n(&queue.open_slot, last, __ATOMIC_RELEASE);
+    return merged;
 }
 
 void push_io_event(Process* proc, IOEvent event) {
-    static bool logged_sizes = false;
-    if (!logged_sizes) {
-        logged_sizes = true;
-    }
-    uint32_t flags = irq_save();
-    if (!ensure_event_queue_integrity(proc, "push")) {
-        irq_restore(flags);
+    if (!process_is_valid(proc, "push")) {
         return;
     }
     EventQueue& queue = proc->io_events;
-    if (queue.count == MAX_EVENT_QUEUE_SIZE) {
-        error("[process] event queue full pid=%d name=%s dropping oldest event", proc->pid, proc->name ? proc->name : "(null)");
-        queue.tail = (queue.tail + 1) % MAX_EVENT_QUEUE_SIZE;
-        if (queue.count > 0) {
-            queue.count--;
+    bool coalescable = event_coalescable(&event);
+    // Producers (softirqs, kworkers, the scheduler) serialize on proc->lock; the
+    // owning process consumes without taking it
+    uint32_t flags = spin_lock_irqsave(&proc->lock);
+    EVENT_QUEUE_CHECK(proc, "push", spin_unlock_irqrestore(&proc->lock, flags); return);
+    if (coalescable && try_coalesce_locked(queue, event)) {
+        queue.coalesced++;
+        spin_unlock_irqrestore(&proc->lock, flags);
+        return; // Not yet consumed, so the waiter is already awake or woken
+    }
+    uint32_t head = queue.head;
+    if (head - __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE) >= MAX_EVENT_QUEUE_SIZE) {
+        // Only the consumer may advance tail: drop the new event instead of the oldest
+        if (queue.dropped++ == 0) {
+            error("[process] event queue full pid=%d name=%s dropping events",
+                  proc->pid, proc->name ? proc->name : "(null)");
         }
+        spin_unlock_irqrestore(&proc->lock, flags);
+        return;
     }
-    queue.queue[queue.head] = event;
-    queue.head = (queue.head + 1) % MAX_EVENT_QUEUE_SIZE;
-    if (queue.count < MAX_EVENT_QUEUE_SIZE) {
-        queue.count++;
+    queue.queue[head % MAX_EVENT_QUEUE_SIZE] = event;
+    // Open (or close) the slot for coalescing before the consumer can see it
+    __atomic_store_n(&queue.open_slot, coalescable ? (head & EVENT_SLOT_INDEX_MASK) : EVENT_SLOT_NONE,
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&queue.head, head + 1, __ATOMIC_RELEASE);
+    // Hook-based waiters (yield_for_event on SIGNAL/pid) are still honoured
+    bool signal_hook = has_matching_hook_locked(proc, HookType::SIGNAL, (uint64_t)proc->pid);
+    spin_unlock_irqrestore(&proc->lock, flags);
+    // Hand the event straight to a blocked waiter and let it run next
+    wake_up(&proc->io_wait, WAKE_BOOST);
+    if (signal_hook) {
+        scheduler_resume_processes_for_event(HookType::SIGNAL, (uint64_t)proc->pid);
     }
-    irq_restore(flags);
 }
+
+// Consumer side: only the owning process pops, without locks or masking interrupts
 int pop_io_event(Process* proc, IOEvent* out_event) {
-    uint32_t flags = irq_save();
-    if (!ensure_event_queue_integrity(proc, "pop")) {
-        irq_restore(flags);
+    if (!process_is_valid(proc, "pop")) {
         return 0;
     }
     EventQueue& queue = proc->io_events;
-    if (queue.count == 0) {
-        irq_restore(flags);
+    EVENT_QUEUE_CHECK(proc, "pop", return 0);
+    uint32_t tail = queue.tail;
+    if (tail == __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE)) {
         return 0; // Empty
     }
-    *out_event = queue.queue[queue.tail];
-    queue.tail = (queue.tail + 1) % MAX_EVENT_QUEUE_SIZE;
-    if (queue.count > 0) {
-        queue.count--;
+    // Close the slot to coalescing; wait out a producer that is merging into it
+    uint32_t index = tail & EVENT_SLOT_INDEX_MASK;
+    for (;;) {
+        uint32_t open = __atomic_load_n(&queue.open_slot, __ATOMIC_ACQUIRE);
+        if (open == (index | EVENT_SLOT_BUSY)) {
+            asm volatile("pause");
+            continue;
+        }
+        if (open != index || __sync_bool_compare_and_swap(&queue.open_slot, index, EVENT_SLOT_NONE)) {
+            break;
+        }
     }
-    //debug("[process] pop event pid=%d type=%d head=%d tail=%d count=%d", proc->pid, out_event->type, queue.head, queue.tail, queue.count);
-    irq_restore(flags);
+    *out_event = queue.queue[tail % MAX_EVENT_QUEUE_SIZE];
+    __atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
     return 1;
 }
+
 int process_poll_io_event(Process* proc, IOEvent* out_event) {
     if (!proc || !out_event) return 0;
     return pop_io_event(proc, out_event);
 }
 
-int process_wait_for_io_event(Process* proc, IOEvent* out_event) {
-    if (!proc || !out_event) return 0;
-    if (pop_io_event(proc, out_event)) {
-        return 1;
+int process_drain_io_events(Process* proc, IOEvent* out_events, int max_events) {
+    if (!proc || !out_events) return 0;
+    int count = 0;
+    while (count < max_events && pop_io_event(proc, &out_events[count])) {
+        count++;
+    }
+    return count;
+}
+
+static int has_matching_hook_locked(Process* proc, HookType type, uint64_t value) {
+    for (int i = 0; i < proc->hook_count; ++i) {
+        if (proc->hooks[i].type == type && proc->hooks[i].trigger_value == value) {
+            return 1;
+        }
     }
-    process_yield_for_event(proc, HookType::SIGNAL, (uint64_t)proc->pid);
     return 0;
 }
 
-int process_register_hook(Process* proc, HookType type, uint64_t trigger_value) {
-    if (!proc || proc->hook_count >= MAX_HOOKS_PER_PROCESS) return -1;
+static int register_hook_locked(Process* proc, HookType type, uint64_t trigger_value) {
+    if (proc->hook_count >= MAX_HOOKS_PER_PROCESS) return -1;
     proc->hooks[proc->hook_count].type = type;
     proc->hooks[proc->hook_count].trigger_value = trigger_value;
     proc->hook_count++;
     return 0;
 }
 
+int process_wait_for_io_event(Process* proc, IOEvent* out_event) {
+    if (!proc || !out_event) return 0;
+    // prepare_to_wait queues us before the ring is checked, so an event pushed in
+    // between wakes us and the next sleep returns immediately
+    wait_event(&proc->io_wait, proc, pop_io_event(proc, out_event));
+    return 1;
+}
+
+int process_wait_drain_io_events(Process* proc, IOEvent* out_events, int max_events) {
+    if (!proc || !out_events || max_events <= 0) return 0;
+    int count = 0;
+    wait_event(&proc->io_wait, proc, (count = process_drain_io_events(proc, out_events, max_events)) > 0);
+    return count;
+}
+
+int process_register_hook(Process* proc, HookType type, uint64_t trigger_value) {
+    if (!proc) return -1;
+    uint32_t flags = spin_lock_irqsave(&proc->lock);
+    int result = register_hook_locked(proc, type, trigger_value);
+    spin_unlock_irqrestore(&proc->lock, flags);
+    return result;
+}
+
 int process_remove_hook(Process* proc, HookType type, uint64_t trigger_value) {
     if (!proc) return -1;
+    int result = -1;
+    uint32_t flags = spin_lock_irqsave(&proc->lock);
     for (int i = 0; i < proc->hook_count; ++i) {
         if (proc->hooks[i].type == type && proc->hooks[i].trigger_value == trigger_value) {
             // Shift hooks down
@@ -241,60 +429,169 @@ int process_remove_hook(Process* proc, HookType type, uint64_t trigger_value) {
                 proc->hooks[j] = proc->hooks[j + 1];
             }
             proc->hook_count--;
-            return 0;
+            result = 0;
+            break;
         }
     }
-    return -1;
+    spin_unlock_irqrestore(&proc->lock, flags);
+    return result;
 }
 
 int process_has_matching_hook(Process* proc, HookType type, uint64_t value) {
     if (!proc) return 0;
-    for (int i = 0; i < proc->hook_count; ++i) {
-        if (proc->hooks[i].type == type && proc->hooks[i].trigger_value == value) {
-            return 1;
-        }
-    }
-    return 0;
+    uint32_t flags = spin_lock_irqsave(&proc->lock);
+    int result = has_matching_hook_locked(proc, type, value);
+    spin_unlock_irqrestore(&proc->lock, flags);
+    return result;
 }
 
-Process* k_start_process(const char* name, void (*entry)(), int speculative, uint32_t stack_size) {
-    Process* proc = (Process*)kmalloc(sizeof(Process));
+// `mm` processes get their user stack demand-paged below USER_STACK_TOP instead of
+// from the kernel heap. Other ring-3 processes run kernel-linked USER_TEXT code in
+// an address space that exposes only that and their stack to user mode.
+static Process* start_process(const char* name, void (*entry)(), int speculative,
+                              uint32_t stack_size, bool user, address_space_t* mm) {
+    Process* proc = process_alloc();
     if (!proc) return NULL;
-    // Zero the struct to avoid stale data
-    for (size_t i = 0; i < sizeof(Process); ++i) ((uint8_t*)proc)[i] = 0;
+    // Clear everything up to the event ring; the ring itself only needs its indices reset
+    memset(proc, 0, offsetof(Process, io_events));
+
+    // Allocate the stacks before the process becomes visible
+    uint32_t stack_top = USER_STACK_TOP;
+    uint8_t* stack_alloc = NULL;
+    if (!mm) {
+        if (user) {
+            // Exposed to ring 3 page by page, so it must not share a page with heap neighbours
+            stack_size = (stack_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+            stack_alloc = (uint8_t*)kmalloc(stack_size + PAGE_SIZE);
+            stack_top = ((uint32_t)stack_alloc + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        } else {
+            stack_alloc = (uint8_t*)kmalloc(stack_size);
+            stack_top = (uint32_t)stack_alloc;
+        }
+        if (!stack_alloc) {
+            process_release(proc);
+            return NULL;
+        }
+        stack_top += stack_size;
+    }
+    address_space_t* kernel_user_space = NULL;
+    if (user && !mm) {
+        kernel_user_space = vmm_create_kernel_user_space(stack_top - stack_size, stack_size);
+        if (!kernel_user_space) {
+            kfree(stack_alloc);
+            process_release(proc);
+            return NULL;
+        }
+        strncpy(kernel_user_space->name, name, sizeof(kernel_user_space->name) - 1);
+    }
+    if (user) {
+        // Interrupts and syscalls from ring 3 switch to this stack via the TSS
+        uint8_t* kernel_stack = (uint8_t*)kmalloc(PROCESS_KERNEL_STACK_SIZE);
+        if (!kernel_stack) {
+            if (kernel_user_space) vmm_destroy_address_space(kernel_user_space);
+            if (stack_alloc) kfree(stack_alloc);
+            process_release(proc);
+            return NULL;
+        }
+        proc->current_state.kernel_stack_base = kernel_stack;
+        proc->current_state.context.kernel_esp = (uint32_t)kernel_stack + PROCESS_KERNEL_STACK_SIZE;
+        proc->current_state.context.cs = GDT_USER_CODE_SELECTOR | GDT_RPL_USER;
+    }
 
     proc->magic = PROCESS_MAGIC;
     proc->pid = create_process(name, entry, speculative);
     proc->name = name;
     proc->speculative = speculative;
-    proc->logical_time = 0;
     proc->alive = 1;
-    proc->hook_count = 0;
+    spin_lock_init(&proc->lock, "proc-events");
+    wait_queue_init(&proc->io_wait, "proc-io-wait");
     proc->tickets = 1;
+    proc->cpu = -1;
+    proc->on_cpu = -1;
+    proc->slot = -1;
+    proc->stats.blocked_reason = -1;
     proc->io_events.guard_front = EVENT_QUEUE_GUARD;
     proc->io_events.guard_back = EVENT_QUEUE_GUARD;
     proc->io_events.head = 0;
     proc->io_events.tail = 0;
-    proc->io_events.count = 0;
-    for (int i = 0; i < MAX_EVENT_QUEUE_SIZE; ++i) {
-        proc->io_events.queue[i] = IOEvent{};
-    }
-    proc->keyboard_handler = NULL;
-
-    // Allocate and set up stack
-    uint32_t stack_top = (uint32_t)kmalloc(stack_size);
-    if (!stack_top) return NULL;
-    stack_top += stack_size;
+    proc->io_events.open_slot = EVENT_SLOT_NONE;
+    proc->io_events.dropped = 0;
+    proc->io_events.coalesced = 0;
 
     proc->current_state.context.eip = (uint32_t)entry;
     proc->current_state.context.esp = stack_top;
     proc->current_state.context.ebp = stack_top;
     proc->current_state.context.eflags = 0x202; // IF=1, reserved bit set
 
-    proc->current_state.stack_base = (uint8_t*)(stack_top - stack_size);
+    if (!mm) {
+        proc->current_state.stack_base = stack_alloc;
+        mm = kernel_user_space;
+    }
+    if (mm) {
+        proc->mm = mm;
+        proc->current_state.page_directory = mm->page_directory;
+    }
     proc->current_state.stack_size = stack_size;
 
+    pid_hash_insert(proc);
     // Insert into scheduler
-    scheduler_add_process(proc);
+    if (scheduler_add_process(proc) != 0) {
+        pid_hash_remove(proc);
+        if (proc->current_state.stack_base) {
+            kfree(proc->current_state.stack_base);
+        }
+        if (proc->current_state.kernel_stack_base) {
+            kfree(proc->current_state.kernel_stack_base);
+        }
+        if (kernel_user_space) {
+            vmm_destroy_address_space(kernel_user_space);
+        }
+        process_release(proc);
+        return NULL;
+    }
     return proc;
 }
+
+Process* k_start_process(const char* name, void (*entry)(), int speculative, uint32_t stack_size) {
+    return start_process(name, entry, speculative, stack_size, false, NULL);
+}
+
+Process* k_start_user_process(const char* name, void (*entry)(), uint32_t stack_size) {
+    return start_process(name, entry, 0, stack_size, true, NULL);
+}
+
+Process* k_start_mm_process(const char* name, address_space_t* mm, uint32_t entry) {
+    if (!mm) return NULL;
+    return start_process(name, (void (*)())entry, 0, USER_STACK_SIZE, true, mm);
+}
+
+int process_fd_alloc(Process* proc) {
+    if (!proc || proc->fd_mask == (1u << PROCESS_MAX_FDS) - 1) return -1;
+    int fd = __builtin_ctz(~proc->fd_mask);
+    proc->fd_mask |= 1u << fd;
+    return fd;
+}
+
+vfs_file_t* process_fd_get(Process* proc, int fd) {
+    if (!proc || fd < 0 || fd >= PROCESS_MAX_FDS || !(proc->fd_mask & (1u << fd))) {
+        return NULL;
+    }
+    return &proc->fds[fd];
+}
+
+void process_fd_release(Process* proc, int fd) {
+    if (!proc || fd < 0 || fd >= PROCESS_MAX_FDS) return;
+    memset(&proc->fds[fd], 0, sizeof(vfs_file_t));
+    proc->fd_mask &= ~(1u << fd);
+}
+
+void process_close_fds(Process* proc) {
+    if (!proc) return;
+    while (proc->fd_mask) {
+        int fd = __builtin_ctz(proc->fd_mask);
+        if (proc->fds[fd].in_use) {
+            vfs_close(&proc->fds[fd]);
+        }
+        process_fd_release(proc, fd);
+    }
+}
@@ -0,0 +1,80 @@
+#include "kernel/ramdisk.h"
+#include "kernel/blockdev.h"
+#include "kernel/heap.h"
+#include "kernel/debug.h"
+#include <string.h>
+
+#define RAMDISK_SECTOR_SIZE 512
+
+typedef struct {
+    uint8_t* data;     // NULL while the slot is free
+    uint32_t sectors;
+    uint8_t device;    // Block device number
+} ramdisk_t;
+
+static ramdisk_t disks[RAMDISK_MAX_DISKS];
+
+int ramdisk_create(uint32_t sectors) {
+    int slot = 0;
+    while (slot < RAMDISK_MAX_DISKS && disks[slot].data) slot++;
+    if (slot == RAMDISK_MAX_DISKS || sectors == 0) return -1;
+    uint8_t* data = (uint8_t*)kmalloc(sectors * RAMDISK_SECTOR_SIZE);
+    if (!data) {
+        error("[RAMDISK] Out of memory for %u sectors", sectors);
+        return -1;
+    }
+    memset(data, 0, sectors * RAMDISK_SECTOR_SIZE);
+
+    blockdev_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.type = BLOCKDEV_TYPE_RAM;
+    info.device_id = (uint8_t)slot;
+    info.sector_count = sectors;
+    info.sector_size = RAMDISK_SECTOR_SIZE;
+    info.present = 1;
+    strcpy(info.name, "rd0");
+    info.name[2] = (char)('0' + slot);
+    int device = blockdev_register(BLOCKDEV_TYPE_RAM, (uint8_t)slot, &info);
+    if (device < 0) {
+        kfree(data);
+        return -1;
+    }
+    disks[slot].data = data;
+    disks[slot].sectors = sectors;
+    disks[slot].device = (uint8_t)device;
+    return device;
+}
+
+void ramdisk_destroy(uint8_t device) {
+    for (int slot = 0; slot < RAMDISK_MAX_DISKS; slot++) {
+        if (disks[slot].data && disks[slot].device == device) {
+            blockdev_unregister(device);
+            kfree(disks[slot].data);
+            disks[slot].data = NULL;
+            return;
+        }
+    }
+}
+
+// Block layer callers have checked the range against the registered size
+static uint8_t* ramdisk_sector(uint8_t disk, uint32_t sector, uint32_t count) {
+    if (disk >= RAMDISK_MAX_DISKS || !disks[disk].data || sector >= disks[disk].sectors ||
+        count > disks[disk].sectors - sector) {
+        return NULL;
+    }
+    return disks[disk].data + sector * RAMDISK_SECTOR_SIZE;
+}
+
+int ramdisk_read_sectors(uint8_t disk, uint32_t sector, uint32_t count, void* buffer) {
+    uint8_t* data = ramdisk_sector(disk, sector, count);
+    if (!data) return BLOCKDEV_ERROR;
+    memcpy(buffer, data, count * RAMDISK_SECTOR_SIZE);
+    return BLOCKDEV_SUCCESS;
+}
+
+int ramdisk_write_sectors(uint8_t disk, uint32_t sector, uint32_t count, const void* buffer) {
+    uint8_t* data = ramdisk_sector(disk, sector, count);
+    if (!data) return BLOCKDEV_ERROR;
+    memcpy(data, buffer, count * RAMDISK_SECTOR_SIZE);
+    return BLOCKDEV_SUCCESS;
+}
@@ -4,37 +4,101 @@
 #include "kernel/terminal_windows.h"
 #include "kernel/vga.h"
 #include "kernel/debug.h"
+#include "kernel/gdt.h"
+#include "kernel/paging.h"
+#include "kernel/smp.h"
+#include "kernel/spinlock.h"
+#include "kernel/softirq.h"
+#include "kernel/timer.h"
+#include "kernel/ktime.h"
+#include <stdio.h>
 
 extern Terminal terminal;
 
-#define SCHEDULER_QUANTUM_TICKS 10 // Number of timer ticks per quantum
+#define SCHEDULER_QUANTUM_TICKS 10 // Number of timer ticks per quantum (lottery policy)
+
+#define SCHED_IDLE_STACK_SIZE 4096
 
 Process* process_table[MAX_PROCESSES];
 int process_count = 0;
-int current_process_idx = -1;
+
+// Per-CPU scheduling state; each CPU runs the processes in its own queue
+typedef struct SchedCpu {
+    int current_idx;            // process_table index running here, -1 when idle
+    int queue[MAX_PROCESSES];   // process_table indices owned by this CPU
+    int queue_len;
+    int quantum_counter;
+    bool need_resched;          // Set when a better process became runnable here
+    int boost_idx;              // Woken process to run next (wake_up with WAKE_BOOST), or -1
+    registers_t* last_regs;
+    CPUContext idle_context;
+    uint32_t switches;
+    uint32_t steals;            // Processes pulled from other CPUs while idle
+    uint32_t busy_ticks;
+    uint32_t idle_ticks;
+    uint32_t top_busy_ticks;    // busy/idle_ticks at the previous `top` refresh
+    uint32_t top_idle_ticks;
+} SchedCpu;
+
+static SchedCpu sched_cpus[MAX_CPUS];
+static uint8_t idle_stacks[MAX_CPUS][SCHED_IDLE_STACK_SIZE] __attribute__((aligned(16)));
+// Protects process_table, the run queues and MLFQ state across CPUs
+static spinlock_t sched_lock = SPINLOCK_INIT("sched");
+static volatile bool scheduler_running = false;
 
 static uint32_t xorshift32_state = 2463534242; // Arbitrary nonzero seed
-static int quantum_counter = 0;
 
-static registers_t* last_regs = NULL;
+// MLFQ state: quanta grow as priority drops so CPU-bound work gets longer, rarer slices
+static SchedulerPolicy scheduler_policy = SCHED_POLICY_MLFQ;
+static const int mlfq_quantum_ticks[MLFQ_LEVELS] = { 5, 10, 20 };
+// Tick of the last anti-starvation boost
+static volatile uint32_t last_boost_tick = 0;
 
-// Trampoline to complete a context switch after returning from an interrupt/syscall
+// Trampoline to complete a context switch after returning from an interrupt/syscall.
+// Takes the next context in EDX and the previous process's on_cpu slot in ECX.
 extern "C" void switch_to_trampoline();
-// Next context to switch to (used by the trampoline)
-extern "C" {
-CPUContext* g_next_context = nullptr;
-}
+extern "C" void scheduler_idle_loop();
 
 static Process* foreground_proc = nullptr;
 static Process* foreground_stack[MAX_PROCESSES];
 static int foreground_stack_top = -1;
 
+static inline SchedCpu* this_sched_cpu() {
+    return &sched_cpus[smp_current_cpu()];
+}
+
+static void rq_add(int cpu, int idx) {
+    SchedCpu* sc = &sched_cpus[cpu];
+    sc->queue[sc->queue_len++] = idx;
+    process_table[idx]->cpu = cpu;
+}
+
+static void rq_remove(int cpu, int idx) {
+    SchedCpu* sc = &sched_cpus[cpu];
+    for (int i = 0; i < sc->queue_len; ++i) {
+        if (sc->queue[i] == idx) {
+            sc->queue[i] = sc->queue[--sc->queue_len];
+            return;
+        }
+    }
+}
+
 void scheduler_init() {
     process_count = 0;
-    current_process_idx = -1;
     for (int i = 0; i < MAX_PROCESSES; ++i) {
         process_table[i] = NULL;
     }
+    for (int c = 0; c < MAX_CPUS; ++c) {
+        SchedCpu* sc = &sched_cpus[c];
+        for (size_t b = 0; b < sizeof(SchedCpu); ++b) ((uint8_t*)sc)[b] = 0;
+        sc->current_idx = -1;
+        sc->boost_idx = -1;
+        sc->idle_context.eip = (uint32_t)scheduler_idle_loop;
+        sc->idle_context.esp = (uint32_t)&idle_stacks[c][SCHED_IDLE_STACK_SIZE];
+        sc->idle_context.ebp = sc->idle_context.esp;
+        sc->idle_context.eflags = 0x202;
+    }
+    scheduler_running = false;
     foreground_proc = nullptr;
     foreground_stack_top = -1;
     for (int i = 0; i < MAX_PROCESSES; ++i) {
@@ -42,33 +106,116 @@ void scheduler_init() {
     }
 }
 
+// New processes go to the online CPU with the shortest run queue
+static int least_loaded_cpu() {
+    int best = 0;
+    for (int c = 1; c < smp_cpu_count(); ++c) {
+        if (sched_cpus[c].queue_len < sched_cpus[best].queue_len) {
+            best = c;
+        }
+    }
+    return best;
+}
+
 int scheduler_add_process(Process* proc) {
-    if (process_count >= MAX_PROCESSES) return -1;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    if (process_count >= MAX_PROCESSES) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
     for (int i = 0; i < MAX_PROCESSES; ++i) {
         if (process_table[i] == NULL) {
             process_table[i] = proc;
+            proc->slot = i;
             process_count++;
-            if (current_process_idx == -1) current_process_idx = i;
             if (proc->tickets <= 0) proc->tickets = 1; // Default to 1 ticket
+            proc->on_cpu = -1;
+            int cpu = least_loaded_cpu();
+            rq_add(cpu, i);
+            // Before scheduler_start the first process becomes the boot CPU's current
+            if (!scheduler_running && cpu == 0 && sched_cpus[0].current_idx == -1) {
+                sched_cpus[0].current_idx = i;
+            }
+            bool kick = scheduler_running && sched_cpus[cpu].current_idx == -1;
+            if (kick) sched_cpus[cpu].need_resched = true;
+            spin_unlock_irqrestore(&sched_lock, flags);
+            if (kick) smp_send_reschedule(cpu);
             return 0;
         }
     }
+    spin_unlock_irqrestore(&sched_lock, flags);
     return -1;
 }
 
 int scheduler_remove_process(int pid) {
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        if (process_table[i] && process_table[i]->pid == pid) {
-            process_table[i] = NULL;
-            process_count--;
-            if (current_process_idx == i) {
-                // Advance to next process
-                scheduler_next_process();
-            }
-            return 0;
+    Process* proc = process_find(pid);
+    if (!proc) return -1;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    int i = proc->slot;
+    if (i < 0 || process_table[i] != proc) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    if (proc->cpu >= 0) {
+        rq_remove(proc->cpu, i);
+        if (sched_cpus[proc->cpu].current_idx == i) {
+            sched_cpus[proc->cpu].current_idx = -1;
         }
     }
-    return -1;
+    process_table[i] = NULL;
+    proc->slot = -1;
+    process_count--;
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+// Drop every scheduler reference to a dead process, once no CPU is on its stack
+int scheduler_release_dead(Process* proc) {
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    if (proc->alive || proc->on_cpu != -1) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    int idx = proc->slot;
+    for (int c = 0; c < MAX_CPUS; ++c) {
+        if (idx >= 0 && sched_cpus[c].current_idx == idx) {
+            // Still recorded as current (e.g. before its CPU's next switch)
+            spin_unlock_irqrestore(&sched_lock, flags);
+            return -1;
+        }
+    }
+    if (idx >= 0 && process_table[idx] == proc) {
+        if (proc->cpu >= 0) {
+            rq_remove(proc->cpu, idx);
+            if (sched_cpus[proc->cpu].boost_idx == idx) sched_cpus[proc->cpu].boost_idx = -1;
+        }
+        process_table[idx] = NULL;
+        process_count--;
+    }
+    proc->slot = -1;
+    proc->cpu = -1;
+    // The object is about to be recycled: forget it as a foreground candidate
+    int kept = 0;
+    for (int i = 0; i <= foreground_stack_top; ++i) {
+        if (foreground_stack[i] != proc) foreground_stack[kept++] = foreground_stack[i];
+    }
+    foreground_stack_top = kept - 1;
+    if (foreground_proc == proc) foreground_proc = nullptr;
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+// Make the CPU running `proc` switch away from it as soon as possible
+void scheduler_evict(Process* proc) {
+    int kick = -1;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    int cpu = proc->on_cpu;
+    if (cpu >= 0 && cpu < MAX_CPUS) {
+        sched_cpus[cpu].need_resched = true;
+        kick = cpu;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    if (kick >= 0) smp_send_reschedule(kick);
 }
 
 uint32_t xorshift32() {
@@ -78,35 +225,149 @@ uint32_t xorshift32() {
     return xorshift32_state;
 }
 
-Process* scheduler_next_process() {
-    if (process_count == 0) return NULL;
+static inline bool process_is_runnable(Process* proc) {
+    // Process is alive, has no hooks and is not blocked on a wait queue
+    return proc && proc->alive && proc->hook_count == 0 && !proc->sleeping;
+}
+
+// Runnable and not executing on (or still leaving the stack of) another CPU
+static inline bool process_can_run_on(Process* proc, int cpu) {
+    return process_is_runnable(proc) && (proc->on_cpu == -1 || proc->on_cpu == cpu);
+}
+
+// Highest-priority (lowest numbered) MLFQ level holding a runnable process, or -1
+static int mlfq_top_runnable_level(int cpu) {
+    SchedCpu* sc = &sched_cpus[cpu];
+    int best = -1;
+    for (int q = 0; q < sc->queue_len; ++q) {
+        Process* proc = process_table[sc->queue[q]];
+        if (process_can_run_on(proc, cpu) && (best < 0 || proc->priority_level < best)) {
+            best = proc->priority_level;
+            if (best == 0) break;
+        }
+    }
+    return best;
+}
+
+// Lottery among this CPU's queue; returns a process_table index or -1
+static int pick_from_queue(int cpu) {
+    SchedCpu* sc = &sched_cpus[cpu];
+    // Under MLFQ the lottery only runs among processes of the best runnable level
+    int level = -1;
+    if (scheduler_policy == SCHED_POLICY_MLFQ) {
+        level = mlfq_top_runnable_level(cpu);
+        if (level < 0) return -1;
+    }
     int total_tickets = 0;
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        Process* proc = process_table[i];
-        if (proc && proc->alive && proc->hook_count == 0) {
-            // Process is alive and has no hooks (is runnable)
+    for (int q = 0; q < sc->queue_len; ++q) {
+        Process* proc = process_table[sc->queue[q]];
+        if (process_can_run_on(proc, cpu) && (level < 0 || proc->priority_level == level)) {
             total_tickets += proc->tickets;
         }
     }
     if (total_tickets == 0) {
-        for (int i = 0; i < MAX_PROCESSES; ++i) {
-            Process* proc = process_table[i];
-        }
-        return NULL;
+        return -1;
     }
     int winner = xorshift32() % total_tickets;
     int count = 0;
-    for (int i = 0; i < MAX_PROCESSES; ++i) {
-        Process* proc = process_table[i];
-        if (proc && proc->alive && proc->hook_count == 0) {
+    for (int q = 0; q < sc->queue_len; ++q) {
+        Process* proc = process_table[sc->queue[q]];
+        if (process_can_run_on(proc, cpu) && (level < 0 || proc->priority_level == level)) {
             count += proc->tickets;
             if (winner < count) {
-                current_process_idx = i;
-                return proc;
+                return sc->queue[q];
             }
         }
     }
-    return NULL;
+    return -1;
+}
+
+static inline bool is_deadline(Process* proc) {
+    return proc->dl.period != 0;
+}
+
+// Deadline processes stay on the CPU that admitted them: its utilization check
+// (scheduler_set_deadline) says nothing about the thief's
+static inline bool can_steal(Process* proc, int cpu) {
+    return process_can_run_on(proc, cpu) && !is_deadline(proc);
+}
+
+// Idle-time work stealing: pull one waiting process from the busiest other CPU
+static int steal_work(int cpu) {
+    if (!scheduler_running || smp_cpu_count() <= 1) return -1;
+    int victim = -1;
+    int victim_waiting = 0;
+    for (int c = 0; c < smp_cpu_count(); ++c) {
+        if (c == cpu) continue;
+        SchedCpu* sc = &sched_cpus[c];
+        int waiting = 0;
+        for (int q = 0; q < sc->queue_len; ++q) {
+            if (can_steal(process_table[sc->queue[q]], cpu)) waiting++;
+        }
+        if (waiting > victim_waiting) {
+            victim = c;
+            victim_waiting = waiting;
+        }
+    }
+    if (victim < 0) return -1;
+    SchedCpu* vc = &sched_cpus[victim];
+    for (int q = 0; q < vc->queue_len; ++q) {
+        int idx = vc->queue[q];
+        if (can_steal(process_table[idx], cpu)) {
+            rq_remove(victim, idx);
+            rq_add(cpu, idx);
+            sched_cpus[cpu].steals++;
+            return idx;
+        }
+    }
+    return -1;
+}
+
+
+// Deadline class member that still has budget this period
+static inline bool dl_active(Process* proc) {
+    return is_deadline(proc) && !proc->dl.throttled;
+}
+
+// EDF: the runnable, unthrottled deadline process with the earliest deadline, or -1
+static int dl_pick(int cpu) {
+    SchedCpu* sc = &sched_cpus[cpu];
+    int best = -1;
+    for (int q = 0; q < sc->queue_len; ++q) {
+        Process* proc = process_table[sc->queue[q]];
+        if (!process_can_run_on(proc, cpu) || !dl_active(proc)) continue;
+        if (best < 0 || (int32_t)(proc->dl.deadline - process_table[best]->dl.deadline) < 0) {
+            best = sc->queue[q];
+        }
+    }
+    return best;
+}
+
+static int select_next(int cpu) {
+    if (process_count == 0) return -1;
+    // Deadline class first: it sits above every normal process
+    int dl_idx = dl_pick(cpu);
+    if (dl_idx >= 0) return dl_idx;
+    // A boosted wakeup jumps the policy once
+    SchedCpu* sc = &sched_cpus[cpu];
+    int boosted = sc->boost_idx;
+    sc->boost_idx = -1;
+    if (boosted >= 0 && process_table[boosted] && process_table[boosted]->cpu == cpu &&
+        process_can_run_on(process_table[boosted], cpu)) {
+        return boosted;
+    }
+    int idx = pick_from_queue(cpu);
+    if (idx < 0) {
+        idx = steal_work(cpu);
+    }
+    return idx;
+}
+
+Process* scheduler_next_process() {
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    int idx = select_next(smp_current_cpu());
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return idx >= 0 ? process_table[idx] : NULL;
 }
 
 // Returns 1 if process is eligible to run (no hooks, or at least one triggered hook), 0 otherwise
@@ -137,7 +398,7 @@ Process* scheduler_next_eligible_process(HookType event_type, uint64_t event_val
         if (process_table[i] && process_table[i]->alive && process_is_eligible(process_table[i], event_type, event_value)) {
             count += process_table[i]->tickets;
             if (winner < count) {
-                current_process_idx = i;
+                this_sched_cpu()->current_idx = i;
                 return process_table[i];
             }
         }
@@ -146,8 +407,9 @@ Process* scheduler_next_eligible_process(HookType event_type, uint64_t event_val
 }
 
 Process* scheduler_current_process() {
-    if (current_process_idx < 0 || current_process_idx >= MAX_PROCESSES) return NULL;
-    return process_table[current_process_idx];
+    int idx = this_sched_cpu()->current_idx;
+    if (idx < 0 || idx >= MAX_PROCESSES) return NULL;
+    return process_table[idx];
 }
 
 void set_process_tickets(Process* proc, int tickets) {
@@ -167,8 +429,91 @@ void process_yield_for_event(Process* proc, HookType event_type, uint64_t event_
     // The scheduler will check hooks to determine if it's runnable.
 }
 
+// Why a process that is leaving the CPU cannot run, or -1 if it still can
+static int block_reason(Process* proc) {
+    if (proc->sleeping) return PROCESS_BLOCK_WAIT_QUEUE;
+    if (proc->hook_count > 0) return (int)proc->hooks[0].type;
+    return -1;
+}
+
+// Caller holds sched_lock. `yielded` is true when the process asked to give up the CPU.
+static void account_switch_out(Process* prev, bool yielded) {
+    if (!prev || !prev->alive) return;
+    int reason = block_reason(prev);
+    if (reason >= 0 || yielded) {
+        prev->stats.voluntary_switches++;
+    } else {
+        prev->stats.involuntary_switches++;
+    }
+    if (reason >= 0) {
+        prev->stats.blocked_since = get_ticks();
+        prev->stats.blocked_reason = reason;
+    }
+}
+
+// Caller holds sched_lock. Closes the blocked interval and starts the latency clock.
+static void account_wakeup(Process* proc) {
+    if (proc->stats.blocked_reason < 0) return;
+    proc->stats.blocked_ticks[proc->stats.blocked_reason] += get_ticks() - proc->stats.blocked_since;
+    proc->stats.blocked_reason = -1;
+    proc->stats.wakeups++;
+    proc->stats.woken_at = ktime_get_ns();
+}
+
+// Upper bounds of the wake latency buckets in ns, a factor of 4 apart
+static const uint32_t wake_latency_limits[WAKE_LATENCY_BUCKETS - 1] = {
+    1000, 4000, 16000, 64000, 256000, 1000000, 4000000
+};
+
+static int wake_latency_bucket(uint64_t ns) {
+    int bucket = 0;
+    while (bucket < WAKE_LATENCY_BUCKETS - 1 && ns >= wake_latency_limits[bucket]) {
+        bucket++;
+    }
+    return bucket;
+}
+
+// Caller holds sched_lock
+static void account_switch_in(Process* next) {
+    // Woken without going through a resume path (e.g. hooks cleared on refocus)
+    account_wakeup(next);
+    if (next->stats.woken_at) {
+        uint64_t latency = ktime_get_ns() - next->stats.woken_at;
+        next->stats.woken_at = 0;
+        next->stats.wake_latency_hist[wake_latency_bucket(latency)]++;
+        if (latency > next->stats.wake_latency_max) {
+            next->stats.wake_latency_max = latency;
+        }
+    }
+}
+
+// Move a process to the top MLFQ level with a fresh allotment
+static void mlfq_promote(Process* proc) {
+    proc->priority_level = 0;
+    proc->quantum_ticks_used = 0;
+}
+
+// Drop a process one MLFQ level after it burned its whole quantum
+static void mlfq_demote(Process* proc) {
+    if (proc->priority_level < MLFQ_LEVELS - 1) {
+        proc->priority_level++;
+    }
+    proc->quantum_ticks_used = 0;
+}
+
+// Periodically lift everyone back to the top level so demoted work cannot starve
+static void mlfq_boost_all() {
+    for (int i = 0; i < MAX_PROCESSES; ++i) {
+        if (process_table[i]) {
+            mlfq_promote(process_table[i]);
+        }
+    }
+}
+
 // Called by event source to resume processes waiting for an event
 void scheduler_resume_processes_for_event(HookType event_type, uint64_t event_value) {
+    uint32_t kick_mask = 0; // CPUs that should reschedule now
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
     for (int i = 0; i < MAX_PROCESSES; ++i) {
         Process* proc = process_table[i];
         if (proc && process_has_matching_hook(proc, event_type, event_value)) {
@@ -178,8 +523,63 @@ void scheduler_resume_processes_for_event(HookType event_type, uint64_t event_va
                 // Remove all matching hooks in case multiple were registered
                 ++removed;
             }
+            if (proc->hook_count != 0 || proc->cpu < 0) continue;
+            account_wakeup(proc);
+            SchedCpu* sc = &sched_cpus[proc->cpu];
+            Process* current = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+            // Processes that sleep on input signals are interactive: promote them and
+            // preempt the current process on the next tick instead of at quantum end
+            if (scheduler_policy == SCHED_POLICY_MLFQ && event_type == HookType::SIGNAL) {
+                mlfq_promote(proc);
+                if (proc != current &&
+                    (!current || current->priority_level > proc->priority_level ||
+                     current->hook_count > 0)) {
+                    sc->need_resched = true;
+                    kick_mask |= 1u << proc->cpu;
+                }
+            } else if (!current || (dl_active(proc) && proc != current)) {
+                // Owning CPU is idling, or a deadline process must run before its
+                // deadline: reschedule now instead of waiting for the next tick
+                sc->need_resched = true;
+                kick_mask |= 1u << proc->cpu;
+            }
         }
     }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    for (int c = 0; kick_mask; ++c, kick_mask >>= 1) {
+        if (kick_mask & 1) smp_send_reschedule(c);
+    }
+}
+
+// Make a process that slept on a wait queue runnable again
+void scheduler_wake_process(Process* proc, bool boost) {
+    if (!proc) return;
+    int kick = -1;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    proc->wait_pending = 0;
+    proc->sleeping = 0;
+    if (proc->hook_count == 0) {
+        account_wakeup(proc);
+    }
+    if (proc->alive && proc->cpu >= 0) {
+        SchedCpu* sc = &sched_cpus[proc->cpu];
+        Process* current = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+        if (boost && proc != current) {
+            // The producer hands its consumer the CPU: promote it and preempt at the next
+            // IRQ exit (or tick) on its CPU
+            if (scheduler_policy == SCHED_POLICY_MLFQ) {
+                mlfq_promote(proc);
+            }
+            sc->boost_idx = proc->slot;
+            sc->need_resched = true;
+            kick = proc->cpu;
+        } else if (!current || (dl_active(proc) && proc != current)) {
+            sc->need_resched = true;
+            kick = proc->cpu;
+        }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    if (kick >= 0) smp_send_reschedule(kick);
 }
 
 static void dispatch_focus_event(Process* proc, int code, int value) {
@@ -189,7 +589,6 @@ static void dispatch_focus_event(Process* proc, int code, int value) {
     event.data.process.code = code;
     event.data.process.value = value;
     push_io_event(proc, event);
-    scheduler_resume_processes_for_event(HookType::SIGNAL, (uint64_t)proc->pid);
 }
 
 static void scheduler_switch_foreground(Process* prev, Process* next) {
@@ -209,14 +608,48 @@ static void scheduler_switch_foreground(Process* prev, Process* next) {
     terminal_windows::activate_process(next, terminal);
 }
 
+// Make the interrupted frame return into the trampoline, which loads `next`
+static void redirect_to_trampoline(registers_t* regs, CPUContext* next, Process* prev) {
+    regs->edx = (uint32_t)next;
+    regs->ecx = prev ? (uint32_t)&prev->on_cpu : 0;
+    // Keep interrupts off until the trampoline is on the next stack
+    regs->eflags &= ~0x200u;
+    regs->eip = (uint32_t)switch_to_trampoline;
+    // A frame from ring 3 must return into the kernel, not to user mode
+    regs->cs = GDT_KERNEL_CODE_SELECTOR;
+}
+
+// Install what `next` needs before the trampoline runs it (NULL: idle). Ring-3
+// processes enter the kernel on their own stack (via the TSS, or SYSENTER which
+// reads esp0 through it); ring-0 processes never switch stacks. Idle and kernel
+// processes run on the kernel-only directory so a dead process's can be freed.
+static inline void load_process_context(int cpu, Process* next) {
+    if (next && next->current_state.context.kernel_esp) {
+        gdt_set_kernel_stack(cpu, next->current_state.context.kernel_esp);
+    }
+    vmm_switch_address_space(next ? next->mm : NULL);
+}
+
 void context_switch(registers_t* regs) {
-    Process* current = scheduler_current_process();
-    if (!current) return;
-    
+    // The frame already returns into the trampoline; switching again would save it as a process
+    if (regs->eip == (uint32_t)switch_to_trampoline) return;
+    int cpu = smp_current_cpu();
+    SchedCpu* sc = &sched_cpus[cpu];
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    Process* current = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+
     // If current process is alive, save its state
-    if (current->alive) {
+    if (current && current->alive) {
         current->current_state.context.eip = regs->eip;
-        current->current_state.context.esp = regs->esp;
+        current->current_state.context.cs = regs->cs;
+        if ((regs->cs & 3) == GDT_RPL_USER) {
+            // Interrupted in ring 3: the CPU pushed the user stack pointer
+            current->current_state.context.esp = regs->useresp;
+        } else {
+            // pusha recorded ESP after the CPU frame and the int_no/err_code pair
+            // were pushed; skip those five words to get the interrupted ESP
+            current->current_state.context.esp = regs->esp + 20;
+        }
         current->current_state.context.ebp = regs->ebp;
         current->current_state.context.eax = regs->eax;
         current->current_state.context.ebx = regs->ebx;
@@ -227,130 +660,448 @@ void context_switch(registers_t* regs) {
         current->current_state.context.eflags = regs->eflags;
     }
 
-    // Select next process
-    Process* next = scheduler_next_process();
-    
-    // If no valid next process and current is dead, we have a problem
+    // Select next process; the outgoing process starts a fresh quantum window
+    sc->quantum_counter = 0;
+    sc->need_resched = false;
+    sc->last_regs = regs;
+    int next_idx = select_next(cpu);
+    Process* next = next_idx >= 0 ? process_table[next_idx] : NULL;
+
+    // A syscall frame here means the process yielded rather than being preempted
+    bool yielded = regs->int_no == 0x80;
+
     if (!next) {
-        if (!current->alive) {
-            PANIC("No runnable processes left after current process exit");
+        // Nothing else to run: a runnable process keeps the CPU; a dead, sleeping or
+        // hooked one hands it to idle until something wakes it
+        if (current && !process_is_runnable(current)) {
+            account_switch_out(current, yielded);
+            sc->current_idx = -1;
+            load_process_context(cpu, NULL);
+            redirect_to_trampoline(regs, &sc->idle_context, current);
         }
+        spin_unlock_irqrestore(&sched_lock, flags);
         return;
     }
-    
+
     // Don't "switch" to the same process unless current is dead
     if (next == current && current->alive) {
+        spin_unlock_irqrestore(&sched_lock, flags);
         return;
     }
 
-    // Program a trampoline return into the next process
-    g_next_context = &next->current_state.context;
-    regs->eip = (uint32_t)switch_to_trampoline;
+    account_switch_out(current, yielded);
+    account_switch_in(next);
+    sc->current_idx = next_idx;
+    sc->switches++;
+    next->on_cpu = cpu;
+    load_process_context(cpu, next);
+    redirect_to_trampoline(regs, &next->current_state.context, current);
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
 
-    last_regs = regs;
+// Start a new period for deadline processes whose deadline passed, charge the running
+// one and enforce its budget. Returns true if this CPU must switch now.
+static bool dl_tick(int cpu) {
+    SchedCpu* sc = &sched_cpus[cpu];
+    uint32_t now = get_ticks();
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    Process* current = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+    bool resched = false;
+    for (int q = 0; q < sc->queue_len; ++q) {
+        Process* proc = process_table[sc->queue[q]];
+        if (!proc || !is_deadline(proc) || (int32_t)(now - proc->dl.deadline) < 0) continue;
+        if (proc->dl.remaining > 0 && process_is_runnable(proc)) {
+            proc->dl.misses++;
+        }
+        proc->dl.deadline = now + proc->dl.period;
+        proc->dl.remaining = proc->dl.budget;
+        proc->dl.throttled = 0;
+    }
+    if (current && current->alive && dl_active(current)) {
+        if (current->dl.remaining > 0) current->dl.remaining--;
+        if (current->dl.remaining == 0) {
+            // Budget enforcement: drop to the normal policy until the next period
+            current->dl.throttled = 1;
+            resched = true;
+        }
+    }
+    int best = dl_pick(cpu);
+    if (best >= 0 && process_table[best] != current &&
+        (!current || !dl_active(current) ||
+         (int32_t)(process_table[best]->dl.deadline - current->dl.deadline) < 0)) {
+        resched = true;
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return resched;
 }
 
 void scheduler_on_tick(registers_t* regs) {
-    last_regs = regs;
-    quantum_counter++;
-    if (quantum_counter >= SCHEDULER_QUANTUM_TICKS) {
-        quantum_counter = 0;
+    int cpu = smp_current_cpu();
+    SchedCpu* sc = &sched_cpus[cpu];
+    sc->last_regs = regs;
+    if (!scheduler_running) return;
+    if (softirq_in_progress() || irq_nested()) {
+        // A tick nested inside softirq processing or another handler: switch once the
+        // outer interrupt unwinds
+        sc->need_resched = true;
+        return;
+    }
+
+    // Timed in global ticks and checked by every CPU, idle or not, so the boost
+    // does not depend on what any one CPU is running
+    if (scheduler_policy == SCHED_POLICY_MLFQ &&
+        get_ticks() - last_boost_tick >= MLFQ_BOOST_INTERVAL_TICKS) {
+        uint32_t flags = spin_lock_irqsave(&sched_lock);
+        uint32_t now = get_ticks();
+        // Another CPU may have boosted since the unlocked check
+        if (now - last_boost_tick >= MLFQ_BOOST_INTERVAL_TICKS) {
+            last_boost_tick = now;
+            mlfq_boost_all();
+        }
+        spin_unlock_irqrestore(&sched_lock, flags);
+    }
+
+    bool dl_resched = dl_tick(cpu);
+    if (sc->current_idx < 0) {
+        // Idle CPUs look for local or stealable work every tick
+        sc->idle_ticks++;
         context_switch(regs);
+        return;
+    }
+    sc->busy_ticks++;
+    Process* running = process_table[sc->current_idx];
+    if (running) {
+        running->stats.cpu_ticks++;
+        running->logical_time++;
+    }
+    if (dl_resched) {
+        context_switch(regs);
+        return;
+    }
+    if (running && running->alive && dl_active(running)) {
+        // Deadline processes run until they block, finish their budget or are preempted
+        // by an earlier deadline; quanta and the lottery do not apply
+        return;
     }
-}
 
-void scheduler_force_switch() {
-    if (last_regs)
-        context_switch(last_regs);
+    if (scheduler_policy == SCHED_POLICY_LOTTERY) {
+        sc->quantum_counter++;
+        if (sc->quantum_counter >= SCHEDULER_QUANTUM_TICKS || sc->need_resched) {
+            context_switch(regs);
+        }
+        return;
+    }
+
+    // MLFQ state is shared with wakeups and work stealing on other CPUs
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    Process* current = process_table[sc->current_idx];
+    bool expired = false;
+    if (current && current->alive) {
+        current->quantum_ticks_used++;
+        if (current->quantum_ticks_used >= scheduler_level_quantum(current->priority_level)) {
+            // Burned the full allotment at this level: demote and pick someone else
+            mlfq_demote(current);
+            expired = true;
+        }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+    if (expired) {
+        context_switch(regs);
+        return;
+    }
+
+    if (sc->need_resched) {
+        context_switch(regs);
+    }
 }
 
-void scheduler_force_switch_with_regs(registers_t* regs) {
-    if (regs)
+void scheduler_handle_reschedule(registers_t* regs) {
+    SchedCpu* sc = this_sched_cpu();
+    sc->last_regs = regs;
+    if (scheduler_running && sc->need_resched && !softirq_in_progress() && !irq_nested()) {
         context_switch(regs);
+    }
 }
 
-// Declare the trampoline as an external assembly function
-extern "C" void switch_to_trampoline();
+void scheduler_set_policy(SchedulerPolicy policy) {
+    if (policy != SCHED_POLICY_LOTTERY && policy != SCHED_POLICY_MLFQ) return;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    scheduler_policy = policy;
+    for (int c = 0; c < MAX_CPUS; ++c) {
+        sched_cpus[c].quantum_counter = 0;
+        sched_cpus[c].need_resched = false;
+    }
+    last_boost_tick = get_ticks();
+    mlfq_boost_all();
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
 
-void scheduler_exit_current_and_switch(registers_t* regs) {
-    (void)regs; // Mark unused parameter
-    
-    // Current process is already dead (killed before calling this)
-    // Select the next alive process, ignoring hooks
-    // We can't use scheduler_next_process() because it filters out hooked processes
-    // When exiting, we need to switch to ANY alive process
-    
-    Process* next = NULL;
-    int total_tickets = 0;
-    
-    // Calculate total tickets for all alive processes (ignore hooks)
+int scheduler_set_deadline(Process* proc, uint32_t period, uint32_t budget) {
+    if (!proc) return -1;
+    if (period != 0 && (budget == 0 || budget > period)) return -1;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    if (period != 0) {
+        // Admission control: keep the guaranteed share of this CPU below the limit
+        int cpu = proc->cpu >= 0 ? proc->cpu : 0;
+        SchedCpu* sc = &sched_cpus[cpu];
+        uint32_t util = budget * 1000 / period;
+        for (int q = 0; q < sc->queue_len; ++q) {
+            Process* other = process_table[sc->queue[q]];
+            if (other && other != proc && is_deadline(other)) {
+                util += other->dl.budget * 1000 / other->dl.period;
+            }
+        }
+        if (util > SCHED_DL_MAX_UTIL_PERMILLE) {
+            spin_unlock_irqrestore(&sched_lock, flags);
+            return -1;
+        }
+    }
+    proc->dl.period = period;
+    proc->dl.budget = budget;
+    proc->dl.deadline = get_ticks() + period;
+    proc->dl.remaining = budget;
+    proc->dl.throttled = 0;
+    proc->dl.misses = 0;
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+SchedulerPolicy scheduler_get_policy() {
+    return scheduler_policy;
+}
+
+int scheduler_level_quantum(int level) {
+    if (level < 0) level = 0;
+    if (level >= MLFQ_LEVELS) level = MLFQ_LEVELS - 1;
+    return mlfq_quantum_ticks[level];
+}
+
+void scheduler_dump() {
+    printf("Policy: %s\n", scheduler_policy == SCHED_POLICY_MLFQ ? "mlfq" : "lottery");
+    if (scheduler_policy == SCHED_POLICY_MLFQ) {
+        printf("Quanta:");
+        for (int level = 0; level < MLFQ_LEVELS; ++level) {
+            printf(" L%d=%d", level, mlfq_quantum_ticks[level]);
+        }
+        printf(" ticks, boost every %d ticks\n", MLFQ_BOOST_INTERVAL_TICKS);
+    }
+    printf("PID  NAME             CPU  LVL  USED  TICKETS  STATE\n");
     for (int i = 0; i < MAX_PROCESSES; ++i) {
         Process* proc = process_table[i];
-        if (proc && proc->alive) {
-            total_tickets += proc->tickets;
+        if (!proc) continue;
+        const char* state = !proc->alive ? "dead"
+                          : (proc->on_cpu >= 0 ? "running"
+                          : (proc->sleeping ? "blocked"
+                          : (proc->hook_count > 0 ? "waiting" : "ready")));
+        printf("%-4d %-16s %-4d %-4d %-5d %-8d %s\n", proc->pid, proc->name ? proc->name : "?",
+               proc->cpu, proc->priority_level, proc->quantum_ticks_used, proc->tickets, state);
+    }
+    bool dl_header = false;
+    for (int i = 0; i < MAX_PROCESSES; ++i) {
+        Process* proc = process_table[i];
+        if (!proc || !is_deadline(proc)) continue;
+        if (!dl_header) {
+            printf("Deadline class (EDF):\nPID  NAME             PERIOD  BUDGET  LEFT  MISSES\n");
+            dl_header = true;
         }
+        printf("%-4d %-16s %-7u %-7u %-5u %u%s\n", proc->pid, proc->name ? proc->name : "?",
+               proc->dl.period, proc->dl.budget, proc->dl.remaining, proc->dl.misses,
+               proc->dl.throttled ? " (throttled)" : "");
     }
-    
-    if (total_tickets == 0) {
-        PANIC("No runnable processes left after process exit");
+}
+
+void scheduler_dump_cpus() {
+    printf("CPU  APIC  QUEUE  SWITCHES  STEALS  BUSY%%  CURRENT\n");
+    for (int c = 0; c < smp_cpu_count(); ++c) {
+        SchedCpu* sc = &sched_cpus[c];
+        cpu_info_t* info = smp_get_cpu(c);
+        uint32_t total = sc->busy_ticks + sc->idle_ticks;
+        Process* current = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+        printf("%-4d %-5u %-6d %-9u %-7u %-6u %s\n", c, info ? info->apic_id : 0, sc->queue_len,
+               sc->switches, sc->steals, total ? (sc->busy_ticks * 100) / total : 0,
+               current && current->name ? current->name : "(idle)");
+    }
+}
+
+static const char* const wake_latency_labels[WAKE_LATENCY_BUCKETS] = {
+    "<1us", "<4us", "<16us", "<64us", "<256us", "<1ms", "<4ms", ">=4ms"
+};
+
+// One `top` line, copied out under sched_lock so printing happens unlocked
+typedef struct TopRow {
+    int pid;
+    const char* name;
+    uint32_t interval_ticks;
+    uint32_t cpu_ticks;
+    uint32_t voluntary;
+    uint32_t involuntary;
+    uint32_t blocked[PROCESS_BLOCK_REASONS];
+    int p50_bucket;
+} TopRow;
+
+// Median bucket of a latency histogram, or -1 if it is empty
+static int wake_latency_p50(const ProcessStats* stats) {
+    uint32_t total = 0;
+    for (int b = 0; b < WAKE_LATENCY_BUCKETS; ++b) total += stats->wake_latency_hist[b];
+    if (total == 0) return -1;
+    uint32_t seen = 0;
+    for (int b = 0; b < WAKE_LATENCY_BUCKETS; ++b) {
+        seen += stats->wake_latency_hist[b];
+        if (seen * 2 >= total) return b;
+    }
+    return WAKE_LATENCY_BUCKETS - 1;
+}
+
+void scheduler_dump_top() {
+    static TopRow rows[MAX_PROCESSES];
+    uint32_t busy[MAX_CPUS];
+    uint32_t idle[MAX_CPUS];
+    uint32_t hist[WAKE_LATENCY_BUCKETS] = {};
+    int ncpus = smp_cpu_count();
+    int nrows = 0;
+
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    for (int c = 0; c < ncpus; ++c) {
+        SchedCpu* sc = &sched_cpus[c];
+        busy[c] = sc->busy_ticks - sc->top_busy_ticks;
+        idle[c] = sc->idle_ticks - sc->top_idle_ticks;
+        sc->top_busy_ticks = sc->busy_ticks;
+        sc->top_idle_ticks = sc->idle_ticks;
     }
-    
-    // Lottery selection from all alive processes
-    int winner = xorshift32() % total_tickets;
-    int count = 0;
     for (int i = 0; i < MAX_PROCESSES; ++i) {
         Process* proc = process_table[i];
-        if (proc && proc->alive) {
-            count += proc->tickets;
-            if (winner < count) {
-                next = proc;
-                current_process_idx = i;
-                break;
-            }
-        }
+        if (!proc || !proc->alive) continue;
+        ProcessStats* st = &proc->stats;
+        TopRow* row = &rows[nrows++];
+        row->pid = proc->pid;
+        row->name = proc->name;
+        row->interval_ticks = st->cpu_ticks - st->top_cpu_ticks;
+        st->top_cpu_ticks = st->cpu_ticks;
+        row->cpu_ticks = st->cpu_ticks;
+        row->voluntary = st->voluntary_switches;
+        row->involuntary = st->involuntary_switches;
+        for (int r = 0; r < PROCESS_BLOCK_REASONS; ++r) row->blocked[r] = st->blocked_ticks[r];
+        row->p50_bucket = wake_latency_p50(st);
+        for (int b = 0; b < WAKE_LATENCY_BUCKETS; ++b) hist[b] += st->wake_latency_hist[b];
     }
-    
-    if (!next) {
-        PANIC("Failed to select next process after exit");
-    }
-        
-    // Set up the next context
-    // Use volatile to prevent compiler optimization issues
-    volatile CPUContext** ctx_ptr = (volatile CPUContext**)&g_next_context;
-    *ctx_ptr = &next->current_state.context;
-    
-    // Memory barrier to ensure g_next_context is written before jumping
-    asm volatile("" ::: "memory");
-    
-    // Get the address of the trampoline and jump to it
-    // We must use jmp, not call, so no return address is pushed
-    // Using a function pointer cast ensures proper linkage in all build configurations
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    printf("top - up %us, %d CPU(s), %d processes (q to quit)\n",
+           (uint32_t)(ktime_get_ns() / 1000000000ull), ncpus, nrows);
+    uint32_t interval = 0;
+    for (int c = 0; c < ncpus; ++c) {
+        uint32_t total = busy[c] + idle[c];
+        if (total > interval) interval = total;
+        printf("cpu%d %3u%%  ", c, total ? (busy[c] * 100) / total : 0);
+    }
+    printf("\n\nPID  NAME         %%CPU   TICKS    VOL  INVOL  TIMER SIGNAL CUSTOM  WAITQ   P50\n");
+    for (int i = 0; i < nrows; ++i) {
+        TopRow* row = &rows[i];
+        printf("%-4d %-12s %3u%% %7u %6u %6u %6u %6u %6u %6u %5s\n", row->pid,
+               row->name ? row->name : "?", interval ? (row->interval_ticks * 100) / interval : 0,
+               row->cpu_ticks, row->voluntary, row->involuntary,
+               row->blocked[(int)HookType::TIME_REACHED], row->blocked[(int)HookType::SIGNAL],
+               row->blocked[(int)HookType::CUSTOM], row->blocked[PROCESS_BLOCK_WAIT_QUEUE],
+               row->p50_bucket >= 0 ? wake_latency_labels[row->p50_bucket] : "-");
+    }
+    printf("\nBlocked times in ms. Wakeup-to-run latency, all processes:\n");
+    for (int b = 0; b < WAKE_LATENCY_BUCKETS; ++b) {
+        printf(" %s:%u", wake_latency_labels[b], hist[b]);
+    }
+    printf("\n");
+}
+
+void scheduler_force_switch() {
+    SchedCpu* sc = this_sched_cpu();
+    if (sc->last_regs)
+        context_switch(sc->last_regs);
+}
+
+void scheduler_force_switch_with_regs(registers_t* regs) {
+    if (regs)
+        context_switch(regs);
+}
+
+// Enter `ctx` through the trampoline; interrupts must already be disabled
+static void __attribute__((noreturn)) jump_to_context(CPUContext* ctx, Process* prev) {
+    volatile int* prev_on_cpu = prev ? &prev->on_cpu : nullptr;
     void (*trampoline_ptr)() = switch_to_trampoline;
-    
+    // We must use jmp, not call, so no return address is pushed
     asm volatile(
         "jmp *%0"
         :
-        : "r"(trampoline_ptr)
+        : "r"(trampoline_ptr), "d"(ctx), "c"(prev_on_cpu)
         : "memory"
     );
-    
-    // This point should never be reached
     __builtin_unreachable();
 }
 
+void scheduler_exit_current_and_switch(registers_t* regs) {
+    (void)regs; // Mark unused parameter
+
+    // Current process is already dead (killed before calling this).
+    // Prefer a runnable process; otherwise any alive process in this CPU's queue,
+    // since a hooked process simply re-polls; otherwise park the CPU in idle.
+    asm volatile("cli");
+    int cpu = smp_current_cpu();
+    SchedCpu* sc = &sched_cpus[cpu];
+    spin_lock(&sched_lock);
+    Process* current = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+
+    // The reaper releases the dead process's slot and memory once we are off its stack
+    if (current && !current->alive) {
+        sc->current_idx = -1;
+    }
+
+    int next_idx = select_next(cpu);
+    if (next_idx < 0) {
+        for (int q = 0; q < sc->queue_len; ++q) {
+            Process* proc = process_table[sc->queue[q]];
+            if (proc && proc->alive && proc->on_cpu == -1) {
+                next_idx = sc->queue[q];
+                break;
+            }
+        }
+    }
+
+    CPUContext* ctx = &sc->idle_context;
+    Process* next = next_idx >= 0 ? process_table[next_idx] : NULL;
+    load_process_context(cpu, next);
+    if (next) {
+        account_switch_in(next);
+        next->on_cpu = cpu;
+        ctx = &next->current_state.context;
+        sc->switches++;
+    }
+    sc->current_idx = next_idx;
+    sc->quantum_counter = 0;
+    sc->need_resched = false;
+    spin_unlock(&sched_lock);
+
+    jump_to_context(ctx, current);
+}
+
 void scheduler_start() {
-    Process* proc = scheduler_current_process();
-    if (!proc) return;
-    asm volatile(
-        "mov %0, %%esp\n"
-        "mov %1, %%ebp\n"
-        "jmp *%2\n"
-        :
-        : "r"(proc->current_state.context.esp),
-          "r"(proc->current_state.context.ebp),
-          "r"(proc->current_state.context.eip)
-        : "memory"
-    );
+    asm volatile("cli");
+    SchedCpu* sc = &sched_cpus[0];
+    spin_lock(&sched_lock);
+    scheduler_running = true;
+    Process* proc = sc->current_idx >= 0 ? process_table[sc->current_idx] : NULL;
+    CPUContext* ctx = &sc->idle_context;
+    if (proc) {
+        proc->on_cpu = 0;
+        load_process_context(0, proc);
+        ctx = &proc->current_state.context;
+    }
+    spin_unlock(&sched_lock);
+    jump_to_context(ctx, nullptr);
+}
+
+void scheduler_ap_enter() {
+    asm volatile("cli");
+    SchedCpu* sc = this_sched_cpu();
+    sc->current_idx = -1;
+    jump_to_context(&sc->idle_context, nullptr);
 }
 
 void scheduler_set_foreground(Process* proc) {
@@ -12,10 +12,24 @@
 #include "editor_process.h"
 #include <kernel/process.h>
 #include <kernel/blockdev.h>
+#include <kernel/bcache.h>
 #include <kernel/fat32.h>
+#include <kernel/ide.h>
 #include <kernel/memory.h>
+#include <kernel/paging.h>
 #include <kernel/scheduler.h>
+#include <kernel/smp.h>
+#include <kernel/spinlock.h>
+#include <kernel/softirq.h>
+#include <kernel/irqstat.h>
+#include <kernel/irqoff.h>
+#include <kernel/workqueue.h>
+#include <kernel/waitqueue.h>
 #include <process.h>
+#include <sys/syscall.h>
+#include <kernel/tsc.h>
+#include <kernel/ktime.h>
+#include <kernel/elf.h>
 #include <kernel/framebuffer.h>
 #include <kernel/graphics.h>
 
@@ -24,6 +38,9 @@ extern shell_command_t commands[];
 
 #define SHELL_BUFFER_SIZE    256
 #define SHELL_HISTORY_SIZE   16
+#define SHELL_DL_PERIOD      16 // ~60 Hz
+#define SHELL_DL_BUDGET      2
+#define SHELL_EVENT_BATCH    16 // Events copied per drain syscall
 
 static Process* g_shell_process = nullptr;
 
@@ -981,6 +998,560 @@ void cmd_lspci(const char* args) {
     pci_list_devices();
 }
 
+// Parse a decimal number, advancing *text past it and any following spaces
+static uint32_t parse_uint(const char** text) {
+    uint32_t value = 0;
+    const char* p = *text;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (uint32_t)(*p++ - '0');
+    }
+    while (*p == ' ') ++p;
+    *text = p;
+    return value;
+}
+
+// sched dl <pid> <period> <budget>: move a process into (period 0: out of) the EDF class
+static void sched_set_deadline(const char* args) {
+    uint32_t pid = parse_uint(&args);
+    uint32_t period = parse_uint(&args);
+    uint32_t budget = parse_uint(&args);
+    Process* target = process_find((int)pid);
+    if (!target || !target->alive) {
+        printf("sched: no process with pid %u\n", pid);
+        return;
+    }
+    if (scheduler_set_deadline(target, period, budget) != 0) {
+        printf("sched: deadline %u/%u rejected (budget must be 1..period, CPU limit %d%%)\n",
+               budget, period, SCHED_DL_MAX_UTIL_PERMILLE / 10);
+    }
+}
+
+// Show or change the scheduling policy
+void cmd_sched(const char* args) {
+    if (args && *args) {
+        if (strncmp(args, "dl ", 3) == 0) {
+            sched_set_deadline(args + 3);
+        } else if (strcmp(args, "mlfq") == 0) {
+            scheduler_set_policy(SCHED_POLICY_MLFQ);
+        } else if (strcmp(args, "lottery") == 0) {
+            scheduler_set_policy(SCHED_POLICY_LOTTERY);
+        } else {
+            printf("Usage: sched [mlfq|lottery|dl <pid> <period> <budget>]\n");
+            return;
+        }
+    }
+    scheduler_dump();
+}
+
+// Show per-CPU scheduler state
+void cmd_cpus(const char* args) {
+    (void)args;
+    printf("%d CPU(s) online\n", smp_cpu_count());
+    scheduler_dump_cpus();
+}
+
+#define TOP_REFRESH_TICKS 1000
+#define TOP_POLL_TICKS    50
+
+// Returns true when the pending input asks `top` to quit (q or Esc)
+static bool top_quit_requested() {
+    IOEvent event;
+    bool quit = false;
+    while (process_poll_event(&event)) {
+        if (event.type != EVENT_KEYBOARD || event.data.keyboard.release) continue;
+        char c = kb_to_ascii(event.data.keyboard);
+        if (c == 'q' || c == 'Q' || event.data.keyboard.scancode == 0x01) {
+            quit = true;
+        }
+    }
+    return quit;
+}
+
+// Live process monitor running in its own terminal window
+static void top_entry() {
+    const bool windowed = framebuffer::is_available();
+    bool running = true;
+    while (running) {
+        if (windowed) {
+            graphics::clear(graphics::make_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        } else {
+            terminal.clear();
+        }
+        scheduler_dump_top();
+        if (windowed) {
+            graphics::present();
+        }
+        uint32_t deadline = get_ticks() + TOP_REFRESH_TICKS;
+        while (running && get_ticks() < deadline) {
+            running = !top_quit_requested();
+            if (running) {
+                yield_for_event((int)HookType::TIME_REACHED, get_ticks() + TOP_POLL_TICKS);
+            }
+        }
+    }
+    process_exit(0);
+}
+
+void cmd_top(const char* args) {
+    (void)args;
+    Process* p = k_start_process("top", top_entry, 0, 8192);
+    if (!p) {
+        printf("top: failed to start process\n");
+        return;
+    }
+    scheduler_set_foreground(p);
+    shell_set_input_enabled(false);
+}
+
+#define SMPBENCH_MAX_WORKERS 16
+#define SMPBENCH_UNITS_PER_WORKER 200
+#define SMPBENCH_SPINS_PER_UNIT 200000
+
+static volatile uint32_t smpbench_finished;
+static volatile uint32_t smpbench_units_on_cpu[MAX_CPUS];
+
+// CPU-bound worker: fixed amount of arithmetic, tallying which CPU ran each unit
+static void smpbench_worker() {
+    for (int unit = 0; unit < SMPBENCH_UNITS_PER_WORKER; ++unit) {
+        volatile uint32_t acc = (uint32_t)unit;
+        for (uint32_t i = 0; i < SMPBENCH_SPINS_PER_UNIT; ++i) {
+            acc = acc * 1664525u + 1013904223u;
+        }
+        __sync_fetch_and_add(&smpbench_units_on_cpu[smp_current_cpu()], 1);
+    }
+    __sync_fetch_and_add(&smpbench_finished, 1);
+    process_exit(0);
+}
+
+// Run N CPU-bound processes and report wall time and per-CPU distribution
+void cmd_smpbench(const char* args) {
+    uint32_t workers = 0;
+    for (const char* p = args; p && *p >= '0' && *p <= '9'; ++p) {
+        workers = workers * 10 + (uint32_t)(*p - '0');
+    }
+    if (workers == 0) workers = 4;
+    if (workers > SMPBENCH_MAX_WORKERS) workers = SMPBENCH_MAX_WORKERS;
+
+    smpbench_finished = 0;
+    for (int c = 0; c < MAX_CPUS; ++c) smpbench_units_on_cpu[c] = 0;
+
+    uint32_t start = get_ticks();
+    uint32_t started = 0;
+    for (uint32_t i = 0; i < workers; ++i) {
+        if (k_start_process("smpbench", smpbench_worker, 0, 4096)) started++;
+    }
+    while (smpbench_finished < started) {
+        yield_for_event((int)HookType::TIME_REACHED, get_ticks() + 10);
+    }
+    uint32_t elapsed = get_ticks() - start;
+
+    printf("smpbench: %u workers x %u units on %d CPU(s): %u ms\n", started,
+           SMPBENCH_UNITS_PER_WORKER, smp_cpu_count(), elapsed);
+    for (int c = 0; c < smp_cpu_count(); ++c) {
+        printf("  cpu%d: %u units\n", c, smpbench_units_on_cpu[c]);
+    }
+}
+
+#define SPAWNBENCH_DEFAULT_CYCLES 5000
+#define SPAWNBENCH_REPORT_EVERY   1000
+
+static volatile uint32_t spawnbench_exited;
+
+static void spawnbench_worker() {
+    __sync_fetch_and_add(&spawnbench_exited, 1);
+    process_exit(0);
+}
+
+// Spawn and exit N trivial processes, reporting time and memory per batch
+void cmd_spawnbench(const char* args) {
+    uint32_t cycles = 0;
+    for (const char* p = args; p && *p >= '0' && *p <= '9'; ++p) {
+        cycles = cycles * 10 + (uint32_t)(*p - '0');
+    }
+    if (cycles == 0) cycles = SPAWNBENCH_DEFAULT_CYCLES;
+
+    spawnbench_exited = 0;
+    uint32_t batch_start = get_ticks();
+    for (uint32_t i = 1; i <= cycles; ++i) {
+        // The process table is small: wait for the reaper when it fills up
+        while (!k_start_process("spawnbench", spawnbench_worker, 0, 4096)) {
+            yield();
+        }
+        if (i % SPAWNBENCH_REPORT_EVERY == 0 || i == cycles) {
+            heap_stats_t heap;
+            get_heap_stats(&heap);
+            uint32_t in_use, capacity, reaped;
+            process_pool_stats(&in_use, &capacity, &reaped);
+            printf("spawnbench: %u spawned, %u ms for last batch, heap used %u, pool %u/%u, reaped %u\n",
+                   i, get_ticks() - batch_start, heap.used_size, in_use, capacity, reaped);
+            batch_start = get_ticks();
+        }
+    }
+    while (spawnbench_exited < cycles) {
+        yield();
+    }
+}
+
+// Run an ELF executable from the VFS as a ring-3 process
+void cmd_exec(const char* args) {
+    if (!args || !*args) {
+        printf("Usage: exec <file>\n");
+        return;
+    }
+
+    char path[VFS_MAX_PATH];
+
+    // Handle relative paths
+    if (args[0] != '/') {
+        strcpy(path, vfs_getcwd());
+        if (strcmp(path, "/") != 0) {
+            strcat(path, "/");
+        }
+        strcat(path, args);
+    } else {
+        strcpy(path, args);
+    }
+
+    uint32_t start = get_ticks();
+    Process* p = elf_exec(path);
+    if (!p) {
+        printf("exec: cannot run '%s'\n", args);
+        return;
+    }
+    printf("exec: started '%s' as pid %d in %u ms\n", args, p->pid, get_ticks() - start);
+}
+
+#define SYSBENCH_DEFAULT_CALLS 100000
+
+static USER_DATA uint32_t sysbench_calls;
+static USER_DATA int sysbench_use_sysenter;
+static USER_DATA volatile uint64_t sysbench_int80_cycles;
+static USER_DATA volatile uint64_t sysbench_sysenter_cycles;
+static USER_DATA volatile uint64_t sysbench_batch_cycles;
+static USER_DATA volatile int sysbench_done;
+static USER_DATA SyscallBatchEntry sysbench_batch[SYSCALL_BATCH_MAX];
+
+// Runs in ring 3: time null syscalls through both entry paths. Only USER_TEXT and
+// USER_DATA are mapped for it, so every helper is inlined and kernel state (like
+// g_sysenter_enabled) is copied into USER_DATA by the caller.
+static USER_TEXT __attribute__((flatten)) void sysbench_worker() {
+    uint32_t calls = sysbench_calls;
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < calls; ++i) {
+        syscall_int80(SYSCALL_NOP, 0, 0, 0, 0);
+    }
+    sysbench_int80_cycles = rdtsc() - start;
+    if (sysbench_use_sysenter) {
+        start = rdtsc();
+        for (uint32_t i = 0; i < calls; ++i) {
+            syscall_sysenter(SYSCALL_NOP, 0, 0, 0, 0);
+        }
+        sysbench_sysenter_cycles = rdtsc() - start;
+    }
+    for (uint32_t i = 0; i < SYSCALL_BATCH_MAX; ++i) {
+        sysbench_batch[i].num = SYSCALL_NOP;
+    }
+    start = rdtsc();
+    for (uint32_t done = 0; done < calls; done += SYSCALL_BATCH_MAX) {
+        uint32_t chunk = calls - done < SYSCALL_BATCH_MAX ? calls - done : SYSCALL_BATCH_MAX;
+        // syscall_batch() would read the kernel's g_sysenter_enabled
+        if (sysbench_use_sysenter) {
+            syscall_sysenter(SYSCALL_BATCH, (uint32_t)sysbench_batch, chunk, 0, 0);
+        } else {
+            syscall_int80(SYSCALL_BATCH, (uint32_t)sysbench_batch, chunk, 0, 0);
+        }
+    }
+    sysbench_batch_cycles = rdtsc() - start;
+    sysbench_done = 1;
+    for (;;) {
+        syscall_int80(SYSCALL_EXIT, 0, 0, 0, 0);
+    }
+}
+
+// Compare the cost of a null syscall via int $0x80 (ring 0 and ring 3), SYSENTER and SYSCALL_BATCH
+void cmd_sysbench(const char* args) {
+    uint32_t calls = args ? parse_uint(&args) : 0;
+    if (calls == 0) calls = SYSBENCH_DEFAULT_CALLS;
+
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < calls; ++i) {
+        syscall_int80(SYSCALL_NOP, 0, 0, 0, 0);
+    }
+    uint64_t ring0_cycles = rdtsc() - start;
+
+    sysbench_calls = calls;
+    sysbench_use_sysenter = g_sysenter_enabled;
+    sysbench_int80_cycles = 0;
+    sysbench_sysenter_cycles = 0;
+    sysbench_batch_cycles = 0;
+    sysbench_done = 0;
+    if (!k_start_user_process("sysbench", sysbench_worker, 4096)) {
+        printf("sysbench: failed to start user process\n");
+        return;
+    }
+    while (!sysbench_done) {
+        yield();
+    }
+
+    printf("sysbench: %u null syscalls per path (cycles/call, ns/call)\n", calls);
+    printf("  int 0x80 from ring 0: %u, %u\n", (uint32_t)(ring0_cycles / calls),
+           (uint32_t)(ktime_cycles_to_ns(ring0_cycles) / calls));
+    printf("  int 0x80 from ring 3: %u, %u\n", (uint32_t)(sysbench_int80_cycles / calls),
+           (uint32_t)(ktime_cycles_to_ns(sysbench_int80_cycles) / calls));
+    if (g_sysenter_enabled) {
+        printf("  sysenter from ring 3: %u, %u\n", (uint32_t)(sysbench_sysenter_cycles / calls),
+               (uint32_t)(ktime_cycles_to_ns(sysbench_sysenter_cycles) / calls));
+    } else {
+        printf("  sysenter: not supported by this CPU\n");
+    }
+    printf("  batched by %u from ring 3: %u, %u\n", (uint32_t)SYSCALL_BATCH_MAX,
+           (uint32_t)(sysbench_batch_cycles / calls),
+           (uint32_t)(ktime_cycles_to_ns(sysbench_batch_cycles) / calls));
+}
+
+#define DISKBENCH_CHUNK_SECTORS 128 // 64 KiB per request
+#define DISKBENCH_DEFAULT_MB    8
+
+// Read `sectors` from the start of block device 0 in 64 KiB requests; returns ns or 0 on error
+static uint64_t diskbench_pass(uint8_t* buffer, uint32_t sectors) {
+    uint64_t start = ktime_get_ns();
+    for (uint32_t lba = 0; lba < sectors; lba += DISKBENCH_CHUNK_SECTORS) {
+        uint32_t count = sectors - lba < DISKBENCH_CHUNK_SECTORS ? sectors - lba : DISKBENCH_CHUNK_SECTORS;
+        if (blockdev_read_direct(0, lba, count, buffer) != 0) return 0;
+    }
+    return ktime_get_ns() - start;
+}
+
+// Sequential read throughput of disk 0 with PIO and with bus-master DMA
+void cmd_diskbench(const char* args) {
+    uint32_t mb = args ? parse_uint(&args) : 0;
+    if (mb == 0) mb = DISKBENCH_DEFAULT_MB;
+    blockdev_info_t* info = blockdev_get_info(0);
+    if (!info) {
+        printf("diskbench: no block device 0\n");
+        return;
+    }
+    uint32_t sectors = mb * 2048;
+    if (sectors > info->sector_count) sectors = info->sector_count;
+    uint8_t* buffer = (uint8_t*)kmalloc(DISKBENCH_CHUNK_SECTORS * 512);
+    if (!buffer) {
+        printf("diskbench: out of memory\n");
+        return;
+    }
+
+    printf("diskbench: reading %u KiB sequentially in 64 KiB requests\n", sectors / 2);
+    const char* const modes[2] = { "PIO", "DMA" };
+    int old = ide_set_dma(0);
+    for (int dma = 0; dma < 2; ++dma) {
+        ide_set_dma(dma);
+        uint64_t ns = diskbench_pass(buffer, sectors);
+        if (ns == 0) {
+            printf("  %s: read failed\n", modes[dma]);
+            continue;
+        }
+        uint64_t kib_per_s = (uint64_t)sectors * 512 * 1000000000ull / 1024 / ns;
+        printf("  %s: %u KiB/s, %u us per request\n", modes[dma], (uint32_t)kib_per_s,
+               (uint32_t)(ns / 1000 / ((sectors + DISKBENCH_CHUNK_SECTORS - 1) / DISKBENCH_CHUNK_SECTORS)));
+    }
+    ide_set_dma(old);
+    kfree(buffer);
+}
+
+#define RANDREAD_BLOCK_SECTORS 8    // 4 KiB per read
+#define RANDREAD_MAX_DEPTH     32
+#define RANDREAD_DEFAULT_READS 2048
+
+// Reads kept in flight by resubmitting from the completion callback
+typedef struct {
+    blk_request_t reqs[RANDREAD_MAX_DEPTH];
+    uint8_t* buffers;
+    wait_queue_t wait;
+    uint8_t device;
+    uint32_t blocks;              // 4 KiB blocks on the device
+    uint32_t base;                // Sequence number of this pass's first read
+    uint32_t total;
+    volatile uint32_t next;       // Next sequence number to submit
+    volatile uint32_t outstanding;
+    volatile uint32_t errors;
+} randread_t;
+
+// Scatter sequence numbers over the device (Knuth's multiplicative hash)
+static uint32_t randread_block(const randread_t* rr, uint32_t seq) {
+    return (uint32_t)(((uint64_t)((rr->base + seq) * 2654435761u) * rr->blocks) >> 32);
+}
+
+static int randread_submit(randread_t* rr, int slot, uint32_t seq) {
+    blk_request_t* req = &rr->reqs[slot];
+    blk_request_init(req, rr->device, randread_block(rr, seq) * RANDREAD_BLOCK_SECTORS,
+                     RANDREAD_BLOCK_SECTORS, rr->buffers + slot * RANDREAD_BLOCK_SECTORS * 512, 0,
+                     req->end_io, rr);
+    return blockdev_submit(req);
+}
+
+// SOFTIRQ_BLOCK: start the next read in this slot, or retire the slot
+static void randread_end_io(blk_request_t* req) {
+    randread_t* rr = (randread_t*)req->private_data;
+    if (req->status != BLOCKDEV_SUCCESS) __sync_add_and_fetch(&rr->errors, 1);
+    uint32_t seq = __sync_fetch_and_add(&rr->next, 1);
+    if (seq < rr->total && randread_submit(rr, (int)(req - rr->reqs), seq) == BLOCKDEV_SUCCESS) {
+        return;
+    }
+    if (__sync_sub_and_fetch(&rr->outstanding, 1) == 0) {
+        wake_up(&rr->wait, 0);
+    }
+}
+
+// One pass at `depth` reads in flight; returns ns, or 0 if nothing could be queued
+static uint64_t randread_pass(randread_t* rr, Process* proc, uint32_t depth) {
+    rr->next = depth;
+    rr->outstanding = depth;
+    uint64_t start = ktime_get_ns();
+    for (uint32_t slot = 0; slot < depth; slot++) {
+        rr->reqs[slot].end_io = randread_end_io;
+        if (randread_submit(rr, (int)slot, slot) != BLOCKDEV_SUCCESS) {
+            if (slot == 0) return 0;
+            // Run with the slots that did get going
+            __sync_sub_and_fetch(&rr->outstanding, depth - slot);
+            break;
+        }
+    }
+    wait_event(&rr->wait, proc, rr->outstanding == 0);
+    return ktime_get_ns() - start;
+}
+
+// Random 4 KiB reads at queue depths 1 to 32, bypassing the buffer cache
+void cmd_randread(const char* args) {
+    uint32_t device = args ? parse_uint(&args) : 0;
+    uint32_t reads = args ? parse_uint(&args) : 0;
+    if (reads == 0) reads = RANDREAD_DEFAULT_READS;
+    blockdev_info_t* info = blockdev_get_info((uint8_t)device);
+    if (!info) {
+        printf("randread: no block device %u\n", device);
+        return;
+    }
+    Process* proc = scheduler_current_process();
+    if (!proc) {
+        printf("randread: needs process context\n");
+        return;
+    }
+    randread_t* rr = (randread_t*)kmalloc(sizeof(randread_t));
+    uint8_t* buffers = (uint8_t*)kmalloc(RANDREAD_MAX_DEPTH * RANDREAD_BLOCK_SECTORS * 512);
+    if (!rr || !buffers) {
+        printf("randread: out of memory\n");
+        kfree(rr);
+        kfree(buffers);
+        return;
+    }
+    memset(rr, 0, sizeof(*rr));
+    rr->buffers = buffers;
+    wait_queue_init(&rr->wait, "randread");
+    rr->device = (uint8_t)device;
+    rr->blocks = info->sector_count / RANDREAD_BLOCK_SECTORS;
+    rr->total = reads;
+
+    printf("randread: %u random 4 KiB reads per depth on %s (%u MiB)\n", reads, info->name,
+           info->sector_count / 2048);
+    for (uint32_t depth = 1; depth <= RANDREAD_MAX_DEPTH; depth *= 2) {
+        rr->errors = 0;
+        uint64_t ns = randread_pass(rr, proc, depth);
+        rr->base += reads; // Fresh blocks each pass, so the drive's cache does not help
+        if (ns == 0) {
+            printf("randread: %s cannot queue requests\n", info->name);
+            break;
+        }
+        // Little's law: average latency = depth / throughput
+        printf("  depth %2u: %u IOPS, %u KiB/s, %u us average latency%s\n", depth,
+               (uint32_t)((uint64_t)reads * 1000000000ull / ns),
+               (uint32_t)((uint64_t)reads * 4 * 1000000000ull / ns),
+               (uint32_t)(ns / 1000 * depth / reads), rr->errors ? " (errors)" : "");
+    }
+    kfree(buffers);
+    kfree(rr);
+}
+
+// Write every dirty cached sector back to its device
+void cmd_sync(const char* args) {
+    (void)args;
+    if (bcache_sync(-1) != BLOCKDEV_SUCCESS) {
+        printf("sync: write-back failed\n");
+    }
+}
+
+// Show buffer cache statistics, flush it, clear its counters or resize it
+void cmd_bcache(const char* args) {
+    if (args && strcmp(args, "sync") == 0) {
+        cmd_sync(NULL);
+        return;
+    }
+    if (args && strcmp(args, "reset") == 0) {
+        bcache_reset_stats();
+        printf("Buffer cache statistics cleared\n");
+        return;
+    }
+    if (args && strncmp(args, "size", 4) == 0) {
+        args += 4;
+        while (*args == ' ') ++args;
+        uint32_t buffers = parse_uint(&args);
+        if (buffers == 0) {
+            printf("Usage: bcache size <buffers>\n");
+            return;
+        }
+        if (bcache_resize(buffers) != 0) {
+            printf("bcache: resize failed\n");
+            return;
+        }
+    }
+    bcache_dump_stats();
+}
+
+// Show or clear the block I/O scheduler's merge and request size counters
+void cmd_iostat(const char* args) {
+    if (args && strcmp(args, "reset") == 0) {
+        blockdev_reset_stats();
+        printf("Block I/O statistics cleared\n");
+        return;
+    }
+    blockdev_dump_stats();
+}
+
+// Show or clear per-lock contention and hold-time statistics
+void cmd_lockstat(const char* args) {
+    if (args && strcmp(args, "reset") == 0) {
+        lock_stats_reset();
+        printf("Lock statistics cleared\n");
+        return;
+    }
+    lock_stats_dump();
+}
+
+// Show softirq/workqueue activity and the longest hard IRQ handler
+void cmd_softirqs(const char* args) {
+    (void)args;
+    softirq_dump_stats();
+    workqueue_dump_stats();
+}
+
+// Show or clear per-vector interrupt counts, handler cycles and latency histograms
+void cmd_irqstat(const char* args) {
+    if (args && strcmp(args, "reset") == 0) {
+        irqstat_reset();
+        printf("Interrupt statistics cleared\n");
+        return;
+    }
+    irqstat_dump();
+}
+
+// Dump the longest interrupts-disabled windows to serial, or clear them
+void cmd_irqoff(const char* args) {
+    if (args && strcmp(args, "reset") == 0) {
+        irqoff_trace_reset();
+        printf("Interrupts-off trace cleared\n");
+        return;
+    }
+    int written = irqoff_trace_dump();
+    printf("irqoff: %d window(s) written to serial\n", written);
+}
+
 // Command lookup table
 shell_command_t commands[] = {
     { "help",     cmd_help,     "Show available commands" },
@@ -1004,6 +1575,22 @@ shell_command_t commands[] = {
     { "meminfo",   cmd_meminfo,    "Show detailed memory usage" },
     { "free",      cmd_free,       "Display memory usage summary" },
     { "lspci",     cmd_lspci,      "List PCI devices" },
+    { "sched",     cmd_sched,      "Show or set scheduler policy (mlfq|lottery|dl <pid> <period> <budget>)" },
+    { "cpus",      cmd_cpus,       "Show per-CPU run queues" },
+    { "spawnbench", cmd_spawnbench, "Spawn/exit N processes and report throughput and memory" },
+    { "top",       cmd_top,        "Live per-process CPU, switch, blocking and latency stats" },
+    { "sysbench",  cmd_sysbench,   "Time null syscalls via int 0x80 and SYSENTER" },
+    { "diskbench", cmd_diskbench,  "Compare PIO and DMA sequential disk reads (diskbench [MB])" },
+    { "randread",  cmd_randread,   "Random 4 KiB reads at queue depths 1-32 (randread [dev] [reads])" },
+    { "bcache",    cmd_bcache,     "Show buffer cache statistics (bcache [sync|reset|size N])" },
+    { "sync",      cmd_sync,       "Write cached disk data back" },
+    { "iostat",    cmd_iostat,     "Show block request merging and sizes (iostat [reset])" },
+    { "exec",      cmd_exec,       "Run an ELF executable (pages load on demand)" },
+    { "smpbench",  cmd_smpbench,   "Run CPU-bound workers across CPUs (smpbench [n])" },
+    { "lockstat",  cmd_lockstat,   "Show lock contention statistics (lockstat [reset])" },
+    { "softirqs",  cmd_softirqs,   "Show deferred work statistics" },
+    { "irqstat",   cmd_irqstat,    "Show per-vector interrupt statistics (irqstat [reset])" },
+    { "irqoff",    cmd_irqoff,     "Dump the longest interrupts-off windows to serial (irqoff [reset])" },
     { NULL,        NULL,          NULL }
 };
 
@@ -1013,28 +1600,29 @@ extern "C" void shell_entry() {
         g_shell_process = proc;
         scheduler_set_foreground(proc);
     }
+    // Keystroke echo should keep up even with CPU hogs running
+    process_set_deadline(SHELL_DL_PERIOD, SHELL_DL_BUDGET);
     shell_init();
-    IOEvent event;
+    // Drain a burst of keystrokes (e.g. a paste) in one syscall
+    IOEvent events[SHELL_EVENT_BATCH];
     while (1) {
-        if (!process_poll_event(&event)) {
-            if (!process_wait_event(&event)) {
+        int count = process_drain_events(events, SHELL_EVENT_BATCH, 1);
+        for (int i = 0; i < count; i++) {
+            const IOEvent& event = events[i];
+            if (event.type == EVENT_PROCESS) {
+                if (event.data.process.code == PROCESS_EVENT_FOCUS_LOST) {
+                    shell_set_input_enabled(false);
+                } else if (event.data.process.code == PROCESS_EVENT_FOCUS_GAINED) {
+                    shell_set_input_enabled(true);
+                    if (!shell.prompt_visible) {
+                        shell_print_prompt();
+                    }
+                }
                 continue;
             }
-        }
-        if (event.type == EVENT_PROCESS) {
-            if (event.data.process.code == PROCESS_EVENT_FOCUS_LOST) {
-                shell_set_input_enabled(false);
-            } else if (event.data.process.code == PROCESS_EVENT_FOCUS_GAINED) {
-                shell_set_input_enabled(true);
-                if (!shell.prompt_visible) {
-                    shell_print_prompt();
-                }
+            if (event.type == EVENT_KEYBOARD) {
+                shell_handle_key(event.data.keyboard);
             }
-            continue;
-        }
-        if (event.type == EVENT_KEYBOARD) {
-            shell_handle_key(event.data.keyboard);
-            continue;
         }
     }
 }
@@ -0,0 +1,157 @@
+#include "kernel/smp.h"
+#include "kernel/acpi.h"
+#include "kernel/lapic.h"
+#include "kernel/ioapic.h"
+#include "kernel/gdt.h"
+#include "kernel/idt.h"
+#include "kernel/isr.h"
+#include "kernel/heap.h"
+#include "kernel/timer.h"
+#include "kernel/scheduler.h"
+#include "kernel/debug.h"
+#include <string.h>
+
+// Trampoline blob and its hand-off slots (see ap_trampoline.s)
+extern "C" uint8_t ap_trampoline_start[];
+extern "C" uint8_t ap_trampoline_end[];
+extern "C" uint32_t ap_cr3;
+extern "C" uint32_t ap_stack;
+extern "C" uint32_t ap_entry;
+
+static cpu_info_t cpus[MAX_CPUS];
+static int cpu_count = 1;
+static uint8_t apic_to_cpu[256];
+static volatile int booting_cpu = -1;
+
+// Address of a hand-off slot inside the copy of the trampoline at SMP_TRAMPOLINE_ADDR
+static inline volatile uint32_t* trampoline_slot(uint32_t* symbol) {
+    return (volatile uint32_t*)(SMP_TRAMPOLINE_ADDR + ((uint8_t*)symbol - ap_trampoline_start));
+}
+
+static void lapic_timer_handler(registers_t* regs) {
+    scheduler_on_tick(regs);
+}
+
+static void reschedule_ipi_handler(registers_t* regs) {
+    scheduler_handle_reschedule(regs);
+}
+
+extern "C" void ap_main() {
+    int index = booting_cpu;
+    cpu_info_t* cpu = &cpus[index];
+
+    gdt_init_cpu(index, cpu->stack_top);
+    idt_load();
+    lapic_enable();
+    lapic_timer_start(SMP_TIMER_HZ);
+
+    cpu->online = 1;
+    // Never returns: idles until the scheduler hands this CPU a process
+    scheduler_ap_enter();
+}
+
+static bool start_ap(int index) {
+    cpu_info_t* cpu = &cpus[index];
+    uint8_t* stack = (uint8_t*)kmalloc(SMP_AP_STACK_SIZE);
+    if (!stack) {
+        error("[SMP] Failed to allocate stack for CPU %d", index);
+        return false;
+    }
+    cpu->stack_top = (uint32_t)stack + SMP_AP_STACK_SIZE;
+    cpu->online = 0;
+
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    *trampoline_slot(&ap_cr3) = cr3;
+    *trampoline_slot(&ap_stack) = cpu->stack_top;
+    *trampoline_slot(&ap_entry) = (uint32_t)ap_main;
+    booting_cpu = index;
+
+    // INIT, then STARTUP twice as required by the MP specification
+    lapic_send_init(cpu->apic_id);
+    timer_busy_wait_us(10000);
+    for (int attempt = 0; attempt < 2 && !cpu->online; ++attempt) {
+        lapic_send_startup(cpu->apic_id, (uint8_t)(SMP_TRAMPOLINE_ADDR >> 12));
+        timer_busy_wait_us(200);
+    }
+    for (int waited = 0; waited < 100 && !cpu->online; ++waited) {
+        timer_busy_wait_us(1000);
+    }
+    if (!cpu->online) {
+        error("[SMP] CPU %d (APIC %u) did not respond", index, cpu->apic_id);
+        kfree(stack);
+        return false;
+    }
+    return true;
+}
+
+void smp_init() {
+    memset(cpus, 0, sizeof(cpus));
+    memset(apic_to_cpu, 0xFF, sizeof(apic_to_cpu));
+    cpu_count = 1;
+    cpus[0].index = 0;
+    cpus[0].online = 1;
+
+    if (acpi_init() != 0) {
+        return;
+    }
+    const acpi_madt_info_t* info = acpi_get_madt_info();
+    if (!lapic_init(info->lapic_address)) {
+        return;
+    }
+
+    uint8_t bsp_apic = lapic_id();
+    cpus[0].apic_id = bsp_apic;
+    apic_to_cpu[bsp_apic] = 0;
+
+    register_interrupt_handler(LAPIC_TIMER_VECTOR, lapic_timer_handler);
+    register_interrupt_handler(LAPIC_RESCHEDULE_VECTOR, reschedule_ipi_handler);
+    // Interrupts are still off here, so lines can move off the 8259 without a gap
+    ioapic_init();
+
+    if (info->cpu_count <= 1) {
+        success("[SMP] Uniprocessor system");
+        return;
+    }
+
+    lapic_timer_calibrate();
+    memcpy((void*)SMP_TRAMPOLINE_ADDR, ap_trampoline_start,
+           (size_t)(ap_trampoline_end - ap_trampoline_start));
+
+    for (int i = 0; i < info->cpu_count && cpu_count < MAX_CPUS; ++i) {
+        uint8_t apic_id = info->cpu_apic_ids[i];
+        if (apic_id == bsp_apic) continue;
+        int index = cpu_count;
+        cpus[index].index = index;
+        cpus[index].apic_id = apic_id;
+        apic_to_cpu[apic_id] = (uint8_t)index;
+        if (start_ap(index)) {
+            cpu_count++;
+        } else {
+            apic_to_cpu[apic_id] = 0xFF;
+        }
+    }
+    booting_cpu = -1;
+    success("[SMP] %d CPU(s) online", cpu_count);
+}
+
+int smp_cpu_count() {
+    return cpu_count;
+}
+
+int smp_current_cpu() {
+    // Look up by APIC id even while cpu_count is still being raised by the BSP
+    if (!lapic_available()) return 0;
+    uint8_t index = apic_to_cpu[lapic_id()];
+    return index == 0xFF ? 0 : index;
+}
+
+cpu_info_t* smp_get_cpu(int index) {
+    if (index < 0 || index >= cpu_count) return nullptr;
+    return &cpus[index];
+}
+
+void smp_send_reschedule(int cpu) {
+    if (cpu < 0 || cpu >= cpu_count || cpu == smp_current_cpu() || !cpus[cpu].online) return;
+    lapic_send_ipi(cpus[cpu].apic_id, LAPIC_RESCHEDULE_VECTOR);
+}
@@ -0,0 +1,87 @@
+#include "kernel/softirq.h"
+#include "kernel/smp.h"
+#include "kernel/tsc.h"
+#include "kernel/ktime.h"
+#include "kernel/ioapic.h"
+#include "kernel/irqoff.h"
+#include <stdio.h>
+
+// Give up after this many passes so a storm of raises cannot starve the interrupted process
+#define SOFTIRQ_MAX_RESTARTS 4
+
+static softirq_handler_t softirq_handlers[NR_SOFTIRQS];
+static volatile uint32_t softirq_pending[MAX_CPUS];
+static volatile int softirq_active[MAX_CPUS];
+
+static const char* const softirq_names[NR_SOFTIRQS] = { "timer", "keyboard", "mouse", "block" };
+static uint32_t softirq_runs[NR_SOFTIRQS];
+static uint32_t softirq_max_cycles[NR_SOFTIRQS];
+
+// Longest hard IRQ handler seen; the IRQ-off window it represents is what softirqs shrink
+static uint32_t hardirq_max_cycles = 0;
+static uint32_t hardirq_max_vector = 0;
+// Time spent acknowledging the interrupt controller before the handler runs
+static uint64_t hardirq_ack_cycles = 0;
+static uint32_t hardirq_count = 0;
+
+void softirq_register(softirq_t nr, softirq_handler_t handler) {
+    if (nr >= NR_SOFTIRQS) return;
+    softirq_handlers[nr] = handler;
+}
+
+void softirq_raise(softirq_t nr) {
+    if (nr >= NR_SOFTIRQS) return;
+    __atomic_or_fetch(&softirq_pending[smp_current_cpu()], 1u << nr, __ATOMIC_RELEASE);
+}
+
+bool softirq_in_progress() {
+    return softirq_active[smp_current_cpu()] != 0;
+}
+
+void softirq_run_pending() {
+    int cpu = smp_current_cpu();
+    // Nested interrupts arriving while handlers run leave their bits for the outer loop
+    if (softirq_active[cpu] || softirq_pending[cpu] == 0) return;
+    softirq_active[cpu] = 1;
+
+    for (int pass = 0; pass < SOFTIRQ_MAX_RESTARTS; ++pass) {
+        uint32_t pending = __atomic_exchange_n(&softirq_pending[cpu], 0, __ATOMIC_ACQUIRE);
+        if (pending == 0) break;
+        IRQOFF_END();
+        asm volatile("sti");
+        for (int nr = 0; nr < NR_SOFTIRQS; ++nr) {
+            if (!(pending & (1u << nr)) || !softirq_handlers[nr]) continue;
+            uint64_t start = rdtsc();
+            softirq_handlers[nr]();
+            uint32_t cycles = (uint32_t)(rdtsc() - start);
+            softirq_runs[nr]++;
+            if (cycles > softirq_max_cycles[nr]) softirq_max_cycles[nr] = cycles;
+        }
+        asm volatile("cli");
+        IRQOFF_BEGIN();
+    }
+
+    softirq_active[cpu] = 0;
+}
+
+void softirq_note_hardirq(uint32_t vector, uint64_t ack_cycles, uint64_t handler_cycles) {
+    hardirq_ack_cycles += ack_cycles;
+    hardirq_count++;
+    uint32_t c = handler_cycles > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)handler_cycles;
+    if (c > hardirq_max_cycles) {
+        hardirq_max_cycles = c;
+        hardirq_max_vector = vector;
+    }
+}
+
+void softirq_dump_stats() {
+    printf("Longest hard IRQ handler: %u cycles, %u ns (vector %u)\n", hardirq_max_cycles,
+           (uint32_t)ktime_cycles_to_ns(hardirq_max_cycles), hardirq_max_vector);
+    printf("Controller ack (%s): %u cycles avg over %u interrupts\n", ioapic_enabled() ? "LAPIC" : "8259",
+           hardirq_count ? (uint32_t)(hardirq_ack_cycles / hardirq_count) : 0, hardirq_count);
+    printf("SOFTIRQ    RUNS      MAX-CYCLES MAX-NS\n");
+    for (int nr = 0; nr < NR_SOFTIRQS; ++nr) {
+        printf("%-10s %-9u %-10u %u\n", softirq_names[nr], softirq_runs[nr], softirq_max_cycles[nr],
+               (uint32_t)ktime_cycles_to_ns(softirq_max_cycles[nr]));
+    }
+}
@@ -42,3 +42,107 @@ _syscall_handler:
     pushl $0                 # Push dummy error code
     pushl $128               # Push interrupt number (0x80)
     jmp syscall_common_stub
+
+# SYSENTER fast path. The caller (see libc sys/syscall.h) pushes arg3, arg2 and the
+# return EIP, then points EBP at them; EAX, EBX and ESI carry the number, arg1 and
+# arg4. The entry builds the same registers_t frame as int $0x80 so syscall_dispatch
+# and the scheduler cannot tell the two paths apart.
+.global sysenter_entry
+.type sysenter_entry, @function
+sysenter_entry:
+    movl 4(%esp), %esp       # MSR_SYSENTER_ESP points at this CPU's TSS; load esp0
+    # EBP comes from ring 3: the 12 bytes it points at must lie in present user
+    # pages before ring 0 reads them
+    cmpl $0xFFFFFFF4, %ebp
+    ja 2f
+    movl %ebp, %ecx
+    call sysenter_user_page
+    jne 2f
+    leal 11(%ebp), %ecx
+    call sysenter_user_page
+    jne 2f
+    pushl $0x23              # User SS
+    pushl %ebp               # User ESP
+    pushfl
+    orl $0x200, (%esp)       # SYSENTER cleared IF; the caller ran with it set
+    pushl $0x1B              # User CS
+    pushl (%ebp)             # Return EIP
+    pushl $0                 # Dummy error code
+    pushl $128               # Same interrupt number as int $0x80
+    movl 4(%ebp), %ecx       # arg2
+    movl 8(%ebp), %edx       # arg3
+3:
+    pusha
+    movw %ds, %ax
+    pushl %eax
+
+    movw $0x10, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+
+    pushl %esp
+    call syscall_dispatch
+    addl $4, %esp
+
+    popl %eax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+
+    popa
+    addl $8, %esp
+    # The scheduler may have redirected the frame into the kernel; only a frame
+    # that still returns to ring 3 can take SYSEXIT
+    testl $3, 4(%esp)
+    jz 1f
+    movl (%esp), %edx        # SYSEXIT: EIP from EDX, ESP from ECX
+    movl 12(%esp), %ecx
+    sti                      # Takes effect after SYSEXIT
+    sysexit
+1:
+    iret
+2:
+    # No return address to go back to: turn the call into SYSCALL_EXIT with status -1
+    pushl $0x23
+    pushl %ebp
+    pushfl
+    orl $0x200, (%esp)
+    pushl $0x1B
+    pushl $0                 # Never resumed
+    pushl $0
+    pushl $128
+    movl $0x83, %eax         # SYSCALL_EXIT
+    movl $-1, %ebx
+    xorl %ecx, %ecx
+    xorl %edx, %edx
+    jmp 3b
+
+# ZF is set if the page holding the address in ECX is present and user-accessible
+# in the current page tables (which are identity mapped). Preserves all registers.
+sysenter_user_page:
+    pushl %eax
+    pushl %ecx
+    pushl %edx
+    movl %cr3, %edx
+    andl $0xFFFFF000, %edx
+    movl %ecx, %eax
+    shrl $22, %eax
+    movl (%edx,%eax,4), %edx # PDE
+    movl %edx, %eax
+    andl $5, %eax            # Present + user
+    cmpl $5, %eax
+    jne 1f
+    andl $0xFFFFF000, %edx
+    shrl $12, %ecx
+    andl $0x3FF, %ecx
+    movl (%edx,%ecx,4), %eax # PTE
+    andl $5, %eax
+    cmpl $5, %eax
+1:
+    popl %edx
+    popl %ecx
+    popl %eax
+    ret
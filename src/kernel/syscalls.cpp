@@ -1,4 +1,3 @@
-#include "kernel/ramfs.h"
 #include "kernel/syscalls.h"
 #include "kernel/keyboard.h"
 #include "kernel/process.h"
@@ -9,54 +8,168 @@
 #include "kernel/framebuffer.h"
 #include "kernel/serial.h"
 #include "kernel/pci.h"
+#include "kernel/paging.h"
+#include "kernel/vfs.h"
+#include "kernel/irqoff.h"
+#include "kernel/mutex.h"
+#include "kernel/softirq.h"
+#include "kernel/uaccess.h"
 #include <sys/gui.h>
+#include <sys/syscall.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #define KEYBOARD_BUFFER_SIZE 128
 static char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
 static size_t keyboard_buffer_head = 0;
 static size_t keyboard_buffer_tail = 0;
 
+// Ring-3 buffers in a demand-paged address space are checked and faulted in up front:
+// a page-in takes the VFS mutex, which the filesystem call would already hold
+static bool user_range_ready(const void* buffer, size_t size, bool write) {
+    Process* proc = scheduler_current_process();
+    if (!proc || !proc->mm) return buffer != nullptr;
+    return vmm_prepare_user_range(proc->mm, (uint32_t)buffer, (uint32_t)size, write) == 0;
+}
+
+// Copy a caller's path into `out`, made absolute against the working directory
+static bool copy_user_path(const char* path, char* out) {
+    if (!path) return false;
+    char name[VFS_MAX_PATH];
+    size_t length = 0;
+    // Faults on later pages of the string are taken here, before any VFS lock;
+    // each page the string reaches is checked before it is read
+    for (;;) {
+        const char* next = path + length;
+        if ((length == 0 || ((uint32_t)next & (PAGE_SIZE - 1)) == 0) && !user_range_ready(next, 1, false)) {
+            return false;
+        }
+        if (copy_from_user(&name[length], next, 1) != 0) return false;
+        if (name[length] == '\0') break;
+        if (++length == VFS_MAX_PATH) return false;
+    }
+    if (length == 0) return false;
+    if (name[0] == '/') {
+        strcpy(out, name);
+        return true;
+    }
+    const char* cwd = vfs_getcwd();
+    size_t cwd_length = strlen(cwd);
+    if (cwd_length + 1 + length >= VFS_MAX_PATH) return false;
+    strcpy(out, cwd);
+    if (strcmp(cwd, "/") != 0) strcat(out, "/");
+    strcat(out, name);
+    return true;
+}
+
 int sys_open(const char* path) {
-    FSNode* node = fs_find_by_path(path);
-    if (!node) return -1;
-    return fs_open(node);
+    Process* proc = scheduler_current_process();
+    char absolute[VFS_MAX_PATH];
+    if (!proc || !copy_user_path(path, absolute)) return VFS_INVALID_PATH;
+    int fd = process_fd_alloc(proc);
+    if (fd < 0) return VFS_NO_SPACE;
+    int result = vfs_open(absolute, &proc->fds[fd]);
+    if (result != VFS_SUCCESS) {
+        process_fd_release(proc, fd);
+        return result;
+    }
+    return fd;
 }
 
+// The filesystem copies straight into the caller's buffer; nothing is staged here
 int sys_read(int fd, uint8_t* buffer, size_t size) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].used) return -1;
-    return fs_read(fd_table[fd].node, fd_table[fd].offset, size, buffer);
+    vfs_file_t* file = process_fd_get(scheduler_current_process(), fd);
+    if (!file || !user_range_ready(buffer, size, true)) return VFS_ERROR;
+    return vfs_read(file, buffer, size);
 }
 
 int sys_write(int fd, const uint8_t* buffer, size_t size) {
-    if (fd < 0 || fd >= MAX_OPEN_FILES || !fd_table[fd].used) return -1;
-    return fs_write(fd_table[fd].node, fd_table[fd].offset, size, buffer);
+    vfs_file_t* file = process_fd_get(scheduler_current_process(), fd);
+    if (!file || !user_range_ready(buffer, size, false)) return VFS_ERROR;
+    return vfs_write(file, buffer, size);
+}
+
+// Shared loop for readv/writev
+static int transfer_vector(int fd, const struct iovec* iov, int count, bool write) {
+    vfs_file_t* file = process_fd_get(scheduler_current_process(), fd);
+    if (!file || count < 0 || count > IOV_MAX ||
+        !user_range_ready(iov, (size_t)count * sizeof(struct iovec), false)) {
+        return VFS_ERROR;
+    }
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        struct iovec segment = iov[i];
+        if (segment.iov_len == 0) continue;
+        if (!user_range_ready(segment.iov_base, segment.iov_len, !write)) {
+            return total ? total : VFS_ERROR;
+        }
+        int moved = write ? vfs_write(file, (const uint8_t*)segment.iov_base, segment.iov_len)
+                          : vfs_read(file, (uint8_t*)segment.iov_base, segment.iov_len);
+        if (moved < 0) return total ? total : moved;
+        total += moved;
+        if ((size_t)moved < segment.iov_len) break;
+    }
+    return total;
+}
+
+int sys_readv(int fd, const struct iovec* iov, int count) {
+    return transfer_vector(fd, iov, count, false);
 }
 
-void sys_close(int fd) {
-    fs_close(fd);
+int sys_writev(int fd, const struct iovec* iov, int count) {
+    return transfer_vector(fd, iov, count, true);
+}
+
+int sys_seek(int fd, uint32_t position) {
+    vfs_file_t* file = process_fd_get(scheduler_current_process(), fd);
+    if (!file) return VFS_ERROR;
+    return vfs_seek(file, position);
+}
+
+int sys_close(int fd) {
+    Process* proc = scheduler_current_process();
+    vfs_file_t* file = process_fd_get(proc, fd);
+    if (!file) return VFS_ERROR;
+    vfs_close(file);
+    process_fd_release(proc, fd);
+    return VFS_SUCCESS;
+}
+
+int sys_readdir(const char* path, vfs_dirent_t* entries, int max_entries) {
+    char absolute[VFS_MAX_PATH];
+    // The byte count must not wrap past what was checked
+    if (max_entries <= 0 || (uint32_t)max_entries > UINT32_MAX / sizeof(vfs_dirent_t) ||
+        !copy_user_path(path, absolute) ||
+        !user_range_ready(entries, (size_t)max_entries * sizeof(vfs_dirent_t), true)) {
+        return VFS_ERROR;
+    }
+    return vfs_readdir(absolute, entries, max_entries);
+}
+
+int sys_stat(const char* path, vfs_dirent_t* info) {
+    char absolute[VFS_MAX_PATH];
+    if (!copy_user_path(path, absolute) || !user_range_ready(info, sizeof(vfs_dirent_t), true)) {
+        return VFS_ERROR;
+    }
+    return vfs_stat(absolute, info);
 }
 
 extern Terminal terminal;
 
 namespace
 {
-bool g_console_write_in_progress = false;
+// Serializes console output. Writers now get preempted mid-write (syscalls run
+// with interrupts on), so a plain busy flag would divert everyone else to serial.
+mutex_t g_console_mutex = MUTEX_INIT("console");
 
-class ConsoleWriteGuard
+// Sleeping is only allowed in process context with interrupts on
+bool console_may_sleep(Process* proc)
 {
-  public:
-    ConsoleWriteGuard()
-    {
-        g_console_write_in_progress = true;
-    }
-
-    ~ConsoleWriteGuard()
-    {
-        g_console_write_in_progress = false;
-    }
-};
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0" : "=r"(eflags));
+    return proc && (eflags & 0x200) && !irq_in_progress() && !softirq_in_progress();
+}
 } // namespace
 
 size_t sys_console_write(const char* buffer, size_t size)
@@ -66,7 +179,25 @@ size_t sys_console_write(const char* buffer, size_t size)
         return 0;
     }
 
-    if (g_console_write_in_progress)
+    Process* proc = scheduler_current_process();
+
+    // A write from inside the console code itself, or from a context that cannot
+    // wait for another writer, goes to serial instead
+    bool reentrant = g_console_mutex.locked && proc && g_console_mutex.owner_pid == proc->pid;
+    bool locked = false;
+    if (!reentrant)
+    {
+        if (console_may_sleep(proc))
+        {
+            mutex_lock(&g_console_mutex);
+            locked = true;
+        }
+        else
+        {
+            locked = mutex_trylock(&g_console_mutex) != 0;
+        }
+    }
+    if (!locked)
     {
 #ifdef DEBUG
         serial_printf("[SYSCON] reentrant write fallback (len=%u)\n", static_cast<unsigned>(size));
@@ -78,23 +209,35 @@ size_t sys_console_write(const char* buffer, size_t size)
         return size;
     }
 
-    ConsoleWriteGuard guard;
-
-    Process* proc = scheduler_current_process();
-
     if (!framebuffer::is_available() || proc == nullptr)
     {
         for (size_t i = 0; i < size; ++i)
         {
             terminal.putchar(buffer[i]);
         }
-        return size;
     }
-
-    terminal_windows::write_text(terminal, proc, buffer, size);
+    else
+    {
+        terminal_windows::write_text(terminal, proc, buffer, size);
+    }
+    mutex_unlock(&g_console_mutex);
     return size;
 }
 
+size_t sys_console_writev(const struct iovec* iov, int count)
+{
+    if (iov == nullptr || count <= 0 || count > IOV_MAX)
+    {
+        return 0;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        total += sys_console_write((const char*)iov[i].iov_base, iov[i].iov_len);
+    }
+    return total;
+}
+
 // Called from interrupt handler
 void keyboard_buffer_push(char c) {
     size_t next_head = (keyboard_buffer_head + 1) % KEYBOARD_BUFFER_SIZE;
@@ -127,20 +270,33 @@ void sys_register_keyboard_handler(KeyboardHandler handler) {
     }
 }
 
+// Events are written straight into the caller's buffer, so it is checked and
+// faulted in first
 int sys_get_io_event(IOEvent* out_event) {
     Process* proc = scheduler_current_process();
-    if (!proc) return 0;
+    if (!proc || !out_event || !user_range_ready(out_event, sizeof(IOEvent), true)) return 0;
     return pop_io_event(proc, out_event);
 }
 
-int sys_wait_io_event(registers_t* regs, IOEvent* out_event) {
+// Blocks on the process's io_wait queue and returns the event in the same call
+int sys_wait_io_event(IOEvent* out_event) {
+    Process* proc = scheduler_current_process();
+    if (!proc || !out_event || !user_range_ready(out_event, sizeof(IOEvent), true)) return 0;
+    return process_wait_for_io_event(proc, out_event);
+}
+
+// Copies up to `max_events` queued events in one trap; with `wait` set it blocks
+// until at least one is available
+int sys_drain_io_events(IOEvent* out_events, int max_events, int wait) {
     Process* proc = scheduler_current_process();
-    if (!proc) return 0;
-    if (process_wait_for_io_event(proc, out_event)) {
-        return 1;
+    if (!proc || !out_events || max_events <= 0) return 0;
+    // More than the ring holds could never be filled
+    if (max_events > MAX_EVENT_QUEUE_SIZE) max_events = MAX_EVENT_QUEUE_SIZE;
+    if (!user_range_ready(out_events, (size_t)max_events * sizeof(IOEvent), true)) return 0;
+    if (wait) {
+        return process_wait_drain_io_events(proc, out_events, max_events);
     }
-    scheduler_force_switch_with_regs(regs);
-    return 0;
+    return process_drain_io_events(proc, out_events, max_events);
 }
 
 void sys_yield_with_regs(registers_t* regs) {
@@ -179,18 +335,67 @@ static inline void sys_exit_with_regs(registers_t* regs) {
     scheduler_exit_current_and_switch(regs);
 }
 
+// Copy a ring-3 buffer into kernel memory before printing it, so any demand-paging
+// fault on it is taken here and never under the console's locks
+static size_t console_write_user(const char* buffer, size_t size)
+{
+    if (!buffer || !user_range_ready(buffer, size, false))
+    {
+        return 0;
+    }
+    char chunk[128];
+    size_t written = 0;
+    while (written < size)
+    {
+        size_t length = size - written < sizeof(chunk) ? size - written : sizeof(chunk);
+        if (copy_from_user(chunk, buffer + written, length) != 0)
+        {
+            break;
+        }
+        sys_console_write(chunk, length);
+        written += length;
+    }
+    return written;
+}
+
+static size_t console_writev_user(const struct iovec* iov, int count)
+{
+    if (count <= 0 || count > IOV_MAX || !user_range_ready(iov, (size_t)count * sizeof(struct iovec), false))
+    {
+        return 0;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        struct iovec segment;
+        if (copy_from_user(&segment, &iov[i], sizeof(segment)) != 0)
+        {
+            break;
+        }
+        total += console_write_user((const char*)segment.iov_base, segment.iov_len);
+    }
+    return total;
+}
+
 static void sys_gui_command(const GuiCommand* user_command)
 {
-    if (user_command == nullptr)
+    GuiCommand command;
+    if (user_command == nullptr || !user_range_ready(user_command, sizeof(command), false) ||
+        copy_from_user(&command, user_command, sizeof(command)) != 0)
     {
         return;
     }
 
-    GuiCommand command = *user_command;
     Process* proc = scheduler_current_process();
     gui::process_command(command, terminal, proc);
 }
 
+int sys_set_deadline(uint32_t period, uint32_t budget) {
+    Process* proc = scheduler_current_process();
+    if (!proc) return -1;
+    return scheduler_set_deadline(proc, period, budget);
+}
+
 void sys_pci_register_listener(uint16_t vendor_id, uint16_t device_id) {
     Process* proc = scheduler_current_process();
     if (proc) {
@@ -205,39 +410,42 @@ void sys_pci_unregister_listener() {
     }
 }
 
-extern "C" void syscall_dispatch(registers_t* regs) {
-    uint32_t syscall_num = regs->eax;
-    uint32_t arg1 = regs->ebx;
-    uint32_t arg2 = regs->ecx;
-    uint32_t arg3 = regs->edx;
-    uint32_t arg4 = regs->esi;
+// Every syscall that finishes without switching away from the caller's register
+// frame. Shared by the trap path and SYSCALL_BATCH; returns false for anything else.
+static bool syscall_execute(uint32_t syscall_num, const uint32_t args[4], bool from_user, uint32_t* result) {
+    uint32_t arg1 = args[0];
+    uint32_t arg2 = args[1];
+    uint32_t arg3 = args[2];
+    uint32_t arg4 = args[3];
+    *result = 0;
     switch (syscall_num) {
-        case 0x80: // SYSCALL_YIELD
-            sys_yield_with_regs(regs);
-            break;
-        case 0x81: // SYSCALL_YIELD_FOR_EVENT
-            sys_yield_for_event_with_regs(regs, (int)arg1, (uint64_t)arg2);
-            break;
         case 0x82: { // SYSCALL_START_PROCESS
-            // arg1: name, arg2: entry, arg3: speculative, arg4: stack_size
+            // arg1: name, arg2: entry, arg3: speculative, arg4: stack_size.
+            // The new process runs in ring 0 and keeps `name`, so ring 3 may not use it.
+            if (from_user) {
+                *result = (uint32_t)-1;
+                break;
+            }
             Process* p = k_start_process((const char*)arg1, (void (*)())arg2, (int)arg3, (uint32_t)arg4);
-            regs->eax = p ? (uint32_t)p->pid : (uint32_t)-1;
+            *result = p ? (uint32_t)p->pid : (uint32_t)-1;
             break;
         }
-        case 0x83: // SYSCALL_EXIT
-            sys_exit_with_regs(regs);
-            break;
         case 0x84: // SYSCALL_POLL_IO_EVENT
-            regs->eax = sys_get_io_event((IOEvent*)arg1);
+            *result = sys_get_io_event((IOEvent*)arg1);
             break;
         case 0x85: // SYSCALL_WAIT_IO_EVENT
-            regs->eax = sys_wait_io_event(regs, (IOEvent*)arg1);
+            *result = sys_wait_io_event((IOEvent*)arg1);
             break;
         case 0x86: // SYSCALL_GUI_COMMAND
             sys_gui_command((const GuiCommand*)arg1);
             break;
         case 0x87: // SYSCALL_CONSOLE_WRITE
-            regs->eax = (uint32_t)sys_console_write((const char*)arg1, (size_t)arg2);
+            if (from_user)
+            {
+                *result = (uint32_t)console_write_user((const char*)arg1, (size_t)arg2);
+                break;
+            }
+            *result = (uint32_t)sys_console_write((const char*)arg1, (size_t)arg2);
             break;
         case 0x88: // SYSCALL_PCI_REGISTER_LISTENER
             sys_pci_register_listener((uint16_t)arg1, (uint16_t)arg2);
@@ -245,9 +453,122 @@ extern "C" void syscall_dispatch(registers_t* regs) {
         case 0x89: // SYSCALL_PCI_UNREGISTER_LISTENER
             sys_pci_unregister_listener();
             break;
-        // ...other syscalls...
+        case 0x8A: // SYSCALL_SET_DEADLINE
+            *result = (uint32_t)sys_set_deadline(arg1, arg2);
+            break;
+        case 0x8B: // SYSCALL_DRAIN_IO_EVENTS
+            *result = (uint32_t)sys_drain_io_events((IOEvent*)arg1, (int)arg2, (int)arg3);
+            break;
+        case 0x8C: // SYSCALL_NOP
+            break;
+        case 0x8D: // SYSCALL_OPEN
+            *result = (uint32_t)sys_open((const char*)arg1);
+            break;
+        case 0x8E: // SYSCALL_READ
+            *result = (uint32_t)sys_read((int)arg1, (uint8_t*)arg2, (size_t)arg3);
+            break;
+        case 0x8F: // SYSCALL_WRITE
+            *result = (uint32_t)sys_write((int)arg1, (const uint8_t*)arg2, (size_t)arg3);
+            break;
+        case 0x90: // SYSCALL_SEEK
+            *result = (uint32_t)sys_seek((int)arg1, arg2);
+            break;
+        case 0x91: // SYSCALL_CLOSE
+            *result = (uint32_t)sys_close((int)arg1);
+            break;
+        case 0x92: // SYSCALL_READDIR
+            *result = (uint32_t)sys_readdir((const char*)arg1, (vfs_dirent_t*)arg2, (int)arg3);
+            break;
+        case 0x93: // SYSCALL_STAT
+            *result = (uint32_t)sys_stat((const char*)arg1, (vfs_dirent_t*)arg2);
+            break;
+        case 0x95: // SYSCALL_CONSOLE_WRITEV
+            if (from_user)
+            {
+                *result = (uint32_t)console_writev_user((const struct iovec*)arg1, (int)arg2);
+                break;
+            }
+            *result = (uint32_t)sys_console_writev((const struct iovec*)arg1, (int)arg2);
+            break;
+        case 0x96: // SYSCALL_READV
+            *result = (uint32_t)sys_readv((int)arg1, (const struct iovec*)arg2, (int)arg3);
+            break;
+        case 0x97: // SYSCALL_WRITEV
+            *result = (uint32_t)sys_writev((int)arg1, (const struct iovec*)arg2, (int)arg3);
+            break;
         default:
-            // Unknown syscall
+            return false;
+    }
+    return true;
+}
+
+// Each entry is copied in, run, and its result written back, so one trap covers the
+// whole array. Calls that would switch away from this frame are refused per entry.
+static int sys_batch(SyscallBatchEntry* entries, int count, bool from_user) {
+    if (!entries || count <= 0) return 0;
+    if (count > SYSCALL_BATCH_MAX) count = SYSCALL_BATCH_MAX;
+    if (!user_range_ready(entries, (size_t)count * sizeof(SyscallBatchEntry), true)) return -1;
+    for (int i = 0; i < count; i++) {
+        SyscallBatchEntry entry = entries[i];
+        uint32_t result;
+        if (!syscall_execute(entry.num, entry.args, from_user, &result)) {
+            result = (uint32_t)-1;
+        }
+        entries[i].result = (int32_t)result;
+    }
+    return count;
+}
+
+// Syscall bodies run with interrupts on whenever the caller had them on, so a long
+// console write or disk read no longer holds off the timer and input IRQs. The
+// entry stub has already saved the whole frame by the time these run.
+static inline void syscall_irq_enable(bool interruptible) {
+    if (interruptible) {
+        IRQOFF_END();
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+static inline void syscall_irq_disable(bool interruptible) {
+    if (interruptible) {
+        asm volatile("cli" ::: "memory");
+        IRQOFF_BEGIN();
+    }
+}
+
+extern "C" void syscall_dispatch(registers_t* regs) {
+    uint32_t syscall_num = regs->eax;
+    uint32_t args[4] = { regs->ebx, regs->ecx, regs->edx, regs->esi };
+    bool from_user = (regs->cs & 3) == 3;
+    bool interruptible = (regs->eflags & 0x200) != 0;
+    IRQOFF_BEGIN();
+    // Calls that rewrite the frame for a context switch keep interrupts off
+    switch (syscall_num) {
+        case 0x80: // SYSCALL_YIELD
+            sys_yield_with_regs(regs);
             break;
+        case 0x81: // SYSCALL_YIELD_FOR_EVENT
+            sys_yield_for_event_with_regs(regs, (int)args[0], (uint64_t)args[1]);
+            break;
+        case 0x83: // SYSCALL_EXIT
+            sys_exit_with_regs(regs);
+            break;
+        case 0x94: // SYSCALL_BATCH
+            syscall_irq_enable(interruptible);
+            regs->eax = (uint32_t)sys_batch((SyscallBatchEntry*)args[0], (int)args[1], from_user);
+            syscall_irq_disable(interruptible);
+            break;
+        default: {
+            uint32_t result;
+            syscall_irq_enable(interruptible);
+            bool known = syscall_execute(syscall_num, args, from_user, &result);
+            syscall_irq_disable(interruptible);
+            if (known) {
+                regs->eax = result;
+            }
+            // Unknown syscalls leave EAX untouched
+            break;
+        }
     }
+    IRQOFF_END();
 }
@@ -0,0 +1,129 @@
+#include <kernel/tests/bcachetest.h>
+#include <kernel/bcache.h>
+#include <kernel/blockdev.h>
+#include <kernel/ramdisk.h>
+#include <kernel/heap.h>
+#include <kernel/debug.h>
+#include <string.h>
+
+// Runs at boot on a RAM disk, with the cache shrunk to its minimum so transfers
+// of more than BCACHE_MIN_BUFFERS / BCACHE_BYPASS_DIVISOR sectors bypass it
+#define TEST_SECTORS 64
+#define TEST_SECTOR_SIZE BCACHE_BLOCK_SIZE
+
+static void fill(uint8_t* buffer, uint32_t sector, uint32_t count, uint8_t tag) {
+    for (uint32_t i = 0; i < count * TEST_SECTOR_SIZE; i++) {
+        buffer[i] = (uint8_t)(tag + sector + i / TEST_SECTOR_SIZE);
+    }
+}
+
+// The device itself must hold `expected` for [sector, sector + count)
+static bool disk_matches(int dev, uint32_t sector, uint32_t count, const uint8_t* expected,
+                         uint8_t* scratch) {
+    return blockdev_read_direct((uint8_t)dev, sector, count, scratch) == BLOCKDEV_SUCCESS &&
+           memcmp(scratch, expected, count * TEST_SECTOR_SIZE) == 0;
+}
+
+// And so must a read through the cache
+static bool cache_matches(int dev, uint32_t sector, uint32_t count, const uint8_t* expected,
+                          uint8_t* scratch) {
+    return bcache_read((uint8_t)dev, sector, count, scratch) == BLOCKDEV_SUCCESS &&
+           memcmp(scratch, expected, count * TEST_SECTOR_SIZE) == 0;
+}
+
+void bcache_test() {
+    test("Buffer Cache Test: hits, write-back, sync and bypass");
+    bcache_stats_t before, s;
+    bcache_get_stats(&before);
+    int dev = ramdisk_create(TEST_SECTORS);
+    uint8_t* data = (uint8_t*)kmalloc(TEST_SECTORS * TEST_SECTOR_SIZE);
+    uint8_t* scratch = (uint8_t*)kmalloc(TEST_SECTORS * TEST_SECTOR_SIZE);
+    if (dev < 0 || !data || !scratch || bcache_resize(BCACHE_MIN_BUFFERS) != 0) {
+        PANIC("[FAIL] Buffer cache test setup failed");
+        return;
+    }
+    fill(data, 0, TEST_SECTORS, 0);
+    blockdev_write_direct((uint8_t)dev, 0, TEST_SECTORS, data);
+    bcache_reset_stats();
+
+    // First read misses and fills the cache; the second is served from it
+    if (!cache_matches(dev, 0, 2, data, scratch) || !cache_matches(dev, 0, 2, data, scratch)) {
+        PANIC("[FAIL] Cached read returned wrong data");
+    }
+    bcache_get_stats(&s);
+    if (s.misses != 2 || s.hits != 2 || s.used != 2) {
+        PANIC("[FAIL] Expected 2 misses and 2 hits, got %u and %u (%u used)", s.misses, s.hits, s.used);
+    }
+    test("[PASS] Miss then hit");
+
+    // A write only dirties the buffer until it is synced
+    fill(data + 1 * TEST_SECTOR_SIZE, 1, 1, 0x40);
+    bcache_write((uint8_t)dev, 1, 1, data + 1 * TEST_SECTOR_SIZE);
+    bcache_get_stats(&s);
+    if (s.dirty != 1 || disk_matches(dev, 1, 1, data + 1 * TEST_SECTOR_SIZE, scratch) ||
+        !cache_matches(dev, 0, 2, data, scratch)) {
+        PANIC("[FAIL] Write was not held back in the cache (%u dirty)", s.dirty);
+    }
+    bcache_sync(dev);
+    bcache_get_stats(&s);
+    if (s.dirty != 0 || s.writebacks != 1 || !disk_matches(dev, 0, 2, data, scratch)) {
+        PANIC("[FAIL] Sync left %u dirty, wrote back %u", s.dirty, s.writebacks);
+    }
+    test("[PASS] Write-back and sync");
+
+    // Adjacent dirty sectors go out as one run
+    fill(data + 10 * TEST_SECTOR_SIZE, 10, 4, 0x80);
+    for (uint32_t i = 10; i < 14; i++) {
+        bcache_write((uint8_t)dev, i, 1, data + i * TEST_SECTOR_SIZE);
+    }
+    bcache_sync(dev);
+    bcache_get_stats(&s);
+    if (s.dirty != 0 || s.writebacks != 5 || s.write_runs != 2 ||
+        !disk_matches(dev, 10, 4, data + 10 * TEST_SECTOR_SIZE, scratch)) {
+        PANIC("[FAIL] 4 dirty sectors written back as %u runs", s.write_runs - 1);
+    }
+    test("[PASS] Dirty runs coalesced");
+
+    // Large transfers stream past the cache
+    uint32_t used = s.used;
+    uint32_t large = BCACHE_MIN_BUFFERS / BCACHE_BYPASS_DIVISOR + 4;
+    if (!cache_matches(dev, 20, large, data + 20 * TEST_SECTOR_SIZE, scratch)) {
+        PANIC("[FAIL] Bypassed read returned wrong data");
+    }
+    bcache_get_stats(&s);
+    if (s.bypassed != large || s.used != used) {
+        PANIC("[FAIL] Large read cached %u sectors, bypassed %u", s.used - used, s.bypassed);
+    }
+    // A bypassing write over a dirty cached sector leaves the cache clean and current
+    fill(data, 0, 1, 0xC0);
+    bcache_write((uint8_t)dev, 0, 1, data);
+    fill(data, 0, large, 0xE0);
+    bcache_write((uint8_t)dev, 0, large, data);
+    bcache_get_stats(&s);
+    if (s.dirty != 0 || s.bypassed != 2 * large || !disk_matches(dev, 0, large, data, scratch) ||
+        !cache_matches(dev, 0, 2, data, scratch)) {
+        PANIC("[FAIL] Bypassed write left a stale or dirty cached copy (%u dirty)", s.dirty);
+    }
+    test("[PASS] Large transfers bypass the cache and keep it coherent");
+
+    // Writing more sectors than there are buffers evicts dirty ones to the disk
+    fill(data + 30 * TEST_SECTOR_SIZE, 30, 2 * BCACHE_MIN_BUFFERS, 0x20);
+    for (uint32_t i = 30; i < 30 + 2 * BCACHE_MIN_BUFFERS; i++) {
+        bcache_write((uint8_t)dev, i, 1, data + i * TEST_SECTOR_SIZE);
+    }
+    bcache_get_stats(&s);
+    uint32_t evictions = s.evictions;
+    bcache_sync(dev);
+    bcache_get_stats(&s);
+    if (evictions == 0 || s.dirty != 0 || !disk_matches(dev, 0, TEST_SECTORS, data, scratch) ||
+        !cache_matches(dev, 30, 2, data + 30 * TEST_SECTOR_SIZE, scratch)) {
+        PANIC("[FAIL] Eviction lost data (%u evictions, %u dirty)", evictions, s.dirty);
+    }
+    test("[PASS] Dirty buffers written back on eviction");
+
+    bcache_resize(before.buffers);
+    ramdisk_destroy((uint8_t)dev);
+    kfree(data);
+    kfree(scratch);
+    test("Buffer Cache Test: Completed");
+}
@@ -0,0 +1,133 @@
+#include <kernel/tests/elevatortest.h>
+#include <kernel/elevator.h>
+#include <kernel/debug.h>
+#include <string.h>
+
+// The elevator only looks at sectors, directions, deadlines and segments, so
+// the requests never reach a device
+#define TEST_NOW    1000
+#define TEST_FUTURE (TEST_NOW + 500)
+
+static blk_request_t requests[6];
+
+static blk_request_t* add_request(blk_queue_t* queue, int i, uint32_t sector, uint32_t count, int write,
+                                  uint32_t deadline) {
+    blk_request_init(&requests[i], 0, sector, count, NULL, write, NULL, NULL);
+    requests[i].deadline = deadline;
+    elevator_add(queue, &requests[i]);
+    return &requests[i];
+}
+
+// Dispatch the next command and check where it starts, how many requests were
+// merged into it and how many sectors it moves
+static void expect_command(blk_queue_t* queue, const blockdev_info_t* dev, uint32_t sector,
+                           int merged, uint32_t sectors, bool deadline) {
+    bool expired;
+    blk_request_t* req = elevator_next(queue, dev, TEST_NOW, &expired);
+    if (!req) {
+        PANIC("[FAIL] Elevator: queue empty, expected sector %u", sector);
+        return;
+    }
+    int count = 0;
+    uint32_t total = 0;
+    for (blk_request_t* r = req; r; r = r->merge_next) {
+        count++;
+        total += r->count;
+        queue->position = r->sector + r->count;
+    }
+    if (req->sector != sector || count != merged || total != sectors || expired != deadline) {
+        PANIC("[FAIL] Elevator: got %u (%d requests, %u sectors%s), expected %u (%d, %u%s)",
+              req->sector, count, total, expired ? ", expired" : "", sector, merged, sectors,
+              deadline ? ", expired" : "");
+    }
+}
+
+static void expect_empty(blk_queue_t* queue) {
+    if (queue->head || queue->depth != 0) {
+        PANIC("[FAIL] Elevator: %u requests left over", queue->depth);
+    }
+}
+
+void elevator_test() {
+    test("Elevator Test: ordering, merging and deadlines");
+    blockdev_info_t dev;
+    memset(&dev, 0, sizeof(dev));
+    dev.max_sectors = BLOCKDEV_MAX_REQUEST_SECTORS;
+    dev.max_segments = BLOCKDEV_MAX_SEGMENTS;
+    blk_queue_t queue;
+    memset(&queue, 0, sizeof(queue));
+
+    // C-LOOK: sweep up from the head position, then wrap to the lowest sector
+    queue.position = 20;
+    add_request(&queue, 0, 40, 2, 1, TEST_FUTURE);
+    add_request(&queue, 1, 10, 2, 1, TEST_FUTURE);
+    add_request(&queue, 2, 30, 2, 1, TEST_FUTURE);
+    expect_command(&queue, &dev, 30, 1, 2, false);
+    expect_command(&queue, &dev, 40, 1, 2, false);
+    expect_command(&queue, &dev, 10, 1, 2, false);
+    expect_empty(&queue);
+    test("[PASS] Requests dispatched in one upward sweep");
+
+    // Contiguous writes merge; a read right behind them does not
+    queue.position = 0;
+    add_request(&queue, 0, 104, 4, 1, TEST_FUTURE);
+    add_request(&queue, 1, 112, 4, 1, TEST_FUTURE);
+    add_request(&queue, 2, 100, 4, 1, TEST_FUTURE);
+    add_request(&queue, 3, 108, 4, 0, TEST_FUTURE);
+    expect_command(&queue, &dev, 100, 2, 8, false);
+    expect_command(&queue, &dev, 108, 1, 4, false);
+    expect_command(&queue, &dev, 112, 1, 4, false);
+    expect_empty(&queue);
+    test("[PASS] Contiguous same-direction requests merged");
+
+    // Merging stops at the device's sector and scatter-gather limits
+    dev.max_sectors = 16;
+    add_request(&queue, 0, 200, 8, 1, TEST_FUTURE);
+    add_request(&queue, 1, 208, 8, 1, TEST_FUTURE);
+    add_request(&queue, 2, 216, 8, 1, TEST_FUTURE);
+    expect_command(&queue, &dev, 200, 2, 16, false);
+    expect_command(&queue, &dev, 216, 1, 8, false);
+    dev.max_segments = 2;
+    dev.seg_boundary = 0x10000;
+    blk_request_t* req = add_request(&queue, 0, 300, 1, 1, TEST_FUTURE);
+    req->segments[0].phys = 0x10000 - 256; // Straddles a boundary: two entries
+    req->segments[0].len = 512;
+    req->segment_count = 1;
+    req = add_request(&queue, 1, 301, 1, 1, TEST_FUTURE);
+    req->segments[0].phys = 0x20000;
+    req->segments[0].len = 512;
+    req->segment_count = 1;
+    expect_command(&queue, &dev, 300, 1, 1, false);
+    expect_command(&queue, &dev, 301, 1, 1, false);
+    expect_empty(&queue);
+    dev.max_sectors = BLOCKDEV_MAX_REQUEST_SECTORS;
+    dev.max_segments = BLOCKDEV_MAX_SEGMENTS;
+    dev.seg_boundary = 0;
+    test("[PASS] Merges respect max_sectors and max_segments");
+
+    // The request whose deadline passed longest ago jumps the sweep
+    queue.position = 0;
+    add_request(&queue, 0, 600, 1, 0, TEST_NOW - 100);
+    add_request(&queue, 1, 700, 1, 0, TEST_NOW - 50);
+    add_request(&queue, 2, 50, 1, 0, TEST_FUTURE);
+    expect_command(&queue, &dev, 600, 1, 1, true);
+    expect_command(&queue, &dev, 700, 1, 1, false); // Next in the sweep anyway
+    expect_command(&queue, &dev, 50, 1, 1, false);
+    expect_empty(&queue);
+    test("[PASS] Expired requests dispatched first");
+
+    // A chain the driver could not take goes back unmerged and comes out the same
+    queue.position = 0;
+    add_request(&queue, 0, 800, 4, 1, TEST_FUTURE);
+    add_request(&queue, 1, 804, 4, 1, TEST_FUTURE);
+    bool expired;
+    elevator_requeue(&queue, elevator_next(&queue, &dev, TEST_NOW, &expired));
+    if (queue.depth != 2 || requests[0].merge_next || requests[1].merge_next) {
+        PANIC("[FAIL] Elevator: requeued chain not split back into %u requests", queue.depth);
+    }
+    expect_command(&queue, &dev, 800, 2, 8, false);
+    expect_empty(&queue);
+    test("[PASS] Requeued chain restored");
+
+    test("Elevator Test: Completed");
+}
@@ -0,0 +1,124 @@
+#include <kernel/tests/eventtest.h>
+#include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/debug.h>
+#include <string.h>
+
+// Runs in the selftest process, which pushes to its own ring and is its only
+// consumer
+#define TEST_MAX_EVENTS (MAX_EVENT_QUEUE_SIZE + 8)
+
+static IOEvent events[TEST_MAX_EVENTS];
+
+static void push_motion(Process* proc, int16_t dx, int16_t dy, int32_t x, int32_t y, uint8_t buttons,
+                        uint8_t changed) {
+    IOEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_MOUSE;
+    event.data.mouse.x = x;
+    event.data.mouse.y = y;
+    event.data.mouse.dx = dx;
+    event.data.mouse.dy = dy;
+    event.data.mouse.buttons = buttons;
+    event.data.mouse.changed = changed;
+    event.data.mouse.target_pid = proc->pid;
+    push_io_event(proc, event);
+}
+
+static void push_process(Process* proc, int code) {
+    IOEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_PROCESS;
+    event.data.process.code = code;
+    push_io_event(proc, event);
+}
+
+static int drain(Process* proc, int max_events) {
+    return process_drain_io_events(proc, events, max_events);
+}
+
+static void expect_motion(int i, int16_t dx, int16_t dy, int32_t x, int32_t y) {
+    const MouseEvent& mouse = events[i].data.mouse;
+    if (events[i].type != EVENT_MOUSE || mouse.dx != dx || mouse.dy != dy || mouse.x != x || mouse.y != y) {
+        PANIC("[FAIL] Event %d: motion (%d,%d) to %d,%d, expected (%d,%d) to %d,%d", i, mouse.dx, mouse.dy,
+              mouse.x, mouse.y, dx, dy, x, y);
+    }
+}
+
+void event_ring_test() {
+    test("Event Ring Test: coalescing, draining and overflow");
+    Process* proc = scheduler_current_process();
+    if (!proc || drain(proc, TEST_MAX_EVENTS) != 0) {
+        PANIC("[FAIL] Event ring test needs a process with an empty ring");
+        return;
+    }
+    EventQueue& queue = proc->io_events;
+    uint32_t coalesced = queue.coalesced;
+    uint32_t dropped = queue.dropped;
+
+    // Plain motion folds into one event: deltas add up, the position is the latest
+    push_motion(proc, 1, 2, 10, 20, 0, 0);
+    push_motion(proc, 3, -1, 13, 19, 0, 0);
+    push_motion(proc, -2, 4, 11, 23, 0, 0);
+    if (drain(proc, TEST_MAX_EVENTS) != 1 || queue.coalesced != coalesced + 2) {
+        PANIC("[FAIL] Mouse motion not coalesced (%u merged)", queue.coalesced - coalesced);
+    }
+    expect_motion(0, 2, 5, 11, 23);
+    push_motion(proc, 30000, -30000, 0, 0, 0, 0);
+    push_motion(proc, 30000, -30000, 0, 0, 0, 0);
+    if (drain(proc, TEST_MAX_EVENTS) != 1) {
+        PANIC("[FAIL] Large mouse motion not coalesced");
+    }
+    expect_motion(0, INT16_MAX, INT16_MIN, 0, 0);
+    test("[PASS] Mouse motion coalesced");
+
+    // Button changes, other buttons held and other event types all end a run
+    push_motion(proc, 1, 0, 1, 0, 0, 0);
+    push_motion(proc, 0, 0, 1, 0, MOUSE_BUTTON_LEFT, MOUSE_BUTTON_LEFT);
+    push_motion(proc, 1, 0, 2, 0, MOUSE_BUTTON_LEFT, 0);
+    push_motion(proc, 1, 0, 3, 0, MOUSE_BUTTON_LEFT, 0);
+    push_process(proc, 1);
+    push_motion(proc, 1, 0, 4, 0, MOUSE_BUTTON_LEFT, 0);
+    if (drain(proc, TEST_MAX_EVENTS) != 5 || events[1].data.mouse.changed != MOUSE_BUTTON_LEFT ||
+        events[3].type != EVENT_PROCESS) {
+        PANIC("[FAIL] Events with button changes or of other types merged");
+    }
+    expect_motion(0, 1, 0, 1, 0);
+    expect_motion(2, 2, 0, 3, 0);
+    expect_motion(4, 1, 0, 4, 0);
+    // Once the consumer has taken the newest event, motion starts a new one
+    push_motion(proc, 5, 0, 5, 0, 0, 0);
+    if (drain(proc, 1) != 1) {
+        PANIC("[FAIL] Event not delivered");
+    }
+    push_motion(proc, 7, 0, 12, 0, 0, 0);
+    if (drain(proc, TEST_MAX_EVENTS) != 1) {
+        PANIC("[FAIL] Motion merged into an event already consumed");
+    }
+    expect_motion(0, 7, 0, 12, 0);
+    test("[PASS] Coalescing limited to the open slot");
+
+    // Draining stops at max_events and keeps order across calls
+    for (int i = 0; i < 5; i++) {
+        push_process(proc, i);
+    }
+    int first = drain(proc, 3);
+    if (first != 3 || events[0].data.process.code != 0 || events[2].data.process.code != 2 ||
+        drain(proc, TEST_MAX_EVENTS) != 2 || events[0].data.process.code != 3) {
+        PANIC("[FAIL] Partial drain returned %d events out of order", first);
+    }
+    test("[PASS] Drain honours max_events");
+
+    // A full ring refuses new events and keeps the queued ones
+    for (int i = 0; i < MAX_EVENT_QUEUE_SIZE + 3; i++) {
+        push_process(proc, i);
+    }
+    int count = drain(proc, TEST_MAX_EVENTS);
+    if (count != MAX_EVENT_QUEUE_SIZE || queue.dropped != dropped + 3 ||
+        events[MAX_EVENT_QUEUE_SIZE - 1].data.process.code != MAX_EVENT_QUEUE_SIZE - 1) {
+        PANIC("[FAIL] Full ring kept %d events, dropped %u", count, queue.dropped - dropped);
+    }
+    test("[PASS] Full ring drops new events");
+
+    test("Event Ring Test: Completed");
+}
@@ -0,0 +1,56 @@
+#include <kernel/tests/ktimetest.h>
+#include <kernel/ktime.h>
+#include <kernel/timer.h>
+#include <kernel/debug.h>
+
+// Runs right after ktime_init(), before the PIT tick is started
+#define TEST_WAIT_US 2000
+
+// |ns - expected| within one part per million, plus a nanosecond of rounding
+static bool close_to(uint64_t ns, uint64_t expected) {
+    uint64_t diff = ns > expected ? ns - expected : expected - ns;
+    return diff <= expected / 1000000 + 1;
+}
+
+void ktime_test() {
+    test("Ktime Test: TSC cycle conversion");
+    uint64_t khz = tsc_khz();
+    if (khz == 0) {
+        if (ktime_cycles_to_ns(1000000) != 0) {
+            PANIC("[FAIL] Cycle conversion without a calibrated TSC");
+        }
+        test("[PASS] No calibrated TSC; tick fallback in use");
+        test("Ktime Test: Completed");
+        return;
+    }
+
+    // One second's worth of cycles, then a quarter of an hour's: well past 32 bits
+    uint64_t second = ktime_cycles_to_ns(khz * 1000);
+    uint64_t long_run = ktime_cycles_to_ns(khz * 1000 * 900);
+    if (!close_to(second, 1000000000ull) || !close_to(long_run, 900000000000ull)) {
+        PANIC("[FAIL] %u kHz: 1 s converted to %u us, 900 s to %u us", (uint32_t)khz,
+              (uint32_t)(second / 1000), (uint32_t)(long_run / 1000));
+    }
+    test("[PASS] Cycle counts convert at the calibrated rate");
+
+    // The high and low halves are converted separately; the seam must not show
+    uint64_t below = 0xFFFFFFF0ull;
+    uint64_t above = 0x100000010ull;
+    uint64_t sum = ktime_cycles_to_ns(below) + ktime_cycles_to_ns(above - below);
+    uint64_t whole = ktime_cycles_to_ns(above);
+    if (whole + 1 < sum || whole > sum + 1 || whole < ktime_cycles_to_ns(below)) {
+        PANIC("[FAIL] Conversion not additive across 2^32 cycles (%u vs %u us)",
+              (uint32_t)(whole / 1000), (uint32_t)(sum / 1000));
+    }
+    test("[PASS] Conversion additive across 32-bit cycle counts");
+
+    uint64_t start = ktime_get_ns();
+    timer_busy_wait_us(TEST_WAIT_US);
+    uint64_t elapsed = ktime_get_ns() - start;
+    if (elapsed < TEST_WAIT_US * 1000ull * 9 / 10) {
+        PANIC("[FAIL] Clock advanced %u us across a %u us wait", (uint32_t)(elapsed / 1000), TEST_WAIT_US);
+    }
+    test("[PASS] Clock advances with the PIT");
+
+    test("Ktime Test: Completed");
+}
@@ -0,0 +1,12 @@
+#include <kernel/tests/selftest.h>
+#include <kernel/tests/eventtest.h>
+#include <kernel/tests/vmmtest.h>
+#include <process.h>
+
+// Kernel process for the tests that need a process context, started alongside
+// the shell
+void selftest_entry() {
+    event_ring_test();
+    vmm_range_test();
+    process_exit(0);
+}
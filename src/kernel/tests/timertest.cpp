@@ -0,0 +1,95 @@
+#include <kernel/tests/timertest.h>
+#include <kernel/timer.h>
+#include <kernel/debug.h>
+
+// Runs before init_timer() starts the PIT, with interrupts off: the test plays
+// the tick interrupt itself, counting timer_ticks up and advancing the wheel as
+// the timer softirq would. Until then a millisecond is one tick.
+extern volatile uint32_t timer_ticks;
+
+typedef struct {
+    ktimer_t timer;
+    uint32_t fired;
+    uint32_t last_tick;  // Tick of the latest expiry
+} timer_probe_t;
+
+static void probe_expired(ktimer_t* timer, void* arg) {
+    (void)timer;
+    timer_probe_t* probe = (timer_probe_t*)arg;
+    probe->fired++;
+    probe->last_tick = get_ticks();
+}
+
+static void probe_init(timer_probe_t* probe) {
+    timer_init(&probe->timer, probe_expired, probe);
+    probe->fired = 0;
+    probe->last_tick = 0;
+}
+
+static void advance_to(uint32_t tick) {
+    while (timer_ticks != tick) {
+        timer_ticks++;
+        timer_wheel_advance(timer_ticks);
+    }
+}
+
+static void expect_fired(const char* name, const timer_probe_t* probe, uint32_t fired, uint32_t last_tick) {
+    if (probe->fired != fired || (fired && probe->last_tick != last_tick)) {
+        PANIC("[FAIL] Timer %s fired %u times (last at %u), expected %u (at %u)", name, probe->fired,
+              probe->last_tick, fired, last_tick);
+    }
+}
+
+void timer_wheel_test() {
+    test("Timer Wheel Test: expiry, periods and cascading");
+    uint32_t base = get_ticks();
+    timer_probe_t near, cascaded, periodic, moved, cancelled, far;
+    probe_init(&near);
+    probe_init(&cascaded);
+    probe_init(&periodic);
+    probe_init(&moved);
+    probe_init(&cancelled);
+    probe_init(&far);
+
+    timer_add(&near.timer, 5, 0);
+    // Past the 256-tick root: filed in level 1 and cascaded down when the root wraps
+    timer_add(&cascaded.timer, 300, 0);
+    timer_add(&periodic.timer, 100, 100);
+    timer_add(&moved.timer, 10, 0);
+    timer_add(&cancelled.timer, 50, 0);
+    // Two levels out; cancelled from there
+    timer_add(&far.timer, 20000, 0);
+    if (timer_add(&near.timer, 1, 0) != -1 || timer_mod(&moved.timer, 150) != 1 ||
+        timer_del(&cancelled.timer) != 1 || timer_del(&far.timer) != 1 || timer_pending(&far.timer)) {
+        PANIC("[FAIL] Timer add/mod/del on pending timers");
+    }
+
+    advance_to(base + 4);
+    expect_fired("near", &near, 0, 0);
+    advance_to(base + 5);
+    expect_fired("near", &near, 1, base + 5);
+    if (timer_pending(&near.timer)) {
+        PANIC("[FAIL] One-shot timer still pending after it fired");
+    }
+    test("[PASS] One-shot timer fired on its tick");
+
+    advance_to(base + 299);
+    expect_fired("cascaded", &cascaded, 0, 0);
+    expect_fired("periodic", &periodic, 2, base + 200);
+    expect_fired("moved", &moved, 1, base + 150);
+    expect_fired("cancelled", &cancelled, 0, 0);
+    advance_to(base + 300);
+    expect_fired("cascaded", &cascaded, 1, base + 300);
+    expect_fired("periodic", &periodic, 3, base + 300);
+    test("[PASS] Cascaded timer fired on its tick");
+
+    if (timer_del(&periodic.timer) != 1) {
+        PANIC("[FAIL] Periodic timer was not re-armed");
+    }
+    advance_to(base + 400);
+    expect_fired("periodic", &periodic, 3, base + 300);
+    expect_fired("far", &far, 0, 0);
+    test("[PASS] Periodic timer re-armed until deleted");
+
+    test("Timer Wheel Test: Completed");
+}
@@ -0,0 +1,68 @@
+#include <kernel/tests/vmmtest.h>
+#include <kernel/paging.h>
+#include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/debug.h>
+
+// Runs in the selftest process, which borrows a fresh address space: a writable
+// area of two pages, a hole, then a read-only page
+#define TEST_RW_START (USER_SPACE_START + 0x100000)
+#define TEST_RW_END   (TEST_RW_START + 2 * PAGE_SIZE)
+#define TEST_RO_START (TEST_RW_END + 2 * PAGE_SIZE)
+#define TEST_RO_END   (TEST_RO_START + PAGE_SIZE)
+
+static void expect_range(address_space_t* as, uint32_t addr, uint32_t size, int write, int expected,
+                         const char* what) {
+    int result = vmm_prepare_user_range(as, addr, size, write);
+    if (result != expected) {
+        PANIC("[FAIL] %s: 0x%x+0x%x (%s) returned %d", what, addr, size, write ? "write" : "read", result);
+    }
+}
+
+static void expect_faults(address_space_t* as, uint32_t faults, const char* what) {
+    if (as->faults != faults) {
+        PANIC("[FAIL] %s: %u pages faulted in, expected %u", what, as->faults, faults);
+    }
+}
+
+void vmm_range_test() {
+    test("VMM Test: user range checks");
+    Process* proc = scheduler_current_process();
+    address_space_t* as = vmm_create_address_space();
+    if (!proc || proc->mm || !as || vmm_add_area(as, TEST_RW_START, TEST_RW_END, VM_WRITE, 0, 0, 0) != 0 ||
+        vmm_add_area(as, TEST_RO_START, TEST_RO_END, 0, 0, 0, 0) != 0) {
+        PANIC("[FAIL] VMM test setup failed");
+        return;
+    }
+
+    expect_range(as, TEST_RW_START, 16, 0, -1, "Range in an inactive address space");
+
+    // The scheduler reloads proc->mm on every switch back to us
+    proc->mm = as;
+    vmm_switch_address_space(as);
+
+    expect_range(as, TEST_RW_START, TEST_RW_END - TEST_RW_START, 1, 0, "Writable area");
+    expect_faults(as, 2, "Writable area");
+    expect_range(as, TEST_RW_START + PAGE_SIZE - 4, 8, 1, 0, "Range across two pages");
+    expect_range(as, TEST_RO_START + 16, 16, 0, 0, "Read of a read-only area");
+    expect_faults(as, 3, "Read-only area");
+    test("[PASS] Ranges inside the areas faulted in");
+
+    expect_range(as, TEST_RO_START, 16, 1, -1, "Write to a read-only area");
+    expect_range(as, TEST_RW_END - 4, 8, 0, -1, "Range running into a hole");
+    expect_range(as, TEST_RW_END + 16, 16, 0, -1, "Range in a hole");
+    expect_range(as, TEST_RW_START - 4, 8, 0, -1, "Range starting below an area");
+    expect_range(as, 0x100000, 16, 0, -1, "Kernel range");
+    expect_range(as, 0xFFFFFFF0u, 0x20, 0, -1, "Wrapping range");
+    expect_range(as, TEST_RW_START, 0xFFFFFFFFu, 0, -1, "Wrapping range");
+    expect_range(as, TEST_RW_START, 0, 1, 0, "Empty range");
+    expect_range(as, 0x100000, 0, 1, -1, "Empty kernel range");
+    expect_range(as, TEST_RW_END, 0, 1, -1, "Empty range in a hole");
+    expect_faults(as, 3, "Rejected ranges");
+    test("[PASS] Ranges outside the areas rejected");
+
+    proc->mm = NULL;
+    vmm_switch_address_space(NULL);
+    vmm_destroy_address_space(as);
+    test("VMM Test: Completed");
+}
@@ -5,18 +5,32 @@
 #include <stdio.h>
 #include <kernel/debug.h>
 #include "kernel/pic.h"
+#include "kernel/softirq.h"
 
 volatile uint32_t timer_ticks = 0;
 static uint32_t timer_frequency_hz = 0;
+// Last tick whose TIME_REACHED hooks have been resumed
+static uint32_t timer_resumed_ticks = 0;
 
 // Called on every timer tick (IRQ0)
 void timer_handler(registers_t* regs) {
     timer_ticks++;
-    // Resume any processes waiting for this tick value
-    scheduler_resume_processes_for_event(HookType::TIME_REACHED, timer_ticks);
+    // Waking sleepers scans the process table and timer callbacks may take
+    // locks; leave both to the softirq
+    softirq_raise(SOFTIRQ_TIMER);
     scheduler_on_tick(regs);
 }
 
+// Run expired kernel timers, then resume processes waiting for every tick value reached since the last run
+static void timer_softirq() {
+    uint32_t now = timer_ticks;
+    timer_wheel_advance(now);
+    while (timer_resumed_ticks != now) {
+        timer_resumed_ticks++;
+        scheduler_resume_processes_for_event(HookType::TIME_REACHED, timer_resumed_ticks);
+    }
+}
+
 // Initialize the PIT timer to the given frequency.
 void init_timer(uint32_t frequency) {
     // Calculate divisor: PIT frequency is 1193180 Hz.
@@ -30,6 +44,8 @@ void init_timer(uint32_t frequency) {
     timer_frequency_hz = frequency;
 
     // Register timer_handler for IRQ0 (interrupt 32).
+    timer_resumed_ticks = timer_ticks;
+    softirq_register(SOFTIRQ_TIMER, timer_softirq);
     register_interrupt_handler(32, timer_handler);
 
     // Unmask IRQ0 on the PIC so timer interrupts are delivered
@@ -38,12 +54,46 @@ void init_timer(uint32_t frequency) {
     success("[TIMER] Timer initialized to %d Hz", frequency);
 }
 
+void timer_busy_wait_us(uint32_t microseconds) {
+    // Channel 2 is gated through port 0x61 and its output can be polled on bit 5,
+    // so this works before interrupts are enabled (e.g. while booting APs).
+    while (microseconds > 0) {
+        uint32_t chunk = microseconds > 50000 ? 50000 : microseconds;
+        microseconds -= chunk;
+        uint32_t count = (1193u * chunk) / 1000u; // PIT input clock is ~1.193 MHz
+        if (count == 0) count = 1;
+
+        uint8_t gate = inb(0x61);
+        outb(0x61, (gate & 0xFD) | 0x01); // Gate on, speaker off
+        outb(0x43, 0xB0);                 // Channel 2, lobyte/hibyte, mode 0
+        outb(0x42, count & 0xFF);
+        outb(0x42, (count >> 8) & 0xFF);
+        // Restart the count by toggling the gate
+        gate = inb(0x61) & 0xFE;
+        outb(0x61, gate);
+        outb(0x61, gate | 0x01);
+        while ((inb(0x61) & 0x20) == 0) {
+        }
+    }
+}
+
 uint32_t get_ticks() {
     return timer_ticks;
 }
 
+uint32_t timer_ms_to_ticks(uint32_t milliseconds) {
+    if (milliseconds == 0) return 0;
+    uint32_t hz = timer_frequency_hz ? timer_frequency_hz : 1000;
+    uint64_t ticks = ((uint64_t)milliseconds * hz + 999) / 1000;
+    return ticks > 0x7FFFFFFFu ? 0x7FFFFFFFu : (uint32_t)ticks;
+}
+
+bool timer_running() {
+    return timer_frequency_hz != 0;
+}
+
 uint32_t get_ticks_milliseconds() {
     if (timer_frequency_hz == 0) return 0;
-    // Convert ticks to milliseconds: ticks * (1000 / Hz)
-    return (timer_ticks * 1000) / timer_frequency_hz;
+    // Widen first: ticks * 1000 overflows 32 bits after ~71 minutes at 1000 Hz
+    return (uint32_t)(((uint64_t)timer_ticks * 1000) / timer_frequency_hz);
 }
@@ -0,0 +1,224 @@
+#include "kernel/timer.h"
+#include "kernel/spinlock.h"
+#include "kernel/waitqueue.h"
+#include "kernel/scheduler.h"
+#include "kernel/softirq.h"
+#include "kernel/smp.h"
+#include "kernel/isr.h"
+
+// Hierarchical timing wheel: the root level has one slot per tick for the next
+// 256 ticks; each outer level covers 64 times the span of the one inside it.
+// Arming and cancelling are O(1). When the root wraps, the next slot of level 1
+// is cascaded into finer slots, and so on outward. Five levels cover the full
+// 32-bit tick range.
+#define WHEEL_ROOT_BITS  8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_ROOT_SIZE  (1u << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1u << WHEEL_LEVEL_BITS)
+#define WHEEL_ROOT_MASK  (WHEEL_ROOT_SIZE - 1)
+#define WHEEL_LEVEL_MASK (WHEEL_LEVEL_SIZE - 1)
+#define WHEEL_LEVELS     4
+
+static ktimer_t* wheel_root[WHEEL_ROOT_SIZE];
+static ktimer_t* wheel_levels[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+// Next tick the wheel will process
+static uint32_t wheel_tick = 0;
+static spinlock_t wheel_lock = SPINLOCK_INIT("timer_wheel");
+// Timer whose callback is executing and the CPU running it (-1 when none)
+static ktimer_t* volatile wheel_running = 0;
+static volatile int wheel_running_cpu = -1;
+
+static inline uint32_t level_shift(int level) {
+    return WHEEL_ROOT_BITS + (uint32_t)level * WHEEL_LEVEL_BITS;
+}
+
+// Caller holds wheel_lock
+static void link_timer(ktimer_t** slot, ktimer_t* timer) {
+    timer->next = *slot;
+    if (timer->next) timer->next->pprev = &timer->next;
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+// Caller holds wheel_lock
+static void unlink_timer(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = 0;
+    timer->pprev = 0;
+}
+
+// Caller holds wheel_lock
+static void enqueue_timer(ktimer_t* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_tick;
+    ktimer_t** slot;
+    if ((int32_t)delta < 0) {
+        // Already due: run it on the next tick processed
+        slot = &wheel_root[wheel_tick & WHEEL_ROOT_MASK];
+    } else if (delta < WHEEL_ROOT_SIZE) {
+        slot = &wheel_root[expires & WHEEL_ROOT_MASK];
+    } else {
+        int level = 0;
+        while (level < WHEEL_LEVELS - 1 && delta >= (1u << level_shift(level + 1))) {
+            level++;
+        }
+        slot = &wheel_levels[level][(expires >> level_shift(level)) & WHEEL_LEVEL_MASK];
+    }
+    link_timer(slot, timer);
+}
+
+// Re-file every timer in one outer slot; returns the slot index so the caller
+// knows whether this level wrapped too. Caller holds wheel_lock.
+static uint32_t cascade(int level) {
+    uint32_t index = (wheel_tick >> level_shift(level)) & WHEEL_LEVEL_MASK;
+    ktimer_t* list = wheel_levels[level][index];
+    wheel_levels[level][index] = 0;
+    while (list) {
+        ktimer_t* timer = list;
+        list = timer->next;
+        timer->next = 0;
+        timer->pprev = 0;
+        enqueue_timer(timer);
+    }
+    return index;
+}
+
+static void arm_locked(ktimer_t* timer, uint32_t ticks) {
+    if (ticks == 0) ticks = 1;
+    timer->expires = get_ticks() + ticks;
+    enqueue_timer(timer);
+}
+
+void timer_init(ktimer_t* timer, ktimer_func_t func, void* arg) {
+    timer->next = 0;
+    timer->pprev = 0;
+    timer->expires = 0;
+    timer->period = 0;
+    timer->func = func;
+    timer->arg = arg;
+}
+
+bool timer_pending(const ktimer_t* timer) {
+    return timer && timer->pprev != 0;
+}
+
+int timer_add(ktimer_t* timer, uint32_t delay_ms, uint32_t period_ms) {
+    if (!timer || !timer->func) return -1;
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    if (timer->pprev) {
+        spin_unlock_irqrestore(&wheel_lock, flags);
+        return -1;
+    }
+    timer->period = timer_ms_to_ticks(period_ms);
+    arm_locked(timer, timer_ms_to_ticks(delay_ms));
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return 0;
+}
+
+int timer_mod(ktimer_t* timer, uint32_t delay_ms) {
+    if (!timer || !timer->func) return -1;
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    int pending = timer->pprev != 0;
+    if (pending) unlink_timer(timer);
+    arm_locked(timer, timer_ms_to_ticks(delay_ms));
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return pending;
+}
+
+int timer_del(ktimer_t* timer) {
+    if (!timer) return 0;
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    int pending = timer->pprev != 0;
+    if (pending) unlink_timer(timer);
+    // A periodic timer is re-armed before its callback runs; clearing the
+    // period also keeps a concurrent run from arming it again.
+    timer->period = 0;
+    spin_unlock_irqrestore(&wheel_lock, flags);
+
+    // The callback may still be using the timer. Waiting is only possible when
+    // it runs elsewhere; on this CPU we are the callback or have interrupted it.
+    int cpu = smp_current_cpu();
+    while (wheel_running == timer && wheel_running_cpu != cpu) {
+        asm volatile("pause");
+    }
+    return pending;
+}
+
+void timer_wheel_advance(uint32_t now) {
+    uint32_t flags = spin_lock_irqsave(&wheel_lock);
+    while ((int32_t)(now - wheel_tick) >= 0) {
+        uint32_t index = wheel_tick & WHEEL_ROOT_MASK;
+        if (index == 0) {
+            for (int level = 0; level < WHEEL_LEVELS && cascade(level) == 0; level++) {
+            }
+        }
+        // Detach the slot first so timers re-armed by callbacks land in later slots
+        ktimer_t* work = wheel_root[index];
+        wheel_root[index] = 0;
+        if (work) work->pprev = &work;
+        wheel_tick++;
+
+        while (work) {
+            ktimer_t* timer = work;
+            unlink_timer(timer);
+            if (timer->period) {
+                timer->expires += timer->period;
+                // Skip missed periods rather than firing them back to back
+                if ((int32_t)(timer->expires - wheel_tick) < 0) {
+                    timer->expires = wheel_tick + timer->period - 1;
+                }
+                enqueue_timer(timer);
+            }
+            ktimer_func_t func = timer->func;
+            void* arg = timer->arg;
+            wheel_running = timer;
+            wheel_running_cpu = smp_current_cpu();
+            spin_unlock_irqrestore(&wheel_lock, flags);
+
+            func(timer, arg);
+
+            flags = spin_lock_irqsave(&wheel_lock);
+            wheel_running = 0;
+            wheel_running_cpu = -1;
+        }
+    }
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+namespace {
+
+struct TimerSleep {
+    wait_queue_t wait;
+    volatile int expired;
+};
+
+void timer_sleep_expired(ktimer_t*, void* arg) {
+    TimerSleep* sleep = (TimerSleep*)arg;
+    sleep->expired = 1;
+    wake_up(&sleep->wait, 0);
+}
+
+} // namespace
+
+void timer_sleep_ms(uint32_t milliseconds) {
+    if (milliseconds == 0) return;
+    uint32_t eflags;
+    asm volatile("pushf\n\tpop %0" : "=r"(eflags));
+    Process* proc = scheduler_current_process();
+    if (!proc || !(eflags & 0x200) || !timer_running() || irq_in_progress() ||
+        softirq_in_progress()) {
+        timer_busy_wait_us(milliseconds * 1000);
+        return;
+    }
+
+    TimerSleep sleep;
+    wait_queue_init(&sleep.wait, "timer_sleep");
+    sleep.expired = 0;
+    ktimer_t timer;
+    timer_init(&timer, timer_sleep_expired, &sleep);
+    timer_add(&timer, milliseconds, 0);
+    wait_event(&sleep.wait, proc, sleep.expired);
+    // Both live on this stack: make sure the callback is done with them
+    timer_del(&timer);
+}
@@ -0,0 +1,42 @@
+#include "kernel/uaccess.h"
+
+// (faulting instruction, resume address) pairs collected by linker.ld
+typedef struct {
+    uint32_t insn;
+    uint32_t fixup;
+} uaccess_entry_t;
+
+extern "C" const uaccess_entry_t __ex_table_start[];
+extern "C" const uaccess_entry_t __ex_table_end[];
+
+// rep movsb leaves the bytes it did not copy in ECX when it faults; the fixup
+// resumes right after it with that count intact
+static size_t uaccess_copy(void* dst, const void* src, size_t size) {
+    asm volatile(
+        "1: rep movsb\n"
+        "2:\n"
+        ".pushsection .ex_table, \"a\"\n"
+        ".long 1b, 2b\n"
+        ".popsection"
+        : "+c"(size), "+D"(dst), "+S"(src)
+        :
+        : "memory");
+    return size;
+}
+
+int copy_from_user(void* dst, const void* user_src, size_t size) {
+    return uaccess_copy(dst, user_src, size) == 0 ? 0 : -1;
+}
+
+int copy_to_user(void* user_dst, const void* src, size_t size) {
+    return uaccess_copy(user_dst, src, size) == 0 ? 0 : -1;
+}
+
+uint32_t uaccess_fixup(uint32_t eip) {
+    for (const uaccess_entry_t* entry = __ex_table_start; entry < __ex_table_end; ++entry) {
+        if (entry->insn == eip) {
+            return entry->fixup;
+        }
+    }
+    return 0;
+}
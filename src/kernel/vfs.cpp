@@ -1,5 +1,6 @@
 #include "kernel/vfs.h"
 #include "kernel/debug.h"
+#include "kernel/mutex.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -7,6 +8,10 @@ static vfs_mount_t mounts[VFS_MAX_MOUNTS];
 static vfs_file_t open_files[VFS_MAX_OPEN_FILES];
 static char current_working_directory[VFS_MAX_PATH];
 static uint8_t vfs_initialized = 0;
+// Serializes the mount table, open file table, cwd and filesystem drivers
+static mutex_t vfs_mutex = MUTEX_INIT("vfs");
+
+static void vfs_close_locked(vfs_file_t* file);
 
 int vfs_init(void) {
     debug("[VFS] Initializing Virtual File System");
@@ -27,6 +32,7 @@ int vfs_init(void) {
 
 int vfs_mount(const char* mountpoint, uint8_t fs_type, uint8_t device_id, 
               vfs_operations_t* ops, void* fs_data) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized) {
         error("[VFS] VFS not initialized");
         return VFS_ERROR;
@@ -73,6 +79,7 @@ int vfs_mount(const char* mountpoint, uint8_t fs_type, uint8_t device_id,
 }
 
 int vfs_unmount(const char* mountpoint) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized) {
         return VFS_ERROR;
     }
@@ -85,7 +92,7 @@ int vfs_unmount(const char* mountpoint) {
             // Close any open files from this mount
             for (int j = 0; j < VFS_MAX_OPEN_FILES; j++) {
                 if (open_files[j].in_use && open_files[j].mount == &mounts[i]) {
-                    vfs_close(&open_files[j]);
+                    vfs_close_locked(&open_files[j]);
                 }
             }
             
@@ -173,6 +180,7 @@ int vfs_resolve_path(const char* path, vfs_mount_t** mount, char* relative_path)
 }
 
 int vfs_list_mounts(void) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized) {
         error("[VFS] VFS not initialized");
         return 0;
@@ -196,6 +204,7 @@ int vfs_list_mounts(void) {
 }
 
 int vfs_chdir(const char* path) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized) {
         return VFS_ERROR;
     }
@@ -240,6 +249,7 @@ const char* vfs_getcwd(void) {
 
 // VFS file operations with path resolution
 int vfs_open(const char* path, vfs_file_t* file) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path || !file) {
         return VFS_ERROR;
     }
@@ -294,6 +304,7 @@ int vfs_open(const char* path, vfs_file_t* file) {
 }
 
 int vfs_read(vfs_file_t* file, void* buffer, size_t size) {
+    MutexGuard guard(&vfs_mutex);
     if (!file || !file->in_use || !file->mount || !file->mount->ops || !file->mount->ops->read) {
         return VFS_ERROR;
     }
@@ -302,6 +313,7 @@ int vfs_read(vfs_file_t* file, void* buffer, size_t size) {
 }
 
 int vfs_write(vfs_file_t* file, const void* buffer, size_t size) {
+    MutexGuard guard(&vfs_mutex);
     if (!file || !file->in_use || !file->mount || !file->mount->ops || !file->mount->ops->write) {
         return VFS_ERROR;
     }
@@ -310,6 +322,7 @@ int vfs_write(vfs_file_t* file, const void* buffer, size_t size) {
 }
 
 int vfs_seek(vfs_file_t* file, uint32_t position) {
+    MutexGuard guard(&vfs_mutex);
     if (!file || !file->in_use || !file->mount || !file->mount->ops || !file->mount->ops->seek) {
         return VFS_ERROR;
     }
@@ -318,6 +331,11 @@ int vfs_seek(vfs_file_t* file, uint32_t position) {
 }
 
 void vfs_close(vfs_file_t* file) {
+    MutexGuard guard(&vfs_mutex);
+    vfs_close_locked(file);
+}
+
+static void vfs_close_locked(vfs_file_t* file) {
     if (!file || !file->in_use) {
         return;
     }
@@ -353,6 +371,7 @@ void vfs_close(vfs_file_t* file) {
 }
 
 int vfs_readdir(const char* path, vfs_dirent_t* entries, int max_entries) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path || !entries) {
         return VFS_ERROR;
     }
@@ -435,6 +454,7 @@ int vfs_readdir(const char* path, vfs_dirent_t* entries, int max_entries) {
 }
 
 int vfs_mkdir(const char* path) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path) {
         return VFS_ERROR;
     }
@@ -458,6 +478,7 @@ int vfs_mkdir(const char* path) {
 }
 
 int vfs_rmdir(const char* path) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path) {
         return VFS_ERROR;
     }
@@ -481,6 +502,7 @@ int vfs_rmdir(const char* path) {
 }
 
 int vfs_create(const char* path) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path) {
         return VFS_ERROR;
     }
@@ -504,6 +526,7 @@ int vfs_create(const char* path) {
 }
 
 int vfs_remove(const char* path) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path) {
         return VFS_ERROR;
     }
@@ -527,6 +550,7 @@ int vfs_remove(const char* path) {
 }
 
 int vfs_stat(const char* path, vfs_dirent_t* info) {
+    MutexGuard guard(&vfs_mutex);
     if (!vfs_initialized || !path || !info) {
         return VFS_ERROR;
     }
@@ -0,0 +1,96 @@
+#include "kernel/waitqueue.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include <sys/syscall.h>
+
+void wait_queue_init(wait_queue_t* wq, const char* name) {
+    spin_lock_init(&wq->lock, name);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+// Caller holds wq->lock
+static void unlink_locked(wait_queue_t* wq, Process* proc) {
+    Process* prev = NULL;
+    for (Process* p = wq->head; p; prev = p, p = p->wait_next) {
+        if (p != proc) continue;
+        if (prev) {
+            prev->wait_next = p->wait_next;
+        } else {
+            wq->head = p->wait_next;
+        }
+        if (wq->tail == p) wq->tail = prev;
+        break;
+    }
+    proc->wait_next = NULL;
+    proc->wait_queue = NULL;
+}
+
+void prepare_to_wait(wait_queue_t* wq, Process* proc) {
+    if (!wq || !proc) return;
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (proc->wait_queue != wq) {
+        proc->wait_next = NULL;
+        if (wq->tail) {
+            wq->tail->wait_next = proc;
+        } else {
+            wq->head = proc;
+        }
+        wq->tail = proc;
+        proc->wait_queue = wq;
+    }
+    proc->wait_pending = 1;
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void finish_wait(wait_queue_t* wq, Process* proc) {
+    if (!wq || !proc) return;
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    proc->wait_pending = 0;
+    proc->sleeping = 0;
+    if (proc->wait_queue == wq) {
+        unlink_locked(wq, proc);
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wait_queue_sleep(wait_queue_t* wq, Process* proc) {
+    if (!wq || !proc) return;
+    // Only now does the process stop being runnable. Being preempted between
+    // prepare_to_wait and here therefore cannot strand it holding whatever the
+    // condition check consumed.
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    bool block = proc->wait_pending && proc->wait_queue == wq;
+    if (block) proc->sleeping = 1;
+    spin_unlock_irqrestore(&wq->lock, flags);
+    if (block) {
+        // A nested int $0x80 is fine inside a syscall: the process resumes right here
+        syscall_yield();
+    }
+}
+
+int wake_up(wait_queue_t* wq, uint32_t wake_flags) {
+    if (!wq) return 0;
+    int woken = 0;
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    while (wq->head) {
+        Process* proc = wq->head;
+        unlink_locked(wq, proc);
+        scheduler_wake_process(proc, (wake_flags & WAKE_BOOST) != 0);
+        woken++;
+        if (!(wake_flags & WAKE_ALL)) break;
+    }
+    spin_unlock_irqrestore(&wq->lock, flags);
+    return woken;
+}
+
+void wait_queue_remove(Process* proc) {
+    if (!proc) return;
+    wait_queue_t* wq = proc->wait_queue;
+    if (wq) {
+        finish_wait(wq, proc);
+    } else {
+        proc->wait_pending = 0;
+        proc->sleeping = 0;
+    }
+}
@@ -0,0 +1,111 @@
+#include "kernel/workqueue.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/smp.h"
+#include "kernel/spinlock.h"
+#include "kernel/waitqueue.h"
+#include "kernel/debug.h"
+#include <stdio.h>
+#include <string.h>
+
+#define KWORKER_STACK_SIZE 8192
+// kworkers run the GUI redraw and input dispatch: give them a 60 Hz deadline slot
+#define KWORKER_DL_PERIOD 16
+#define KWORKER_DL_BUDGET 4
+
+static spinlock_t workqueue_lock = SPINLOCK_INIT("workqueue");
+static work_t* work_head = NULL;
+static work_t* work_tail = NULL;
+static wait_queue_t kworker_wait = WAIT_QUEUE_INIT("kworker-wait");
+static int kworker_count = 0;
+static char kworker_names[MAX_CPUS][12];
+
+static uint32_t work_queued = 0;
+static uint32_t work_executed = 0;
+
+// Caller holds workqueue_lock
+static void enqueue_locked(work_t* work) {
+    work->next = NULL;
+    if (work_tail) {
+        work_tail->next = work;
+    } else {
+        work_head = work;
+    }
+    work_tail = work;
+    work->state |= WORK_STATE_QUEUED;
+    work_queued++;
+}
+
+int queue_work(work_t* work) {
+    if (!work || !work->func) return 0;
+    uint32_t flags = spin_lock_irqsave(&workqueue_lock);
+    if (work->state & WORK_STATE_QUEUED) {
+        spin_unlock_irqrestore(&workqueue_lock, flags);
+        return 0;
+    }
+    if (work->state & WORK_STATE_RUNNING) {
+        // The running worker requeues it when it finishes
+        work->state |= WORK_STATE_REQUEUE;
+        spin_unlock_irqrestore(&workqueue_lock, flags);
+        return 1;
+    }
+    enqueue_locked(work);
+    spin_unlock_irqrestore(&workqueue_lock, flags);
+    wake_up(&kworker_wait, 0);
+    return 1;
+}
+
+static void kworker_main() {
+    Process* self = scheduler_current_process();
+    for (;;) {
+        // Get on the wait queue before looking so a queue_work in between wakes us
+        prepare_to_wait(&kworker_wait, self);
+        uint32_t flags = spin_lock_irqsave(&workqueue_lock);
+        work_t* work = work_head;
+        if (work) {
+            work_head = work->next;
+            if (!work_head) work_tail = NULL;
+            work->state = WORK_STATE_RUNNING;
+        }
+        spin_unlock_irqrestore(&workqueue_lock, flags);
+
+        if (!work) {
+            wait_queue_sleep(&kworker_wait, self);
+            continue;
+        }
+        finish_wait(&kworker_wait, self);
+
+        work->func(work->arg);
+
+        flags = spin_lock_irqsave(&workqueue_lock);
+        work_executed++;
+        bool requeue = (work->state & WORK_STATE_REQUEUE) != 0;
+        work->state = 0;
+        if (requeue) {
+            enqueue_locked(work);
+        }
+        spin_unlock_irqrestore(&workqueue_lock, flags);
+    }
+}
+
+void workqueue_init() {
+    int count = smp_cpu_count();
+    for (int i = 0; i < count && i < MAX_CPUS; ++i) {
+        strcpy(kworker_names[i], "kworker/");
+        kworker_names[i][8] = (char)('0' + i);
+        kworker_names[i][9] = '\0';
+        Process* worker = k_start_process(kworker_names[i], kworker_main, 0, KWORKER_STACK_SIZE);
+        if (worker) {
+            kworker_count++;
+            if (scheduler_set_deadline(worker, KWORKER_DL_PERIOD, KWORKER_DL_BUDGET) != 0) {
+                error("[WQ] %s: deadline admission failed", kworker_names[i]);
+            }
+        }
+    }
+    success("[WQ] Started %d kworker(s)", kworker_count);
+}
+
+void workqueue_dump_stats() {
+    printf("Workqueue: %d kworker(s), %u queued, %u executed\n",
+           kworker_count, work_queued, work_executed);
+}
@@ -542,24 +542,21 @@ extern "C" void editor_entry() {
     if (proc) {
         scheduler_set_foreground(proc);
     }
+    // Redraws and typing stay responsive next to CPU-bound work
+    process_set_deadline(EDITOR_DL_PERIOD, EDITOR_DL_BUDGET);
 
     // Use the safe copied params
     const char* target = s_path[0] ? s_path : "/untitled";
     printf("[editor] starting file '%s'\n", target);
     editor_start(target);
-    IOEvent io_event;
+    IOEvent io_events[EDITOR_EVENT_BATCH];
     while (editor_is_active()) {
-        if (!process_poll_event(&io_event)) {
-            if (!process_wait_event(&io_event)) {
-                continue;
+        int count = process_drain_events(io_events, EDITOR_EVENT_BATCH, 1);
+        for (int i = 0; i < count && editor_is_active(); i++) {
+            if (io_events[i].type == EVENT_KEYBOARD) {
+                editor_handle_key(io_events[i].data.keyboard);
             }
         }
-        if (io_event.type == EVENT_PROCESS) {
-            continue;
-        }
-        if (io_event.type == EVENT_KEYBOARD) {
-            editor_handle_key(io_event.data.keyboard);
-        }
     }
     printf("[editor] exit loop\n");
     process_exit(0);